@@ -38,6 +38,7 @@
 #include <jack/metadata.h>
 
 #include <spa/support/cpu.h>
+#include <spa/control/merge.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/debug/types.h>
@@ -1002,64 +1003,15 @@ static inline void fix_midi_event(uint8_t *data, size_t size)
 	}
 }
 
-static inline int event_sort(struct spa_pod_control *a, struct spa_pod_control *b)
-{
-	if (a->offset < b->offset)
-		return -1;
-	if (a->offset > b->offset)
-		return 1;
-	if (a->type != b->type)
-		return 0;
-	switch(a->type) {
-	case SPA_CONTROL_Midi:
-	{
-		/* 11 (controller) > 12 (program change) >
-		 * 8 (note off) > 9 (note on) > 10 (aftertouch) >
-		 * 13 (channel pressure) > 14 (pitch bend) */
-		static int priotab[] = { 5,4,3,7,6,2,1,0 };
-		uint8_t *da, *db;
-
-		if (SPA_POD_BODY_SIZE(&a->value) < 1 ||
-		    SPA_POD_BODY_SIZE(&b->value) < 1)
-			return 0;
-
-		da = SPA_POD_BODY(&a->value);
-		db = SPA_POD_BODY(&b->value);
-		if ((da[0] & 0xf) != (db[0] & 0xf))
-			return 0;
-		return priotab[(db[0]>>4) & 7] - priotab[(da[0]>>4) & 7];
-	}
-	default:
-		return 0;
-	}
-}
-
 static void convert_to_midi(struct spa_pod_sequence **seq, uint32_t n_seq, void *midi, bool fix)
 {
-	struct spa_pod_control *c[n_seq];
-	uint32_t i;
+	struct spa_control_merge_item items[n_seq];
+	struct spa_control_merge merge;
+	struct spa_pod_control *next;
 	int res;
 
-	for (i = 0; i < n_seq; i++)
-		c[i] = spa_pod_control_first(&seq[i]->body);
-
-	while (true) {
-		struct spa_pod_control *next = NULL;
-		uint32_t next_index = 0;
-
-		for (i = 0; i < n_seq; i++) {
-			if (!spa_pod_control_is_inside(&seq[i]->body,
-						SPA_POD_BODY_SIZE(seq[i]), c[i]))
-				continue;
-
-			if (next == NULL || event_sort(c[i], next) <= 0) {
-				next = c[i];
-				next_index = i;
-			}
-		}
-		if (SPA_UNLIKELY(next == NULL))
-			break;
-
+	spa_control_merge_init(&merge, items, seq, n_seq);
+	while ((next = spa_control_merge_peek(&merge)) != NULL) {
 		switch(next->type) {
 		case SPA_CONTROL_Midi:
 		{
@@ -1075,7 +1027,7 @@ static void convert_to_midi(struct spa_pod_sequence **seq, uint32_t n_seq, void
 			break;
 		}
 		}
-		c[next_index] = spa_pod_control_next(c[next_index]);
+		spa_control_merge_advance(&merge);
 	}
 }
 
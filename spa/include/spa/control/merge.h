@@ -0,0 +1,218 @@
+/* Simple Plugin API
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_CONTROL_MERGE_H
+#define SPA_CONTROL_MERGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/utils/defs.h>
+#include <spa/pod/iter.h>
+#include <spa/control/control.h>
+
+/**
+ * \addtogroup spa_control
+ * \{
+ */
+
+/**
+ * Compare the order of two controls in a sequence.
+ *
+ * Controls are ordered by offset. MIDI events on the same offset and
+ * channel are ordered so that a receiver sees the controller and program
+ * changes before the notes and note off before note on.
+ *
+ * \return < 0 when \a a comes before \a b, > 0 when \a a comes after \a b
+ *         and 0 when the order does not matter.
+ */
+static inline int spa_control_compare(const struct spa_pod_control *a,
+		const struct spa_pod_control *b)
+{
+	if (a->offset < b->offset)
+		return -1;
+	if (a->offset > b->offset)
+		return 1;
+	if (a->type != b->type)
+		return 0;
+	switch(a->type) {
+	case SPA_CONTROL_Midi:
+	{
+		/* 11 (controller) > 12 (program change) >
+		 * 8 (note off) > 9 (note on) > 10 (aftertouch) >
+		 * 13 (channel pressure) > 14 (pitch bend) */
+		static const int priotab[] = { 5,4,3,7,6,2,1,0 };
+		const uint8_t *da, *db;
+
+		if (SPA_POD_BODY_SIZE(&a->value) < 1 ||
+		    SPA_POD_BODY_SIZE(&b->value) < 1)
+			return 0;
+
+		da = (const uint8_t *)SPA_POD_BODY_CONST(&a->value);
+		db = (const uint8_t *)SPA_POD_BODY_CONST(&b->value);
+		if ((da[0] & 0xf) != (db[0] & 0xf))
+			return 0;
+		return priotab[(db[0]>>4) & 7] - priotab[(da[0]>>4) & 7];
+	}
+	default:
+		return 0;
+	}
+}
+
+/** The state of one input of a merge */
+struct spa_control_merge_item {
+	const struct spa_pod_sequence *seq;
+	struct spa_pod_control *ctrl;		/**< next control of the sequence */
+	uint32_t index;				/**< index of the sequence */
+};
+
+/**
+ * Merges the controls of multiple sequences in order.
+ *
+ * The sequences are kept in a binary heap ordered by their next control,
+ * so that taking the next control costs O(log n_seq) instead of a scan
+ * over all sequences. Controls with the same order are taken from the
+ * sequence with the highest index first.
+ *
+ * \code{.c}
+ * struct spa_control_merge_item items[n_seq];
+ * struct spa_control_merge merge;
+ * struct spa_pod_control *c;
+ *
+ * spa_control_merge_init(&merge, items, seq, n_seq);
+ * while ((c = spa_control_merge_peek(&merge)) != NULL) {
+ *	// use c
+ *	spa_control_merge_advance(&merge);
+ * }
+ * \endcode
+ */
+struct spa_control_merge {
+	struct spa_control_merge_item *items;	/**< heap of sequences with controls */
+	uint32_t n_items;
+};
+
+static inline bool spa_control_merge_before(const struct spa_control_merge_item *a,
+		const struct spa_control_merge_item *b)
+{
+	int res = spa_control_compare(a->ctrl, b->ctrl);
+	return res < 0 || (res == 0 && a->index > b->index);
+}
+
+static inline void spa_control_merge_sift_down(struct spa_control_merge *merge, uint32_t i)
+{
+	struct spa_control_merge_item *items = merge->items, tmp;
+	uint32_t n = merge->n_items, child;
+
+	if ((child = 2 * i + 1) >= n)
+		return;
+	if (child + 1 < n && spa_control_merge_before(&items[child + 1], &items[child]))
+		child++;
+	if (!spa_control_merge_before(&items[child], &items[i]))
+		return;
+
+	tmp = items[i];
+	items[i] = items[child];
+	i = child;
+
+	while ((child = 2 * i + 1) < n) {
+		if (child + 1 < n && spa_control_merge_before(&items[child + 1], &items[child]))
+			child++;
+		if (!spa_control_merge_before(&items[child], &tmp))
+			break;
+		items[i] = items[child];
+		i = child;
+	}
+	items[i] = tmp;
+}
+
+/**
+ * Initialize \a merge to merge the sequences in \a seq. \a items should
+ * have space for \a n_seq elements and stay valid while merging.
+ */
+static inline void spa_control_merge_init(struct spa_control_merge *merge,
+		struct spa_control_merge_item *items,
+		struct spa_pod_sequence * const *seq, uint32_t n_seq)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < n_seq; i++) {
+		struct spa_pod_control *c = spa_pod_control_first(&seq[i]->body);
+		if (!spa_pod_control_is_inside(&seq[i]->body, SPA_POD_BODY_SIZE(seq[i]), c))
+			continue;
+		items[n].seq = seq[i];
+		items[n].ctrl = c;
+		items[n].index = i;
+		n++;
+	}
+	merge->items = items;
+	merge->n_items = n;
+	for (i = n / 2; i-- > 0;)
+		spa_control_merge_sift_down(merge, i);
+}
+
+/**
+ * Get the next control of the merge without removing it.
+ *
+ * \return the next control or NULL when all sequences are done
+ */
+static inline struct spa_pod_control *spa_control_merge_peek(const struct spa_control_merge *merge)
+{
+	return merge->n_items > 0 ? merge->items[0].ctrl : NULL;
+}
+
+/**
+ * Get the index of the sequence of the next control.
+ */
+static inline uint32_t spa_control_merge_index(const struct spa_control_merge *merge)
+{
+	return merge->n_items > 0 ? merge->items[0].index : SPA_ID_INVALID;
+}
+
+/**
+ * Remove the next control from the merge.
+ */
+static inline void spa_control_merge_advance(struct spa_control_merge *merge)
+{
+	struct spa_control_merge_item *top;
+
+	if (merge->n_items == 0)
+		return;
+
+	top = &merge->items[0];
+	top->ctrl = spa_pod_control_next(top->ctrl);
+	if (!spa_pod_control_is_inside(&top->seq->body, SPA_POD_BODY_SIZE(top->seq), top->ctrl))
+		*top = merge->items[--merge->n_items];
+	spa_control_merge_sift_down(merge, 0);
+}
+
+/**
+ * \}
+ */
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_CONTROL_MERGE_H */
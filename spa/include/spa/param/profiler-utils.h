@@ -0,0 +1,290 @@
+/* Simple Plugin API
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_PARAM_PROFILER_UTILS_H
+#define SPA_PARAM_PROFILER_UTILS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \addtogroup spa_param
+ * \{
+ */
+
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+#include <spa/node/io.h>
+#include <spa/param/profiler.h>
+
+/** SPA_PROFILER_info values */
+struct spa_profiler_info {
+	int64_t counter;
+	float cpu_load[3];		/**< fast, medium and slow cpu load */
+	int32_t xrun_count;
+};
+
+#define SPA_PROFILER_INFO(...)	((struct spa_profiler_info) { __VA_ARGS__ })
+
+/** SPA_PROFILER_driverBlock and SPA_PROFILER_followerBlock values */
+struct spa_profiler_block {
+	int32_t id;
+	const char *name;
+	int64_t prev_signal;
+	int64_t signal;
+	int64_t awake;
+	int64_t finish;
+	int32_t status;
+	struct spa_fraction latency;
+	int32_t n_dead;			/**< skipped dead followers, only for drivers */
+};
+
+#define SPA_PROFILER_BLOCK(...)	((struct spa_profiler_block) { __VA_ARGS__ })
+
+/* The fixed size parts of the profiler structs, encoded and decoded with
+ * spa_pod_builder_layout() and spa_pod_parser_get_layout(). */
+struct spa_profiler_info_layout {
+	struct spa_pod_struct pod;
+	struct spa_pod_long counter;
+	struct spa_pod_float cpu_load[3];
+	struct spa_pod_int xrun_count;
+};
+
+struct spa_profiler_clock_head {
+	struct spa_pod_int flags;
+	struct spa_pod_int id;
+};
+
+struct spa_profiler_clock_tail {
+	struct spa_pod_long nsec;
+	struct spa_pod_fraction rate;
+	struct spa_pod_long position;
+	struct spa_pod_long duration;
+	struct spa_pod_long delay;
+	struct spa_pod_double rate_diff;
+	struct spa_pod_long next_nsec;
+};
+
+struct spa_profiler_block_tail {
+	struct spa_pod_long prev_signal;
+	struct spa_pod_long signal;
+	struct spa_pod_long awake;
+	struct spa_pod_long finish;
+	struct spa_pod_int status;
+	struct spa_pod_fraction latency;
+};
+
+#define SPA_PROFILER_INFO_LAYOUT_INIT(i)						\
+	((struct spa_profiler_info_layout) {						\
+		SPA_POD_INIT_Struct(sizeof(struct spa_profiler_info_layout) -		\
+				sizeof(struct spa_pod)),				\
+		SPA_POD_INIT_Long((i)->counter),					\
+		{ SPA_POD_INIT_Float((i)->cpu_load[0]),					\
+		  SPA_POD_INIT_Float((i)->cpu_load[1]),					\
+		  SPA_POD_INIT_Float((i)->cpu_load[2]) },				\
+		SPA_POD_INIT_Int((i)->xrun_count) })
+
+#define SPA_PROFILER_CLOCK_HEAD_INIT(c)							\
+	((struct spa_profiler_clock_head) {						\
+		SPA_POD_INIT_Int((int32_t)(c)->flags),						\
+		SPA_POD_INIT_Int((int32_t)(c)->id) })
+
+#define SPA_PROFILER_CLOCK_TAIL_INIT(c)							\
+	((struct spa_profiler_clock_tail) {						\
+		SPA_POD_INIT_Long((int64_t)(c)->nsec),						\
+		SPA_POD_INIT_Fraction((c)->rate),					\
+		SPA_POD_INIT_Long((int64_t)(c)->position),					\
+		SPA_POD_INIT_Long((int64_t)(c)->duration),					\
+		SPA_POD_INIT_Long((int64_t)(c)->delay),						\
+		SPA_POD_INIT_Double((c)->rate_diff),					\
+		SPA_POD_INIT_Long((int64_t)(c)->next_nsec) })
+
+#define SPA_PROFILER_BLOCK_TAIL_INIT(b)							\
+	((struct spa_profiler_block_tail) {						\
+		SPA_POD_INIT_Long((b)->prev_signal),					\
+		SPA_POD_INIT_Long((b)->signal),						\
+		SPA_POD_INIT_Long((b)->awake),						\
+		SPA_POD_INIT_Long((b)->finish),						\
+		SPA_POD_INIT_Int((b)->status),						\
+		SPA_POD_INIT_Fraction((b)->latency) })
+
+static inline int
+spa_profiler_info_build(struct spa_pod_builder *b, const struct spa_profiler_info *info)
+{
+	struct spa_profiler_info_layout l = SPA_PROFILER_INFO_LAYOUT_INIT(info);
+	return spa_pod_builder_layout(b, &l, sizeof(l));
+}
+
+static inline int
+spa_profiler_info_parse(const struct spa_pod *pod, struct spa_profiler_info *info)
+{
+	const struct spa_profiler_info zero = { 0 };
+	struct spa_profiler_info_layout l = SPA_PROFILER_INFO_LAYOUT_INIT(&zero);
+	struct spa_pod_parser prs;
+	int res;
+
+	spa_pod_parser_pod(&prs, pod);
+	if (spa_pod_parser_get_layout(&prs, &l, sizeof(l)) < 0) {
+		/* older versions don't have the xrun count */
+		info->xrun_count = 0;
+		res = spa_pod_parse_struct(pod,
+				SPA_POD_Long(&info->counter),
+				SPA_POD_Float(&info->cpu_load[0]),
+				SPA_POD_Float(&info->cpu_load[1]),
+				SPA_POD_Float(&info->cpu_load[2]),
+				SPA_POD_OPT_Int(&info->xrun_count));
+		return res < 0 ? res : 0;
+	}
+	info->counter = l.counter.value;
+	info->cpu_load[0] = l.cpu_load[0].value;
+	info->cpu_load[1] = l.cpu_load[1].value;
+	info->cpu_load[2] = l.cpu_load[2].value;
+	info->xrun_count = l.xrun_count.value;
+	return 0;
+}
+
+static inline int
+spa_profiler_clock_build(struct spa_pod_builder *b, const struct spa_io_clock *clock)
+{
+	struct spa_profiler_clock_head h = SPA_PROFILER_CLOCK_HEAD_INIT(clock);
+	struct spa_profiler_clock_tail t = SPA_PROFILER_CLOCK_TAIL_INIT(clock);
+	struct spa_pod_frame f;
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_layout(b, &h, sizeof(h));
+	spa_pod_builder_string(b, clock->name);
+	spa_pod_builder_layout(b, &t, sizeof(t));
+	return spa_pod_builder_pop(b, &f) == NULL ? -ENOSPC : 0;
+}
+
+static inline int
+spa_profiler_clock_parse(const struct spa_pod *pod, struct spa_io_clock *clock)
+{
+	const struct spa_io_clock zero = { 0 };
+	struct spa_profiler_clock_head h = SPA_PROFILER_CLOCK_HEAD_INIT(&zero);
+	struct spa_profiler_clock_tail t = SPA_PROFILER_CLOCK_TAIL_INIT(&zero);
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	const char *name;
+	int res;
+
+	spa_pod_parser_pod(&prs, pod);
+	if (spa_pod_parser_push_struct(&prs, &f) < 0 ||
+	    spa_pod_parser_get_layout(&prs, &h, sizeof(h)) < 0 ||
+	    spa_pod_parser_get_string(&prs, &name) < 0 ||
+	    spa_pod_parser_get_layout(&prs, &t, sizeof(t)) < 0) {
+		res = spa_pod_parse_struct(pod,
+				SPA_POD_Int(&clock->flags),
+				SPA_POD_Int(&clock->id),
+				SPA_POD_Stringn(clock->name, sizeof(clock->name)),
+				SPA_POD_Long(&clock->nsec),
+				SPA_POD_Fraction(&clock->rate),
+				SPA_POD_Long(&clock->position),
+				SPA_POD_Long(&clock->duration),
+				SPA_POD_Long(&clock->delay),
+				SPA_POD_Double(&clock->rate_diff),
+				SPA_POD_Long(&clock->next_nsec));
+		return res < 0 ? res : 0;
+	}
+
+	clock->flags = h.flags.value;
+	clock->id = h.id.value;
+	snprintf(clock->name, sizeof(clock->name), "%s", name);
+	clock->nsec = t.nsec.value;
+	clock->rate = t.rate.value;
+	clock->position = t.position.value;
+	clock->duration = t.duration.value;
+	clock->delay = t.delay.value;
+	clock->rate_diff = t.rate_diff.value;
+	clock->next_nsec = t.next_nsec.value;
+	return 0;
+}
+
+static inline int
+spa_profiler_block_build(struct spa_pod_builder *b, const struct spa_profiler_block *block,
+		bool driver)
+{
+	struct spa_profiler_block_tail t = SPA_PROFILER_BLOCK_TAIL_INIT(block);
+	struct spa_pod_frame f;
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_int(b, block->id);
+	spa_pod_builder_string(b, block->name);
+	spa_pod_builder_layout(b, &t, sizeof(t));
+	if (driver)
+		spa_pod_builder_int(b, block->n_dead);
+	return spa_pod_builder_pop(b, &f) == NULL ? -ENOSPC : 0;
+}
+
+/** Parse a driver or follower block. The name points into the pod. */
+static inline int
+spa_profiler_block_parse(const struct spa_pod *pod, struct spa_profiler_block *block)
+{
+	const struct spa_profiler_block zero = { 0 };
+	struct spa_profiler_block_tail t = SPA_PROFILER_BLOCK_TAIL_INIT(&zero);
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	int res;
+
+	block->n_dead = 0;
+
+	spa_pod_parser_pod(&prs, pod);
+	if (spa_pod_parser_push_struct(&prs, &f) < 0 ||
+	    spa_pod_parser_get_int(&prs, &block->id) < 0 ||
+	    spa_pod_parser_get_string(&prs, &block->name) < 0 ||
+	    spa_pod_parser_get_layout(&prs, &t, sizeof(t)) < 0) {
+		/* older versions don't have the latency */
+		block->latency = SPA_FRACTION(0, 0);
+		res = spa_pod_parse_struct(pod,
+				SPA_POD_Int(&block->id),
+				SPA_POD_String(&block->name),
+				SPA_POD_Long(&block->prev_signal),
+				SPA_POD_Long(&block->signal),
+				SPA_POD_Long(&block->awake),
+				SPA_POD_Long(&block->finish),
+				SPA_POD_Int(&block->status),
+				SPA_POD_OPT_Fraction(&block->latency),
+				SPA_POD_OPT_Int(&block->n_dead));
+		return res < 0 ? res : 0;
+	}
+	block->prev_signal = t.prev_signal.value;
+	block->signal = t.signal.value;
+	block->awake = t.awake.value;
+	block->finish = t.finish.value;
+	block->status = t.status.value;
+	block->latency = t.latency.value;
+	spa_pod_parser_get_int(&prs, &block->n_dead);
+	return 0;
+}
+
+/**
+ * \}
+ */
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_PARAM_PROFILER_UTILS_H */
@@ -69,7 +69,8 @@ enum spa_profiler {
 							  *      Long : driver awake,
 							  *      Long : driver finish,
 							  *      Int : driver status),
-							  *      Fraction : latency))  */
+							  *      Fraction : latency,
+							  *      Int : skipped dead followers))  */
 
 	SPA_PROFILER_START_Follower	= 0x20000,	/**< follower related profiler properties */
 	SPA_PROFILER_followerBlock,			/**< generic follower info block
@@ -83,6 +84,24 @@ enum spa_profiler {
 							  *      Int : status,
 							  *      Fraction : latency))  */
 
+	SPA_PROFILER_START_Node		= 0x30000,	/**< node related profiler properties */
+	SPA_PROFILER_nodeHistogram,			/**< cumulative timing histograms of a node.
+							  *  Bucket 0 counts the values below
+							  *  1 << min_shift nanoseconds, after that
+							  *  each power of 2 has 1 << sub_shift
+							  *  buckets. The arrays have no trailing
+							  *  empty buckets.
+							  *  (Struct(
+							  *      Int : id,
+							  *      Int : min_shift,
+							  *      Int : sub_shift,
+							  *      Long : wakeup max,
+							  *      Array of Long : wakeup buckets,
+							  *      Long : process max,
+							  *      Array of Long : process buckets,
+							  *      Long : cycle max,
+							  *      Array of Long : cycle buckets))  */
+
 	SPA_PROFILER_START_CUSTOM	= 0x1000000,
 };
 
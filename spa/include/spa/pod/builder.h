@@ -214,6 +214,24 @@ spa_pod_builder_primitive(struct spa_pod_builder *builder, const struct spa_pod
 	return res;
 }
 
+/**
+ * Add pods with a layout that is known at compile time with one copy.
+ *
+ * \a layout is a struct of fixed size pods, such as struct spa_pod_int or
+ * struct spa_pod_long, that are initialized with the SPA_POD_INIT_* macros.
+ * It can start with a struct spa_pod_struct or struct spa_pod_object header
+ * to add a complete Struct or Object. The fixed size pods are padded to 8
+ * bytes so the struct has the same layout as the encoded pods.
+ *
+ * See spa_pod_parser_get_layout() to parse the pods.
+ */
+static inline int spa_pod_builder_layout(struct spa_pod_builder *builder,
+		const void *layout, uint32_t size)
+{
+	SPA_FLAG_CLEAR(builder->state.flags, SPA_POD_BUILDER_FLAG_FIRST);
+	return spa_pod_builder_raw(builder, layout, size);
+}
+
 #define SPA_POD_INIT(size,type) ((struct spa_pod) { (size), (type) })
 
 #define SPA_POD_INIT_None() SPA_POD_INIT(0, SPA_TYPE_None)
@@ -288,6 +288,96 @@ static inline int spa_pod_parser_push_object(struct spa_pod_parser *parser,
 	return 0;
 }
 
+/**
+ * Check if \a pod has the same layout as \a layout, which must be a valid pod:
+ * the same type and size, the same layout of the children of a struct, the
+ * same object type, id and property keys of an object and the same choice
+ * type and child type of a choice or array. The values are not compared.
+ */
+static inline bool spa_pod_layout_equal(const struct spa_pod *pod, const struct spa_pod *layout)
+{
+	const void *body, *lbody;
+	uint32_t offs, size;
+
+	if (pod->size != layout->size || pod->type != layout->type)
+		return false;
+
+	body = SPA_POD_BODY_CONST(pod);
+	lbody = SPA_POD_BODY_CONST(layout);
+	size = layout->size;
+
+	switch (layout->type) {
+	case SPA_TYPE_Struct:
+		for (offs = 0; offs + sizeof(struct spa_pod) <= size;) {
+			const struct spa_pod *l = SPA_PTROFF(lbody, offs, const struct spa_pod);
+			if (!spa_pod_layout_equal(SPA_PTROFF(body, offs, const struct spa_pod), l))
+				return false;
+			offs += SPA_ROUND_UP_N(SPA_POD_SIZE(l), 8);
+		}
+		return true;
+	case SPA_TYPE_Object:
+		if (size < sizeof(struct spa_pod_object_body) ||
+		    memcmp(body, lbody, sizeof(struct spa_pod_object_body)) != 0)
+			return false;
+		for (offs = sizeof(struct spa_pod_object_body);
+		     offs + sizeof(struct spa_pod_prop) <= size;) {
+			const struct spa_pod_prop *p = SPA_PTROFF(body, offs, const struct spa_pod_prop);
+			const struct spa_pod_prop *l = SPA_PTROFF(lbody, offs, const struct spa_pod_prop);
+			if (p->key != l->key || !spa_pod_layout_equal(&p->value, &l->value))
+				return false;
+			offs += SPA_ROUND_UP_N(SPA_POD_PROP_SIZE(l), 8);
+		}
+		return true;
+	case SPA_TYPE_Choice:
+		return size >= sizeof(struct spa_pod_choice_body) &&
+			memcmp(body, lbody, sizeof(struct spa_pod_choice_body)) == 0;
+	case SPA_TYPE_Array:
+		return size >= sizeof(struct spa_pod_array_body) &&
+			memcmp(body, lbody, sizeof(struct spa_pod_array_body)) == 0;
+	default:
+		return true;
+	}
+}
+
+/**
+ * Get the next pods when they have the same layout as the pods in \a layout,
+ * see spa_pod_layout_equal(), and copy them over \a layout.
+ *
+ * \a layout is a struct of fixed size pods that is initialized with the
+ * SPA_POD_INIT_* macros, see spa_pod_builder_layout(). The values can then be
+ * read from the struct members. This avoids the type checks of
+ * spa_pod_parser_get() for each value but it does not accept values that
+ * are encoded differently, such as in a Choice. Use spa_pod_parser_get() when
+ * this fails.
+ *
+ * \return 0 on success, -EPIPE when there is not enough data or -EPROTO
+ *   when the layout is different.
+ */
+static inline int spa_pod_parser_get_layout(struct spa_pod_parser *parser,
+		void *layout, uint32_t size)
+{
+	struct spa_pod_frame *f = parser->state.frame;
+	uint64_t end = f ? f->offset + SPA_POD_SIZE(&f->pod) : parser->size;
+	const void *data = SPA_PTROFF(parser->data, parser->state.offset, void);
+	uint32_t offs;
+
+	if ((uint64_t)parser->state.offset + size > SPA_MIN(end, (uint64_t)parser->size))
+		return -EPIPE;
+	if ((parser->state.offset & 7) != 0 ||
+	    !SPA_IS_ALIGNED(data, __alignof__(struct spa_pod)))
+		return -EPROTO;
+
+	for (offs = 0; offs + sizeof(struct spa_pod) <= size;) {
+		const struct spa_pod *l = SPA_PTROFF(layout, offs, const struct spa_pod);
+		if (!spa_pod_layout_equal(SPA_PTROFF(data, offs, const struct spa_pod), l))
+			return -EPROTO;
+		offs += SPA_ROUND_UP_N(SPA_POD_SIZE(l), 8);
+	}
+	memcpy(layout, data, size);
+	parser->state.offset += size;
+	return 0;
+}
+
 static inline bool spa_pod_parser_can_collect(const struct spa_pod *pod, char type)
 {
 	if (pod == NULL)
@@ -310,6 +310,9 @@ do {								\
 #define SPA_KEY_LOG_TIMESTAMP		"log.timestamp"		/**< log timestamps */
 #define SPA_KEY_LOG_LINE		"log.line"		/**< log file and line numbers */
 #define SPA_KEY_LOG_PATTERNS		"log.patterns"		/**< Spa:String:JSON array of [ {"pattern" : level}, ... ] */
+#define SPA_KEY_LOG_DEFERRED		"log.deferred"		/**< only copy the arguments in the calling
+								  *  thread and format the messages in a
+								  *  separate thread */
 
 /**
  * \}
@@ -37,6 +37,12 @@ extern "C" {
 #include <math.h>
 #include <float.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include <spa/utils/defs.h>
 #include <spa/utils/string.h>
 
@@ -73,6 +79,90 @@ static inline void spa_json_enter(struct spa_json * iter, struct spa_json * sub)
 
 #define SPA_JSON_SAVE(iter) ((struct spa_json) { (iter)->cur, (iter)->end, })
 
+enum spa_json_scan {
+	SPA_JSON_SCAN_SPACE,	/* whitespace and separators between tokens */
+	SPA_JSON_SCAN_BARE,	/* characters of a bare word */
+	SPA_JSON_SCAN_STRING,	/* printable ASCII in a string, except escapes */
+	SPA_JSON_SCAN_COMMENT,	/* characters until the end of the line */
+};
+
+#if defined(__SSE2__)
+#define SPA_JSON_SCAN_BLOCK	16
+#define SPA_JSON_EQ(c)		_mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define SPA_JSON_OR(a,b)	_mm_or_si128(a, b)
+#define SPA_JSON_LT(c)		_mm_cmplt_epi8(v, _mm_set1_epi8(c))
+#define SPA_JSON_MASK(m)	((uint32_t)_mm_movemask_epi8(m))
+#define SPA_JSON_LOAD(p)	_mm_loadu_si128((const __m128i*)(p))
+typedef __m128i spa_json_vec;
+#elif defined(__ARM_NEON)
+#define SPA_JSON_SCAN_BLOCK	16
+#define SPA_JSON_EQ(c)		vceqq_s8(v, vdupq_n_s8(c))
+#define SPA_JSON_OR(a,b)	vorrq_u8(a, b)
+#define SPA_JSON_LT(c)		vcltq_s8(v, vdupq_n_s8(c))
+/* 4 bits per byte */
+#define SPA_JSON_MASK(m)	vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0)
+#define SPA_JSON_LOAD(p)	vld1q_s8((const int8_t*)(p))
+typedef int8x16_t spa_json_vec;
+#endif
+
+/** Skip the characters of a run that don't change the tokenizer state, whole
+ * blocks at a time. Returns a pointer to the first character that needs to
+ * be looked at, or to the start of the last partial block. */
+static inline const char *spa_json_scan(enum spa_json_scan scan, const char *p, const char *end)
+{
+#ifdef SPA_JSON_SCAN_BLOCK
+	for (; end - p >= SPA_JSON_SCAN_BLOCK; p += SPA_JSON_SCAN_BLOCK) {
+		spa_json_vec v = SPA_JSON_LOAD(p);
+		uint64_t mask;
+
+		switch (scan) {
+		case SPA_JSON_SCAN_SPACE:
+			mask = ~SPA_JSON_MASK(SPA_JSON_OR(
+				SPA_JSON_OR(SPA_JSON_OR(SPA_JSON_EQ('\0'), SPA_JSON_EQ('\t')),
+					SPA_JSON_OR(SPA_JSON_EQ(' '), SPA_JSON_EQ('\r'))),
+				SPA_JSON_OR(SPA_JSON_OR(SPA_JSON_EQ('\n'), SPA_JSON_EQ(':')),
+					SPA_JSON_OR(SPA_JSON_EQ('='), SPA_JSON_EQ(',')))));
+			break;
+		case SPA_JSON_SCAN_BARE:
+			mask = SPA_JSON_MASK(SPA_JSON_OR(
+				SPA_JSON_OR(SPA_JSON_OR(SPA_JSON_EQ('\t'), SPA_JSON_EQ(' ')),
+					SPA_JSON_OR(SPA_JSON_EQ('\r'), SPA_JSON_EQ('\n'))),
+				SPA_JSON_OR(SPA_JSON_OR(
+					SPA_JSON_OR(SPA_JSON_EQ(':'), SPA_JSON_EQ(',')),
+					SPA_JSON_OR(SPA_JSON_EQ('='), SPA_JSON_EQ(']'))),
+					SPA_JSON_EQ('}'))));
+			break;
+		case SPA_JSON_SCAN_STRING:
+			/* the signed compare also matches the UTF-8 bytes >= 128 */
+			mask = SPA_JSON_MASK(SPA_JSON_OR(
+				SPA_JSON_OR(SPA_JSON_EQ('"'), SPA_JSON_EQ('\\')),
+				SPA_JSON_OR(SPA_JSON_LT(32), SPA_JSON_EQ(127))));
+			break;
+		case SPA_JSON_SCAN_COMMENT:
+			mask = SPA_JSON_MASK(SPA_JSON_OR(SPA_JSON_EQ('\n'), SPA_JSON_EQ('\r')));
+			break;
+		default:
+			return p;
+		}
+#if defined(__ARM_NEON) && !defined(__SSE2__)
+		if (mask != 0)
+			return p + (__builtin_ctzll(mask) >> 2);
+#else
+		mask &= (1ull << SPA_JSON_SCAN_BLOCK) - 1;
+		if (mask != 0)
+			return p + __builtin_ctzll(mask);
+#endif
+	}
+#endif
+	return p;
+}
+
+#undef SPA_JSON_EQ
+#undef SPA_JSON_OR
+#undef SPA_JSON_LT
+#undef SPA_JSON_MASK
+#undef SPA_JSON_LOAD
+
 /** Get the next token. \a value points to the token and the return value
  * is the length. */
 static inline int spa_json_next(struct spa_json * iter, const char **value)
@@ -92,13 +182,16 @@ static inline int spa_json_next(struct spa_json * iter, const char **value)
 		case __STRUCT:
 			switch (cur) {
 			case '\0': case '\t': case ' ': case '\r': case '\n': case ':': case '=': case ',':
+				iter->cur = spa_json_scan(SPA_JSON_SCAN_SPACE, iter->cur + 1, iter->end) - 1;
 				continue;
 			case '#':
 				iter->state = __COMMENT;
+				iter->cur = spa_json_scan(SPA_JSON_SCAN_COMMENT, iter->cur + 1, iter->end) - 1;
 				continue;
 			case '"':
 				*value = iter->cur;
 				iter->state = __STRING;
+				iter->cur = spa_json_scan(SPA_JSON_SCAN_STRING, iter->cur + 1, iter->end) - 1;
 				continue;
 			case '[': case '{':
 				*value = iter->cur;
@@ -117,6 +210,7 @@ static inline int spa_json_next(struct spa_json * iter, const char **value)
 			default:
 				*value = iter->cur;
 				iter->state = __BARE;
+				iter->cur = spa_json_scan(SPA_JSON_SCAN_BARE, iter->cur + 1, iter->end) - 1;
 			}
 			continue;
 		case __BARE:
@@ -157,8 +251,11 @@ static inline int spa_json_next(struct spa_json * iter, const char **value)
 		case __UTF8:
 			switch (cur) {
 			case 128 ... 191:
-				if (--utf8_remain == 0)
+				if (--utf8_remain == 0) {
 					iter->state = __STRING;
+					iter->cur = spa_json_scan(SPA_JSON_SCAN_STRING,
+							iter->cur + 1, iter->end) - 1;
+				}
 				continue;
 			}
 			return -1;
@@ -167,6 +264,7 @@ static inline int spa_json_next(struct spa_json * iter, const char **value)
 			case '"': case '\\': case '/': case 'b': case 'f':
 			case 'n': case 'r': case 't': case 'u':
 				iter->state = __STRING;
+				iter->cur = spa_json_scan(SPA_JSON_SCAN_STRING, iter->cur + 1, iter->end) - 1;
 				continue;
 			}
 			return -1;
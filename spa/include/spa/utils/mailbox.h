@@ -0,0 +1,138 @@
+/* Simple Plugin API
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_MAILBOX_H
+#define SPA_MAILBOX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup spa_mailbox Mailbox
+ * Lock-free latest-value exchange between two threads
+ */
+
+/**
+ * \addtogroup spa_mailbox
+ * \{
+ */
+
+#include <stdbool.h>
+
+#include <spa/utils/defs.h>
+
+/**
+ * A mailbox passes the latest version of some state from one writer thread
+ * to one reader thread without locks, wakeups or copies on the reader side.
+ *
+ * The state lives in 3 slots owned by the user. The writer fills the slot
+ * returned by spa_mailbox_write_index() completely and publishes it. The
+ * reader fetches the most recently published slot, usually at the start
+ * of its processing cycle, and uses the slot at spa_mailbox_read_index()
+ * until the next fetch. Intermediate versions are dropped when the writer
+ * publishes faster than the reader fetches.
+ */
+struct spa_mailbox {
+	uint32_t write;		/*< slot owned by the writer */
+	uint32_t state;		/*< slot that was last exchanged, with the dirty flag */
+	uint32_t read;		/*< slot owned by the reader */
+};
+
+#define SPA_MAILBOX_SLOTS	3u
+
+#define SPA_MAILBOX_INDEX	0x3u
+#define SPA_MAILBOX_DIRTY	0x4u
+
+#define SPA_MAILBOX_INIT()	((struct spa_mailbox) { 0, 1, 2 })
+
+/**
+ * Initialize a spa_mailbox.
+ *
+ * \param mbox a spa_mailbox
+ */
+static inline void spa_mailbox_init(struct spa_mailbox *mbox)
+{
+	*mbox = SPA_MAILBOX_INIT();
+}
+
+/**
+ * Get the slot that the writer should fill before calling
+ * spa_mailbox_publish().
+ *
+ * \param mbox a spa_mailbox
+ * \return the slot index, less than SPA_MAILBOX_SLOTS
+ */
+static inline uint32_t spa_mailbox_write_index(struct spa_mailbox *mbox)
+{
+	return mbox->write;
+}
+
+/**
+ * Make the slot at the write index available to the reader.
+ *
+ * \param mbox a spa_mailbox
+ */
+static inline void spa_mailbox_publish(struct spa_mailbox *mbox)
+{
+	mbox->write = __atomic_exchange_n(&mbox->state,
+			mbox->write | SPA_MAILBOX_DIRTY, __ATOMIC_ACQ_REL) & SPA_MAILBOX_INDEX;
+}
+
+/**
+ * Fetch the most recently published slot.
+ *
+ * \param mbox a spa_mailbox
+ * \return true when a new slot was published since the last fetch, the
+ *   new slot can be found with spa_mailbox_read_index().
+ */
+static inline bool spa_mailbox_fetch(struct spa_mailbox *mbox)
+{
+	if (SPA_LIKELY((__atomic_load_n(&mbox->state, __ATOMIC_RELAXED) & SPA_MAILBOX_DIRTY) == 0))
+		return false;
+	mbox->read = __atomic_exchange_n(&mbox->state,
+			mbox->read, __ATOMIC_ACQ_REL) & SPA_MAILBOX_INDEX;
+	return true;
+}
+
+/**
+ * Get the slot that the reader should use.
+ *
+ * \param mbox a spa_mailbox
+ * \return the slot index, less than SPA_MAILBOX_SLOTS
+ */
+static inline uint32_t spa_mailbox_read_index(struct spa_mailbox *mbox)
+{
+	return mbox->read;
+}
+
+/**
+ * \}
+ */
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_MAILBOX_H */
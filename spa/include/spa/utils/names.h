@@ -133,6 +133,8 @@ extern "C" {
 #define SPA_NAME_API_V4L2_DEVICE	"api.v4l2.device"		/**< a v4l2 Device interface */
 #define SPA_NAME_API_V4L2_SOURCE	"api.v4l2.source"		/**< a v4l2 Node interface for
 									  *  capturing */
+#define SPA_NAME_API_V4L2_MJPEG_DECODER	"api.v4l2.mjpeg.decoder"	/**< a Node interface to decode
+									  *  MJPEG from a v4l2 device */
 
 /** keys for libcamera factory names */
 #define SPA_NAME_API_LIBCAMERA_ENUM_CLIENT	"api.libcamera.enum.client"	/**< a libcamera client Device interface */
@@ -0,0 +1,69 @@
+/* Simple Plugin API
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SPA_PROBE_H
+#define SPA_PROBE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup spa_probe Probes
+ * Static tracepoints
+ */
+
+/**
+ * \addtogroup spa_probe
+ * \{
+ */
+
+/**
+ * Place a USDT/SDT static tracepoint named \a name in \a provider with
+ * up to 12 integer or pointer arguments.
+ *
+ * When compiled with SPA_ENABLE_PROBES, this expands to a single nop
+ * instruction plus a note in the .note.stapsdt section that tools like
+ * bpftrace, perf or systemtap can attach to at runtime. Argument values
+ * are only evaluated into registers, no function is called.
+ *
+ * Without SPA_ENABLE_PROBES this expands to nothing and the arguments
+ * are not evaluated.
+ */
+#ifdef SPA_ENABLE_PROBES
+#include <sys/sdt.h>
+#define spa_probe(provider,name,...)	STAP_PROBEV(provider,name,##__VA_ARGS__)
+#else
+#define spa_probe(provider,name,...)	do { } while(0)
+#endif
+
+/**
+ * \}
+ */
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_PROBE_H */
@@ -13,6 +13,7 @@
 #include <spa/utils/result.h>
 #include <spa/support/system.h>
 #include <spa/utils/keys.h>
+#include <spa/utils/probe.h>
 
 #include "alsa-pcm.h"
 
@@ -2473,6 +2474,7 @@ static void alsa_on_timeout_event(struct spa_source *source)
 		state->next_time += state->threshold * 1e9 / state->rate;
 		goto done;
 	}
+	spa_probe(spa, alsa_wakeup, state, state->stream, current_time, delay, target);
 
 #ifndef FASTPATH
 	if (SPA_UNLIKELY(spa_log_level_topic_enabled(state->log, SPA_LOG_TOPIC_DEFAULT, SPA_LOG_LEVEL_TRACE))) {
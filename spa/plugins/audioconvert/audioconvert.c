@@ -33,7 +33,9 @@
 #include <spa/utils/result.h>
 #include <spa/utils/list.h>
 #include <spa/utils/json.h>
+#include <spa/utils/mailbox.h>
 #include <spa/utils/names.h>
+#include <spa/utils/probe.h>
 #include <spa/utils/string.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
@@ -94,6 +96,12 @@ struct props {
 	double rate;
 };
 
+/* volumes passed from the main thread to the data thread */
+struct volume_update {
+	float volume;
+	struct volumes vol;
+};
+
 static void props_reset(struct props *props)
 {
 	uint32_t i;
@@ -213,6 +221,9 @@ struct impl {
 	struct volume volume;
 	double rate_scale;
 
+	struct spa_mailbox volume_mailbox;
+	struct volume_update volume_update[SPA_MAILBOX_SLOTS];
+
 	uint32_t in_offset;
 	uint32_t out_offset;
 	unsigned int started:1;
@@ -939,8 +950,6 @@ static int apply_props(struct impl *this, const struct spa_pod *param)
 			p->have_soft_volume = true;
 		else if (have_channel_volume)
 			p->have_soft_volume = false;
-
-		set_volume(this);
 	}
 	return changed;
 }
@@ -958,7 +967,6 @@ static int apply_midi(struct impl *this, const struct spa_pod *value)
 		return 0;
 
 	p->volume = val[2] / 127.0f;
-	set_volume(this);
 	return 1;
 }
 
@@ -1097,8 +1105,10 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 		break;
 	}
 	case SPA_PARAM_Props:
-		if (apply_props(this, param) > 0)
+		if (apply_props(this, param) > 0) {
+			set_volume(this);
 			emit_node_info(this, false);
+		}
 		break;
 	default:
 		return -ENOENT;
@@ -1231,11 +1241,10 @@ static int remap_volumes(struct impl *this, const struct spa_audio_info *info)
 	return 1;
 }
 
-static void set_volume(struct impl *this)
+static bool prepare_volume(struct impl *this, struct volume_update *update)
 {
 	struct volumes *vol;
 	uint32_t i;
-	float volumes[SPA_AUDIO_MAX_CHANNELS];
 	struct dir *dir = &this->dir[this->direction];
 
 	spa_log_debug(this->log, "%p have_format:%d", this, dir->have_format);
@@ -1244,21 +1253,63 @@ static void set_volume(struct impl *this)
 		remap_volumes(this, &dir->format);
 
 	if (this->mix.set_volume == NULL)
-		return;
+		return false;
 
 	if (this->props.have_soft_volume)
 		vol = &this->props.soft;
 	else
 		vol = &this->props.channel;
 
+	update->volume = this->props.volume;
+	update->vol.mute = vol->mute;
+	update->vol.n_volumes = vol->n_volumes;
 	for (i = 0; i < vol->n_volumes; i++)
-		volumes[i] = vol->volumes[dir->remap[i]];
-
-	channelmix_set_volume(&this->mix, this->props.volume, vol->mute,
-			vol->n_volumes, volumes);
+		update->vol.volumes[i] = vol->volumes[dir->remap[i]];
 
 	this->info.change_mask |= SPA_NODE_CHANGE_MASK_PARAMS;
 	this->params[IDX_Props].user++;
+	return true;
+}
+
+static void apply_volume(struct impl *this, struct volume_update *update)
+{
+	channelmix_set_volume(&this->mix, update->volume, update->vol.mute,
+			update->vol.n_volumes, update->vol.volumes);
+}
+
+/* called from the data thread, pick up the volumes that were posted by
+ * set_volume() */
+static inline void update_volume(struct impl *this)
+{
+	if (SPA_UNLIKELY(spa_mailbox_fetch(&this->volume_mailbox)))
+		apply_volume(this, &this->volume_update[
+				spa_mailbox_read_index(&this->volume_mailbox)]);
+}
+
+/* called from the main thread, the channelmix matrix is owned by the data
+ * thread and is updated at the start of the next cycle without a wakeup. */
+static void set_volume(struct impl *this)
+{
+	struct volume_update *update;
+
+	update = &this->volume_update[spa_mailbox_write_index(&this->volume_mailbox)];
+	if (!prepare_volume(this, update))
+		return;
+
+	spa_mailbox_publish(&this->volume_mailbox);
+
+	/* when not started, we can safely apply the new volumes now */
+	if (!this->started)
+		update_volume(this);
+}
+
+/* called from the data thread for controls in the stream */
+static void set_volume_rt(struct impl *this)
+{
+	struct volume_update update;
+
+	if (prepare_volume(this, &update))
+		apply_volume(this, &update);
 }
 
 static char *format_position(char *str, size_t len, uint32_t channels, uint32_t *position)
@@ -2200,10 +2251,12 @@ static int channelmix_process_control(struct impl *this, struct port *ctrlport,
 		if (prev) {
 			switch (prev->type) {
 			case SPA_CONTROL_Midi:
-				apply_midi(this, &prev->value);
+				if (apply_midi(this, &prev->value) > 0)
+					set_volume_rt(this);
 				break;
 			case SPA_CONTROL_Properties:
-				apply_props(this, &prev->value);
+				if (apply_props(this, &prev->value) > 0)
+					set_volume_rt(this);
 				break;
 			default:
 				continue;
@@ -2291,6 +2344,10 @@ static int impl_node_process(void *object)
 	struct spa_io_buffers *io, *ctrlio = NULL;
 	const struct spa_pod_sequence *ctrl = NULL;
 
+	spa_probe(spa, audioconvert_process, this);
+
+	update_volume(this);
+
 	/* calculate quantum scale, this is how many samples we need to produce or
 	 * consume. Also update the rate scale, this is sent to the resampler to adjust
 	 * the rate, either when the graph clock changed or when the user adjusted the
@@ -2521,6 +2578,7 @@ static int impl_node_process(void *object)
 			resample_update_rate_match(this, resample_passthrough, n_out, 0);
 			spa_log_trace_fp(this->log, "%p: no input drained:%d", this, this->drained);
 			res |= this->drained ? SPA_STATUS_DRAINED : SPA_STATUS_NEED_DATA;
+			spa_probe(spa, audioconvert_process_done, this, 0, res);
 			return res;
 		}
 		/* else figure out how much input samples we need to consume */
@@ -2707,6 +2765,7 @@ static int impl_node_process(void *object)
 			max_in - this->in_offset) > 0)
 		res |= SPA_STATUS_NEED_DATA;
 
+	spa_probe(spa, audioconvert_process_done, this, n_samples, res);
 	return res;
 }
 
@@ -2883,6 +2942,7 @@ impl_init(const struct spa_handle_factory *factory,
 			SPA_VERSION_NODE,
 			&impl_node, this);
 	spa_hook_list_init(&this->hooks);
+	spa_mailbox_init(&this->volume_mailbox);
 
 	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
 			SPA_NODE_CHANGE_MASK_PARAMS;
@@ -38,6 +38,7 @@
 #include <spa/param/audio/format-utils.h>
 #include <spa/param/param.h>
 #include <spa/control/control.h>
+#include <spa/control/merge.h>
 #include <spa/pod/filter.h>
 
 #define NAME "control-mixer"
@@ -575,38 +576,6 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return queue_buffer(this, port, &port->buffers[buffer_id]);
 }
 
-static inline int event_sort(struct spa_pod_control *a, struct spa_pod_control *b)
-{
-	if (a->offset < b->offset)
-		return -1;
-	if (a->offset > b->offset)
-		return 1;
-	if (a->type != b->type)
-		return 0;
-	switch(a->type) {
-	case SPA_CONTROL_Midi:
-	{
-		/* 11 (controller) > 12 (program change) >
-		 * 8 (note off) > 9 (note on) > 10 (aftertouch) >
-		 * 13 (channel pressure) > 14 (pitch bend) */
-		static int priotab[] = { 5,4,3,7,6,2,1,0 };
-		uint8_t *da, *db;
-
-		if (SPA_POD_BODY_SIZE(&a->value) < 1 ||
-		    SPA_POD_BODY_SIZE(&b->value) < 1)
-			return 0;
-
-		da = SPA_POD_BODY(&a->value);
-		db = SPA_POD_BODY(&b->value);
-		if ((da[0] & 0xf) != (db[0] & 0xf))
-			return 0;
-		return priotab[(db[0]>>4) & 7] - priotab[(da[0]>>4) & 7];
-	}
-	default:
-		return 0;
-	}
-}
-
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
@@ -614,7 +583,9 @@ static int impl_node_process(void *object)
 	struct spa_io_buffers *outio;
 	uint32_t n_seq, i;
         struct spa_pod_sequence **seq;
-        struct spa_pod_control **ctrl;
+	struct spa_control_merge_item *items;
+	struct spa_control_merge merge;
+	struct spa_pod_control *next;
 	struct spa_pod_builder builder;
 	struct spa_pod_frame f;
         struct buffer *outb;
@@ -644,7 +615,7 @@ static int impl_node_process(void *object)
                 return -EPIPE;
         }
 
-	ctrl = alloca(MAX_PORTS * sizeof(struct spa_pod_control *));
+	items = alloca(MAX_PORTS * sizeof(struct spa_control_merge_item));
 	seq = alloca(MAX_PORTS * sizeof(struct spa_pod_sequence *));
         n_seq = 0;
 
@@ -679,7 +650,6 @@ static int impl_node_process(void *object)
 			continue;
 
 		seq[n_seq] = pod;
-		ctrl[n_seq] = spa_pod_control_first(&seq[n_seq]->body);
 		inio->status = SPA_STATUS_NEED_DATA;
 		n_seq++;
 	}
@@ -691,27 +661,11 @@ static int impl_node_process(void *object)
 	spa_pod_builder_push_sequence(&builder, &f, 0);
 
 	/* merge sort all sequences into output buffer */
-	while (true) {
-		struct spa_pod_control *next = NULL;
-		uint32_t next_index = 0;
-
-		for (i = 0; i < n_seq; i++) {
-			if (!spa_pod_control_is_inside(&seq[i]->body,
-					SPA_POD_BODY_SIZE(seq[i]), ctrl[i]))
-				continue;
-
-			if (next == NULL || event_sort(ctrl[i], next) <= 0) {
-				next = ctrl[i];
-				next_index = i;
-			}
-		}
-		if (next == NULL)
-			break;
-
+	spa_control_merge_init(&merge, items, seq, n_seq);
+	while ((next = spa_control_merge_peek(&merge)) != NULL) {
 		spa_pod_builder_control(&builder, next->offset, next->type);
 		spa_pod_builder_primitive(&builder, &next->value);
-
-		ctrl[next_index] = spa_pod_control_next(ctrl[next_index]);
+		spa_control_merge_advance(&merge);
 	}
 	spa_pod_builder_pop(&builder, &f);
 
@@ -27,8 +27,10 @@
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <fnmatch.h>
+#include <pthread.h>
 
 #include <spa/support/log.h>
 #include <spa/support/loop.h>
@@ -52,6 +54,38 @@
 
 #define TRACE_BUFFER (16*1024)
 
+#define DEFERRED_BUFFER		(64*1024)
+#define DEFERRED_MAX_RECORD	1024
+#define DEFERRED_INTERVAL_NS	(10 * SPA_NSEC_PER_MSEC)
+#define DEFERRED_FREE_RINGS	4
+
+/* a message of a deferred log call, followed by copies of the topic, file,
+ * function and format strings and the raw arguments. The strings are copied
+ * because the module that logged might be unloaded before the record is
+ * formatted. */
+struct log_record {
+	uint32_t size;
+	uint32_t level;
+	uint64_t time;
+	int32_t line;
+	int32_t err;
+#define LOG_RECORD_TRUNCATED	(1<<0)
+	uint32_t flags;
+	uint32_t padding;
+};
+
+/* each thread writes its deferred messages in its own ring */
+struct log_ring {
+	struct spa_list link;
+	struct spa_ringbuffer rb;
+	uint32_t dropped;		/* written by the thread */
+	uint32_t reported;		/* formatter thread */
+	bool dead;
+	bool have_head;
+	struct log_record head;
+	uint8_t data[DEFERRED_BUFFER];
+};
+
 struct impl {
 	struct spa_handle handle;
 	struct spa_log log;
@@ -68,23 +102,43 @@ struct impl {
 	unsigned int colors:1;
 	unsigned int timestamp:1;
 	unsigned int line:1;
+	unsigned int deferred:1;
 
 	struct spa_list patterns;
+
+	/* deferred logging */
+	uint64_t id;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_key_t ring_key;
+	bool running;
+	struct spa_list rings;
+	/* rings for new threads, made and added to rings by the formatter
+	 * thread so that a thread doesn't allocate on its first message */
+	struct log_ring *free_rings[DEFERRED_FREE_RINGS];
+	uint32_t no_ring;		/* messages dropped without free ring */
+	uint32_t no_ring_reported;
 };
 
-static SPA_PRINTF_FUNC(7,0) void
-impl_log_logtv(void *object,
+static uint64_t logger_id;
+static __thread uint64_t thread_logger_id;
+static __thread struct log_ring *thread_ring;
+
+static SPA_PRINTF_FUNC(9,0) void
+log_writev(struct impl *impl,
 	      enum spa_log_level level,
 	      const struct spa_log_topic *topic,
 	      const char *file,
 	      int line,
 	      const char *func,
+	      const struct timespec *now,
+	      bool allow_trace,
 	      const char *fmt,
 	      va_list args)
 {
 #define RESERVED_LENGTH 24
 
-	struct impl *impl = object;
 	char timestamp[15] = {0};
 	char topicstr[32] = {0};
 	char filename[64] = {0};
@@ -94,7 +148,7 @@ impl_log_logtv(void *object,
 	int size, len;
 	bool do_trace;
 
-	if ((do_trace = (level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
+	if ((do_trace = (allow_trace && level == SPA_LOG_LEVEL_TRACE && impl->have_source)))
 		level++;
 
 	if (impl->colors) {
@@ -112,10 +166,8 @@ impl_log_logtv(void *object,
 	len = sizeof(location) - RESERVED_LENGTH;
 
 	if (impl->timestamp) {
-		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
 		spa_scnprintf(timestamp, sizeof(timestamp), "[%05lu.%06lu]",
-			(now.tv_sec & 0x1FFFFFFF) % 100000, now.tv_nsec / 1000);
+			(now->tv_sec & 0x1FFFFFFF) % 100000, now->tv_nsec / 1000);
 	}
 
 	if (topic && topic->topic)
@@ -172,6 +224,632 @@ impl_log_logtv(void *object,
 #undef RESERVED_LENGTH
 }
 
+static SPA_PRINTF_FUNC(8,9) void
+log_write(struct impl *impl,
+	      enum spa_log_level level,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const struct timespec *now,
+	      const char *fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	log_writev(impl, level, topic, file, line, func, now, false, fmt, args);
+	va_end(args);
+}
+
+/* a printf conversion specification */
+struct spec {
+	const char *end;	/* first char after the conversion */
+	uint32_t n_star;	/* number of * width and precision arguments */
+	bool star_precision;	/* the last * argument is the precision */
+	int precision;		/* -1 when not given */
+	char length;		/* h, H (hh), l, q (ll), L, j, z or t */
+	char conv;
+};
+
+static bool parse_spec(const char *p, struct spec *sp)
+{
+	spa_zero(*sp);
+	sp->precision = -1;
+
+	for (p++; *p && strchr("-+ #0'", *p); p++);
+	if (*p == '*') {
+		sp->n_star++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			sp->n_star++;
+			sp->star_precision = true;
+			p++;
+		} else {
+			sp->precision = 0;
+			while (*p >= '0' && *p <= '9')
+				sp->precision = sp->precision * 10 + (*p++ - '0');
+		}
+	}
+	switch (*p) {
+	case 'h':
+		sp->length = *++p == 'h' ? (p++, 'H') : 'h';
+		break;
+	case 'l':
+		sp->length = *++p == 'l' ? (p++, 'q') : 'l';
+		break;
+	case 'q': case 'L': case 'j': case 'z': case 't':
+		sp->length = *p++;
+		break;
+	}
+	if (*p == '\0' || strchr("diouxXceEfFgGaAspm%", *p) == NULL ||
+	    (*p == 's' && sp->length != 0))
+		return false;
+	sp->conv = *p++;
+	sp->end = p;
+	return true;
+}
+
+static inline bool is_signed_conv(char conv)
+{
+	return conv == 'd' || conv == 'i';
+}
+
+static inline bool is_float_conv(char conv)
+{
+	return strchr("eEfFgGaA", conv) != NULL;
+}
+
+struct arg_writer {
+	uint8_t *p;
+	uint8_t *end;
+};
+
+static inline bool put_arg(struct arg_writer *w, const void *val, size_t size)
+{
+	size_t avail = w->end - w->p;
+	if (SPA_UNLIKELY(avail < SPA_ROUND_UP_N(size, 8)))
+		return false;
+	memcpy(w->p, val, size);
+	w->p += SPA_ROUND_UP_N(size, 8);
+	return true;
+}
+
+static bool put_string(struct arg_writer *w, const char *str, int precision)
+{
+	uint32_t len, max;
+
+	if (str == NULL) {
+		len = UINT32_MAX;
+		return put_arg(w, &len, sizeof(len));
+	}
+	if ((size_t)(w->end - w->p) < 16)
+		return false;
+	max = w->end - w->p - 8 - 1;
+	len = strnlen(str, precision >= 0 ? SPA_MIN((uint32_t)precision, max) : max);
+	memcpy(w->p, &len, sizeof(len));
+	memcpy(w->p + 8, str, len);
+	w->p[8 + len] = '\0';
+	w->p += 8 + SPA_ROUND_UP_N(len + 1, 8);
+	return true;
+}
+
+/* copy the arguments as described by fmt, strings are copied, the rest
+ * as a raw value. Returns false when not all arguments fit. Packing stops
+ * at the first unsupported conversion, the formatter stops there as well. */
+static bool pack_args(struct arg_writer *w, const char *fmt, va_list args)
+{
+	struct spec sp;
+	const char *p;
+	uint32_t i;
+
+	for (p = fmt; (p = strchr(p, '%')) != NULL; p = sp.end) {
+		if (!parse_spec(p, &sp))
+			break;
+
+		for (i = 0; i < sp.n_star; i++) {
+			int star = va_arg(args, int);
+			if (i + 1 == sp.n_star && sp.star_precision)
+				sp.precision = star;
+			if (!put_arg(w, &star, sizeof(star)))
+				return false;
+		}
+		switch (sp.conv) {
+		case '%':
+		case 'm':
+			break;
+		case 's':
+			if (!put_string(w, va_arg(args, const char *), sp.precision))
+				return false;
+			break;
+		case 'p':
+		{
+			void *val = va_arg(args, void *);
+			if (!put_arg(w, &val, sizeof(val)))
+				return false;
+			break;
+		}
+		default:
+			if (is_float_conv(sp.conv)) {
+				if (sp.length == 'L') {
+					long double val = va_arg(args, long double);
+					if (!put_arg(w, &val, sizeof(val)))
+						return false;
+				} else {
+					double val = va_arg(args, double);
+					if (!put_arg(w, &val, sizeof(val)))
+						return false;
+				}
+			} else {
+				uint64_t val;
+				switch (sp.length) {
+				case 'l': val = va_arg(args, long); break;
+				case 'q': case 'L': val = va_arg(args, long long); break;
+				case 'j': val = va_arg(args, intmax_t); break;
+				case 'z': val = va_arg(args, size_t); break;
+				case 't': val = va_arg(args, ptrdiff_t); break;
+				default: val = va_arg(args, int); break;
+				}
+				if (!put_arg(w, &val, sizeof(val)))
+					return false;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+static struct log_ring *get_ring(struct impl *impl)
+{
+	struct log_ring *ring;
+	uint32_t i;
+
+	if (SPA_LIKELY(thread_logger_id == impl->id))
+		return thread_ring;
+
+	if ((ring = pthread_getspecific(impl->ring_key)) == NULL) {
+		/* first message of this thread, take one of the free rings,
+		 * they are already in the list of rings */
+		for (i = 0; i < DEFERRED_FREE_RINGS; i++) {
+			if ((ring = __atomic_exchange_n(&impl->free_rings[i], NULL,
+							__ATOMIC_ACQ_REL)) != NULL)
+				break;
+		}
+		if (ring == NULL) {
+			__atomic_add_fetch(&impl->no_ring, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+		pthread_setspecific(impl->ring_key, ring);
+	}
+
+	thread_ring = ring;
+	thread_logger_id = impl->id;
+	return ring;
+}
+
+/* make rings for the free slots, called with the lock held */
+static void fill_free_rings(struct impl *impl)
+{
+	struct log_ring *ring;
+	uint32_t i;
+
+	for (i = 0; i < DEFERRED_FREE_RINGS; i++) {
+		if (__atomic_load_n(&impl->free_rings[i], __ATOMIC_RELAXED) != NULL)
+			continue;
+		if ((ring = calloc(1, sizeof(*ring))) == NULL)
+			break;
+		spa_ringbuffer_init(&ring->rb);
+		spa_list_append(&impl->rings, &ring->link);
+		__atomic_store_n(&impl->free_rings[i], ring, __ATOMIC_RELEASE);
+	}
+}
+
+static void ring_thread_exit(void *data)
+{
+	struct log_ring *ring = data;
+	__atomic_store_n(&ring->dead, true, __ATOMIC_RELEASE);
+}
+
+static SPA_PRINTF_FUNC(7,0) void
+log_deferred(struct impl *impl,
+	      enum spa_log_level level,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	uint64_t buffer[DEFERRED_MAX_RECORD / sizeof(uint64_t)];
+	struct log_record *rec = (struct log_record *)buffer;
+	struct arg_writer w;
+	struct log_ring *ring;
+	struct timespec now;
+	uint32_t index;
+	int32_t filled;
+	uint8_t *args_start;
+
+	if (SPA_UNLIKELY((ring = get_ring(impl)) == NULL))
+		return;
+
+	rec->err = errno;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+	rec->time = SPA_TIMESPEC_TO_NSEC(&now);
+	rec->level = level;
+	rec->line = line;
+	rec->flags = 0;
+	rec->padding = 0;
+
+	w.p = (uint8_t *)buffer + SPA_ROUND_UP_N(sizeof(*rec), 8);
+	w.end = (uint8_t *)buffer + sizeof(buffer);
+	if (SPA_UNLIKELY(!put_string(&w, topic ? topic->topic : NULL, -1) ||
+	    !put_string(&w, file, -1) ||
+	    !put_string(&w, func, -1) ||
+	    !put_string(&w, fmt, -1))) {
+		rec->flags |= LOG_RECORD_TRUNCATED;
+	} else {
+		args_start = w.p;
+		if (SPA_UNLIKELY(!pack_args(&w, fmt, args))) {
+			rec->flags |= LOG_RECORD_TRUNCATED;
+			w.p = args_start;
+		}
+	}
+	rec->size = w.p - (uint8_t *)buffer;
+
+	filled = spa_ringbuffer_get_write_index(&ring->rb, &index);
+	if (SPA_UNLIKELY(filled < 0 || (uint32_t)filled + rec->size > DEFERRED_BUFFER)) {
+		__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+		return;
+	}
+	spa_ringbuffer_write_data(&ring->rb, ring->data, DEFERRED_BUFFER,
+			index & (DEFERRED_BUFFER - 1), buffer, rec->size);
+	spa_ringbuffer_write_update(&ring->rb, index + rec->size);
+}
+
+struct arg_reader {
+	const uint8_t *p;
+	const uint8_t *end;
+};
+
+static inline const void *get_arg(struct arg_reader *r, size_t size)
+{
+	const void *val = r->p;
+	r->p += SPA_ROUND_UP_N(size, 8);
+	return r->p <= r->end ? val : NULL;
+}
+
+#define print_arg(o,n,spec,n_star,star,val)					\
+	((n_star) == 0 ? snprintf(o, n, spec, val) :				\
+	 (n_star) == 1 ? snprintf(o, n, spec, star[0], val) :			\
+			 snprintf(o, n, spec, star[0], star[1], val))
+
+/* get a string that was written with put_string */
+static bool get_string(struct arg_reader *r, const char **str)
+{
+	const void *val;
+	uint32_t len;
+
+	if ((val = get_arg(r, sizeof(uint32_t))) == NULL)
+		return false;
+	memcpy(&len, val, sizeof(len));
+	if (len == UINT32_MAX) {
+		*str = NULL;
+		return true;
+	}
+	r->p = SPA_PTROFF(val, 8, uint8_t);
+	return (*str = get_arg(r, len + 1)) != NULL;
+}
+
+/* format the message of a record, like vsnprintf would have done */
+static void format_record(const struct log_record *rec, const char *fmt,
+		struct arg_reader *r, char *out, size_t size)
+{
+	struct spec sp;
+	const char *p, *next;
+	const void *val;
+	char spec[32];
+	int star[2] = { 0, 0 };
+	size_t pos = 0, len;
+	uint32_t i;
+
+	if (fmt == NULL || (rec->flags & LOG_RECORD_TRUNCATED)) {
+		snprintf(out, size, "(message too large)");
+		return;
+	}
+	out[0] = '\0';
+	for (p = fmt; *p && pos < size - 1; p = next) {
+		if (*p == '%' && !parse_spec(p, &sp)) {
+			snprintf(out + pos, size - pos, "%s", p);
+			break;
+		}
+		if (*p != '%') {
+			next = strchrnul(p, '%');
+			len = SPA_MIN((size_t)(next - p), size - 1 - pos);
+			memcpy(out + pos, p, len);
+			out[pos += len] = '\0';
+			continue;
+		}
+		next = sp.end;
+		len = SPA_MIN((size_t)(next - p), sizeof(spec) - 1);
+		memcpy(spec, p, len);
+		spec[len] = '\0';
+
+		for (i = 0; i < sp.n_star; i++) {
+			if ((val = get_arg(r, sizeof(int))) == NULL)
+				return;
+			memcpy(&star[i], val, sizeof(int));
+		}
+		len = size - pos;
+		switch (sp.conv) {
+		case '%':
+			pos += snprintf(out + pos, len, "%%");
+			break;
+		case 'm':
+			pos += snprintf(out + pos, len, "%s", strerror(rec->err));
+			break;
+		case 's':
+		{
+			const char *str;
+			if (!get_string(r, &str))
+				return;
+			pos += print_arg(out + pos, len, spec, sp.n_star, star, str);
+			break;
+		}
+		case 'p':
+		{
+			void *ptr;
+			if ((val = get_arg(r, sizeof(void *))) == NULL)
+				return;
+			memcpy(&ptr, val, sizeof(ptr));
+			pos += print_arg(out + pos, len, spec, sp.n_star, star, ptr);
+			break;
+		}
+		default:
+			if (is_float_conv(sp.conv)) {
+				if (sp.length == 'L') {
+					long double v;
+					if ((val = get_arg(r, sizeof(v))) == NULL)
+						return;
+					memcpy(&v, val, sizeof(v));
+					pos += print_arg(out + pos, len, spec, sp.n_star, star, v);
+				} else {
+					double v;
+					if ((val = get_arg(r, sizeof(v))) == NULL)
+						return;
+					memcpy(&v, val, sizeof(v));
+					pos += print_arg(out + pos, len, spec, sp.n_star, star, v);
+				}
+			} else {
+				uint64_t v;
+				bool s = is_signed_conv(sp.conv);
+				if ((val = get_arg(r, sizeof(v))) == NULL)
+					return;
+				memcpy(&v, val, sizeof(v));
+				switch (sp.length) {
+				case 'l':
+					if (s)
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (long)v);
+					else
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (unsigned long)v);
+					break;
+				case 'q': case 'L':
+					if (s)
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (long long)v);
+					else
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (unsigned long long)v);
+					break;
+				case 'j':
+					if (s)
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (intmax_t)v);
+					else
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (uintmax_t)v);
+					break;
+				case 'z':
+					if (s)
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (ssize_t)v);
+					else
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (size_t)v);
+					break;
+				case 't':
+					pos += print_arg(out + pos, len, spec, sp.n_star, star, (ptrdiff_t)v);
+					break;
+				default:
+					if (s)
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (int)v);
+					else
+						pos += print_arg(out + pos, len, spec, sp.n_star, star, (unsigned int)v);
+					break;
+				}
+			}
+			break;
+		}
+		pos = SPA_MIN(pos, size - 1);
+	}
+}
+
+static bool ring_peek(struct log_ring *ring)
+{
+	uint32_t index;
+
+	if (ring->have_head)
+		return true;
+	if (spa_ringbuffer_get_read_index(&ring->rb, &index) < (int32_t)sizeof(struct log_record))
+		return false;
+	spa_ringbuffer_read_data(&ring->rb, ring->data, DEFERRED_BUFFER,
+			index & (DEFERRED_BUFFER - 1), &ring->head, sizeof(ring->head));
+	ring->have_head = true;
+	return true;
+}
+
+/* write out the messages of all threads in time order, called with the
+ * lock held */
+static void deferred_flush(struct impl *impl)
+{
+	uint64_t buffer[DEFERRED_MAX_RECORD / sizeof(uint64_t)];
+	const struct log_record *rec = (const struct log_record *)buffer;
+	struct log_ring *ring, *best, *t;
+	struct spa_log_topic topic;
+	struct arg_reader r;
+	struct timespec ts;
+	const char *topic_name, *file, *func, *fmt;
+	char msg[1024];
+	uint32_t index, dropped;
+
+	while (true) {
+		best = NULL;
+		spa_list_for_each(ring, &impl->rings, link) {
+			if (ring_peek(ring) &&
+			    (best == NULL || ring->head.time < best->head.time))
+				best = ring;
+		}
+		if (best == NULL)
+			break;
+
+		spa_ringbuffer_get_read_index(&best->rb, &index);
+		spa_ringbuffer_read_data(&best->rb, best->data, DEFERRED_BUFFER,
+				index & (DEFERRED_BUFFER - 1), buffer, best->head.size);
+		spa_ringbuffer_read_update(&best->rb, index + best->head.size);
+		best->have_head = false;
+
+		r.p = (const uint8_t *)buffer + SPA_ROUND_UP_N(sizeof(*rec), 8);
+		r.end = (const uint8_t *)buffer + rec->size;
+		topic_name = file = func = fmt = NULL;
+		if (!get_string(&r, &topic_name) || !get_string(&r, &file) ||
+		    !get_string(&r, &func) || !get_string(&r, &fmt))
+			fmt = NULL;
+		format_record(rec, fmt, &r, msg, sizeof(msg));
+
+		topic = SPA_LOG_TOPIC(0, topic_name);
+		ts.tv_sec = rec->time / SPA_NSEC_PER_SEC;
+		ts.tv_nsec = rec->time % SPA_NSEC_PER_SEC;
+		log_write(impl, rec->level, topic_name ? &topic : NULL,
+				file ? file : "", rec->line, func ? func : "",
+				&ts, "%s", msg);
+	}
+
+	spa_list_for_each_safe(ring, t, &impl->rings, link) {
+		dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+		if (dropped != ring->reported) {
+			clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+			log_write(impl, SPA_LOG_LEVEL_WARN, NULL, __FILE__, __LINE__, __func__,
+					&ts, "%p: dropped %u messages of thread ring %p",
+					impl, dropped - ring->reported, ring);
+			ring->reported = dropped;
+		}
+		if (__atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE) && !ring_peek(ring)) {
+			spa_list_remove(&ring->link);
+			free(ring);
+		}
+	}
+	dropped = __atomic_load_n(&impl->no_ring, __ATOMIC_RELAXED);
+	if (dropped != impl->no_ring_reported) {
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+		log_write(impl, SPA_LOG_LEVEL_WARN, NULL, __FILE__, __LINE__, __func__,
+				&ts, "%p: dropped %u messages of new threads without a ring",
+				impl, dropped - impl->no_ring_reported);
+		impl->no_ring_reported = dropped;
+	}
+	fill_free_rings(impl);
+}
+
+static void *deferred_thread(void *data)
+{
+	struct impl *impl = data;
+	struct timespec ts;
+	uint64_t next;
+
+	pthread_mutex_lock(&impl->lock);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	next = SPA_TIMESPEC_TO_NSEC(&ts);
+	while (impl->running) {
+		next += DEFERRED_INTERVAL_NS;
+		ts.tv_sec = next / SPA_NSEC_PER_SEC;
+		ts.tv_nsec = next % SPA_NSEC_PER_SEC;
+		pthread_cond_timedwait(&impl->cond, &impl->lock, &ts);
+		deferred_flush(impl);
+	}
+	deferred_flush(impl);
+	pthread_mutex_unlock(&impl->lock);
+	return NULL;
+}
+
+static int deferred_start(struct impl *impl)
+{
+	pthread_condattr_t attr;
+	int res;
+
+	spa_list_init(&impl->rings);
+	impl->id = __atomic_add_fetch(&logger_id, 1, __ATOMIC_RELAXED);
+
+	if ((res = pthread_key_create(&impl->ring_key, ring_thread_exit)) != 0)
+		return -res;
+
+	pthread_mutex_init(&impl->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&impl->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	fill_free_rings(impl);
+
+	impl->running = true;
+	if ((res = pthread_create(&impl->thread, NULL, deferred_thread, impl)) != 0) {
+		impl->running = false;
+		pthread_cond_destroy(&impl->cond);
+		pthread_mutex_destroy(&impl->lock);
+		pthread_key_delete(impl->ring_key);
+		return -res;
+	}
+	return 0;
+}
+
+static void deferred_stop(struct impl *impl)
+{
+	struct log_ring *ring;
+
+	pthread_mutex_lock(&impl->lock);
+	impl->running = false;
+	pthread_cond_signal(&impl->cond);
+	pthread_mutex_unlock(&impl->lock);
+	pthread_join(impl->thread, NULL);
+
+	spa_list_consume(ring, &impl->rings, link) {
+		spa_list_remove(&ring->link);
+		free(ring);
+	}
+	spa_zero(impl->free_rings);
+	pthread_key_delete(impl->ring_key);
+	pthread_cond_destroy(&impl->cond);
+	pthread_mutex_destroy(&impl->lock);
+}
+
+static SPA_PRINTF_FUNC(7,0) void
+impl_log_logtv(void *object,
+	      enum spa_log_level level,
+	      const struct spa_log_topic *topic,
+	      const char *file,
+	      int line,
+	      const char *func,
+	      const char *fmt,
+	      va_list args)
+{
+	struct impl *impl = object;
+	struct timespec now = { 0, 0 };
+
+	if (impl->deferred) {
+		log_deferred(impl, level, topic, file, line, func, fmt, args);
+		return;
+	}
+	if (impl->timestamp)
+		clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+	log_writev(impl, level, topic, file, line, func, &now, true, fmt, args);
+}
+
 static SPA_PRINTF_FUNC(6,0) void
 impl_log_logv(void *object,
 	      enum spa_log_level level,
@@ -284,6 +962,11 @@ static int impl_clear(struct spa_handle *handle)
 
 	this = (struct impl *) handle;
 
+	if (this->deferred) {
+		deferred_stop(this);
+		this->deferred = false;
+	}
+
 	support_log_free_patterns(&this->patterns);
 
 	if (this->close_file && this->file != NULL)
@@ -314,6 +997,7 @@ impl_init(const struct spa_handle_factory *factory,
 	struct impl *this;
 	struct spa_loop *loop = NULL;
 	const char *str;
+	int res;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
@@ -365,6 +1049,8 @@ impl_init(const struct spa_handle_factory *factory,
 		}
 		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_PATTERNS)) != NULL)
 			support_log_parse_patterns(&this->patterns, str);
+		if ((str = spa_dict_lookup(info, SPA_KEY_LOG_DEFERRED)) != NULL)
+			this->deferred = spa_atob(str);
 	}
 	if (this->file == NULL)
 		this->file = stderr;
@@ -373,6 +1059,12 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_ringbuffer_init(&this->trace_rb);
 
+	if (this->deferred && (res = deferred_start(this)) < 0) {
+		fprintf(stderr, "Warning: failed to start deferred logging: %s",
+				strerror(-res));
+		this->deferred = false;
+	}
+
 	spa_log_debug(&this->log, NAME " %p: initialized", this);
 
 	setlinebuf(this->file);
@@ -40,6 +40,7 @@
 #include <spa/utils/type.h>
 #include <spa/utils/ringbuffer.h>
 #include <spa/utils/string.h>
+#include <spa/utils/probe.h>
 
 static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.loop");
 #undef SPA_LOG_TOPIC_DEFAULT
@@ -419,7 +420,9 @@ static int loop_iterate(void *object, int timeout)
 	impl->polling = true;
 	spa_loop_control_hook_before(&impl->hooks_list);
 
+	spa_probe(spa, loop_poll, impl, timeout);
 	nfds = spa_system_pollfd_wait(impl->system, impl->poll_fd, ep, SPA_N_ELEMENTS(ep), timeout);
+	spa_probe(spa, loop_wakeup, impl, nfds);
 
 	spa_loop_control_hook_after(&impl->hooks_list);
 	impl->polling = false;
@@ -448,8 +451,10 @@ static int loop_iterate(void *object, int timeout)
 
 	for (i = 0; i < nfds; i++) {
 		struct spa_source *s = ep[i].data;
-		if (SPA_LIKELY(s && s->rmask))
+		if (SPA_LIKELY(s && s->rmask)) {
+			spa_probe(spa, loop_dispatch, impl, s->fd, s->rmask, s->func);
 			s->func(s);
+		}
 	}
 
 	pthread_cleanup_pop(true);
@@ -0,0 +1,378 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <jpeglib.h>
+
+#include <spa/utils/names.h>
+#include <spa/utils/string.h>
+#include <spa/support/plugin.h>
+#include <spa/buffer/buffer.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/param.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/support/log-impl.h>
+
+SPA_LOG_IMPL(logger);
+
+#define WIDTH		64
+#define HEIGHT		48
+#define BPP		3
+#define N_FRAMES	32
+#define N_IN		4
+#define N_OUT		8
+#define MAX_JPEG	(64 * 1024)
+
+struct test_buffer {
+	struct spa_buffer buf;
+	struct spa_meta metas[1];
+	struct spa_meta_header header;
+	struct spa_data datas[1];
+	struct spa_chunk chunk;
+	uint8_t *mem;
+};
+
+struct context {
+	struct spa_handle *handle;
+	struct spa_node *node;
+
+	struct spa_io_buffers in_io;
+	struct spa_io_buffers out_io;
+
+	struct test_buffer in[N_IN];
+	struct test_buffer out[N_OUT];
+
+	uint32_t n_fed;
+	uint32_t n_received;
+};
+
+static const struct spa_handle_factory *find_factory(const char *name)
+{
+	uint32_t index = 0;
+	const struct spa_handle_factory *factory;
+
+	while (spa_handle_factory_enum(&factory, &index) == 1) {
+		if (spa_streq(factory->name, name))
+			return factory;
+	}
+	return NULL;
+}
+
+static void frame_color(uint32_t seq, uint8_t color[BPP])
+{
+	color[0] = (seq * 37) & 0xff;
+	color[1] = 255 - ((seq * 23) & 0xff);
+	color[2] = (seq * 91 + 64) & 0xff;
+}
+
+static uint32_t encode_frame(uint32_t seq, uint8_t *dst, uint32_t maxsize)
+{
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	uint8_t line[WIDTH * BPP], color[BPP];
+	unsigned char *out = NULL;
+	unsigned long size = 0;
+	JSAMPROW row = line;
+	uint32_t i;
+
+	frame_color(seq, color);
+	for (i = 0; i < WIDTH; i++)
+		memcpy(&line[i * BPP], color, BPP);
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_mem_dest(&cinfo, &out, &size);
+	cinfo.image_width = WIDTH;
+	cinfo.image_height = HEIGHT;
+	cinfo.input_components = BPP;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 95, TRUE);
+	jpeg_start_compress(&cinfo, TRUE);
+	while (cinfo.next_scanline < cinfo.image_height)
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+
+	spa_assert_se(size <= maxsize);
+	memcpy(dst, out, size);
+	free(out);
+
+	return size;
+}
+
+static void init_buffer(struct test_buffer *b, uint32_t size)
+{
+	spa_zero(*b);
+	b->mem = calloc(1, size);
+	spa_assert_se(b->mem != NULL);
+
+	b->metas[0].type = SPA_META_Header;
+	b->metas[0].size = sizeof(b->header);
+	b->metas[0].data = &b->header;
+	b->datas[0].type = SPA_DATA_MemPtr;
+	b->datas[0].maxsize = size;
+	b->datas[0].data = b->mem;
+	b->datas[0].chunk = &b->chunk;
+	b->buf.n_metas = 1;
+	b->buf.metas = b->metas;
+	b->buf.n_datas = 1;
+	b->buf.datas = b->datas;
+}
+
+static void setup_context(struct context *ctx, const char *threads)
+{
+	const struct spa_handle_factory *factory;
+	struct spa_support support[1];
+	struct spa_dict_item items[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b;
+	struct spa_pod *param;
+	struct spa_buffer *bufs[N_OUT];
+	struct spa_video_info_mjpg mjpg;
+	struct spa_video_info_raw raw;
+	void *iface;
+	uint32_t i;
+	int res;
+
+	spa_zero(*ctx);
+
+	logger.log.level = SPA_LOG_LEVEL_WARN;
+	support[0] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Log, &logger);
+
+	factory = find_factory(SPA_NAME_API_V4L2_MJPEG_DECODER);
+	spa_assert_se(factory != NULL);
+
+	ctx->handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+	spa_assert_se(ctx->handle != NULL);
+
+	items[0] = SPA_DICT_ITEM_INIT("decoder.threads", threads);
+	res = spa_handle_factory_init(factory, ctx->handle,
+			&SPA_DICT_INIT(items, 1), support, 1);
+	spa_assert_se(res >= 0);
+
+	res = spa_handle_get_interface(ctx->handle, SPA_TYPE_INTERFACE_Node, &iface);
+	spa_assert_se(res >= 0);
+	ctx->node = iface;
+
+	spa_zero(mjpg);
+	mjpg.size = SPA_RECTANGLE(WIDTH, HEIGHT);
+	mjpg.framerate = SPA_FRACTION(30, 1);
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_format_video_mjpg_build(&b, SPA_PARAM_Format, &mjpg);
+	res = spa_node_port_set_param(ctx->node, SPA_DIRECTION_INPUT, 0,
+			SPA_PARAM_Format, 0, param);
+	spa_assert_se(res >= 0);
+
+	spa_zero(raw);
+	raw.format = SPA_VIDEO_FORMAT_RGB;
+	raw.size = SPA_RECTANGLE(WIDTH, HEIGHT);
+	raw.framerate = SPA_FRACTION(30, 1);
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	param = spa_format_video_raw_build(&b, SPA_PARAM_Format, &raw);
+	res = spa_node_port_set_param(ctx->node, SPA_DIRECTION_OUTPUT, 0,
+			SPA_PARAM_Format, 0, param);
+	spa_assert_se(res >= 0);
+
+	for (i = 0; i < N_IN; i++) {
+		init_buffer(&ctx->in[i], MAX_JPEG);
+		bufs[i] = &ctx->in[i].buf;
+	}
+	res = spa_node_port_use_buffers(ctx->node, SPA_DIRECTION_INPUT, 0, 0, bufs, N_IN);
+	spa_assert_se(res >= 0);
+
+	for (i = 0; i < N_OUT; i++) {
+		init_buffer(&ctx->out[i], SPA_ROUND_UP_N(WIDTH * BPP, 4) * HEIGHT);
+		bufs[i] = &ctx->out[i].buf;
+	}
+	res = spa_node_port_use_buffers(ctx->node, SPA_DIRECTION_OUTPUT, 0, 0, bufs, N_OUT);
+	spa_assert_se(res >= 0);
+
+	ctx->in_io = SPA_IO_BUFFERS_INIT;
+	ctx->out_io = SPA_IO_BUFFERS_INIT;
+	res = spa_node_port_set_io(ctx->node, SPA_DIRECTION_INPUT, 0,
+			SPA_IO_Buffers, &ctx->in_io, sizeof(ctx->in_io));
+	spa_assert_se(res >= 0);
+	res = spa_node_port_set_io(ctx->node, SPA_DIRECTION_OUTPUT, 0,
+			SPA_IO_Buffers, &ctx->out_io, sizeof(ctx->out_io));
+	spa_assert_se(res >= 0);
+
+	res = spa_node_send_command(ctx->node,
+			&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start));
+	spa_assert_se(res >= 0);
+}
+
+static void clean_context(struct context *ctx)
+{
+	uint32_t i;
+
+	spa_handle_clear(ctx->handle);
+	free(ctx->handle);
+	for (i = 0; i < N_IN; i++)
+		free(ctx->in[i].mem);
+	for (i = 0; i < N_OUT; i++)
+		free(ctx->out[i].mem);
+}
+
+static void check_frame(struct context *ctx, struct test_buffer *b)
+{
+	uint32_t seq = b->header.seq, stride = SPA_ROUND_UP_N(WIDTH * BPP, 4);
+	uint8_t color[BPP];
+	uint32_t x, y, c;
+
+	/* frames come out in the order they went in */
+	spa_assert_se(seq == ctx->n_received);
+
+	frame_color(seq, color);
+	for (y = 0; y < HEIGHT; y++) {
+		const uint8_t *p = &b->mem[y * stride];
+		for (x = 0; x < WIDTH; x++) {
+			for (c = 0; c < BPP; c++)
+				spa_assert_se(abs((int)p[x * BPP + c] - color[c]) <= 4);
+		}
+	}
+	ctx->n_received++;
+}
+
+/* run a cycle, with the next frame as input when feed is set */
+static void process(struct context *ctx, bool feed)
+{
+	int res;
+
+	if (feed) {
+		struct test_buffer *b = &ctx->in[ctx->n_fed % N_IN];
+
+		b->chunk.offset = 0;
+		b->chunk.size = encode_frame(ctx->n_fed, b->mem, MAX_JPEG);
+		b->header.seq = ctx->n_fed;
+		ctx->in_io.buffer_id = ctx->n_fed % N_IN;
+		ctx->in_io.status = SPA_STATUS_HAVE_DATA;
+		ctx->n_fed++;
+	}
+
+	res = spa_node_process(ctx->node);
+	spa_assert_se(res >= 0);
+
+	if (feed)
+		spa_assert_se(ctx->in_io.status == SPA_STATUS_NEED_DATA);
+
+	if (ctx->out_io.status == SPA_STATUS_HAVE_DATA) {
+		spa_assert_se(res & SPA_STATUS_HAVE_DATA);
+		spa_assert_se(ctx->out_io.buffer_id < N_OUT);
+		check_frame(ctx, &ctx->out[ctx->out_io.buffer_id]);
+		/* keep the buffer id, the decoder recycles it in the next cycle */
+		ctx->out_io.status = SPA_STATUS_NEED_DATA;
+	}
+}
+
+/* run cycles until at most max frames are pending in the decoder */
+static void drain(struct context *ctx, uint32_t max)
+{
+	uint32_t i;
+
+	for (i = 0; ctx->n_fed - ctx->n_received > max; i++) {
+		spa_assert_se(i < 10000);
+		process(ctx, false);
+		if (ctx->n_fed - ctx->n_received > max)
+			usleep(100);
+	}
+}
+
+static void test_decode(const char *threads, uint32_t n_threads)
+{
+	struct context ctx;
+	uint32_t i;
+
+	setup_context(&ctx, threads);
+
+	/* keep the decoder threads busy, frames must not be dropped or
+	 * reordered */
+	for (i = 0; i < N_FRAMES; i++) {
+		drain(&ctx, SPA_MAX(n_threads, 1u) - 1);
+		process(&ctx, true);
+	}
+	drain(&ctx, 0);
+	spa_assert_se(ctx.n_received == N_FRAMES);
+
+	clean_context(&ctx);
+}
+
+static void test_flush(void)
+{
+	struct context ctx;
+	uint32_t i, n_threads = 2, n_received;
+	int res;
+
+	setup_context(&ctx, "2");
+
+	/* queue some frames and flush them, the frames that are not out yet
+	 * must not be output anymore */
+	for (i = 0; i < n_threads; i++)
+		process(&ctx, true);
+	n_received = ctx.n_received;
+
+	res = spa_node_send_command(ctx.node,
+			&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Flush));
+	spa_assert_se(res >= 0);
+
+	for (i = 0; i < 100; i++) {
+		process(&ctx, false);
+		usleep(100);
+	}
+	spa_assert_se(ctx.n_received == n_received);
+
+	/* the output buffers of the flushed frames were recycled */
+	res = spa_node_send_command(ctx.node,
+			&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start));
+	spa_assert_se(res >= 0);
+
+	ctx.n_received = ctx.n_fed;
+	for (i = 0; i < N_OUT * 2; i++) {
+		drain(&ctx, n_threads - 1);
+		process(&ctx, true);
+	}
+	drain(&ctx, 0);
+	spa_assert_se(ctx.n_received == ctx.n_fed);
+
+	clean_context(&ctx);
+}
+
+int main(int argc, char *argv[])
+{
+	test_decode("0", 0);
+	test_decode("1", 1);
+	test_decode("2", 2);
+	test_decode("4", 4);
+	test_flush();
+
+	return 0;
+}
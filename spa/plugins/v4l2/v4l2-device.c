@@ -25,6 +25,7 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
 
 #include <linux/videodev2.h>
@@ -52,6 +53,7 @@ struct props {
 	char product_id[6];
 	char vendor_id[6];
 	int device_fd;
+	bool mjpeg_decoder;
 };
 
 static void reset_props(struct props *props)
@@ -72,6 +74,21 @@ struct impl {
 	struct spa_v4l2_device dev;
 };
 
+#ifdef HAVE_JPEG
+static bool has_mjpeg(struct impl *this)
+{
+	struct v4l2_fmtdesc fmt;
+
+	spa_zero(fmt);
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	for (fmt.index = 0; ioctl(this->dev.fd, VIDIOC_ENUM_FMT, &fmt) == 0; fmt.index++) {
+		if (fmt.pixelformat == V4L2_PIX_FMT_MJPEG)
+			return true;
+	}
+	return false;
+}
+#endif
+
 static int emit_info(struct impl *this, bool full)
 {
 	int res;
@@ -131,6 +148,13 @@ static int emit_info(struct impl *this, bool full)
 		oinfo.props = &SPA_DICT_INIT(items, n_items);
 
 		spa_device_emit_object_info(&this->hooks, 0, &oinfo);
+
+#ifdef HAVE_JPEG
+		if (this->props.mjpeg_decoder && has_mjpeg(this)) {
+			oinfo.factory_name = SPA_NAME_API_V4L2_MJPEG_DECODER;
+			spa_device_emit_object_info(&this->hooks, 1, &oinfo);
+		}
+#endif
 	}
 
 	spa_v4l2_close(&this->dev);
@@ -257,6 +281,8 @@ impl_init(const struct spa_handle_factory *factory,
 		strncpy(this->props.product_id, str, 5);
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_DEVICE_VENDOR_ID)))
 		strncpy(this->props.vendor_id, str, 5);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_V4L2_MJPEG_DECODER)))
+		this->props.mjpeg_decoder = spa_atob(str);
 
 	return 0;
 }
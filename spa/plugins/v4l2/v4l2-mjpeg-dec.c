@@ -0,0 +1,1553 @@
+/* Spa V4l2 MJPEG decoder
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <linux/videodev2.h>
+#include <jpeglib.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/log.h>
+#include <spa/support/loop.h>
+#include <spa/utils/list.h>
+#include <spa/utils/result.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/names.h>
+#include <spa/utils/string.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/param.h>
+#include <spa/param/latency-utils.h>
+#include <spa/pod/filter.h>
+#include <spa/debug/types.h>
+#include <spa/param/video/type-info.h>
+
+#include "v4l2.h"
+
+#define DEFAULT_THREADS		2
+#define MAX_THREADS		16
+#define MAX_BUFFERS		32
+#define MAX_SIZE		16384
+#define MAX_MODES		64
+#define STATS_INTERVAL		(5 * SPA_NSEC_PER_SEC)
+
+struct format_info {
+	uint32_t format;
+	J_COLOR_SPACE color_space;
+	uint32_t bpp;
+};
+
+static const struct format_info format_info[] = {
+#ifdef JCS_EXTENSIONS
+	{ SPA_VIDEO_FORMAT_BGRx, JCS_EXT_BGRX, 4 },
+	{ SPA_VIDEO_FORMAT_RGBx, JCS_EXT_RGBX, 4 },
+	{ SPA_VIDEO_FORMAT_xBGR, JCS_EXT_XBGR, 4 },
+	{ SPA_VIDEO_FORMAT_xRGB, JCS_EXT_XRGB, 4 },
+#endif
+#ifdef JCS_ALPHA_EXTENSIONS
+	{ SPA_VIDEO_FORMAT_BGRA, JCS_EXT_BGRA, 4 },
+	{ SPA_VIDEO_FORMAT_RGBA, JCS_EXT_RGBA, 4 },
+	{ SPA_VIDEO_FORMAT_ABGR, JCS_EXT_ABGR, 4 },
+	{ SPA_VIDEO_FORMAT_ARGB, JCS_EXT_ARGB, 4 },
+#endif
+	{ SPA_VIDEO_FORMAT_RGB, JCS_RGB, 3 },
+#ifdef JCS_EXTENSIONS
+	{ SPA_VIDEO_FORMAT_BGR, JCS_EXT_BGR, 3 },
+#endif
+	{ SPA_VIDEO_FORMAT_GRAY8, JCS_GRAYSCALE, 1 },
+};
+
+static const struct format_info *find_format_info(uint32_t format)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(format_info, f)
+		if (f->format == format)
+			return f;
+	return NULL;
+}
+
+/* a size and framerate of the device we decode for */
+struct mode {
+	struct spa_rectangle size;
+	struct spa_fraction framerate;
+};
+
+struct buffer {
+	uint32_t id;
+#define BUFFER_FLAG_QUEUED	(1<<0)
+	uint32_t flags;
+	struct spa_list link;
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+};
+
+struct port {
+	enum spa_direction direction;
+
+	struct spa_io_buffers *io;
+
+	uint64_t info_all;
+	struct spa_port_info info;
+#define IDX_EnumFormat	0
+#define IDX_Meta	1
+#define IDX_IO		2
+#define IDX_Format	3
+#define IDX_Buffers	4
+#define IDX_Latency	5
+#define N_PORT_PARAMS	6
+	struct spa_param_info params[N_PORT_PARAMS];
+
+	struct spa_video_info format;
+	const struct format_info *finfo;
+	unsigned int have_format:1;
+	uint32_t stride;
+	uint32_t size;
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+	uint32_t maxsize;
+
+	struct spa_list queue;
+};
+
+struct error_mgr {
+	struct jpeg_error_mgr pub;
+	struct impl *impl;
+	jmp_buf jump;
+};
+
+struct decoder {
+	struct impl *impl;
+	struct jpeg_decompress_struct cinfo;
+	struct error_mgr err;
+	pthread_t thread;
+	unsigned int valid:1;
+};
+
+/* a compressed frame that is being decoded into an output buffer. The state
+ * is changed with atomic operations, FREE -> QUEUED in the data thread,
+ * QUEUED -> BUSY -> DONE in a decoder thread and DONE -> FREE in the data
+ * thread again. */
+struct job {
+#define JOB_FREE	0
+#define JOB_QUEUED	1
+#define JOB_BUSY	2
+#define JOB_DONE	3
+	uint32_t state;
+	int res;
+	bool cancel;			/* the frame is not wanted anymore */
+
+	struct buffer *out;
+	const void *data;
+	uint32_t size;
+
+	void *mem;
+	uint32_t maxsize;
+
+	struct spa_meta_header header;
+	unsigned int have_header:1;
+
+	uint64_t submit_time;
+	uint64_t cpu_time;
+};
+
+struct stats {
+	uint64_t start;
+	uint32_t frames;
+	uint32_t dropped;
+	uint32_t errors;
+	uint64_t cpu_time;
+	uint64_t latency;
+	uint64_t max_latency;
+	uint64_t elapsed;		/* time covered by the stats */
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct spa_log *log;
+	struct spa_loop *main_loop;
+
+	struct mode modes[MAX_MODES];
+	uint32_t n_modes;
+
+	uint64_t info_all;
+	struct spa_node_info info;
+#define IDX_ProcessLatency	0
+#define N_NODE_PARAMS		1
+	struct spa_param_info params[N_NODE_PARAMS];
+
+	struct spa_hook_list hooks;
+
+	struct port ports[2];
+	struct spa_latency_info latency[2];
+	struct spa_process_latency_info process_latency;
+
+	uint32_t n_threads;
+	struct decoder decoders[MAX_THREADS];
+
+	/* a token for each queued job and for each finished job */
+	sem_t queued;
+	sem_t done;
+	bool running;
+
+	/* jobs are submitted at tail and taken in order from head by the data
+	 * thread, decoder threads claim the queued jobs starting from next */
+	struct job jobs[MAX_THREADS];
+	uint32_t n_jobs;
+	uint32_t head;
+	uint32_t next;
+	uint32_t tail;
+	uint32_t n_pending;
+
+	struct stats stats;
+
+	unsigned int started:1;
+};
+
+#define CHECK_PORT(this,d,p)	((p) == 0)
+#define GET_PORT(this,d,p)	(&this->ports[d])
+#define GET_IN_PORT(this,p)	(&this->ports[SPA_DIRECTION_INPUT])
+#define GET_OUT_PORT(this,p)	(&this->ports[SPA_DIRECTION_OUTPUT])
+
+static inline uint64_t get_time_ns(clockid_t clock_id)
+{
+	struct timespec ts;
+	clock_gettime(clock_id, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void emit_node_info(struct impl *this, bool full)
+{
+	uint64_t old = full ? this->info.change_mask : 0;
+
+	if (full)
+		this->info.change_mask = this->info_all;
+	if (this->info.change_mask) {
+		if (this->info.change_mask & SPA_NODE_CHANGE_MASK_PARAMS) {
+			SPA_FOR_EACH_ELEMENT_VAR(this->params, p) {
+				if (p->user > 0) {
+					p->flags ^= SPA_PARAM_INFO_SERIAL;
+					p->user = 0;
+				}
+			}
+		}
+		spa_node_emit_info(&this->hooks, &this->info);
+		this->info.change_mask = old;
+	}
+}
+
+static void emit_port_info(struct impl *this, struct port *port, bool full)
+{
+	uint64_t old = full ? port->info.change_mask : 0;
+
+	if (full)
+		port->info.change_mask = port->info_all;
+	if (port->info.change_mask) {
+		if (port->info.change_mask & SPA_PORT_CHANGE_MASK_PARAMS) {
+			SPA_FOR_EACH_ELEMENT_VAR(port->params, p) {
+				if (p->user > 0) {
+					p->flags ^= SPA_PARAM_INFO_SERIAL;
+					p->user = 0;
+				}
+			}
+		}
+		spa_node_emit_port_info(&this->hooks, port->direction, 0, &port->info);
+		port->info.change_mask = old;
+	}
+}
+
+static void error_exit(j_common_ptr cinfo)
+{
+	struct error_mgr *err = SPA_CONTAINER_OF(cinfo->err, struct error_mgr, pub);
+	longjmp(err->jump, 1);
+}
+
+static void output_message(j_common_ptr cinfo)
+{
+	struct error_mgr *err = SPA_CONTAINER_OF(cinfo->err, struct error_mgr, pub);
+	char buffer[JMSG_LENGTH_MAX];
+
+	cinfo->err->format_message(cinfo, buffer);
+	spa_log_debug(err->impl->log, "%p: %s", err->impl, buffer);
+}
+
+static int init_decoder(struct impl *this, struct decoder *d)
+{
+	d->impl = this;
+	d->err.impl = this;
+	d->cinfo.err = jpeg_std_error(&d->err.pub);
+	d->err.pub.error_exit = error_exit;
+	d->err.pub.output_message = output_message;
+
+	if (setjmp(d->err.jump))
+		return -ENOMEM;
+
+	jpeg_create_decompress(&d->cinfo);
+	d->valid = true;
+	return 0;
+}
+
+static void clear_decoder(struct impl *this, struct decoder *d)
+{
+	if (d->valid)
+		jpeg_destroy_decompress(&d->cinfo);
+	d->valid = false;
+}
+
+static int decode_frame(struct impl *this, struct decoder *d, struct job *j)
+{
+	struct jpeg_decompress_struct *cinfo = &d->cinfo;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_data *dd = &j->out->buf->datas[0];
+	uint8_t *data = dd->data;
+	JSAMPROW rows[16];
+	uint32_t i, n_rows;
+
+	if (setjmp(d->err.jump)) {
+		jpeg_abort_decompress(cinfo);
+		return -EINVAL;
+	}
+
+	jpeg_mem_src(cinfo, j->data, j->size);
+	if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
+		jpeg_abort_decompress(cinfo);
+		return -EINVAL;
+	}
+
+	cinfo->out_color_space = port->finfo->color_space;
+	cinfo->dct_method = JDCT_ISLOW;
+
+	jpeg_start_decompress(cinfo);
+
+	if (cinfo->output_width != port->format.info.raw.size.width ||
+	    cinfo->output_height != port->format.info.raw.size.height ||
+	    port->size > dd->maxsize) {
+		jpeg_abort_decompress(cinfo);
+		return -EMSGSIZE;
+	}
+
+	while (cinfo->output_scanline < cinfo->output_height) {
+		n_rows = SPA_MIN((uint32_t)cinfo->rec_outbuf_height, SPA_N_ELEMENTS(rows));
+		for (i = 0; i < n_rows; i++)
+			rows[i] = data + (cinfo->output_scanline + i) * port->stride;
+		jpeg_read_scanlines(cinfo, rows, n_rows);
+	}
+	jpeg_finish_decompress(cinfo);
+
+	dd->chunk->offset = 0;
+	dd->chunk->size = port->size;
+	dd->chunk->stride = port->stride;
+	dd->chunk->flags = 0;
+
+	return 0;
+}
+
+static void run_job(struct impl *this, struct decoder *d, struct job *j)
+{
+	uint64_t t1, t2;
+
+	t1 = get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+	j->res = decode_frame(this, d, j);
+	t2 = get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+	j->cpu_time = t2 - t1;
+}
+
+static struct job *claim_job(struct impl *this)
+{
+	uint32_t next, index;
+
+	next = __atomic_load_n(&this->next, __ATOMIC_RELAXED);
+	do {
+		index = next;
+		next = (index + 1) % this->n_jobs;
+	} while (!__atomic_compare_exchange_n(&this->next, &index, next,
+				false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+	return &this->jobs[index];
+}
+
+static void *decoder_thread(void *data)
+{
+	struct decoder *d = data;
+	struct impl *this = d->impl;
+	struct job *j;
+
+	while (true) {
+		/* there is a token for each queued job, jobs are queued in
+		 * order so the next job to claim is queued */
+		while (sem_wait(&this->queued) < 0 && errno == EINTR);
+		if (!__atomic_load_n(&this->running, __ATOMIC_ACQUIRE))
+			break;
+
+		j = claim_job(this);
+		__atomic_store_n(&j->state, JOB_BUSY, __ATOMIC_RELAXED);
+
+		if (__atomic_load_n(&j->cancel, __ATOMIC_RELAXED))
+			j->res = -ECANCELED;
+		else
+			run_job(this, d, j);
+
+		__atomic_store_n(&j->state, JOB_DONE, __ATOMIC_RELEASE);
+		sem_post(&this->done);
+	}
+	return NULL;
+}
+
+static int start_threads(struct impl *this)
+{
+	uint32_t i;
+	int res;
+
+	sem_init(&this->queued, 0, 0);
+	sem_init(&this->done, 0, 0);
+	this->running = true;
+
+	for (i = 0; i < this->n_threads; i++) {
+		struct decoder *d = &this->decoders[i];
+		if ((res = pthread_create(&d->thread, NULL, decoder_thread, d)) != 0) {
+			spa_log_warn(this->log, "%p: can't create decoder thread: %s",
+					this, strerror(res));
+			break;
+		}
+	}
+	this->n_threads = i;
+	spa_log_info(this->log, "%p: started %d decoder threads", this, i);
+	return 0;
+}
+
+static void stop_threads(struct impl *this)
+{
+	uint32_t i;
+
+	if (!this->running)
+		return;
+
+	__atomic_store_n(&this->running, false, __ATOMIC_RELEASE);
+	for (i = 0; i < this->n_threads; i++)
+		sem_post(&this->queued);
+
+	for (i = 0; i < this->n_threads; i++)
+		pthread_join(this->decoders[i].thread, NULL);
+
+	sem_destroy(&this->done);
+	sem_destroy(&this->queued);
+}
+
+static void queue_buffer(struct impl *this, struct port *port, uint32_t id)
+{
+	struct buffer *b = &port->buffers[id];
+
+	spa_log_trace_fp(this->log, "%p: queue buffer %d %d", this, id, b->flags);
+	if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_QUEUED))
+		return;
+
+	spa_list_append(&port->queue, &b->link);
+	SPA_FLAG_SET(b->flags, BUFFER_FLAG_QUEUED);
+}
+
+static struct buffer *dequeue_buffer(struct impl *this, struct port *port)
+{
+	struct buffer *b;
+
+	if (spa_list_is_empty(&port->queue))
+		return NULL;
+
+	b = spa_list_first(&port->queue, struct buffer, link);
+	spa_list_remove(&b->link);
+	SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_QUEUED);
+	return b;
+}
+
+/* Cancel the pending jobs. The data thread returns their buffers when the
+ * decoder threads are done with them. With wait, wait for the decoder threads
+ * and return the buffers now, this is only done when the node is not
+ * processing, before the buffers are changed. */
+static void flush_jobs(struct impl *this, bool wait)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	uint32_t i;
+
+	for (i = 0; i < this->n_pending; i++) {
+		struct job *j = &this->jobs[(this->head + i) % this->n_jobs];
+		__atomic_store_n(&j->cancel, true, __ATOMIC_RELAXED);
+	}
+	if (!wait)
+		return;
+
+	while (this->n_pending > 0) {
+		struct job *j = &this->jobs[this->head];
+
+		while (__atomic_load_n(&j->state, __ATOMIC_ACQUIRE) != JOB_DONE)
+			while (sem_wait(&this->done) < 0 && errno == EINTR);
+
+		queue_buffer(this, port, j->out->id);
+		j->state = JOB_FREE;
+		this->head = (this->head + 1) % this->n_jobs;
+		this->n_pending--;
+	}
+	/* all decoder threads are idle now */
+	if (this->running)
+		while (sem_trywait(&this->done) == 0);
+	this->head = this->next = this->tail = 0;
+}
+
+static void free_jobs(struct impl *this)
+{
+	uint32_t i;
+
+	flush_jobs(this, true);
+	for (i = 0; i < MAX_THREADS; i++) {
+		free(this->jobs[i].mem);
+		this->jobs[i].mem = NULL;
+		this->jobs[i].maxsize = 0;
+	}
+}
+
+static void update_process_latency(struct impl *this)
+{
+	struct spa_fraction *rate = &GET_IN_PORT(this, 0)->format.info.mjpg.framerate;
+	struct spa_process_latency_info info;
+
+	spa_zero(info);
+	/* with N threads, frames leave the decoder N-1 frames after they
+	 * were submitted */
+	if (this->n_threads > 1 && rate->num > 0)
+		info.ns = (this->n_threads - 1) * SPA_NSEC_PER_SEC * rate->denom / rate->num;
+
+	if (info.ns == this->process_latency.ns)
+		return;
+
+	this->process_latency = info;
+	spa_log_info(this->log, "%p: process latency %"PRIi64" ns", this, info.ns);
+
+	this->info.change_mask |= SPA_NODE_CHANGE_MASK_PARAMS;
+	this->params[IDX_ProcessLatency].user++;
+	SPA_FOR_EACH_ELEMENT_VAR(this->ports, p) {
+		p->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+		p->params[IDX_Latency].user++;
+	}
+}
+
+static int impl_node_enum_params(void *object, int seq,
+				 uint32_t id, uint32_t start, uint32_t num,
+				 const struct spa_pod *filter)
+{
+	struct impl *this = object;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_ProcessLatency:
+		switch (result.index) {
+		case 0:
+			param = spa_process_latency_build(&b, id, &this->process_latency);
+			break;
+		default:
+			return 0;
+		}
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_send_command(void *object, const struct spa_command *command)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+		if (!GET_IN_PORT(this, 0)->have_format ||
+		    !GET_OUT_PORT(this, 0)->have_format)
+			return -EIO;
+		if (this->started)
+			return 0;
+		spa_zero(this->stats);
+		this->started = true;
+		break;
+	case SPA_NODE_COMMAND_Suspend:
+	case SPA_NODE_COMMAND_Pause:
+	case SPA_NODE_COMMAND_Flush:
+		this->started = false;
+		flush_jobs(this, false);
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static int
+impl_node_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct impl *this = object;
+	struct spa_hook_list save;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_hook_list_isolate(&this->hooks, &save, listener, events, data);
+
+	emit_node_info(this, true);
+	emit_port_info(this, GET_IN_PORT(this, 0), true);
+	emit_port_info(this, GET_OUT_PORT(this, 0), true);
+
+	spa_hook_list_join(&this->hooks, &save);
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(void *object,
+			const struct spa_node_callbacks *callbacks,
+			void *user_data)
+{
+	return 0;
+}
+
+static int impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int port_enum_formats(struct impl *this, enum spa_direction direction,
+			     uint32_t index, struct spa_pod **param,
+			     struct spa_pod_builder *b)
+{
+	struct port *other = GET_PORT(this, SPA_DIRECTION_REVERSE(direction), 0);
+	struct spa_rectangle *size = NULL;
+	struct spa_fraction *framerate = NULL;
+	struct spa_pod_frame f[2];
+
+	if (other->have_format) {
+		if (index > 0)
+			return 0;
+		if (direction == SPA_DIRECTION_INPUT) {
+			size = &other->format.info.raw.size;
+			framerate = &other->format.info.raw.framerate;
+		} else {
+			size = &other->format.info.mjpg.size;
+			framerate = &other->format.info.mjpg.framerate;
+		}
+	} else if (this->n_modes > 0) {
+		/* offer the modes of the device, in the order of the device */
+		if (index >= this->n_modes)
+			return 0;
+		size = &this->modes[index].size;
+		framerate = &this->modes[index].framerate;
+	} else if (index > 0) {
+		return 0;
+	}
+
+	spa_pod_builder_push_object(b, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+	spa_pod_builder_add(b,
+		SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+		SPA_FORMAT_mediaSubtype,   SPA_POD_Id(direction == SPA_DIRECTION_INPUT ?
+				SPA_MEDIA_SUBTYPE_mjpg : SPA_MEDIA_SUBTYPE_raw),
+		0);
+
+	if (direction == SPA_DIRECTION_OUTPUT) {
+		spa_pod_builder_prop(b, SPA_FORMAT_VIDEO_format, 0);
+		spa_pod_builder_push_choice(b, &f[1], SPA_CHOICE_Enum, 0);
+		spa_pod_builder_id(b, format_info[0].format);
+		SPA_FOR_EACH_ELEMENT_VAR(format_info, fi)
+			spa_pod_builder_id(b, fi->format);
+		spa_pod_builder_pop(b, &f[1]);
+	}
+	if (size)
+		spa_pod_builder_add(b,
+			SPA_FORMAT_VIDEO_size, SPA_POD_Rectangle(size), 0);
+	else
+		spa_pod_builder_add(b,
+			SPA_FORMAT_VIDEO_size, SPA_POD_CHOICE_RANGE_Rectangle(
+					&SPA_RECTANGLE(640, 480),
+					&SPA_RECTANGLE(1, 1),
+					&SPA_RECTANGLE(MAX_SIZE, MAX_SIZE)), 0);
+	if (framerate)
+		spa_pod_builder_add(b,
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(framerate), 0);
+	else
+		spa_pod_builder_add(b,
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+					&SPA_FRACTION(25, 1),
+					&SPA_FRACTION(0, 1),
+					&SPA_FRACTION(INT32_MAX, 1)), 0);
+
+	*param = spa_pod_builder_pop(b, &f[0]);
+	return 1;
+}
+
+static int
+impl_node_port_enum_params(void *object, int seq,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t id, uint32_t start, uint32_t num,
+			   const struct spa_pod *filter)
+{
+	struct impl *this = object;
+	struct port *port;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		if ((res = port_enum_formats(this, direction, result.index, &param, &b)) <= 0)
+			return res;
+		break;
+	case SPA_PARAM_Format:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+		if (direction == SPA_DIRECTION_INPUT)
+			param = spa_format_video_mjpg_build(&b, id, &port->format.info.mjpg);
+		else
+			param = spa_format_video_raw_build(&b, id, &port->format.info.raw);
+		break;
+	case SPA_PARAM_Buffers:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamBuffers, id,
+				SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
+				SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+				SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
+								port->size, 1, INT32_MAX),
+				SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(0));
+		} else {
+			/* we hold on to a buffer for each thread */
+			uint32_t n_buffers = SPA_MIN(this->n_threads + 2, (uint32_t)MAX_BUFFERS);
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamBuffers, id,
+				SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(n_buffers,
+								SPA_MIN(n_buffers, 2u), MAX_BUFFERS),
+				SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+				SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port->size),
+				SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port->stride));
+		}
+		break;
+	case SPA_PARAM_Meta:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamMeta, id,
+				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+	case SPA_PARAM_Latency:
+		switch (result.index) {
+		case 0: case 1:
+		{
+			struct spa_latency_info latency = this->latency[result.index];
+			spa_process_latency_info_add(&this->process_latency, &latency);
+			param = spa_latency_build(&b, id, &latency);
+			break;
+		}
+		default:
+			return 0;
+		}
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_debug(this->log, "%p: clear buffers %d", this, port->direction);
+		flush_jobs(this, true);
+		port->n_buffers = 0;
+		spa_list_init(&port->queue);
+	}
+	return 0;
+}
+
+static int port_set_latency(struct impl *this, enum spa_direction direction,
+			    const struct spa_pod *latency)
+{
+	enum spa_direction other = SPA_DIRECTION_REVERSE(direction);
+	struct spa_latency_info info;
+
+	if (latency == NULL) {
+		info = SPA_LATENCY_INFO(other);
+	} else if (spa_latency_parse(latency, &info) < 0 || info.direction != other) {
+		return -EINVAL;
+	}
+	this->latency[other] = info;
+
+	SPA_FOR_EACH_ELEMENT_VAR(this->ports, p) {
+		p->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+		p->params[IDX_Latency].user++;
+		emit_port_info(this, p, false);
+	}
+	return 0;
+}
+
+static int port_set_format(struct impl *this, enum spa_direction direction,
+			   uint32_t flags, const struct spa_pod *format)
+{
+	struct port *port = GET_PORT(this, direction, 0);
+	struct port *other;
+	int res;
+
+	if (format == NULL) {
+		clear_buffers(this, port);
+		port->have_format = false;
+	} else {
+		struct spa_video_info info = { 0 };
+		struct spa_rectangle *size;
+
+		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
+			return res;
+
+		if (info.media_type != SPA_MEDIA_TYPE_video)
+			return -EINVAL;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != SPA_MEDIA_SUBTYPE_mjpg)
+				return -EINVAL;
+			if ((res = spa_format_video_mjpg_parse(format, &info.info.mjpg)) < 0)
+				return res;
+			size = &info.info.mjpg.size;
+		} else {
+			if (info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+				return -EINVAL;
+			if ((res = spa_format_video_raw_parse(format, &info.info.raw)) < 0)
+				return res;
+			if ((port->finfo = find_format_info(info.info.raw.format)) == NULL) {
+				spa_log_error(this->log, "%p: unsupported format %s", this,
+						spa_debug_type_find_short_name(spa_type_video_format,
+							info.info.raw.format));
+				return -ENOTSUP;
+			}
+			size = &info.info.raw.size;
+		}
+		if (size->width == 0 || size->height == 0 ||
+		    size->width > MAX_SIZE || size->height > MAX_SIZE)
+			return -EINVAL;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			port->stride = 0;
+			port->size = size->width * size->height * 2;
+		} else {
+			port->stride = SPA_ROUND_UP_N(size->width * port->finfo->bpp, 4);
+			port->size = port->stride * size->height;
+		}
+		port->format = info;
+		port->have_format = true;
+
+		if (direction == SPA_DIRECTION_INPUT)
+			update_process_latency(this);
+
+		spa_log_debug(this->log, "%p: %d format %dx%d stride:%d size:%d", this,
+				direction, size->width, size->height, port->stride, port->size);
+	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->params[IDX_Format] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[IDX_Buffers] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[IDX_Format] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[IDX_Buffers] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
+	other = GET_PORT(this, SPA_DIRECTION_REVERSE(direction), 0);
+	other->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	other->params[IDX_EnumFormat].user++;
+	emit_port_info(this, other, false);
+
+	emit_node_info(this, false);
+
+	return 0;
+}
+
+static int
+impl_node_port_set_param(void *object,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	switch (id) {
+	case SPA_PARAM_Latency:
+		return port_set_latency(this, direction, param);
+	case SPA_PARAM_Format:
+		return port_set_format(this, direction, flags, param);
+	default:
+		return -ENOENT;
+	}
+}
+
+static int alloc_jobs(struct impl *this, uint32_t maxsize)
+{
+	uint32_t i;
+
+	this->n_jobs = SPA_MAX(this->n_threads, 1u);
+
+	/* without threads we decode straight from the input buffer */
+	if (this->n_threads == 0)
+		return 0;
+
+	for (i = 0; i < this->n_jobs; i++) {
+		struct job *j = &this->jobs[i];
+		void *mem;
+
+		if (j->maxsize >= maxsize)
+			continue;
+		if ((mem = realloc(j->mem, maxsize)) == NULL)
+			return -errno;
+		j->mem = mem;
+		j->maxsize = maxsize;
+	}
+	return 0;
+}
+
+static int
+impl_node_port_use_buffers(void *object,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   uint32_t flags,
+			   struct spa_buffer **buffers,
+			   uint32_t n_buffers)
+{
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i, maxsize = 0;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	spa_log_debug(this->log, "%p: use buffers %d on port %d", this, n_buffers, direction);
+
+	clear_buffers(this, port);
+
+	if (n_buffers > 0 && !port->have_format)
+		return -EIO;
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		if (buffers[i]->n_datas < 1 || d[0].data == NULL) {
+			spa_log_error(this->log, "%p: invalid memory on buffer %d", this, i);
+			return -EINVAL;
+		}
+		b->id = i;
+		b->flags = 0;
+		b->buf = buffers[i];
+		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+		maxsize = SPA_MAX(maxsize, d[0].maxsize);
+
+		if (direction == SPA_DIRECTION_OUTPUT)
+			queue_buffer(this, port, i);
+	}
+	port->n_buffers = n_buffers;
+	port->maxsize = maxsize;
+
+	if (direction == SPA_DIRECTION_INPUT && n_buffers > 0) {
+		if ((res = alloc_jobs(this, maxsize)) < 0) {
+			port->n_buffers = 0;
+			return res;
+		}
+	}
+	return 0;
+}
+
+static int
+impl_node_port_set_io(void *object,
+		      enum spa_direction direction, uint32_t port_id,
+		      uint32_t id, void *data, size_t size)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	switch (id) {
+	case SPA_IO_Buffers:
+		port->io = data;
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, SPA_DIRECTION_OUTPUT, port_id), -EINVAL);
+
+	port = GET_OUT_PORT(this, port_id);
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	queue_buffer(this, port, buffer_id);
+	return 0;
+}
+
+static int xioctl(int fd, unsigned long request, void *arg)
+{
+	int err;
+
+	do {
+		err = ioctl(fd, request, arg);
+	} while (err == -1 && errno == EINTR);
+
+	return err;
+}
+
+static void add_mode(struct impl *this, uint32_t width, uint32_t height,
+		uint32_t num, uint32_t denom)
+{
+	struct mode *m;
+
+	if (this->n_modes >= MAX_MODES || width > MAX_SIZE || height > MAX_SIZE)
+		return;
+
+	m = &this->modes[this->n_modes++];
+	m->size = SPA_RECTANGLE(width, height);
+	/* the device gives us the frame interval */
+	m->framerate = SPA_FRACTION(denom, num);
+}
+
+/* Get the discrete MJPEG sizes and framerates of the device so that the
+ * decoder negotiates the formats that the device can produce. */
+static int probe_device(struct impl *this, const char *path)
+{
+	struct v4l2_frmsizeenum size;
+	struct v4l2_frmivalenum ival;
+	int fd;
+
+	if ((fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC, 0)) < 0) {
+		spa_log_warn(this->log, "%p: can't open %s: %m", this, path);
+		return -errno;
+	}
+
+	spa_zero(size);
+	size.pixel_format = V4L2_PIX_FMT_MJPEG;
+	for (size.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMESIZES, &size) == 0; size.index++) {
+		if (size.type != V4L2_FRMSIZE_TYPE_DISCRETE)
+			break;
+
+		spa_zero(ival);
+		ival.pixel_format = V4L2_PIX_FMT_MJPEG;
+		ival.width = size.discrete.width;
+		ival.height = size.discrete.height;
+		for (ival.index = 0; xioctl(fd, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == 0; ival.index++) {
+			if (ival.type != V4L2_FRMIVAL_TYPE_DISCRETE ||
+			    ival.discrete.numerator == 0)
+				break;
+			add_mode(this, size.discrete.width, size.discrete.height,
+					ival.discrete.numerator, ival.discrete.denominator);
+		}
+	}
+	close(fd);
+
+	spa_log_info(this->log, "%p: %s has %u MJPEG modes", this, path, this->n_modes);
+	return 0;
+}
+
+static int do_log_stats(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct impl *this = user_data;
+	const struct stats *s = data;
+	uint64_t elapsed = s->elapsed;
+
+	spa_log_info(this->log, "%p: decoded %u frames (%u dropped, %u errors) "
+			"cpu:%.2fms/frame (%.1f%%) latency:%.2fms max:%.2fms threads:%u", this,
+			s->frames, s->dropped, s->errors,
+			s->frames ? s->cpu_time / (double)s->frames / SPA_NSEC_PER_MSEC : 0.0,
+			s->cpu_time * 100.0 / elapsed,
+			s->frames ? s->latency / (double)s->frames / SPA_NSEC_PER_MSEC : 0.0,
+			s->max_latency / (double)SPA_NSEC_PER_MSEC,
+			this->n_threads);
+	return 0;
+}
+
+/* called from the data thread, the stats are logged from the main loop */
+static void update_stats(struct impl *this, struct job *j, uint64_t now)
+{
+	struct stats *s = &this->stats;
+	uint64_t latency = now - j->submit_time;
+
+	s->frames++;
+	s->cpu_time += j->cpu_time;
+	s->latency += latency;
+	s->max_latency = SPA_MAX(s->max_latency, latency);
+
+	if (s->start == 0)
+		s->start = now;
+	if (now - s->start < STATS_INTERVAL)
+		return;
+
+	s->elapsed = now - s->start;
+	if (this->main_loop)
+		spa_loop_invoke(this->main_loop, do_log_stats, 0,
+				s, sizeof(*s), false, this);
+	spa_zero(*s);
+	s->start = now;
+}
+
+static int submit_frame(struct impl *this, struct buffer *in)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_data *d = &in->buf->datas[0];
+	uint32_t offset, size;
+	struct buffer *out;
+	struct job *j;
+
+	offset = SPA_MIN(d->chunk->offset, d->maxsize);
+	size = SPA_MIN(d->chunk->size, d->maxsize - offset);
+
+	/* all decoder threads are busy, don't wait for them */
+	j = &this->jobs[this->tail];
+	if (SPA_UNLIKELY(this->n_pending == this->n_jobs ||
+	    __atomic_load_n(&j->state, __ATOMIC_ACQUIRE) != JOB_FREE))
+		return -EBUSY;
+	if (SPA_UNLIKELY((out = dequeue_buffer(this, port)) == NULL))
+		return -EPIPE;
+
+	j->out = out;
+	j->res = 0;
+	j->cancel = false;
+	j->have_header = in->h != NULL;
+	if (in->h)
+		j->header = *in->h;
+	j->submit_time = get_time_ns(CLOCK_MONOTONIC);
+
+	if (this->n_threads == 0) {
+		j->data = SPA_PTROFF(d->data, offset, void);
+		j->size = size;
+		run_job(this, &this->decoders[0], j);
+		j->state = JOB_DONE;
+	} else {
+		size = SPA_MIN(size, j->maxsize);
+		memcpy(j->mem, SPA_PTROFF(d->data, offset, void), size);
+		j->data = j->mem;
+		j->size = size;
+
+		__atomic_store_n(&j->state, JOB_QUEUED, __ATOMIC_RELEASE);
+		sem_post(&this->queued);
+	}
+	this->tail = (this->tail + 1) % this->n_jobs;
+	this->n_pending++;
+	return 0;
+}
+
+/* Get the oldest job when it is done. This never waits for the decoder
+ * threads, when the oldest frame is not decoded yet, the consumer keeps the
+ * previous frame for another cycle. */
+static struct job *complete_job(struct impl *this)
+{
+	struct job *j;
+
+	if (this->n_pending == 0)
+		return NULL;
+
+	j = &this->jobs[this->head];
+	if (__atomic_load_n(&j->state, __ATOMIC_ACQUIRE) != JOB_DONE)
+		return NULL;
+
+	this->head = (this->head + 1) % this->n_jobs;
+	this->n_pending--;
+	return j;
+}
+
+static int impl_node_process(void *object)
+{
+	struct impl *this = object;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *inio, *outio;
+	struct job *j;
+	int res, status = 0;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	in_port = GET_IN_PORT(this, 0);
+	out_port = GET_OUT_PORT(this, 0);
+
+	if (SPA_UNLIKELY((inio = in_port->io) == NULL ||
+	    (outio = out_port->io) == NULL))
+		return -EIO;
+
+	if (SPA_UNLIKELY(outio->status == SPA_STATUS_HAVE_DATA))
+		return SPA_STATUS_HAVE_DATA;
+
+	if (SPA_LIKELY(outio->buffer_id < out_port->n_buffers)) {
+		queue_buffer(this, out_port, outio->buffer_id);
+		outio->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (inio->status == SPA_STATUS_HAVE_DATA &&
+	    inio->buffer_id < in_port->n_buffers) {
+		if ((res = submit_frame(this, &in_port->buffers[inio->buffer_id])) < 0) {
+			spa_log_trace_fp(this->log, "%p: dropped frame: %s", this,
+					spa_strerror(res));
+			this->stats.dropped++;
+		}
+		inio->status = SPA_STATUS_NEED_DATA;
+	}
+	status |= SPA_STATUS_NEED_DATA;
+
+	while ((j = complete_job(this)) != NULL) {
+		struct buffer *out = j->out;
+		bool cancel = __atomic_load_n(&j->cancel, __ATOMIC_RELAXED);
+
+		res = j->res;
+		if (j->have_header && out->h)
+			*out->h = j->header;
+		if (!cancel && res >= 0)
+			update_stats(this, j, get_time_ns(CLOCK_MONOTONIC));
+		__atomic_store_n(&j->state, JOB_FREE, __ATOMIC_RELEASE);
+
+		if (SPA_UNLIKELY(cancel || res < 0)) {
+			spa_log_trace_fp(this->log, "%p: can't decode frame: %s", this,
+					spa_strerror(res));
+			if (!cancel)
+				this->stats.errors++;
+			queue_buffer(this, out_port, out->id);
+			continue;
+		}
+		outio->buffer_id = out->id;
+		outio->status = SPA_STATUS_HAVE_DATA;
+		status |= SPA_STATUS_HAVE_DATA;
+		break;
+	}
+	return status;
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_node_add_listener,
+	.set_callbacks = impl_node_set_callbacks,
+	.enum_params = impl_node_enum_params,
+	.set_param = impl_node_set_param,
+	.set_io = impl_node_set_io,
+	.send_command = impl_node_send_command,
+	.add_port = impl_node_add_port,
+	.remove_port = impl_node_remove_port,
+	.port_enum_params = impl_node_port_enum_params,
+	.port_set_param = impl_node_port_set_param,
+	.port_use_buffers = impl_node_port_use_buffers,
+	.port_set_io = impl_node_port_set_io,
+	.port_reuse_buffer = impl_node_port_reuse_buffer,
+	.process = impl_node_process,
+};
+
+static int impl_get_interface(struct spa_handle *handle, const char *type, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (spa_streq(type, SPA_TYPE_INTERFACE_Node))
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+	uint32_t i;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	free_jobs(this);
+	stop_threads(this);
+	for (i = 0; i < MAX_THREADS; i++)
+		clear_decoder(this, &this->decoders[i]);
+
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static void init_port(struct impl *this, enum spa_direction direction)
+{
+	struct port *port = GET_PORT(this, direction, 0);
+
+	port->direction = direction;
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = SPA_PORT_FLAG_NO_REF;
+	port->params[IDX_EnumFormat] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[IDX_Meta] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
+	port->params[IDX_IO] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[IDX_Format] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[IDX_Buffers] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->params[IDX_Latency] = SPA_PARAM_INFO(SPA_PARAM_Latency, SPA_PARAM_INFO_READWRITE);
+	port->info.params = port->params;
+	port->info.n_params = N_PORT_PARAMS;
+	spa_list_init(&port->queue);
+
+	this->latency[direction] = SPA_LATENCY_INFO(direction);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	uint32_t i;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	v4l2_log_topic_init(this->log);
+	this->main_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Loop);
+
+	this->n_threads = DEFAULT_THREADS;
+	for (i = 0; info && i < info->n_items; i++) {
+		const char *k = info->items[i].key;
+		const char *s = info->items[i].value;
+		if (spa_streq(k, "decoder.threads"))
+			spa_atou32(s, &this->n_threads, 0);
+		else if (spa_streq(k, SPA_KEY_API_V4L2_PATH))
+			probe_device(this, s);
+	}
+	this->n_threads = SPA_MIN(this->n_threads, (uint32_t)MAX_THREADS);
+
+	for (i = 0; i < SPA_MAX(this->n_threads, 1u); i++) {
+		if ((res = init_decoder(this, &this->decoders[i])) < 0) {
+			impl_clear(handle);
+			return res;
+		}
+	}
+	this->n_jobs = SPA_MAX(this->n_threads, 1u);
+
+	this->node.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, this);
+	spa_hook_list_init(&this->hooks);
+
+	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
+			SPA_NODE_CHANGE_MASK_PARAMS;
+	this->info = SPA_NODE_INFO_INIT();
+	this->info.max_input_ports = 1;
+	this->info.max_output_ports = 1;
+	this->info.flags = SPA_NODE_FLAG_RT;
+	this->params[IDX_ProcessLatency] = SPA_PARAM_INFO(SPA_PARAM_ProcessLatency, SPA_PARAM_INFO_READ);
+	this->info.params = this->params;
+	this->info.n_params = N_NODE_PARAMS;
+
+	init_port(this, SPA_DIRECTION_INPUT);
+	init_port(this, SPA_DIRECTION_OUTPUT);
+
+	if (this->n_threads > 0)
+		start_threads(this);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+	return 1;
+}
+
+static const struct spa_dict_item info_items[] = {
+	{ SPA_KEY_FACTORY_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
+	{ SPA_KEY_FACTORY_DESCRIPTION, "Decode MJPEG video from a V4l2 device" },
+	{ SPA_KEY_FACTORY_USAGE, "[ decoder.threads=<number of threads, 0 decodes in the data thread> ] "
+		"[ "SPA_KEY_API_V4L2_PATH"=<device to take the MJPEG modes from> ]" },
+};
+
+static const struct spa_dict info = SPA_DICT_INIT_ARRAY(info_items);
+
+const struct spa_handle_factory spa_v4l2_mjpeg_decoder_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_API_V4L2_MJPEG_DECODER,
+	&info,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info,
+};
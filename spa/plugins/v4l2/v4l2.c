@@ -30,6 +30,9 @@
 extern const struct spa_handle_factory spa_v4l2_source_factory;
 extern const struct spa_handle_factory spa_v4l2_udev_factory;
 extern const struct spa_handle_factory spa_v4l2_device_factory;
+#ifdef HAVE_JPEG
+extern const struct spa_handle_factory spa_v4l2_mjpeg_decoder_factory;
+#endif
 
 struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.v4l2");
 struct spa_log_topic *v4l2_log_topic = &log_topic;
@@ -51,6 +54,11 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory,
 	case 2:
 		*factory = &spa_v4l2_device_factory;
 		break;
+#ifdef HAVE_JPEG
+	case 3:
+		*factory = &spa_v4l2_mjpeg_decoder_factory;
+		break;
+#endif
 	default:
 		return 0;
 	}
@@ -0,0 +1,206 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "test-helper.h"
+#include "video-ops.h"
+
+static uint32_t cpu_flags;
+
+struct stats {
+	uint32_t width;
+	uint32_t height;
+	uint64_t perf;
+	const char *name;
+	const char *impl;
+};
+
+#define MAX_WIDTH	1920
+#define MAX_HEIGHT	1080
+
+#define MAX_COUNT	20
+
+static uint8_t frame_in[MAX_WIDTH * MAX_HEIGHT * 4];
+static uint8_t frame_out[MAX_WIDTH * MAX_HEIGHT * 4];
+
+static const uint32_t sizes[][2] = {
+	{ 640, 480 }, { 1280, 720 }, { 1920, 1080 },
+};
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sizes) * 64
+
+static uint32_t n_results = 0;
+static struct stats results[MAX_RESULTS];
+
+static void init_frame(struct video_frame *f, uint8_t *mem, uint32_t format,
+		uint32_t width, uint32_t height)
+{
+	const struct format_info *info = video_format_info(format);
+	uint32_t i;
+
+	spa_zero(*f);
+	for (i = 0; i < info->n_planes; i++) {
+		uint32_t w = (width + (1u << info->wsub[i]) - 1) >> info->wsub[i];
+		f->stride[i] = SPA_ROUND_UP(w * info->pstride[i], 32u);
+		f->data[i] = mem;
+		mem += f->stride[i] * height;
+	}
+}
+
+static void run_test1(const char *name, uint32_t src_fmt, uint32_t dst_fmt, uint32_t flags,
+		uint32_t src_width, uint32_t src_height, uint32_t dst_width, uint32_t dst_height)
+{
+	struct convert conv;
+	struct video_frame in, out;
+	struct timespec ts;
+	uint64_t count, t1, t2;
+	uint32_t i;
+
+	spa_zero(conv);
+	conv.src_fmt = src_fmt;
+	conv.dst_fmt = dst_fmt;
+	conv.src_width = src_width;
+	conv.src_height = src_height;
+	conv.dst_width = dst_width;
+	conv.dst_height = dst_height;
+	conv.cpu_flags = flags;
+	spa_assert_se(convert_init(&conv) == 0);
+
+	/* the SIMD version was not available */
+	if (flags != 0 && conv.cpu_flags == 0)
+		goto done;
+
+	init_frame(&in, frame_in, src_fmt, src_width, src_height);
+	init_frame(&out, frame_out, dst_fmt, dst_width, dst_height);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		convert_process(&conv, &out, &in, 0, 1);
+		count++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	spa_assert(n_results < MAX_RESULTS);
+
+	results[n_results++] = (struct stats) {
+		.width = dst_width,
+		.height = dst_height,
+		.perf = count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+		.name = name,
+		.impl = conv.func_name,
+	};
+done:
+	convert_free(&conv);
+}
+
+static void run_test(const char *name, uint32_t src_fmt, uint32_t dst_fmt, bool scale)
+{
+	static const uint32_t flags[] = { 0, SPA_CPU_FLAG_SSE2, SPA_CPU_FLAG_SSE2 | SPA_CPU_FLAG_AVX2,
+		SPA_CPU_FLAG_NEON };
+
+	SPA_FOR_EACH_ELEMENT_VAR(sizes, s) {
+		SPA_FOR_EACH_ELEMENT_VAR(flags, f) {
+			if ((*f & cpu_flags) != *f)
+				continue;
+			if (scale)
+				run_test1(name, src_fmt, dst_fmt, *f, (*s)[0], (*s)[1],
+						(*s)[0] / 2, (*s)[1] / 2);
+			else
+				run_test1(name, src_fmt, dst_fmt, *f, (*s)[0], (*s)[1],
+						(*s)[0], (*s)[1]);
+		}
+	}
+}
+
+static void test_yuv_yuv(void)
+{
+	run_test("yuy2_i420", SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_I420, false);
+	run_test("yuy2_nv12", SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_NV12, false);
+	run_test("nv12_i420", SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_I420, false);
+}
+
+static void test_yuv_rgb(void)
+{
+	run_test("yuy2_bgrx", SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_BGRx, false);
+	run_test("i420_bgra", SPA_VIDEO_FORMAT_I420, SPA_VIDEO_FORMAT_BGRA, false);
+	run_test("nv12_rgba", SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_RGBA, false);
+}
+
+static void test_rgb_yuv(void)
+{
+	run_test("bgrx_i420", SPA_VIDEO_FORMAT_BGRx, SPA_VIDEO_FORMAT_I420, false);
+	run_test("rgba_nv12", SPA_VIDEO_FORMAT_RGBA, SPA_VIDEO_FORMAT_NV12, false);
+	run_test("rgba_bgrx", SPA_VIDEO_FORMAT_RGBA, SPA_VIDEO_FORMAT_BGRx, false);
+}
+
+static void test_scale(void)
+{
+	run_test("scale_yuy2_i420", SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_I420, true);
+	run_test("scale_nv12_bgrx", SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_BGRx, true);
+}
+
+static int compare_func(const void *_a, const void *_b)
+{
+	const struct stats *a = _a, *b = _b;
+	int diff;
+	if ((diff = strcmp(a->name, b->name)) != 0) return diff;
+	if ((diff = a->width - b->width) != 0) return diff;
+	if ((diff = a->height - b->height) != 0) return diff;
+	if ((diff = b->perf - a->perf) != 0) return diff;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i;
+
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	test_yuv_yuv();
+	test_yuv_rgb();
+	test_rgb_yuv();
+	test_scale();
+
+	qsort(results, n_results, sizeof(struct stats), compare_func);
+
+	for (i = 0; i < n_results; i++) {
+		struct stats *s = &results[i];
+		fprintf(stderr, "%-12."PRIu64" \t%-32.32s %-28.28s \t %dx%d\n",
+				s->perf, s->name, s->impl, s->width, s->height);
+	}
+	return 0;
+}
@@ -0,0 +1,335 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <spa/debug/mem.h>
+
+#include "test-helper.h"
+#include "video-ops.h"
+
+#define MAX_WIDTH	256
+#define MAX_HEIGHT	16
+/* init_frame() pads each line with 8 bytes */
+#define MAX_STRIDE	(MAX_WIDTH * 4 + 8)
+
+static uint32_t cpu_flags;
+
+struct frame {
+	struct video_frame f;
+	uint32_t size[VIDEO_MAX_PLANES];
+	uint8_t mem[VIDEO_MAX_PLANES][MAX_STRIDE * MAX_HEIGHT];
+};
+
+static void init_frame(struct frame *fr, uint32_t format, uint32_t width, uint32_t height)
+{
+	const struct format_info *info = video_format_info(format);
+	uint32_t i;
+
+	spa_assert_se(info != NULL);
+	spa_zero(*fr);
+	for (i = 0; i < info->n_planes; i++) {
+		uint32_t w = (width + (1u << info->wsub[i]) - 1) >> info->wsub[i];
+		uint32_t h = (height + (1u << info->hsub[i]) - 1) >> info->hsub[i];
+		/* add some padding to catch stride errors */
+		fr->f.stride[i] = w * info->pstride[i] + 8;
+		fr->f.data[i] = fr->mem[i];
+		fr->size[i] = fr->f.stride[i] * h;
+		spa_assert_se(fr->size[i] <= sizeof(fr->mem[i]));
+	}
+}
+
+static void fill_random(struct frame *fr)
+{
+	uint32_t i, j;
+	for (i = 0; i < VIDEO_MAX_PLANES; i++)
+		for (j = 0; j < fr->size[i]; j++)
+			fr->mem[i][j] = rand();
+}
+
+static void compare_frame(const char *name, const struct frame *f1, const struct frame *f2)
+{
+	uint32_t i;
+	for (i = 0; i < VIDEO_MAX_PLANES; i++) {
+		int res = memcmp(f1->mem[i], f2->mem[i], f1->size[i]);
+		if (res != 0) {
+			fprintf(stderr, "%s: plane %d differs\n", name, i);
+			spa_debug_mem(0, f1->mem[i], f1->size[i]);
+			spa_debug_mem(0, f2->mem[i], f2->size[i]);
+		}
+		spa_assert_se(res == 0);
+	}
+}
+
+static void run_convert(struct convert *conv, struct frame *dst, const struct frame *src,
+		uint32_t n_slices)
+{
+	uint32_t i;
+	for (i = 0; i < n_slices; i++)
+		convert_process(conv, &dst->f, &src->f, i, n_slices);
+}
+
+static struct frame in, out1, out2;
+
+/* all optimized versions and slicing must produce the same result as the
+ * plain C version. Returns the number of conversions that used one of flags. */
+static uint32_t test_simd_exact(uint32_t flags)
+{
+	static const uint32_t sizes[][2] = {
+		{ 1, 1 }, { 2, 2 }, { 15, 3 }, { 16, 4 }, { 17, 5 },
+		{ 33, 2 }, { 64, 8 }, { 127, 7 }, { 256, 16 },
+	};
+	uint32_t i, j, k, n_used = 0;
+
+	for (i = 0; i < n_video_formats; i++) {
+		for (j = 0; j < n_video_formats; j++) {
+			for (k = 0; k < SPA_N_ELEMENTS(sizes); k++) {
+				struct convert c1, c2;
+				uint32_t w = sizes[k][0], h = sizes[k][1];
+
+				spa_zero(c1);
+				c1.src_fmt = video_formats[i];
+				c1.dst_fmt = video_formats[j];
+				c1.src_width = c1.dst_width = w;
+				c1.src_height = c1.dst_height = h;
+				c1.color_matrix = k & 1 ? SPA_VIDEO_COLOR_MATRIX_BT709 :
+					SPA_VIDEO_COLOR_MATRIX_BT601;
+				c2 = c1;
+				c1.cpu_flags = 0;
+				c2.cpu_flags = flags;
+				c2.n_slices = 3;
+
+				spa_assert_se(convert_init(&c1) == 0);
+				spa_assert_se(convert_init(&c2) == 0);
+				if (c2.cpu_flags & flags)
+					n_used++;
+
+				init_frame(&in, c1.src_fmt, w, h);
+				fill_random(&in);
+				init_frame(&out1, c1.dst_fmt, w, h);
+				init_frame(&out2, c1.dst_fmt, w, h);
+
+				run_convert(&c1, &out1, &in, 1);
+				run_convert(&c2, &out2, &in, 3);
+				compare_frame(c2.func_name, &out1, &out2);
+
+				convert_free(&c1);
+				convert_free(&c2);
+			}
+		}
+	}
+	return n_used;
+}
+
+/* check each SIMD implementation on its own, the best one hides the others */
+static void test_simd_impls(void)
+{
+	static const struct {
+		uint32_t flag;
+		const char *name;
+	} impls[] = {
+#if defined (HAVE_SSE2)
+		{ SPA_CPU_FLAG_SSE2, "sse2" },
+#endif
+#if defined (HAVE_AVX2)
+		{ SPA_CPU_FLAG_AVX2, "avx2" },
+#endif
+#if defined (HAVE_NEON)
+		{ SPA_CPU_FLAG_NEON, "neon" },
+#endif
+		{ 0, "c" },
+	};
+
+	SPA_FOR_EACH_ELEMENT_VAR(impls, i) {
+		uint32_t n_used;
+
+		if (i->flag != 0 && (cpu_flags & i->flag) == 0) {
+			printf("%s: not supported by the CPU, skipped\n", i->name);
+			continue;
+		}
+		n_used = test_simd_exact(i->flag);
+		printf("%s: %u conversions\n", i->name, n_used);
+		/* make sure the implementation was actually used */
+		spa_assert_se(i->flag == 0 || n_used > 0);
+	}
+	test_simd_exact(cpu_flags);
+}
+
+static void test_scale_exact(void)
+{
+	static const uint32_t sizes[][4] = {
+		{ 64, 8, 32, 4 }, { 33, 7, 64, 16 }, { 256, 16, 127, 9 }, { 20, 10, 20, 5 },
+	};
+	static const uint32_t formats[][2] = {
+		{ SPA_VIDEO_FORMAT_YUY2, SPA_VIDEO_FORMAT_I420 },
+		{ SPA_VIDEO_FORMAT_NV12, SPA_VIDEO_FORMAT_BGRx },
+		{ SPA_VIDEO_FORMAT_RGBA, SPA_VIDEO_FORMAT_RGBA },
+		{ SPA_VIDEO_FORMAT_BGR, SPA_VIDEO_FORMAT_UYVY },
+	};
+	uint32_t i, k;
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++) {
+		for (k = 0; k < SPA_N_ELEMENTS(sizes); k++) {
+			struct convert c1, c2;
+
+			spa_zero(c1);
+			c1.src_fmt = formats[i][0];
+			c1.dst_fmt = formats[i][1];
+			c1.src_width = sizes[k][0];
+			c1.src_height = sizes[k][1];
+			c1.dst_width = sizes[k][2];
+			c1.dst_height = sizes[k][3];
+			c2 = c1;
+			c1.cpu_flags = 0;
+			c2.cpu_flags = cpu_flags;
+			c2.n_slices = 2;
+
+			spa_assert_se(convert_init(&c1) == 0);
+			spa_assert_se(convert_init(&c2) == 0);
+			spa_assert_se(c1.is_scaling);
+
+			init_frame(&in, c1.src_fmt, c1.src_width, c1.src_height);
+			fill_random(&in);
+			init_frame(&out1, c1.dst_fmt, c1.dst_width, c1.dst_height);
+			init_frame(&out2, c1.dst_fmt, c1.dst_width, c1.dst_height);
+
+			run_convert(&c1, &out1, &in, 1);
+			run_convert(&c2, &out2, &in, 2);
+			compare_frame(c2.func_name, &out1, &out2);
+
+			convert_free(&c1);
+			convert_free(&c2);
+		}
+	}
+}
+
+static void test_colors(void)
+{
+	static const struct {
+		uint8_t y, u, v;
+		uint8_t r, g, b;
+	} colors[] = {
+		{ 16, 128, 128, 0, 0, 0 },
+		{ 235, 128, 128, 255, 255, 255 },
+		{ 81, 90, 240, 255, 0, 0 },
+		{ 145, 54, 34, 0, 255, 0 },
+		{ 41, 240, 110, 0, 0, 255 },
+	};
+	uint32_t i;
+
+	SPA_FOR_EACH_ELEMENT_VAR(colors, c) {
+		struct convert conv;
+		uint8_t *p;
+
+		spa_zero(conv);
+		conv.src_fmt = SPA_VIDEO_FORMAT_YUY2;
+		conv.dst_fmt = SPA_VIDEO_FORMAT_RGBA;
+		conv.src_width = conv.dst_width = 32;
+		conv.src_height = conv.dst_height = 2;
+		conv.cpu_flags = cpu_flags;
+		spa_assert_se(convert_init(&conv) == 0);
+
+		init_frame(&in, conv.src_fmt, 32, 2);
+		init_frame(&out1, conv.dst_fmt, 32, 2);
+		for (i = 0; i < 32; i++) {
+			p = &in.mem[0][i * 4];
+			p[0] = p[2] = c->y;
+			p[1] = c->u;
+			p[3] = c->v;
+		}
+		run_convert(&conv, &out1, &in, 1);
+
+		for (i = 0; i < 32; i++) {
+			p = &out1.mem[0][i * 4];
+			spa_assert_se(abs(p[0] - c->r) <= 1);
+			spa_assert_se(abs(p[1] - c->g) <= 1);
+			spa_assert_se(abs(p[2] - c->b) <= 1);
+			spa_assert_se(p[3] == 0xff);
+		}
+		convert_free(&conv);
+	}
+}
+
+static void test_roundtrip(void)
+{
+	struct convert c1, c2;
+	uint32_t i, w = 64, h = 4;
+
+	spa_zero(c1);
+	c1.src_fmt = SPA_VIDEO_FORMAT_AYUV;
+	c1.dst_fmt = SPA_VIDEO_FORMAT_BGRA;
+	c1.src_width = c1.dst_width = w;
+	c1.src_height = c1.dst_height = h;
+	c1.cpu_flags = cpu_flags;
+	c2 = c1;
+	c2.src_fmt = SPA_VIDEO_FORMAT_BGRA;
+	c2.dst_fmt = SPA_VIDEO_FORMAT_AYUV;
+	spa_assert_se(convert_init(&c1) == 0);
+	spa_assert_se(convert_init(&c2) == 0);
+
+	init_frame(&in, c1.src_fmt, w, h);
+	init_frame(&out1, c1.dst_fmt, w, h);
+	init_frame(&out2, c2.dst_fmt, w, h);
+
+	/* stay inside the RGB gamut so that nothing is clipped */
+	for (i = 0; i < w * h; i++) {
+		uint8_t *p = &in.mem[0][(i / w) * in.f.stride[0] + (i % w) * 4];
+		p[0] = i;
+		p[1] = 60 + (rand() % 160);
+		p[2] = 120 + (rand() % 16);
+		p[3] = 120 + (rand() % 16);
+	}
+	run_convert(&c1, &out1, &in, 1);
+	run_convert(&c2, &out2, &out1, 1);
+
+	for (i = 0; i < w * h; i++) {
+		uint32_t offs = (i / w) * in.f.stride[0] + (i % w) * 4;
+		uint8_t *p1 = &in.mem[0][offs], *p2 = &out2.mem[0][offs];
+		spa_assert_se(p1[0] == p2[0]);
+		spa_assert_se(abs(p1[1] - p2[1]) <= 1);
+		spa_assert_se(abs(p1[2] - p2[2]) <= 1);
+		spa_assert_se(abs(p1[3] - p2[3]) <= 1);
+	}
+	convert_free(&c1);
+	convert_free(&c2);
+}
+
+int main(int argc, char *argv[])
+{
+	cpu_flags = get_cpu_flags();
+	printf("got CPU flags %d\n", cpu_flags);
+
+	test_simd_impls();
+	test_scale_exact();
+	test_colors();
+	test_roundtrip();
+
+	return 0;
+}
@@ -0,0 +1,329 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "video-ops.h"
+
+#include <immintrin.h>
+
+static inline void
+yuv_to_rgb_avx2(const struct convert_matrix *m, __m256i y, __m256i u, __m256i v,
+		__m256i *r, __m256i *g, __m256i *b)
+{
+	const __m256i two = _mm256_set1_epi16(2);
+	__m256i c, d, e, yy;
+
+	c = _mm256_slli_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), 6);
+	d = _mm256_slli_epi16(_mm256_sub_epi16(u, _mm256_set1_epi16(128)), 6);
+	e = _mm256_slli_epi16(_mm256_sub_epi16(v, _mm256_set1_epi16(128)), 6);
+
+	yy = _mm256_add_epi16(_mm256_mulhi_epi16(c, _mm256_set1_epi16(m->y)), two);
+	*r = _mm256_srai_epi16(_mm256_add_epi16(yy,
+				_mm256_mulhi_epi16(e, _mm256_set1_epi16(m->rv))), 2);
+	*g = _mm256_srai_epi16(_mm256_add_epi16(yy,
+				_mm256_add_epi16(_mm256_mulhi_epi16(d, _mm256_set1_epi16(m->gu)),
+					_mm256_mulhi_epi16(e, _mm256_set1_epi16(m->gv)))), 2);
+	*b = _mm256_srai_epi16(_mm256_add_epi16(yy,
+				_mm256_mulhi_epi16(d, _mm256_set1_epi16(m->bu))), 2);
+}
+
+/* convert 32 pixels of 16 bits Y, U and V to 32 bytes R, G and B. The
+ * bytes are in lane order: 0-7, 16-23, 8-15, 24-31, which is what
+ * store_rgb32_avx2() expects. */
+static inline void
+yuv32_to_rgb_avx2(const struct convert_matrix *m,
+		__m256i y0, __m256i u0, __m256i v0,
+		__m256i y1, __m256i u1, __m256i v1,
+		__m256i *r, __m256i *g, __m256i *b)
+{
+	__m256i r0, g0, b0, r1, g1, b1;
+	yuv_to_rgb_avx2(m, y0, u0, v0, &r0, &g0, &b0);
+	yuv_to_rgb_avx2(m, y1, u1, v1, &r1, &g1, &b1);
+	*r = _mm256_packus_epi16(r0, r1);
+	*g = _mm256_packus_epi16(g0, g1);
+	*b = _mm256_packus_epi16(b0, b1);
+}
+
+static inline void
+store_rgb32_avx2(const uint8_t *dor, uint8_t *d, __m256i r, __m256i g, __m256i b, __m256i a)
+{
+	__m256i c[4], t0, t1, t2, t3, p0, p1, p2, p3;
+
+	c[dor[0]] = r;
+	c[dor[1]] = g;
+	c[dor[2]] = b;
+	c[dor[3]] = a;
+
+	t0 = _mm256_unpacklo_epi8(c[0], c[1]);	/* 0-7, 8-15 */
+	t1 = _mm256_unpackhi_epi8(c[0], c[1]);	/* 16-23, 24-31 */
+	t2 = _mm256_unpacklo_epi8(c[2], c[3]);
+	t3 = _mm256_unpackhi_epi8(c[2], c[3]);
+
+	p0 = _mm256_unpacklo_epi16(t0, t2);	/* 0-3, 8-11 */
+	p1 = _mm256_unpackhi_epi16(t0, t2);	/* 4-7, 12-15 */
+	p2 = _mm256_unpacklo_epi16(t1, t3);	/* 16-19, 24-27 */
+	p3 = _mm256_unpackhi_epi16(t1, t3);	/* 20-23, 28-31 */
+
+	_mm256_storeu_si256((__m256i*)(d + 0), _mm256_permute2x128_si256(p0, p1, 0x20));
+	_mm256_storeu_si256((__m256i*)(d + 32), _mm256_permute2x128_si256(p0, p1, 0x31));
+	_mm256_storeu_si256((__m256i*)(d + 64), _mm256_permute2x128_si256(p2, p3, 0x20));
+	_mm256_storeu_si256((__m256i*)(d + 96), _mm256_permute2x128_si256(p2, p3, 0x31));
+}
+
+static inline void
+convert_tail(const struct convert_step *s, convert_func_t func,
+		void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_dst, uint32_t n_src,
+		const uint32_t *dst_bpp, const uint32_t *src_bpp,
+		uint32_t done, uint32_t width)
+{
+	void *d[VIDEO_MAX_PLANES];
+	const void *sp[VIDEO_MAX_PLANES];
+	uint32_t i;
+
+	if (done >= width)
+		return;
+	for (i = 0; i < n_dst; i++)
+		d[i] = dst[i] ? SPA_PTROFF(dst[i], done * dst_bpp[i] / 2, void) : NULL;
+	for (i = 0; i < n_src; i++)
+		sp[i] = SPA_PTROFF(src[i], done * src_bpp[i] / 2, void);
+	func(s, d, sp, width - done);
+}
+
+static const uint32_t bpp_422[] = { 4 };
+static const uint32_t bpp_420[] = { 2, 1, 1 };
+static const uint32_t bpp_nv12[] = { 2, 2 };
+static const uint32_t bpp_rgb32[] = { 8 };
+
+#define SPLIT_422(v,ys,cs,y,c)						\
+	y = _mm256_and_si256(_mm256_srl_epi16(v, ys), mask);		\
+	c = _mm256_and_si256(_mm256_srl_epi16(v, cs), mask);
+
+/* pack 16 bits to bytes and undo the lane interleave */
+#define PACK_U8(a,b)	_mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), _MM_SHUFFLE(3,1,2,0))
+
+DEFINE_FUNCTION(yuv422_to_i420, avx2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width & ~31u;
+	const __m256i mask = _mm256_set1_epi16(0xff), mask32 = _mm256_set1_epi32(0xffff);
+	const __m128i ys = _mm_cvtsi32_si128((so[0] & 1) * 8);
+	const __m128i cs = _mm_cvtsi32_si128((so[1] & 1) * 8);
+	const bool u_first = so[1] < so[3];
+	__m256i a, b, ya, yb, ca, cb, c0, c1;
+
+	for (i = 0; i < n; i += 32, sp += 64) {
+		a = _mm256_loadu_si256((const __m256i*)(sp + 0));
+		b = _mm256_loadu_si256((const __m256i*)(sp + 32));
+		SPLIT_422(a, ys, cs, ya, ca);
+		SPLIT_422(b, ys, cs, yb, cb);
+		_mm256_storeu_si256((__m256i*)(y + i), PACK_U8(ya, yb));
+
+		if (u == NULL || v == NULL)
+			continue;
+
+		c0 = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+					_mm256_and_si256(ca, mask32),
+					_mm256_and_si256(cb, mask32)), _MM_SHUFFLE(3,1,2,0));
+		c1 = _mm256_permute4x64_epi64(_mm256_packs_epi32(
+					_mm256_srli_epi32(ca, 16),
+					_mm256_srli_epi32(cb, 16)), _MM_SHUFFLE(3,1,2,0));
+		if (!u_first)
+			SPA_SWAP(c0, c1);
+		_mm_storeu_si128((__m128i*)(u + i / 2), _mm_packus_epi16(
+					_mm256_castsi256_si128(c0), _mm256_extracti128_si256(c0, 1)));
+		_mm_storeu_si128((__m128i*)(v + i / 2), _mm_packus_epi16(
+					_mm256_castsi256_si128(c1), _mm256_extracti128_si256(c1, 1)));
+	}
+	convert_tail(s, conv_yuv422_to_i420_c, dst, src, 3, 1, bpp_420, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(yuv422_to_nv12, avx2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width & ~31u;
+	const __m256i mask = _mm256_set1_epi16(0xff);
+	const __m128i ys = _mm_cvtsi32_si128((so[0] & 1) * 8);
+	const __m128i cs = _mm_cvtsi32_si128((so[1] & 1) * 8);
+	const bool swap = (so[1] < so[3]) != (dor[1] < dor[2]);
+	__m256i a, b, ya, yb, ca, cb;
+
+	for (i = 0; i < n; i += 32, sp += 64) {
+		a = _mm256_loadu_si256((const __m256i*)(sp + 0));
+		b = _mm256_loadu_si256((const __m256i*)(sp + 32));
+		SPLIT_422(a, ys, cs, ya, ca);
+		SPLIT_422(b, ys, cs, yb, cb);
+		_mm256_storeu_si256((__m256i*)(y + i), PACK_U8(ya, yb));
+
+		if (uv == NULL)
+			continue;
+
+		if (swap) {
+			ca = _mm256_or_si256(_mm256_srli_epi32(ca, 16), _mm256_slli_epi32(ca, 16));
+			cb = _mm256_or_si256(_mm256_srli_epi32(cb, 16), _mm256_slli_epi32(cb, 16));
+		}
+		_mm256_storeu_si256((__m256i*)(uv + i), PACK_U8(ca, cb));
+	}
+	convert_tail(s, conv_yuv422_to_nv12_c, dst, src, 2, 1, bpp_nv12, bpp_422, n, width);
+}
+
+#define DUP_EVEN(c)	_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c,		\
+				_MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0))
+#define DUP_ODD(c)	_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(c,		\
+				_MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1))
+
+DEFINE_FUNCTION(yuv422_to_rgb32, avx2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order;
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~31u;
+	const __m256i mask = _mm256_set1_epi16(0xff), alpha = _mm256_set1_epi8(-1);
+	const __m128i ys = _mm_cvtsi32_si128((so[0] & 1) * 8);
+	const __m128i cs = _mm_cvtsi32_si128((so[1] & 1) * 8);
+	const bool u_first = so[1] < so[3];
+	__m256i a, b, ya, yb, ca, cb, ua, va, ub, vb, r, g, bl;
+
+	for (i = 0; i < n; i += 32, sp += 64, d += 128) {
+		a = _mm256_loadu_si256((const __m256i*)(sp + 0));
+		b = _mm256_loadu_si256((const __m256i*)(sp + 32));
+		SPLIT_422(a, ys, cs, ya, ca);
+		SPLIT_422(b, ys, cs, yb, cb);
+
+		ua = DUP_EVEN(ca);
+		va = DUP_ODD(ca);
+		ub = DUP_EVEN(cb);
+		vb = DUP_ODD(cb);
+		if (!u_first) {
+			SPA_SWAP(ua, va);
+			SPA_SWAP(ub, vb);
+		}
+		yuv32_to_rgb_avx2(s->m, ya, ua, va, yb, ub, vb, &r, &g, &bl);
+		store_rgb32_avx2(s->dst_order, d, r, g, bl, alpha);
+	}
+	convert_tail(s, conv_yuv422_to_rgb32_c, dst, src, 1, 1, bpp_rgb32, bpp_422, n, width);
+}
+
+/* load 8 chroma bytes and duplicate them to 16 values of 16 bits */
+#define LOAD_DUP(p)	_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(				\
+				_mm_loadl_epi64((const __m128i*)(p)),			\
+				_mm_loadl_epi64((const __m128i*)(p))))
+#define LOAD_Y(p)	_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(p)))
+
+DEFINE_FUNCTION(i420_to_rgb32, avx2)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[so[0]], *u = src[so[1]], *v = src[so[2]];
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~31u;
+	const __m256i alpha = _mm256_set1_epi8(-1);
+	__m256i r, g, b;
+
+	for (i = 0; i < n; i += 32, d += 128) {
+		yuv32_to_rgb_avx2(s->m,
+				LOAD_Y(y + i), LOAD_DUP(u + i / 2), LOAD_DUP(v + i / 2),
+				LOAD_Y(y + i + 16), LOAD_DUP(u + i / 2 + 8), LOAD_DUP(v + i / 2 + 8),
+				&r, &g, &b);
+		store_rgb32_avx2(s->dst_order, d, r, g, b, alpha);
+	}
+	convert_tail(s, conv_i420_to_rgb32_c, dst, src, 1, 3, bpp_rgb32, bpp_420, n, width);
+}
+
+DEFINE_FUNCTION(nv12_to_rgb32, avx2)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[0], *uv = src[1];
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~31u;
+	const __m256i alpha = _mm256_set1_epi8(-1);
+	__m256i c0, c1, u0, v0, u1, v1, r, g, b;
+
+	for (i = 0; i < n; i += 32, d += 128) {
+		c0 = LOAD_Y(uv + i);
+		c1 = LOAD_Y(uv + i + 16);
+		u0 = DUP_EVEN(c0);
+		v0 = DUP_ODD(c0);
+		u1 = DUP_EVEN(c1);
+		v1 = DUP_ODD(c1);
+		if (so[1] != 0) {
+			SPA_SWAP(u0, v0);
+			SPA_SWAP(u1, v1);
+		}
+		yuv32_to_rgb_avx2(s->m,
+				LOAD_Y(y + i), u0, v0,
+				LOAD_Y(y + i + 16), u1, v1,
+				&r, &g, &b);
+		store_rgb32_avx2(s->dst_order, d, r, g, b, alpha);
+	}
+	convert_tail(s, conv_nv12_to_rgb32_c, dst, src, 1, 2, bpp_rgb32, bpp_nv12, n, width);
+}
+
+DEFINE_FUNCTION(rgb32_to_rgb32, avx2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *d = dst[0];
+	uint32_t i, j, n = width & ~7u, nc = s->src_alpha ? 4 : 3;
+	const __m256i mask = _mm256_set1_epi32(0xff);
+	__m128i ss[4], ds[4];
+	__m256i alpha, in, out;
+
+	for (j = 0; j < 4; j++) {
+		ss[j] = _mm_cvtsi32_si128(so[j] * 8);
+		ds[j] = _mm_cvtsi32_si128(dor[j] * 8);
+	}
+	alpha = s->src_alpha ? _mm256_setzero_si256() : _mm256_sll_epi32(mask, ds[3]);
+
+	for (i = 0; i < n; i += 8, sp += 32, d += 32) {
+		in = _mm256_loadu_si256((const __m256i*)sp);
+		out = alpha;
+		for (j = 0; j < nc; j++)
+			out = _mm256_or_si256(out, _mm256_sll_epi32(
+					_mm256_and_si256(_mm256_srl_epi32(in, ss[j]), mask), ds[j]));
+		_mm256_storeu_si256((__m256i*)d, out);
+	}
+	convert_tail(s, conv_rgb32_to_rgb32_c, dst, src, 1, 1, bpp_rgb32, bpp_rgb32, n, width);
+}
+
+DEFINE_SCALE_FUNCTION(v, avx2)
+{
+	const uint8_t *s0 = src0, *s1 = src1;
+	uint8_t *d = dst;
+	uint32_t i, n = n_bytes & ~31u;
+	const __m256i round = _mm256_set1_epi16(128);
+	const __m256i f0 = _mm256_set1_epi16(256 - frac), f1 = _mm256_set1_epi16(frac);
+	__m256i lo, hi;
+
+	for (i = 0; i < n; i += 32) {
+		lo = _mm256_add_epi16(_mm256_add_epi16(
+				_mm256_mullo_epi16(LOAD_Y(s0 + i), f0),
+				_mm256_mullo_epi16(LOAD_Y(s1 + i), f1)), round);
+		hi = _mm256_add_epi16(_mm256_add_epi16(
+				_mm256_mullo_epi16(LOAD_Y(s0 + i + 16), f0),
+				_mm256_mullo_epi16(LOAD_Y(s1 + i + 16), f1)), round);
+		_mm256_storeu_si256((__m256i*)(d + i), PACK_U8(
+					_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+	}
+	if (n < n_bytes)
+		scale_v_c(d + n, s0 + n, s1 + n, frac, n_bytes - n);
+}
@@ -0,0 +1,542 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "video-ops.h"
+
+/* Chroma planes of 4:2:0 destinations are NULL for the odd lines,
+ * chroma of 4:2:0 sources is repeated for the odd lines. */
+
+#define AVG(a,b)	(((a) + (b) + 1) >> 1)
+
+DEFINE_FUNCTION(yuv422_to_yuv422, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i, n = (width + 1) >> 1;
+
+	for (i = 0; i < n; i++, sp += 4, dp += 4) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[2]];
+		dp[dor[3]] = sp[so[3]];
+	}
+}
+
+DEFINE_FUNCTION(yuv422_to_i420, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, sp += 4) {
+		y[2*i+0] = sp[so[0]];
+		y[2*i+1] = sp[so[2]];
+	}
+	if (width & 1)
+		y[2*i] = sp[so[0]];
+
+	if (u == NULL || v == NULL)
+		return;
+
+	sp = src[0];
+	n = (width + 1) >> 1;
+	for (i = 0; i < n; i++, sp += 4) {
+		u[i] = sp[so[1]];
+		v[i] = sp[so[3]];
+	}
+}
+
+DEFINE_FUNCTION(yuv422_to_nv12, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, sp += 4) {
+		y[2*i+0] = sp[so[0]];
+		y[2*i+1] = sp[so[2]];
+	}
+	if (width & 1)
+		y[2*i] = sp[so[0]];
+
+	if (uv == NULL)
+		return;
+
+	sp = src[0];
+	n = (width + 1) >> 1;
+	for (i = 0; i < n; i++, sp += 4, uv += 2) {
+		uv[dor[1]] = sp[so[1]];
+		uv[dor[2]] = sp[so[3]];
+	}
+}
+
+DEFINE_FUNCTION(yuv422_to_ayuv, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, sp += 4, dp += 8) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[3]];
+		dp[dor[3]] = 0xff;
+		dp[4+dor[0]] = sp[so[2]];
+		dp[4+dor[1]] = sp[so[1]];
+		dp[4+dor[2]] = sp[so[3]];
+		dp[4+dor[3]] = 0xff;
+	}
+	if (width & 1) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[3]];
+		dp[dor[3]] = 0xff;
+	}
+}
+
+DEFINE_FUNCTION(i420_to_i420, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	uint32_t cw = (width + 1) >> 1;
+
+	memcpy(dst[dor[0]], src[so[0]], width);
+	if (dst[dor[1]] == NULL || dst[dor[2]] == NULL)
+		return;
+	memcpy(dst[dor[1]], src[so[1]], cw);
+	memcpy(dst[dor[2]], src[so[2]], cw);
+}
+
+DEFINE_FUNCTION(i420_to_nv12, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *u = src[so[1]], *v = src[so[2]];
+	uint8_t *uv = dst[1];
+	uint32_t i, cw = (width + 1) >> 1;
+
+	memcpy(dst[0], src[so[0]], width);
+	if (uv == NULL)
+		return;
+	for (i = 0; i < cw; i++, uv += 2) {
+		uv[dor[1]] = u[i];
+		uv[dor[2]] = v[i];
+	}
+}
+
+DEFINE_FUNCTION(i420_to_yuv422, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *y = src[so[0]], *u = src[so[1]], *v = src[so[2]];
+	uint8_t *dp = dst[0];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, dp += 4) {
+		dp[dor[0]] = y[2*i+0];
+		dp[dor[1]] = u[i];
+		dp[dor[2]] = y[2*i+1];
+		dp[dor[3]] = v[i];
+	}
+	if (width & 1) {
+		dp[dor[0]] = y[2*i];
+		dp[dor[1]] = u[i];
+		dp[dor[2]] = y[2*i];
+		dp[dor[3]] = v[i];
+	}
+}
+
+DEFINE_FUNCTION(i420_to_ayuv, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *y = src[so[0]], *u = src[so[1]], *v = src[so[2]];
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, dp += 4) {
+		dp[dor[0]] = y[i];
+		dp[dor[1]] = u[i >> 1];
+		dp[dor[2]] = v[i >> 1];
+		dp[dor[3]] = 0xff;
+	}
+}
+
+DEFINE_FUNCTION(nv12_to_nv12, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *suv = src[1];
+	uint8_t *uv = dst[1];
+	uint32_t i, cw = (width + 1) >> 1;
+
+	memcpy(dst[0], src[0], width);
+	if (uv == NULL)
+		return;
+	for (i = 0; i < cw; i++, uv += 2, suv += 2) {
+		uv[dor[1]] = suv[so[1]];
+		uv[dor[2]] = suv[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(nv12_to_i420, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *suv = src[1];
+	uint8_t *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, cw = (width + 1) >> 1;
+
+	memcpy(dst[dor[0]], src[0], width);
+	if (u == NULL || v == NULL)
+		return;
+	for (i = 0; i < cw; i++, suv += 2) {
+		u[i] = suv[so[1]];
+		v[i] = suv[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(nv12_to_yuv422, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *y = src[0], *uv = src[1];
+	uint8_t *dp = dst[0];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, dp += 4, uv += 2) {
+		dp[dor[0]] = y[2*i+0];
+		dp[dor[1]] = uv[so[1]];
+		dp[dor[2]] = y[2*i+1];
+		dp[dor[3]] = uv[so[2]];
+	}
+	if (width & 1) {
+		dp[dor[0]] = y[2*i];
+		dp[dor[1]] = uv[so[1]];
+		dp[dor[2]] = y[2*i];
+		dp[dor[3]] = uv[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(nv12_to_ayuv, c)
+{
+	const uint8_t *so = s->src_order, *dor = s->dst_order;
+	const uint8_t *y = src[0], *uv = src[1];
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, dp += 4) {
+		dp[dor[0]] = y[i];
+		dp[dor[1]] = uv[(i & ~1u) + so[1]];
+		dp[dor[2]] = uv[(i & ~1u) + so[2]];
+		dp[dor[3]] = 0xff;
+	}
+}
+
+DEFINE_FUNCTION(ayuv_to_ayuv, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 4, dp += 4) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[2]];
+		dp[dor[3]] = s->src_alpha ? sp[so[3]] : 0xff;
+	}
+}
+
+DEFINE_FUNCTION(ayuv_to_yuv422, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, sp += 8, dp += 4) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = AVG(sp[so[1]], sp[4+so[1]]);
+		dp[dor[2]] = sp[4+so[0]];
+		dp[dor[3]] = AVG(sp[so[2]], sp[4+so[2]]);
+	}
+	if (width & 1) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[0]];
+		dp[dor[3]] = sp[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(ayuv_to_i420, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < width; i++)
+		y[i] = sp[i*4+so[0]];
+
+	if (u == NULL || v == NULL)
+		return;
+
+	for (i = 0; i < n; i++, sp += 8) {
+		u[i] = AVG(sp[so[1]], sp[4+so[1]]);
+		v[i] = AVG(sp[so[2]], sp[4+so[2]]);
+	}
+	if (width & 1) {
+		u[i] = sp[so[1]];
+		v[i] = sp[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(ayuv_to_nv12, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < width; i++)
+		y[i] = sp[i*4+so[0]];
+
+	if (uv == NULL)
+		return;
+
+	for (i = 0; i < n; i++, sp += 8, uv += 2) {
+		uv[dor[1]] = AVG(sp[so[1]], sp[4+so[1]]);
+		uv[dor[2]] = AVG(sp[so[2]], sp[4+so[2]]);
+	}
+	if (width & 1) {
+		uv[dor[1]] = sp[so[1]];
+		uv[dor[2]] = sp[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(rgb32_to_rgb32, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 4, dp += 4) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[2]];
+		dp[dor[3]] = s->src_alpha ? sp[so[3]] : 0xff;
+	}
+}
+
+DEFINE_FUNCTION(rgb32_to_rgb24, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 4, dp += 3) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[2]];
+	}
+}
+
+DEFINE_FUNCTION(rgb24_to_rgb32, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 3, dp += 4) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[2]];
+		dp[dor[3]] = 0xff;
+	}
+}
+
+DEFINE_FUNCTION(rgb24_to_rgb24, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 3, dp += 3) {
+		dp[dor[0]] = sp[so[0]];
+		dp[dor[1]] = sp[so[1]];
+		dp[dor[2]] = sp[so[2]];
+	}
+}
+
+static inline void put_rgb32(const struct convert_step *s, uint8_t *dp,
+		uint8_t y, uint8_t u, uint8_t v, uint8_t a)
+{
+	const uint8_t *dor = s->dst_order;
+	yuv_to_rgb(s->m, y, u, v, &dp[dor[0]], &dp[dor[1]], &dp[dor[2]]);
+	dp[dor[3]] = a;
+}
+
+DEFINE_FUNCTION(yuv422_to_rgb32, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order;
+	uint8_t *dp = dst[0];
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, sp += 4, dp += 8) {
+		put_rgb32(s, dp, sp[so[0]], sp[so[1]], sp[so[3]], 0xff);
+		put_rgb32(s, dp + 4, sp[so[2]], sp[so[1]], sp[so[3]], 0xff);
+	}
+	if (width & 1)
+		put_rgb32(s, dp, sp[so[0]], sp[so[1]], sp[so[3]], 0xff);
+}
+
+DEFINE_FUNCTION(i420_to_rgb32, c)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[so[0]], *u = src[so[1]], *v = src[so[2]];
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, dp += 4)
+		put_rgb32(s, dp, y[i], u[i >> 1], v[i >> 1], 0xff);
+}
+
+DEFINE_FUNCTION(nv12_to_rgb32, c)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[0], *uv = src[1];
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, dp += 4)
+		put_rgb32(s, dp, y[i], uv[(i & ~1u) + so[1]], uv[(i & ~1u) + so[2]], 0xff);
+}
+
+DEFINE_FUNCTION(ayuv_to_rgb32, c)
+{
+	const uint8_t *sp = src[0], *so = s->src_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 4, dp += 4)
+		put_rgb32(s, dp, sp[so[0]], sp[so[1]], sp[so[2]],
+				s->src_alpha ? sp[so[3]] : 0xff);
+}
+
+/* average the RGB components of 2 pixels, used for the subsampled chroma */
+static inline void avg_rgb32(const uint8_t *so, const uint8_t *p0, const uint8_t *p1,
+		uint8_t *r, uint8_t *g, uint8_t *b)
+{
+	*r = AVG(p0[so[0]], p1[so[0]]);
+	*g = AVG(p0[so[1]], p1[so[1]]);
+	*b = AVG(p0[so[2]], p1[so[2]]);
+}
+
+DEFINE_FUNCTION(rgb32_to_yuv422, c)
+{
+	const struct convert_matrix *m = s->m;
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0], r, g, b;
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < n; i++, sp += 8, dp += 4) {
+		dp[dor[0]] = rgb_to_y(m, sp[so[0]], sp[so[1]], sp[so[2]]);
+		dp[dor[2]] = rgb_to_y(m, sp[4+so[0]], sp[4+so[1]], sp[4+so[2]]);
+		avg_rgb32(so, sp, sp + 4, &r, &g, &b);
+		dp[dor[1]] = rgb_to_u(m, r, g, b);
+		dp[dor[3]] = rgb_to_v(m, r, g, b);
+	}
+	if (width & 1) {
+		r = sp[so[0]]; g = sp[so[1]]; b = sp[so[2]];
+		dp[dor[0]] = dp[dor[2]] = rgb_to_y(m, r, g, b);
+		dp[dor[1]] = rgb_to_u(m, r, g, b);
+		dp[dor[3]] = rgb_to_v(m, r, g, b);
+	}
+}
+
+DEFINE_FUNCTION(rgb32_to_i420, c)
+{
+	const struct convert_matrix *m = s->m;
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]], r, g, b;
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < width; i++)
+		y[i] = rgb_to_y(m, sp[i*4+so[0]], sp[i*4+so[1]], sp[i*4+so[2]]);
+
+	if (u == NULL || v == NULL)
+		return;
+
+	for (i = 0; i < n; i++, sp += 8) {
+		avg_rgb32(so, sp, sp + 4, &r, &g, &b);
+		u[i] = rgb_to_u(m, r, g, b);
+		v[i] = rgb_to_v(m, r, g, b);
+	}
+	if (width & 1) {
+		u[i] = rgb_to_u(m, sp[so[0]], sp[so[1]], sp[so[2]]);
+		v[i] = rgb_to_v(m, sp[so[0]], sp[so[1]], sp[so[2]]);
+	}
+}
+
+DEFINE_FUNCTION(rgb32_to_nv12, c)
+{
+	const struct convert_matrix *m = s->m;
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1], r, g, b;
+	uint32_t i, n = width >> 1;
+
+	for (i = 0; i < width; i++)
+		y[i] = rgb_to_y(m, sp[i*4+so[0]], sp[i*4+so[1]], sp[i*4+so[2]]);
+
+	if (uv == NULL)
+		return;
+
+	for (i = 0; i < n; i++, sp += 8, uv += 2) {
+		avg_rgb32(so, sp, sp + 4, &r, &g, &b);
+		uv[dor[1]] = rgb_to_u(m, r, g, b);
+		uv[dor[2]] = rgb_to_v(m, r, g, b);
+	}
+	if (width & 1) {
+		uv[dor[1]] = rgb_to_u(m, sp[so[0]], sp[so[1]], sp[so[2]]);
+		uv[dor[2]] = rgb_to_v(m, sp[so[0]], sp[so[1]], sp[so[2]]);
+	}
+}
+
+DEFINE_FUNCTION(rgb32_to_ayuv, c)
+{
+	const struct convert_matrix *m = s->m;
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *dp = dst[0];
+	uint32_t i;
+
+	for (i = 0; i < width; i++, sp += 4, dp += 4) {
+		uint8_t r = sp[so[0]], g = sp[so[1]], b = sp[so[2]];
+		dp[dor[0]] = rgb_to_y(m, r, g, b);
+		dp[dor[1]] = rgb_to_u(m, r, g, b);
+		dp[dor[2]] = rgb_to_v(m, r, g, b);
+		dp[dor[3]] = s->src_alpha ? sp[so[3]] : 0xff;
+	}
+}
+
+DEFINE_SCALE_FUNCTION(v, c)
+{
+	const uint8_t *s0 = src0, *s1 = src1;
+	uint8_t *d = dst;
+	uint32_t i, f0 = 256 - frac;
+
+	for (i = 0; i < n_bytes; i++)
+		d[i] = (s0[i] * f0 + s1[i] * frac + 128) >> 8;
+}
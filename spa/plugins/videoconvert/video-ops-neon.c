@@ -0,0 +1,324 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "video-ops.h"
+
+#include <arm_neon.h>
+
+static inline int16x8_t mulhi_neon(int16x8_t a, int16_t b)
+{
+	return vcombine_s16(
+			vshrn_n_s32(vmull_n_s16(vget_low_s16(a), b), 16),
+			vshrn_n_s32(vmull_n_s16(vget_high_s16(a), b), 16));
+}
+
+static inline int16x8_t widen_neon(uint8x8_t v, int offs)
+{
+	return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(offs));
+}
+
+static inline void
+yuv_to_rgb_neon(const struct convert_matrix *m, uint8x8_t y, uint8x8_t u, uint8x8_t v,
+		uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
+{
+	int16x8_t c, d, e, yy;
+
+	c = vshlq_n_s16(widen_neon(y, 16), 6);
+	d = vshlq_n_s16(widen_neon(u, 128), 6);
+	e = vshlq_n_s16(widen_neon(v, 128), 6);
+
+	yy = vaddq_s16(mulhi_neon(c, m->y), vdupq_n_s16(2));
+	*r = vqmovun_s16(vshrq_n_s16(vaddq_s16(yy, mulhi_neon(e, m->rv)), 2));
+	*g = vqmovun_s16(vshrq_n_s16(vaddq_s16(yy,
+				vaddq_s16(mulhi_neon(d, m->gu), mulhi_neon(e, m->gv))), 2));
+	*b = vqmovun_s16(vshrq_n_s16(vaddq_s16(yy, mulhi_neon(d, m->bu)), 2));
+}
+
+/* convert 16 pixels, y0 are the even and y1 the odd pixels that share
+ * the chroma values u and v */
+static inline void
+yuv16_to_rgb_neon(const struct convert_matrix *m, uint8x8_t y0, uint8x8_t y1,
+		uint8x8_t u, uint8x8_t v, uint8x16_t *r, uint8x16_t *g, uint8x16_t *b)
+{
+	uint8x8_t r0, g0, b0, r1, g1, b1;
+	uint8x8x2_t t;
+
+	yuv_to_rgb_neon(m, y0, u, v, &r0, &g0, &b0);
+	yuv_to_rgb_neon(m, y1, u, v, &r1, &g1, &b1);
+	t = vzip_u8(r0, r1);
+	*r = vcombine_u8(t.val[0], t.val[1]);
+	t = vzip_u8(g0, g1);
+	*g = vcombine_u8(t.val[0], t.val[1]);
+	t = vzip_u8(b0, b1);
+	*b = vcombine_u8(t.val[0], t.val[1]);
+}
+
+static inline void
+store_rgb32_neon(const uint8_t *dor, uint8_t *d, uint8x16_t r, uint8x16_t g, uint8x16_t b)
+{
+	uint8x16x4_t o;
+	o.val[dor[0]] = r;
+	o.val[dor[1]] = g;
+	o.val[dor[2]] = b;
+	o.val[dor[3]] = vdupq_n_u8(0xff);
+	vst4q_u8(d, o);
+}
+
+static inline void
+convert_tail(const struct convert_step *s, convert_func_t func,
+		void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_dst, uint32_t n_src,
+		const uint32_t *dst_bpp, const uint32_t *src_bpp,
+		uint32_t done, uint32_t width)
+{
+	void *d[VIDEO_MAX_PLANES];
+	const void *sp[VIDEO_MAX_PLANES];
+	uint32_t i;
+
+	if (done >= width)
+		return;
+	for (i = 0; i < n_dst; i++)
+		d[i] = dst[i] ? SPA_PTROFF(dst[i], done * dst_bpp[i] / 2, void) : NULL;
+	for (i = 0; i < n_src; i++)
+		sp[i] = SPA_PTROFF(src[i], done * src_bpp[i] / 2, void);
+	func(s, d, sp, width - done);
+}
+
+static const uint32_t bpp_422[] = { 4 };
+static const uint32_t bpp_420[] = { 2, 1, 1 };
+static const uint32_t bpp_nv12[] = { 2, 2 };
+static const uint32_t bpp_rgb32[] = { 8 };
+
+DEFINE_FUNCTION(yuv422_to_i420, neon)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width & ~31u;
+	uint8x16x4_t in;
+	uint8x16x2_t yy;
+
+	for (i = 0; i < n; i += 32, sp += 64) {
+		in = vld4q_u8(sp);
+		yy.val[0] = in.val[so[0]];
+		yy.val[1] = in.val[so[2]];
+		vst2q_u8(y + i, yy);
+		if (u == NULL || v == NULL)
+			continue;
+		vst1q_u8(u + i / 2, in.val[so[1]]);
+		vst1q_u8(v + i / 2, in.val[so[3]]);
+	}
+	convert_tail(s, conv_yuv422_to_i420_c, dst, src, 3, 1, bpp_420, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(yuv422_to_nv12, neon)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width & ~31u;
+	uint8x16x4_t in;
+	uint8x16x2_t yy, c;
+
+	for (i = 0; i < n; i += 32, sp += 64) {
+		in = vld4q_u8(sp);
+		yy.val[0] = in.val[so[0]];
+		yy.val[1] = in.val[so[2]];
+		vst2q_u8(y + i, yy);
+		if (uv == NULL)
+			continue;
+		c.val[dor[1]] = in.val[so[1]];
+		c.val[dor[2]] = in.val[so[3]];
+		vst2q_u8(uv + i, c);
+	}
+	convert_tail(s, conv_yuv422_to_nv12_c, dst, src, 2, 1, bpp_nv12, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(yuv422_to_rgb32, neon)
+{
+	const uint8_t *sp = src[0], *so = s->src_order;
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	uint8x8x4_t in;
+	uint8x16_t r, g, b;
+
+	for (i = 0; i < n; i += 16, sp += 32, d += 64) {
+		in = vld4_u8(sp);
+		yuv16_to_rgb_neon(s->m, in.val[so[0]], in.val[so[2]],
+				in.val[so[1]], in.val[so[3]], &r, &g, &b);
+		store_rgb32_neon(s->dst_order, d, r, g, b);
+	}
+	convert_tail(s, conv_yuv422_to_rgb32_c, dst, src, 1, 1, bpp_rgb32, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(i420_to_rgb32, neon)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[so[0]], *u = src[so[1]], *v = src[so[2]];
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	uint8x8x2_t yy;
+	uint8x16_t r, g, b;
+
+	for (i = 0; i < n; i += 16, d += 64) {
+		yy = vld2_u8(y + i);
+		yuv16_to_rgb_neon(s->m, yy.val[0], yy.val[1],
+				vld1_u8(u + i / 2), vld1_u8(v + i / 2), &r, &g, &b);
+		store_rgb32_neon(s->dst_order, d, r, g, b);
+	}
+	convert_tail(s, conv_i420_to_rgb32_c, dst, src, 1, 3, bpp_rgb32, bpp_420, n, width);
+}
+
+DEFINE_FUNCTION(nv12_to_rgb32, neon)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[0], *uv = src[1];
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	uint8x8x2_t yy, c;
+	uint8x16_t r, g, b;
+
+	for (i = 0; i < n; i += 16, d += 64) {
+		yy = vld2_u8(y + i);
+		c = vld2_u8(uv + i);
+		yuv16_to_rgb_neon(s->m, yy.val[0], yy.val[1],
+				c.val[so[1]], c.val[so[2]], &r, &g, &b);
+		store_rgb32_neon(s->dst_order, d, r, g, b);
+	}
+	convert_tail(s, conv_nv12_to_rgb32_c, dst, src, 1, 2, bpp_rgb32, bpp_nv12, n, width);
+}
+
+DEFINE_FUNCTION(rgb32_to_rgb32, neon)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	uint8x16x4_t in, out;
+
+	for (i = 0; i < n; i += 16, sp += 64, d += 64) {
+		in = vld4q_u8(sp);
+		out.val[dor[0]] = in.val[so[0]];
+		out.val[dor[1]] = in.val[so[1]];
+		out.val[dor[2]] = in.val[so[2]];
+		out.val[dor[3]] = s->src_alpha ? in.val[so[3]] : vdupq_n_u8(0xff);
+		vst4q_u8(d, out);
+	}
+	convert_tail(s, conv_rgb32_to_rgb32_c, dst, src, 1, 1, bpp_rgb32, bpp_rgb32, n, width);
+}
+
+static inline uint8x8_t
+rgb_to_comp_neon(uint16x8_t r, uint16x8_t g, uint16x8_t b,
+		int16_t cr, int16_t cg, int16_t cb, int16_t offs)
+{
+	int16x8_t t;
+	t = vaddq_s16(mulhi_neon(vreinterpretq_s16_u16(vshlq_n_u16(r, 7)), cr),
+			mulhi_neon(vreinterpretq_s16_u16(vshlq_n_u16(g, 7)), cg));
+	t = vaddq_s16(t, mulhi_neon(vreinterpretq_s16_u16(vshlq_n_u16(b, 7)), cb));
+	t = vshrq_n_s16(vaddq_s16(t, vdupq_n_s16(2)), 2);
+	return vqmovun_s16(vaddq_s16(t, vdupq_n_s16(offs)));
+}
+
+/* convert 16 RGB32 pixels to 16 Y and, when chroma is set, 8 U and V */
+static inline void
+rgb32_to_yuv_neon(const struct convert_step *s, const uint8_t *sp,
+		uint8_t *y, uint8x8_t *u, uint8x8_t *v, bool chroma)
+{
+	const struct convert_matrix *m = s->m;
+	const uint8_t *so = s->src_order;
+	uint8x16x4_t in = vld4q_u8(sp);
+	uint8x16_t r = in.val[so[0]], g = in.val[so[1]], b = in.val[so[2]];
+	uint16x8_t ra, ga, ba;
+
+	vst1q_u8(y, vcombine_u8(
+			rgb_to_comp_neon(vmovl_u8(vget_low_u8(r)), vmovl_u8(vget_low_u8(g)),
+				vmovl_u8(vget_low_u8(b)), m->yr, m->yg, m->yb, 16),
+			rgb_to_comp_neon(vmovl_u8(vget_high_u8(r)), vmovl_u8(vget_high_u8(g)),
+				vmovl_u8(vget_high_u8(b)), m->yr, m->yg, m->yb, 16)));
+	if (!chroma)
+		return;
+
+	/* average of pixel pairs, (a + b + 1) >> 1 */
+	ra = vrshrq_n_u16(vpaddlq_u8(r), 1);
+	ga = vrshrq_n_u16(vpaddlq_u8(g), 1);
+	ba = vrshrq_n_u16(vpaddlq_u8(b), 1);
+	*u = rgb_to_comp_neon(ra, ga, ba, m->ur, m->ug, m->ub, 128);
+	*v = rgb_to_comp_neon(ra, ga, ba, m->vr, m->vg, m->vb, 128);
+}
+
+DEFINE_FUNCTION(rgb32_to_i420, neon)
+{
+	const uint8_t *sp = src[0], *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width & ~15u;
+	bool chroma = u != NULL && v != NULL;
+	uint8x8_t uc, vc;
+
+	for (i = 0; i < n; i += 16, sp += 64) {
+		rgb32_to_yuv_neon(s, sp, y + i, &uc, &vc, chroma);
+		if (!chroma)
+			continue;
+		vst1_u8(u + i / 2, uc);
+		vst1_u8(v + i / 2, vc);
+	}
+	convert_tail(s, conv_rgb32_to_i420_c, dst, src, 3, 1, bpp_420, bpp_rgb32, n, width);
+}
+
+DEFINE_FUNCTION(rgb32_to_nv12, neon)
+{
+	const uint8_t *sp = src[0], *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width & ~15u;
+	bool chroma = uv != NULL;
+	uint8x8x2_t c;
+
+	for (i = 0; i < n; i += 16, sp += 64) {
+		rgb32_to_yuv_neon(s, sp, y + i, &c.val[dor[1]], &c.val[dor[2]], chroma);
+		if (!chroma)
+			continue;
+		vst2_u8(uv + i, c);
+	}
+	convert_tail(s, conv_rgb32_to_nv12_c, dst, src, 2, 1, bpp_nv12, bpp_rgb32, n, width);
+}
+
+DEFINE_SCALE_FUNCTION(v, neon)
+{
+	const uint8_t *s0 = src0, *s1 = src1;
+	uint8_t *d = dst;
+	uint32_t i, n = n_bytes & ~15u;
+	const uint16_t f0 = 256 - frac, f1 = frac;
+	uint8x16_t a, b;
+	uint16x8_t lo, hi;
+
+	for (i = 0; i < n; i += 16) {
+		a = vld1q_u8(s0 + i);
+		b = vld1q_u8(s1 + i);
+		lo = vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_low_u8(a)), f0),
+				vmovl_u8(vget_low_u8(b)), f1);
+		hi = vmlaq_n_u16(vmulq_n_u16(vmovl_u8(vget_high_u8(a)), f0),
+				vmovl_u8(vget_high_u8(b)), f1);
+		vst1q_u8(d + i, vcombine_u8(
+				vshrn_n_u16(vaddq_u16(lo, vdupq_n_u16(128)), 8),
+				vshrn_n_u16(vaddq_u16(hi, vdupq_n_u16(128)), 8)));
+	}
+	if (n < n_bytes)
+		scale_v_c(d + n, s0 + n, s1 + n, frac, n_bytes - n);
+}
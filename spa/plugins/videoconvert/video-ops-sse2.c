@@ -0,0 +1,425 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "video-ops.h"
+
+#include <emmintrin.h>
+
+static inline void
+yuv_to_rgb_sse2(const struct convert_matrix *m, __m128i y, __m128i u, __m128i v,
+		__m128i *r, __m128i *g, __m128i *b)
+{
+	const __m128i two = _mm_set1_epi16(2);
+	__m128i c, d, e, yy;
+
+	c = _mm_slli_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), 6);
+	d = _mm_slli_epi16(_mm_sub_epi16(u, _mm_set1_epi16(128)), 6);
+	e = _mm_slli_epi16(_mm_sub_epi16(v, _mm_set1_epi16(128)), 6);
+
+	yy = _mm_add_epi16(_mm_mulhi_epi16(c, _mm_set1_epi16(m->y)), two);
+	*r = _mm_srai_epi16(_mm_add_epi16(yy,
+				_mm_mulhi_epi16(e, _mm_set1_epi16(m->rv))), 2);
+	*g = _mm_srai_epi16(_mm_add_epi16(yy,
+				_mm_add_epi16(_mm_mulhi_epi16(d, _mm_set1_epi16(m->gu)),
+					_mm_mulhi_epi16(e, _mm_set1_epi16(m->gv)))), 2);
+	*b = _mm_srai_epi16(_mm_add_epi16(yy,
+				_mm_mulhi_epi16(d, _mm_set1_epi16(m->bu))), 2);
+}
+
+/* convert 16 pixels of 16 bits Y, U and V to 16 bytes R, G and B */
+static inline void
+yuv16_to_rgb_sse2(const struct convert_matrix *m,
+		__m128i y0, __m128i u0, __m128i v0,
+		__m128i y1, __m128i u1, __m128i v1,
+		__m128i *r, __m128i *g, __m128i *b)
+{
+	__m128i r0, g0, b0, r1, g1, b1;
+	yuv_to_rgb_sse2(m, y0, u0, v0, &r0, &g0, &b0);
+	yuv_to_rgb_sse2(m, y1, u1, v1, &r1, &g1, &b1);
+	*r = _mm_packus_epi16(r0, r1);
+	*g = _mm_packus_epi16(g0, g1);
+	*b = _mm_packus_epi16(b0, b1);
+}
+
+static inline void
+store_rgb32_sse2(const uint8_t *dor, uint8_t *d, __m128i r, __m128i g, __m128i b, __m128i a)
+{
+	__m128i c[4], t0, t1, t2, t3;
+
+	c[dor[0]] = r;
+	c[dor[1]] = g;
+	c[dor[2]] = b;
+	c[dor[3]] = a;
+
+	t0 = _mm_unpacklo_epi8(c[0], c[1]);
+	t1 = _mm_unpackhi_epi8(c[0], c[1]);
+	t2 = _mm_unpacklo_epi8(c[2], c[3]);
+	t3 = _mm_unpackhi_epi8(c[2], c[3]);
+
+	_mm_storeu_si128((__m128i*)(d + 0), _mm_unpacklo_epi16(t0, t2));
+	_mm_storeu_si128((__m128i*)(d + 16), _mm_unpackhi_epi16(t0, t2));
+	_mm_storeu_si128((__m128i*)(d + 32), _mm_unpacklo_epi16(t1, t3));
+	_mm_storeu_si128((__m128i*)(d + 48), _mm_unpackhi_epi16(t1, t3));
+}
+
+/* the remaining pixels are done with the C version */
+static inline void
+convert_tail(const struct convert_step *s, convert_func_t func,
+		void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_dst, uint32_t n_src,
+		const uint32_t *dst_bpp, const uint32_t *src_bpp,
+		uint32_t done, uint32_t width)
+{
+	void *d[VIDEO_MAX_PLANES];
+	const void *sp[VIDEO_MAX_PLANES];
+	uint32_t i;
+
+	if (done >= width)
+		return;
+	for (i = 0; i < n_dst; i++)
+		d[i] = dst[i] ? SPA_PTROFF(dst[i], done * dst_bpp[i] / 2, void) : NULL;
+	for (i = 0; i < n_src; i++)
+		sp[i] = SPA_PTROFF(src[i], done * src_bpp[i] / 2, void);
+	func(s, d, sp, width - done);
+}
+
+/* bytes per 2 pixels for each plane */
+static const uint32_t bpp_422[] = { 4 };
+static const uint32_t bpp_420[] = { 2, 1, 1 };
+static const uint32_t bpp_nv12[] = { 2, 2 };
+static const uint32_t bpp_rgb32[] = { 8 };
+
+/* extract 8 Y values and 8 chroma values as 16 bits from 8 bytes of
+ * packed 4:2:2 */
+#define SPLIT_422(v,ys,cs,y,c)						\
+	y = _mm_and_si128(_mm_srl_epi16(v, ys), mask);			\
+	c = _mm_and_si128(_mm_srl_epi16(v, cs), mask);
+
+DEFINE_FUNCTION(yuv422_to_i420, sse2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width & ~15u;
+	const __m128i mask = _mm_set1_epi16(0xff), mask32 = _mm_set1_epi32(0xffff);
+	const __m128i ys = _mm_cvtsi32_si128((so[0] & 1) * 8);
+	const __m128i cs = _mm_cvtsi32_si128((so[1] & 1) * 8);
+	const bool u_first = so[1] < so[3];
+	__m128i a, b, ya, yb, ca, cb, c0, c1;
+
+	for (i = 0; i < n; i += 16, sp += 32) {
+		a = _mm_loadu_si128((const __m128i*)(sp + 0));
+		b = _mm_loadu_si128((const __m128i*)(sp + 16));
+		SPLIT_422(a, ys, cs, ya, ca);
+		SPLIT_422(b, ys, cs, yb, cb);
+		_mm_storeu_si128((__m128i*)(y + i), _mm_packus_epi16(ya, yb));
+
+		if (u == NULL || v == NULL)
+			continue;
+
+		c0 = _mm_packs_epi32(_mm_and_si128(ca, mask32), _mm_and_si128(cb, mask32));
+		c1 = _mm_packs_epi32(_mm_srli_epi32(ca, 16), _mm_srli_epi32(cb, 16));
+		c0 = _mm_packus_epi16(c0, c0);
+		c1 = _mm_packus_epi16(c1, c1);
+		_mm_storel_epi64((__m128i*)(u + i / 2), u_first ? c0 : c1);
+		_mm_storel_epi64((__m128i*)(v + i / 2), u_first ? c1 : c0);
+	}
+	convert_tail(s, conv_yuv422_to_i420_c, dst, src, 3, 1, bpp_420, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(yuv422_to_nv12, sse2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width & ~15u;
+	const __m128i mask = _mm_set1_epi16(0xff);
+	const __m128i ys = _mm_cvtsi32_si128((so[0] & 1) * 8);
+	const __m128i cs = _mm_cvtsi32_si128((so[1] & 1) * 8);
+	const bool swap = (so[1] < so[3]) != (dor[1] < dor[2]);
+	__m128i a, b, ya, yb, ca, cb, c0, c1;
+
+	for (i = 0; i < n; i += 16, sp += 32) {
+		a = _mm_loadu_si128((const __m128i*)(sp + 0));
+		b = _mm_loadu_si128((const __m128i*)(sp + 16));
+		SPLIT_422(a, ys, cs, ya, ca);
+		SPLIT_422(b, ys, cs, yb, cb);
+		_mm_storeu_si128((__m128i*)(y + i), _mm_packus_epi16(ya, yb));
+
+		if (uv == NULL)
+			continue;
+
+		if (swap) {
+			c0 = _mm_or_si128(_mm_srli_epi32(ca, 16), _mm_slli_epi32(ca, 16));
+			c1 = _mm_or_si128(_mm_srli_epi32(cb, 16), _mm_slli_epi32(cb, 16));
+		} else {
+			c0 = ca;
+			c1 = cb;
+		}
+		_mm_storeu_si128((__m128i*)(uv + i), _mm_packus_epi16(c0, c1));
+	}
+	convert_tail(s, conv_yuv422_to_nv12_c, dst, src, 2, 1, bpp_nv12, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(yuv422_to_rgb32, sse2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order;
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	const __m128i mask = _mm_set1_epi16(0xff), alpha = _mm_set1_epi8(-1);
+	const __m128i ys = _mm_cvtsi32_si128((so[0] & 1) * 8);
+	const __m128i cs = _mm_cvtsi32_si128((so[1] & 1) * 8);
+	const bool u_first = so[1] < so[3];
+	__m128i a, b, ya, yb, ca, cb, ua, va, ub, vb, r, g, bl;
+
+	for (i = 0; i < n; i += 16, sp += 32, d += 64) {
+		a = _mm_loadu_si128((const __m128i*)(sp + 0));
+		b = _mm_loadu_si128((const __m128i*)(sp + 16));
+		SPLIT_422(a, ys, cs, ya, ca);
+		SPLIT_422(b, ys, cs, yb, cb);
+
+		if (u_first) {
+			ua = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ca, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+			va = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ca, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+			ub = _mm_shufflehi_epi16(_mm_shufflelo_epi16(cb, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+			vb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(cb, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+		} else {
+			va = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ca, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+			ua = _mm_shufflehi_epi16(_mm_shufflelo_epi16(ca, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+			vb = _mm_shufflehi_epi16(_mm_shufflelo_epi16(cb, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0));
+			ub = _mm_shufflehi_epi16(_mm_shufflelo_epi16(cb, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1));
+		}
+		yuv16_to_rgb_sse2(s->m, ya, ua, va, yb, ub, vb, &r, &g, &bl);
+		store_rgb32_sse2(s->dst_order, d, r, g, bl, alpha);
+	}
+	convert_tail(s, conv_yuv422_to_rgb32_c, dst, src, 1, 1, bpp_rgb32, bpp_422, n, width);
+}
+
+DEFINE_FUNCTION(i420_to_rgb32, sse2)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[so[0]], *u = src[so[1]], *v = src[so[2]];
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	const __m128i zero = _mm_setzero_si128(), alpha = _mm_set1_epi8(-1);
+	__m128i yv, uv8, vv8, u16, v16, r, g, b;
+
+	for (i = 0; i < n; i += 16, d += 64) {
+		yv = _mm_loadu_si128((const __m128i*)(y + i));
+		uv8 = _mm_loadl_epi64((const __m128i*)(u + i / 2));
+		vv8 = _mm_loadl_epi64((const __m128i*)(v + i / 2));
+		u16 = _mm_unpacklo_epi8(uv8, zero);
+		v16 = _mm_unpacklo_epi8(vv8, zero);
+
+		yuv16_to_rgb_sse2(s->m,
+				_mm_unpacklo_epi8(yv, zero),
+				_mm_unpacklo_epi16(u16, u16),
+				_mm_unpacklo_epi16(v16, v16),
+				_mm_unpackhi_epi8(yv, zero),
+				_mm_unpackhi_epi16(u16, u16),
+				_mm_unpackhi_epi16(v16, v16),
+				&r, &g, &b);
+		store_rgb32_sse2(s->dst_order, d, r, g, b, alpha);
+	}
+	convert_tail(s, conv_i420_to_rgb32_c, dst, src, 1, 3, bpp_rgb32, bpp_420, n, width);
+}
+
+DEFINE_FUNCTION(nv12_to_rgb32, sse2)
+{
+	const uint8_t *so = s->src_order;
+	const uint8_t *y = src[0], *uv = src[1];
+	uint8_t *d = dst[0];
+	uint32_t i, n = width & ~15u;
+	const __m128i zero = _mm_setzero_si128(), alpha = _mm_set1_epi8(-1);
+	const __m128i mask = _mm_set1_epi16(0xff);
+	__m128i yv, c, c0, c1, u16, v16, r, g, b;
+
+	for (i = 0; i < n; i += 16, d += 64) {
+		yv = _mm_loadu_si128((const __m128i*)(y + i));
+		c = _mm_loadu_si128((const __m128i*)(uv + i));
+		c0 = _mm_and_si128(c, mask);
+		c1 = _mm_srli_epi16(c, 8);
+		u16 = so[1] == 0 ? c0 : c1;
+		v16 = so[1] == 0 ? c1 : c0;
+
+		yuv16_to_rgb_sse2(s->m,
+				_mm_unpacklo_epi8(yv, zero),
+				_mm_unpacklo_epi16(u16, u16),
+				_mm_unpacklo_epi16(v16, v16),
+				_mm_unpackhi_epi8(yv, zero),
+				_mm_unpackhi_epi16(u16, u16),
+				_mm_unpackhi_epi16(v16, v16),
+				&r, &g, &b);
+		store_rgb32_sse2(s->dst_order, d, r, g, b, alpha);
+	}
+	convert_tail(s, conv_nv12_to_rgb32_c, dst, src, 1, 2, bpp_rgb32, bpp_nv12, n, width);
+}
+
+DEFINE_FUNCTION(rgb32_to_rgb32, sse2)
+{
+	const uint8_t *sp = src[0], *so = s->src_order, *dor = s->dst_order;
+	uint8_t *d = dst[0];
+	uint32_t i, j, n = width & ~3u, nc = s->src_alpha ? 4 : 3;
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i ss[4], ds[4], alpha, in, out;
+
+	for (j = 0; j < 4; j++) {
+		ss[j] = _mm_cvtsi32_si128(so[j] * 8);
+		ds[j] = _mm_cvtsi32_si128(dor[j] * 8);
+	}
+	alpha = s->src_alpha ? _mm_setzero_si128() : _mm_sll_epi32(mask, ds[3]);
+
+	for (i = 0; i < n; i += 4, sp += 16, d += 16) {
+		in = _mm_loadu_si128((const __m128i*)sp);
+		out = alpha;
+		for (j = 0; j < nc; j++)
+			out = _mm_or_si128(out, _mm_sll_epi32(
+					_mm_and_si128(_mm_srl_epi32(in, ss[j]), mask), ds[j]));
+		_mm_storeu_si128((__m128i*)d, out);
+	}
+	convert_tail(s, conv_rgb32_to_rgb32_c, dst, src, 1, 1, bpp_rgb32, bpp_rgb32, n, width);
+}
+
+/* get 8 components at byte offset sh of 8 RGB32 pixels as 16 bits */
+#define GET_RGB32(a,b,sh)	_mm_packs_epi32(					\
+		_mm_and_si128(_mm_srl_epi32(a, sh), mask),				\
+		_mm_and_si128(_mm_srl_epi32(b, sh), mask))
+
+/* average pairs of 16 bit components */
+#define AVG_PAIRS(a,b)		_mm_packs_epi32(						\
+		_mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_and_si128(a, mask16),	\
+				_mm_srli_epi32(a, 16)), one), 1),				\
+		_mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_and_si128(b, mask16),	\
+				_mm_srli_epi32(b, 16)), one), 1))
+
+static inline __m128i
+rgb_to_comp_sse2(__m128i r, __m128i g, __m128i b, int16_t cr, int16_t cg, int16_t cb, int16_t offs)
+{
+	__m128i t;
+	t = _mm_add_epi16(_mm_mulhi_epi16(_mm_slli_epi16(r, 7), _mm_set1_epi16(cr)),
+			_mm_mulhi_epi16(_mm_slli_epi16(g, 7), _mm_set1_epi16(cg)));
+	t = _mm_add_epi16(t, _mm_mulhi_epi16(_mm_slli_epi16(b, 7), _mm_set1_epi16(cb)));
+	t = _mm_srai_epi16(_mm_add_epi16(t, _mm_set1_epi16(2)), 2);
+	return _mm_add_epi16(t, _mm_set1_epi16(offs));
+}
+
+static inline void
+rgb32_to_yuv_sse2(const struct convert_step *s, const uint8_t *sp,
+		uint8_t *y, __m128i *u, __m128i *v, bool chroma)
+{
+	const struct convert_matrix *m = s->m;
+	const uint8_t *so = s->src_order;
+	const __m128i mask = _mm_set1_epi32(0xff), mask16 = _mm_set1_epi32(0xffff);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i sr = _mm_cvtsi32_si128(so[0] * 8);
+	const __m128i sg = _mm_cvtsi32_si128(so[1] * 8);
+	const __m128i sb = _mm_cvtsi32_si128(so[2] * 8);
+	__m128i a0, a1, a2, a3, r0, g0, b0, r1, g1, b1;
+
+	a0 = _mm_loadu_si128((const __m128i*)(sp + 0));
+	a1 = _mm_loadu_si128((const __m128i*)(sp + 16));
+	a2 = _mm_loadu_si128((const __m128i*)(sp + 32));
+	a3 = _mm_loadu_si128((const __m128i*)(sp + 48));
+
+	r0 = GET_RGB32(a0, a1, sr);
+	g0 = GET_RGB32(a0, a1, sg);
+	b0 = GET_RGB32(a0, a1, sb);
+	r1 = GET_RGB32(a2, a3, sr);
+	g1 = GET_RGB32(a2, a3, sg);
+	b1 = GET_RGB32(a2, a3, sb);
+
+	_mm_storeu_si128((__m128i*)y, _mm_packus_epi16(
+				rgb_to_comp_sse2(r0, g0, b0, m->yr, m->yg, m->yb, 16),
+				rgb_to_comp_sse2(r1, g1, b1, m->yr, m->yg, m->yb, 16)));
+
+	if (!chroma)
+		return;
+
+	r0 = AVG_PAIRS(r0, r1);
+	g0 = AVG_PAIRS(g0, g1);
+	b0 = AVG_PAIRS(b0, b1);
+	*u = rgb_to_comp_sse2(r0, g0, b0, m->ur, m->ug, m->ub, 128);
+	*v = rgb_to_comp_sse2(r0, g0, b0, m->vr, m->vg, m->vb, 128);
+}
+
+DEFINE_FUNCTION(rgb32_to_i420, sse2)
+{
+	const uint8_t *sp = src[0], *dor = s->dst_order;
+	uint8_t *y = dst[dor[0]], *u = dst[dor[1]], *v = dst[dor[2]];
+	uint32_t i, n = width & ~15u;
+	bool chroma = u != NULL && v != NULL;
+	__m128i uc, vc;
+
+	for (i = 0; i < n; i += 16, sp += 64) {
+		rgb32_to_yuv_sse2(s, sp, y + i, &uc, &vc, chroma);
+		if (!chroma)
+			continue;
+		_mm_storel_epi64((__m128i*)(u + i / 2), _mm_packus_epi16(uc, uc));
+		_mm_storel_epi64((__m128i*)(v + i / 2), _mm_packus_epi16(vc, vc));
+	}
+	convert_tail(s, conv_rgb32_to_i420_c, dst, src, 3, 1, bpp_420, bpp_rgb32, n, width);
+}
+
+DEFINE_FUNCTION(rgb32_to_nv12, sse2)
+{
+	const uint8_t *sp = src[0], *dor = s->dst_order;
+	uint8_t *y = dst[0], *uv = dst[1];
+	uint32_t i, n = width & ~15u;
+	bool chroma = uv != NULL;
+	__m128i uc, vc;
+
+	for (i = 0; i < n; i += 16, sp += 64) {
+		rgb32_to_yuv_sse2(s, sp, y + i, &uc, &vc, chroma);
+		if (!chroma)
+			continue;
+		uc = _mm_packus_epi16(uc, uc);
+		vc = _mm_packus_epi16(vc, vc);
+		_mm_storeu_si128((__m128i*)(uv + i), dor[1] == 0 ?
+				_mm_unpacklo_epi8(uc, vc) : _mm_unpacklo_epi8(vc, uc));
+	}
+	convert_tail(s, conv_rgb32_to_nv12_c, dst, src, 2, 1, bpp_nv12, bpp_rgb32, n, width);
+}
+
+DEFINE_SCALE_FUNCTION(v, sse2)
+{
+	const uint8_t *s0 = src0, *s1 = src1;
+	uint8_t *d = dst;
+	uint32_t i, n = n_bytes & ~15u;
+	const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(128);
+	const __m128i f0 = _mm_set1_epi16(256 - frac), f1 = _mm_set1_epi16(frac);
+	__m128i a, b, lo, hi;
+
+	for (i = 0; i < n; i += 16) {
+		a = _mm_loadu_si128((const __m128i*)(s0 + i));
+		b = _mm_loadu_si128((const __m128i*)(s1 + i));
+		lo = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), f0),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), f1)), round);
+		hi = _mm_add_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), f0),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), f1)), round);
+		_mm_storeu_si128((__m128i*)(d + i), _mm_packus_epi16(
+					_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+	if (n < n_bytes)
+		scale_v_c(d + n, s0 + n, s1 + n, frac, n_bytes - n);
+}
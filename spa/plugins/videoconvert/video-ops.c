@@ -0,0 +1,574 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+#include <spa/param/video/format.h>
+
+#include "video-ops.h"
+
+#define MAKE_FMT(fmt,layout,family,planes,ps0,ps1,ps2,ws,hs,o0,o1,o2,o3)	\
+	{ SPA_VIDEO_FORMAT_ ##fmt, LAYOUT_ ##layout, FAMILY_ ##family, planes,	\
+	  { ps0, ps1, ps2, }, { 0, ws, ws, }, { 0, hs, hs, }, { o0, o1, o2, o3 } }
+
+static const struct format_info format_table[] =
+{
+	MAKE_FMT(I420, PLANAR_420,	YUV, 3, 1, 1, 1, 1, 1, 0, 1, 2, 0),
+	MAKE_FMT(YV12, PLANAR_420,	YUV, 3, 1, 1, 1, 1, 1, 0, 2, 1, 0),
+	MAKE_FMT(NV12, SEMI_PLANAR_420,	YUV, 2, 1, 2, 0, 1, 1, 0, 0, 1, 0),
+	MAKE_FMT(NV21, SEMI_PLANAR_420,	YUV, 2, 1, 2, 0, 1, 1, 0, 1, 0, 0),
+	/* packed 4:2:2 is handled as macropixels of 2 pixels */
+	{ SPA_VIDEO_FORMAT_YUY2, LAYOUT_PACKED_422, FAMILY_YUV, 1, { 4, }, { 1, }, { 0, }, { 0, 1, 2, 3 } },
+	{ SPA_VIDEO_FORMAT_UYVY, LAYOUT_PACKED_422, FAMILY_YUV, 1, { 4, }, { 1, }, { 0, }, { 1, 0, 3, 2 } },
+	{ SPA_VIDEO_FORMAT_YVYU, LAYOUT_PACKED_422, FAMILY_YUV, 1, { 4, }, { 1, }, { 0, }, { 0, 3, 2, 1 } },
+	{ SPA_VIDEO_FORMAT_VYUY, LAYOUT_PACKED_422, FAMILY_YUV, 1, { 4, }, { 1, }, { 0, }, { 1, 2, 3, 0 } },
+	MAKE_FMT(AYUV, PACKED_444,	YUV, 1, 4, 0, 0, 0, 0, 1, 2, 3, 0),
+	MAKE_FMT(RGBA, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 0, 1, 2, 3),
+	MAKE_FMT(BGRA, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 2, 1, 0, 3),
+	MAKE_FMT(ARGB, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 1, 2, 3, 0),
+	MAKE_FMT(ABGR, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 3, 2, 1, 0),
+	MAKE_FMT(RGBx, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 0, 1, 2, 3),
+	MAKE_FMT(BGRx, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 2, 1, 0, 3),
+	MAKE_FMT(xRGB, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 1, 2, 3, 0),
+	MAKE_FMT(xBGR, RGB32,		RGB, 1, 4, 0, 0, 0, 0, 3, 2, 1, 0),
+	MAKE_FMT(RGB, RGB24,		RGB, 1, 3, 0, 0, 0, 0, 0, 1, 2, 0),
+	MAKE_FMT(BGR, RGB24,		RGB, 1, 3, 0, 0, 0, 0, 2, 1, 0, 0),
+};
+
+const uint32_t video_formats[] = {
+	SPA_VIDEO_FORMAT_I420,
+	SPA_VIDEO_FORMAT_YV12,
+	SPA_VIDEO_FORMAT_NV12,
+	SPA_VIDEO_FORMAT_NV21,
+	SPA_VIDEO_FORMAT_YUY2,
+	SPA_VIDEO_FORMAT_UYVY,
+	SPA_VIDEO_FORMAT_YVYU,
+	SPA_VIDEO_FORMAT_VYUY,
+	SPA_VIDEO_FORMAT_AYUV,
+	SPA_VIDEO_FORMAT_RGBA,
+	SPA_VIDEO_FORMAT_BGRA,
+	SPA_VIDEO_FORMAT_ARGB,
+	SPA_VIDEO_FORMAT_ABGR,
+	SPA_VIDEO_FORMAT_RGBx,
+	SPA_VIDEO_FORMAT_BGRx,
+	SPA_VIDEO_FORMAT_xRGB,
+	SPA_VIDEO_FORMAT_xBGR,
+	SPA_VIDEO_FORMAT_RGB,
+	SPA_VIDEO_FORMAT_BGR,
+};
+const uint32_t n_video_formats = SPA_N_ELEMENTS(video_formats);
+
+const struct format_info *video_format_info(uint32_t format)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(format_table, f) {
+		if (f->format == format)
+			return f;
+	}
+	return NULL;
+}
+
+static inline bool format_has_alpha(uint32_t format)
+{
+	switch (format) {
+	case SPA_VIDEO_FORMAT_AYUV:
+	case SPA_VIDEO_FORMAT_RGBA:
+	case SPA_VIDEO_FORMAT_BGRA:
+	case SPA_VIDEO_FORMAT_ARGB:
+	case SPA_VIDEO_FORMAT_ABGR:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* YUV -> RGB coefficients are scaled by 256 * 16, RGB -> YUV by 256 * 8,
+ * both for limited range YUV */
+static const struct convert_matrix matrix_bt601 = {
+	4768, 6544, -1600, -3328, 8256,
+	528, 1032, 200, -304, -592, 896, 896, -752, -144,
+};
+
+static const struct convert_matrix matrix_bt709 = {
+	4768, 7344, -880, -2176, 8656,
+	376, 1256, 128, -208, -696, 896, 896, -816, -80,
+};
+
+struct conv_info {
+	uint32_t src_layout;
+	uint32_t dst_layout;
+
+	convert_func_t process;
+	const char *name;
+
+	uint32_t cpu_flags;
+};
+
+#define MAKE(lay1,lay2,func,...) \
+	{ LAYOUT_ ##lay1, LAYOUT_ ##lay2, func, #func , __VA_ARGS__ }
+
+static struct conv_info conv_table[] =
+{
+	/* packed 4:2:2 */
+	MAKE(PACKED_422, PACKED_422, conv_yuv422_to_yuv422_c),
+#if defined (HAVE_NEON)
+	MAKE(PACKED_422, PLANAR_420, conv_yuv422_to_i420_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(PACKED_422, PLANAR_420, conv_yuv422_to_i420_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(PACKED_422, PLANAR_420, conv_yuv422_to_i420_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(PACKED_422, PLANAR_420, conv_yuv422_to_i420_c),
+#if defined (HAVE_NEON)
+	MAKE(PACKED_422, SEMI_PLANAR_420, conv_yuv422_to_nv12_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(PACKED_422, SEMI_PLANAR_420, conv_yuv422_to_nv12_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(PACKED_422, SEMI_PLANAR_420, conv_yuv422_to_nv12_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(PACKED_422, SEMI_PLANAR_420, conv_yuv422_to_nv12_c),
+	MAKE(PACKED_422, PACKED_444, conv_yuv422_to_ayuv_c),
+#if defined (HAVE_NEON)
+	MAKE(PACKED_422, RGB32, conv_yuv422_to_rgb32_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(PACKED_422, RGB32, conv_yuv422_to_rgb32_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(PACKED_422, RGB32, conv_yuv422_to_rgb32_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(PACKED_422, RGB32, conv_yuv422_to_rgb32_c),
+
+	/* planar 4:2:0 */
+	MAKE(PLANAR_420, PLANAR_420, conv_i420_to_i420_c),
+	MAKE(PLANAR_420, SEMI_PLANAR_420, conv_i420_to_nv12_c),
+	MAKE(PLANAR_420, PACKED_422, conv_i420_to_yuv422_c),
+	MAKE(PLANAR_420, PACKED_444, conv_i420_to_ayuv_c),
+#if defined (HAVE_NEON)
+	MAKE(PLANAR_420, RGB32, conv_i420_to_rgb32_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(PLANAR_420, RGB32, conv_i420_to_rgb32_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(PLANAR_420, RGB32, conv_i420_to_rgb32_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(PLANAR_420, RGB32, conv_i420_to_rgb32_c),
+
+	/* semi planar 4:2:0 */
+	MAKE(SEMI_PLANAR_420, SEMI_PLANAR_420, conv_nv12_to_nv12_c),
+	MAKE(SEMI_PLANAR_420, PLANAR_420, conv_nv12_to_i420_c),
+	MAKE(SEMI_PLANAR_420, PACKED_422, conv_nv12_to_yuv422_c),
+	MAKE(SEMI_PLANAR_420, PACKED_444, conv_nv12_to_ayuv_c),
+#if defined (HAVE_NEON)
+	MAKE(SEMI_PLANAR_420, RGB32, conv_nv12_to_rgb32_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(SEMI_PLANAR_420, RGB32, conv_nv12_to_rgb32_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(SEMI_PLANAR_420, RGB32, conv_nv12_to_rgb32_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(SEMI_PLANAR_420, RGB32, conv_nv12_to_rgb32_c),
+
+	/* packed 4:4:4 */
+	MAKE(PACKED_444, PACKED_444, conv_ayuv_to_ayuv_c),
+	MAKE(PACKED_444, PACKED_422, conv_ayuv_to_yuv422_c),
+	MAKE(PACKED_444, PLANAR_420, conv_ayuv_to_i420_c),
+	MAKE(PACKED_444, SEMI_PLANAR_420, conv_ayuv_to_nv12_c),
+	MAKE(PACKED_444, RGB32, conv_ayuv_to_rgb32_c),
+
+	/* RGB */
+#if defined (HAVE_NEON)
+	MAKE(RGB32, RGB32, conv_rgb32_to_rgb32_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(RGB32, RGB32, conv_rgb32_to_rgb32_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(RGB32, RGB32, conv_rgb32_to_rgb32_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(RGB32, RGB32, conv_rgb32_to_rgb32_c),
+	MAKE(RGB32, RGB24, conv_rgb32_to_rgb24_c),
+	MAKE(RGB24, RGB32, conv_rgb24_to_rgb32_c),
+	MAKE(RGB24, RGB24, conv_rgb24_to_rgb24_c),
+	MAKE(RGB32, PACKED_422, conv_rgb32_to_yuv422_c),
+#if defined (HAVE_NEON)
+	MAKE(RGB32, PLANAR_420, conv_rgb32_to_i420_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(RGB32, PLANAR_420, conv_rgb32_to_i420_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(RGB32, PLANAR_420, conv_rgb32_to_i420_c),
+#if defined (HAVE_NEON)
+	MAKE(RGB32, SEMI_PLANAR_420, conv_rgb32_to_nv12_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(RGB32, SEMI_PLANAR_420, conv_rgb32_to_nv12_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(RGB32, SEMI_PLANAR_420, conv_rgb32_to_nv12_c),
+	MAKE(RGB32, PACKED_444, conv_rgb32_to_ayuv_c),
+};
+#undef MAKE
+
+#define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
+
+static const struct conv_info *find_conv_info(uint32_t src_layout, uint32_t dst_layout,
+		uint32_t cpu_flags)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(conv_table, c) {
+		if (c->src_layout == src_layout &&
+		    c->dst_layout == dst_layout &&
+		    MATCH_CPU_FLAGS(c->cpu_flags, cpu_flags))
+			return c;
+	}
+	return NULL;
+}
+
+struct scale_info {
+	void (*scale_v) (void * SPA_RESTRICT dst, const void * SPA_RESTRICT src0,
+			const void * SPA_RESTRICT src1, uint32_t frac, uint32_t n_bytes);
+	const char *name;
+
+	uint32_t cpu_flags;
+};
+
+#define MAKE(func,...) \
+	{ func, #func, __VA_ARGS__ }
+
+static const struct scale_info scale_table[] =
+{
+#if defined (HAVE_NEON)
+	MAKE(scale_v_neon, SPA_CPU_FLAG_NEON),
+#endif
+#if defined (HAVE_AVX2)
+	MAKE(scale_v_avx2, SPA_CPU_FLAG_AVX2),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(scale_v_sse2, SPA_CPU_FLAG_SSE2),
+#endif
+	MAKE(scale_v_c),
+};
+#undef MAKE
+
+static const struct scale_info *find_scale_info(uint32_t cpu_flags)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(scale_table, s) {
+		if (MATCH_CPU_FLAGS(s->cpu_flags, cpu_flags))
+			return s;
+	}
+	return NULL;
+}
+
+static int init_step(struct convert *conv, struct convert_step *step,
+		const struct format_info *src, const struct format_info *dst)
+{
+	const struct conv_info *info;
+
+	info = find_conv_info(src->layout, dst->layout, conv->cpu_flags);
+	if (info == NULL)
+		return -ENOTSUP;
+
+	step->func = info->process;
+	step->name = info->name;
+	step->cpu_flags = info->cpu_flags;
+	step->m = conv->color_matrix == SPA_VIDEO_COLOR_MATRIX_BT709 ?
+		&matrix_bt709 : &matrix_bt601;
+	step->src_alpha = format_has_alpha(src->format);
+	memcpy(step->src_order, src->order, sizeof(step->src_order));
+	memcpy(step->dst_order, dst->order, sizeof(step->dst_order));
+	return 0;
+}
+
+static inline void get_rows(const struct format_info *info, const struct video_frame *frame,
+		uint32_t y, bool write, void *rows[])
+{
+	uint32_t i;
+	for (i = 0; i < info->n_planes; i++) {
+		if (write && (y & ((1u << info->hsub[i]) - 1)))
+			rows[i] = NULL;
+		else
+			rows[i] = SPA_PTROFF(frame->data[i],
+					(int32_t)(y >> info->hsub[i]) * frame->stride[i], void);
+	}
+}
+
+static inline void get_slice(struct convert *conv, uint32_t slice, uint32_t n_slices,
+		uint32_t *start, uint32_t *end)
+{
+	uint32_t lines = conv->dst_height, size;
+
+	size = SPA_ROUND_UP((lines + n_slices - 1) / n_slices, conv->slice_align);
+	*start = SPA_MIN(slice * size, lines);
+	*end = SPA_MIN(*start + size, lines);
+}
+
+static void impl_convert_copy(struct convert *conv, const struct video_frame *dst,
+		const struct video_frame *src, uint32_t slice, uint32_t n_slices)
+{
+	const struct format_info *info = conv->dst_info;
+	uint32_t y, i, start, end, bytes;
+
+	get_slice(conv, slice, n_slices, &start, &end);
+
+	for (i = 0; i < info->n_planes; i++) {
+		uint32_t s = start >> info->hsub[i], e = (end + (1u << info->hsub[i]) - 1) >> info->hsub[i];
+		bytes = ((conv->dst_width + (1u << info->wsub[i]) - 1) >> info->wsub[i]) * info->pstride[i];
+		for (y = s; y < e; y++)
+			memcpy(SPA_PTROFF(dst->data[i], (int32_t)y * dst->stride[i], void),
+				SPA_PTROFF(src->data[i], (int32_t)y * src->stride[i], void),
+				bytes);
+	}
+}
+
+static void impl_convert_direct(struct convert *conv, const struct video_frame *dst,
+		const struct video_frame *src, uint32_t slice, uint32_t n_slices)
+{
+	const struct convert_step *s = &conv->steps[STEP_DIRECT];
+	void *drows[VIDEO_MAX_PLANES];
+	const void *srows[VIDEO_MAX_PLANES];
+	uint32_t y, start, end;
+
+	get_slice(conv, slice, n_slices, &start, &end);
+
+	for (y = start; y < end; y++) {
+		get_rows(conv->src_info, src, y, false, (void**)srows);
+		get_rows(conv->dst_info, dst, y, true, drows);
+		s->func(s, drows, srows, conv->dst_width);
+	}
+}
+
+/* bilinear horizontal scaling of 4 byte pixels */
+static void scale_h(struct convert *conv, uint8_t * SPA_RESTRICT d, const uint8_t * SPA_RESTRICT s)
+{
+	uint32_t i, j, width = conv->dst_width;
+	const uint32_t *xmap = conv->xmap;
+
+	for (i = 0; i < width; i++, d += 4) {
+		uint32_t x = xmap[i] >> 8, f1 = xmap[i] & 0xff, f0 = 256 - f1;
+		const uint8_t *p0 = &s[x * 4];
+		const uint8_t *p1 = x + 1 < conv->src_width ? p0 + 4 : p0;
+		for (j = 0; j < 4; j++)
+			d[j] = (p0[j] * f0 + p1[j] * f1 + 128) >> 8;
+	}
+}
+
+struct slice_data {
+	uint8_t *unpack;
+	uint8_t *rows[2];
+	int32_t row_y[2];
+	uint8_t *blend;
+	uint8_t *conv;
+};
+
+static inline void init_slice_data(struct convert *conv, uint32_t slice, struct slice_data *sd)
+{
+	uint8_t *p = SPA_PTROFF(conv->tmp, slice * conv->tmp_size, uint8_t);
+	uint32_t src_size = SPA_ROUND_UP(conv->src_width * 4, VIDEO_OPS_MAX_ALIGN);
+	uint32_t dst_size = SPA_ROUND_UP(SPA_MAX(conv->src_width, conv->dst_width) * 4, VIDEO_OPS_MAX_ALIGN);
+
+	sd->unpack = p;
+	sd->rows[0] = p + src_size;
+	sd->rows[1] = sd->rows[0] + dst_size;
+	sd->blend = sd->rows[1] + dst_size;
+	sd->conv = sd->blend + dst_size;
+	sd->row_y[0] = sd->row_y[1] = -1;
+}
+
+/* get source line y unpacked and horizontally scaled, keeps the last
+ * 2 lines cached */
+static uint8_t *get_line(struct convert *conv, struct slice_data *sd,
+		const struct video_frame *src, uint32_t y)
+{
+	const struct convert_step *s = &conv->steps[STEP_UNPACK];
+	const void *srows[VIDEO_MAX_PLANES];
+	void *d[1];
+	uint32_t idx;
+
+	if (sd->row_y[0] == (int32_t)y)
+		return sd->rows[0];
+	if (sd->row_y[1] == (int32_t)y)
+		return sd->rows[1];
+
+	idx = sd->row_y[0] < sd->row_y[1] ? 0 : 1;
+
+	get_rows(conv->src_info, src, y, false, (void**)srows);
+	if (conv->src_width != conv->dst_width) {
+		d[0] = sd->unpack;
+		s->func(s, d, srows, conv->src_width);
+		scale_h(conv, sd->rows[idx], sd->unpack);
+	} else {
+		d[0] = sd->rows[idx];
+		s->func(s, d, srows, conv->src_width);
+	}
+	sd->row_y[idx] = y;
+	return sd->rows[idx];
+}
+
+static void impl_convert_generic(struct convert *conv, const struct video_frame *dst,
+		const struct video_frame *src, uint32_t slice, uint32_t n_slices)
+{
+	struct slice_data sd;
+	void *drows[VIDEO_MAX_PLANES], *d[1];
+	const void *s[1];
+	uint32_t y, start, end, width = conv->dst_width;
+
+	get_slice(conv, slice, n_slices, &start, &end);
+	init_slice_data(conv, slice, &sd);
+
+	for (y = start; y < end; y++) {
+		uint8_t *line;
+		uint32_t sy, frac;
+
+		if (conv->src_height != conv->dst_height) {
+			int64_t fy = ((int64_t)(2 * y + 1) * conv->src_height * 256) /
+				(2 * conv->dst_height) - 128;
+			fy = SPA_CLAMP(fy, 0, (int64_t)(conv->src_height - 1) * 256);
+			sy = fy >> 8;
+			frac = fy & 0xff;
+		} else {
+			sy = y;
+			frac = 0;
+		}
+
+		line = get_line(conv, &sd, src, sy);
+		if (frac != 0 && sy + 1 < conv->src_height) {
+			uint8_t *line1 = get_line(conv, &sd, src, sy + 1);
+			conv->scale_v(sd.blend, line, line1, frac, width * 4);
+			line = sd.blend;
+		}
+		if (conv->n_steps > 2) {
+			const struct convert_step *m = &conv->steps[STEP_MATRIX];
+			s[0] = line;
+			d[0] = sd.conv;
+			m->func(m, d, s, width);
+			line = sd.conv;
+		}
+		get_rows(conv->dst_info, dst, y, true, drows);
+		s[0] = line;
+		conv->steps[STEP_PACK].func(&conv->steps[STEP_PACK], drows, s, width);
+	}
+}
+
+static void impl_convert_free(struct convert *conv)
+{
+	free(conv->data);
+	conv->data = NULL;
+	conv->tmp = NULL;
+	conv->xmap = NULL;
+}
+
+int convert_init(struct convert *conv)
+{
+	const struct format_info *pivot[2];
+	const struct scale_info *sinfo;
+	uint32_t i, xmap_size;
+	int res;
+
+	conv->src_info = video_format_info(conv->src_fmt);
+	conv->dst_info = video_format_info(conv->dst_fmt);
+	if (conv->src_info == NULL || conv->dst_info == NULL)
+		return -ENOTSUP;
+	if (conv->src_width == 0 || conv->src_height == 0 ||
+	    conv->dst_width == 0 || conv->dst_height == 0)
+		return -EINVAL;
+
+	conv->n_slices = SPA_MAX(conv->n_slices, 1u);
+	conv->is_scaling = conv->src_width != conv->dst_width ||
+		conv->src_height != conv->dst_height;
+	conv->is_passthrough = !conv->is_scaling && conv->src_fmt == conv->dst_fmt;
+	conv->slice_align = 1u << SPA_MAX(conv->dst_info->hsub[1], conv->src_info->hsub[1]);
+	conv->free = impl_convert_free;
+	conv->data = NULL;
+	conv->n_steps = 0;
+
+	if (conv->is_passthrough) {
+		conv->process = impl_convert_copy;
+		conv->func_name = "copy";
+		conv->cpu_flags = 0;
+		return 0;
+	}
+	if (!conv->is_scaling &&
+	    init_step(conv, &conv->steps[STEP_DIRECT], conv->src_info, conv->dst_info) >= 0) {
+		conv->n_steps = 1;
+		conv->process = impl_convert_direct;
+		conv->func_name = conv->steps[STEP_DIRECT].name;
+		conv->cpu_flags = conv->steps[STEP_DIRECT].cpu_flags;
+		return 0;
+	}
+
+	/* generic path, unpack to AYUV or RGBA, scale, convert the matrix
+	 * and pack */
+	for (i = 0; i < 2; i++) {
+		const struct format_info *info = i == 0 ? conv->src_info : conv->dst_info;
+		pivot[i] = video_format_info(info->family == FAMILY_YUV ?
+				SPA_VIDEO_FORMAT_AYUV : SPA_VIDEO_FORMAT_RGBA);
+	}
+	if ((res = init_step(conv, &conv->steps[STEP_UNPACK], conv->src_info, pivot[0])) < 0)
+		return res;
+	if ((res = init_step(conv, &conv->steps[STEP_PACK], pivot[1], conv->dst_info)) < 0)
+		return res;
+	if (pivot[0] != pivot[1]) {
+		if ((res = init_step(conv, &conv->steps[STEP_MATRIX], pivot[0], pivot[1])) < 0)
+			return res;
+		conv->n_steps = 3;
+	} else {
+		conv->n_steps = 2;
+	}
+
+	sinfo = find_scale_info(conv->cpu_flags);
+	conv->scale_v = sinfo->scale_v;
+
+	conv->tmp_size = SPA_ROUND_UP(conv->src_width * 4, VIDEO_OPS_MAX_ALIGN) +
+		4 * SPA_ROUND_UP(SPA_MAX(conv->src_width, conv->dst_width) * 4, VIDEO_OPS_MAX_ALIGN);
+	xmap_size = SPA_ROUND_UP(conv->dst_width * sizeof(uint32_t), VIDEO_OPS_MAX_ALIGN);
+
+	conv->data = calloc(1, VIDEO_OPS_MAX_ALIGN + xmap_size + conv->tmp_size * conv->n_slices);
+	if (conv->data == NULL)
+		return -errno;
+
+	conv->xmap = SPA_PTR_ALIGN(conv->data, VIDEO_OPS_MAX_ALIGN, uint32_t);
+	conv->tmp = SPA_PTROFF(conv->xmap, xmap_size, void);
+
+	for (i = 0; i < conv->dst_width; i++) {
+		int64_t fx = ((int64_t)(2 * i + 1) * conv->src_width * 256) /
+			(2 * conv->dst_width) - 128;
+		conv->xmap[i] = SPA_CLAMP(fx, 0, (int64_t)(conv->src_width - 1) * 256);
+	}
+
+	conv->process = impl_convert_generic;
+	conv->func_name = conv->steps[STEP_PACK].name;
+	conv->cpu_flags = conv->steps[STEP_UNPACK].cpu_flags | conv->steps[STEP_PACK].cpu_flags |
+		sinfo->cpu_flags;
+
+	return 0;
+}
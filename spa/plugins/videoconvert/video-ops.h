@@ -0,0 +1,250 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <spa/utils/defs.h>
+#include <spa/param/video/raw.h>
+
+#define VIDEO_OPS_MAX_ALIGN	32
+#define VIDEO_MAX_PLANES	4
+
+/* pixel layouts, the conversion functions are selected on the layout,
+ * the format specific component order is passed in the convert_step */
+#define LAYOUT_PACKED_422	1	/* YUY2, UYVY, YVYU, VYUY */
+#define LAYOUT_PLANAR_420	2	/* I420, YV12 */
+#define LAYOUT_SEMI_PLANAR_420	3	/* NV12, NV21 */
+#define LAYOUT_PACKED_444	4	/* AYUV */
+#define LAYOUT_RGB32		5	/* RGBA, BGRA, ARGB, ABGR, RGBx, BGRx, xRGB, xBGR */
+#define LAYOUT_RGB24		6	/* RGB, BGR */
+
+#define FAMILY_YUV		1
+#define FAMILY_RGB		2
+
+struct format_info {
+	uint32_t format;
+	uint32_t layout;
+	uint32_t family;
+	uint32_t n_planes;
+	uint32_t pstride[VIDEO_MAX_PLANES];	/* bytes per (subsampled) pixel */
+	uint32_t wsub[VIDEO_MAX_PLANES];	/* log2 horizontal subsampling */
+	uint32_t hsub[VIDEO_MAX_PLANES];	/* log2 vertical subsampling */
+	/* PACKED_422: byte offsets of Y0, U, Y1, V in a macropixel
+	 * PLANAR_420: plane index of Y, U, V
+	 * SEMI_PLANAR_420: unused, byte offset of U and V in the chroma pair
+	 * PACKED_444: byte offsets of Y, U, V, A
+	 * RGB32/RGB24: byte offsets of R, G, B, A */
+	uint8_t order[4];
+};
+
+const struct format_info *video_format_info(uint32_t format);
+
+/** the pixel formats we can convert between, the first one is the
+ * preferred one */
+extern const uint32_t video_formats[];
+extern const uint32_t n_video_formats;
+
+/* fixed point YUV <-> RGB matrices, see yuv_to_rgb() and rgb_to_y() */
+struct convert_matrix {
+	int16_t y, rv, gu, gv, bu;
+	int16_t yr, yg, yb, ur, ug, ub, vr, vg, vb;
+};
+
+struct video_frame {
+	void *data[VIDEO_MAX_PLANES];
+	int32_t stride[VIDEO_MAX_PLANES];
+};
+
+struct convert_step;
+
+typedef void (*convert_func_t) (const struct convert_step *s, void * SPA_RESTRICT dst[],
+		const void * SPA_RESTRICT src[], uint32_t width);
+
+struct convert_step {
+	convert_func_t func;
+	const char *name;
+	uint32_t cpu_flags;
+	const struct convert_matrix *m;
+	unsigned int src_alpha:1;	/* source has a valid alpha component */
+	uint8_t src_order[4];
+	uint8_t dst_order[4];
+};
+
+struct convert {
+	uint32_t src_fmt;
+	uint32_t dst_fmt;
+	uint32_t src_width;
+	uint32_t src_height;
+	uint32_t dst_width;
+	uint32_t dst_height;
+	uint32_t color_matrix;
+	uint32_t cpu_flags;
+	uint32_t n_slices;		/* max number of slices processed in parallel */
+	const char *func_name;
+
+	unsigned int is_passthrough:1;
+	unsigned int is_scaling:1;
+
+	/* destination lines in a slice must be a multiple of this */
+	uint32_t slice_align;
+
+	const struct format_info *src_info;
+	const struct format_info *dst_info;
+
+#define STEP_DIRECT	0
+#define STEP_UNPACK	0
+#define STEP_MATRIX	1
+#define STEP_PACK	2
+	struct convert_step steps[3];
+	uint32_t n_steps;
+	void (*scale_v) (void * SPA_RESTRICT dst, const void * SPA_RESTRICT src0,
+			const void * SPA_RESTRICT src1, uint32_t frac, uint32_t n_bytes);
+
+	void (*process) (struct convert *conv, const struct video_frame *dst,
+			const struct video_frame *src, uint32_t slice, uint32_t n_slices);
+	void (*free) (struct convert *conv);
+
+	uint32_t tmp_size;
+	void *tmp;
+	uint32_t *xmap;
+	void *data;
+};
+
+int convert_init(struct convert *conv);
+
+#define convert_process(conv,...)	(conv)->process(conv, __VA_ARGS__)
+#define convert_free(conv)		(conv)->free(conv)
+
+static inline int16_t mulhi16(int16_t a, int16_t b)
+{
+	return (int16_t)(((int32_t)a * (int32_t)b) >> 16);
+}
+
+static inline uint8_t clamp_u8(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* The fixed point math is arranged so that it can be done with 16 bit
+ * multiply-high operations in SIMD, the C code does the same to produce
+ * bit exact results. */
+static inline void yuv_to_rgb(const struct convert_matrix *m, uint8_t y, uint8_t u, uint8_t v,
+		uint8_t *r, uint8_t *g, uint8_t *b)
+{
+	int16_t c = (y - 16) * 64, d = (u - 128) * 64, e = (v - 128) * 64;
+	int yy = mulhi16(c, m->y);
+	*r = clamp_u8((yy + mulhi16(e, m->rv) + 2) >> 2);
+	*g = clamp_u8((yy + mulhi16(d, m->gu) + mulhi16(e, m->gv) + 2) >> 2);
+	*b = clamp_u8((yy + mulhi16(d, m->bu) + 2) >> 2);
+}
+
+static inline uint8_t rgb_to_y(const struct convert_matrix *m, uint8_t r, uint8_t g, uint8_t b)
+{
+	return clamp_u8(((mulhi16(r * 128, m->yr) + mulhi16(g * 128, m->yg) +
+			mulhi16(b * 128, m->yb) + 2) >> 2) + 16);
+}
+
+static inline uint8_t rgb_to_u(const struct convert_matrix *m, uint8_t r, uint8_t g, uint8_t b)
+{
+	return clamp_u8(((mulhi16(r * 128, m->ur) + mulhi16(g * 128, m->ug) +
+			mulhi16(b * 128, m->ub) + 2) >> 2) + 128);
+}
+
+static inline uint8_t rgb_to_v(const struct convert_matrix *m, uint8_t r, uint8_t g, uint8_t b)
+{
+	return clamp_u8(((mulhi16(r * 128, m->vr) + mulhi16(g * 128, m->vg) +
+			mulhi16(b * 128, m->vb) + 2) >> 2) + 128);
+}
+
+#define DEFINE_FUNCTION(name,arch)						\
+void conv_##name##_##arch(const struct convert_step *s,			\
+		void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],	\
+		uint32_t width)
+
+/* vertical scaling, blends n_bytes of src0 and src1 with a factor of
+ * frac/256 of src1 */
+#define DEFINE_SCALE_FUNCTION(name,arch)					\
+void scale_##name##_##arch(void * SPA_RESTRICT dst,				\
+		const void * SPA_RESTRICT src0, const void * SPA_RESTRICT src1,	\
+		uint32_t frac, uint32_t n_bytes)
+
+DEFINE_FUNCTION(yuv422_to_yuv422, c);
+DEFINE_FUNCTION(yuv422_to_i420, c);
+DEFINE_FUNCTION(yuv422_to_nv12, c);
+DEFINE_FUNCTION(yuv422_to_ayuv, c);
+DEFINE_FUNCTION(i420_to_i420, c);
+DEFINE_FUNCTION(i420_to_nv12, c);
+DEFINE_FUNCTION(i420_to_yuv422, c);
+DEFINE_FUNCTION(i420_to_ayuv, c);
+DEFINE_FUNCTION(nv12_to_nv12, c);
+DEFINE_FUNCTION(nv12_to_i420, c);
+DEFINE_FUNCTION(nv12_to_yuv422, c);
+DEFINE_FUNCTION(nv12_to_ayuv, c);
+DEFINE_FUNCTION(ayuv_to_ayuv, c);
+DEFINE_FUNCTION(ayuv_to_yuv422, c);
+DEFINE_FUNCTION(ayuv_to_i420, c);
+DEFINE_FUNCTION(ayuv_to_nv12, c);
+DEFINE_FUNCTION(rgb32_to_rgb32, c);
+DEFINE_FUNCTION(rgb32_to_rgb24, c);
+DEFINE_FUNCTION(rgb24_to_rgb32, c);
+DEFINE_FUNCTION(rgb24_to_rgb24, c);
+DEFINE_FUNCTION(yuv422_to_rgb32, c);
+DEFINE_FUNCTION(i420_to_rgb32, c);
+DEFINE_FUNCTION(nv12_to_rgb32, c);
+DEFINE_FUNCTION(ayuv_to_rgb32, c);
+DEFINE_FUNCTION(rgb32_to_yuv422, c);
+DEFINE_FUNCTION(rgb32_to_i420, c);
+DEFINE_FUNCTION(rgb32_to_nv12, c);
+DEFINE_FUNCTION(rgb32_to_ayuv, c);
+DEFINE_SCALE_FUNCTION(v, c);
+
+#if defined(HAVE_SSE2)
+DEFINE_FUNCTION(yuv422_to_i420, sse2);
+DEFINE_FUNCTION(yuv422_to_nv12, sse2);
+DEFINE_FUNCTION(yuv422_to_rgb32, sse2);
+DEFINE_FUNCTION(i420_to_rgb32, sse2);
+DEFINE_FUNCTION(nv12_to_rgb32, sse2);
+DEFINE_FUNCTION(rgb32_to_rgb32, sse2);
+DEFINE_FUNCTION(rgb32_to_i420, sse2);
+DEFINE_FUNCTION(rgb32_to_nv12, sse2);
+DEFINE_SCALE_FUNCTION(v, sse2);
+#endif
+#if defined(HAVE_AVX2)
+DEFINE_FUNCTION(yuv422_to_i420, avx2);
+DEFINE_FUNCTION(yuv422_to_nv12, avx2);
+DEFINE_FUNCTION(yuv422_to_rgb32, avx2);
+DEFINE_FUNCTION(i420_to_rgb32, avx2);
+DEFINE_FUNCTION(nv12_to_rgb32, avx2);
+DEFINE_FUNCTION(rgb32_to_rgb32, avx2);
+DEFINE_SCALE_FUNCTION(v, avx2);
+#endif
+#if defined(HAVE_NEON)
+DEFINE_FUNCTION(yuv422_to_i420, neon);
+DEFINE_FUNCTION(yuv422_to_nv12, neon);
+DEFINE_FUNCTION(yuv422_to_rgb32, neon);
+DEFINE_FUNCTION(i420_to_rgb32, neon);
+DEFINE_FUNCTION(nv12_to_rgb32, neon);
+DEFINE_FUNCTION(rgb32_to_rgb32, neon);
+DEFINE_FUNCTION(rgb32_to_i420, neon);
+DEFINE_FUNCTION(rgb32_to_nv12, neon);
+DEFINE_SCALE_FUNCTION(v, neon);
+#endif
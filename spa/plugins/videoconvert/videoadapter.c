@@ -1544,9 +1544,7 @@ impl_get_size(const struct spa_handle_factory *factory,
 {
 	size_t size = 0;
 
-#if 0
 	size += spa_handle_factory_get_size(&spa_videoconvert_factory, params);
-#endif
 	size += sizeof(struct impl);
 
 	return size;
@@ -1560,9 +1558,7 @@ impl_init(const struct spa_handle_factory *factory,
 	  uint32_t n_support)
 {
 	struct impl *this;
-#if 0
 	void *iface;
-#endif
 	const char *str;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
@@ -1596,7 +1592,6 @@ impl_init(const struct spa_handle_factory *factory,
 			SPA_VERSION_NODE,
 			&impl_node, this);
 
-#if 0
 	this->hnd_convert = SPA_PTROFF(this, sizeof(struct impl), struct spa_handle);
 	spa_handle_factory_init(&spa_videoconvert_factory,
 				this->hnd_convert,
@@ -1604,7 +1599,6 @@ impl_init(const struct spa_handle_factory *factory,
 
 	spa_handle_get_interface(this->hnd_convert, SPA_TYPE_INTERFACE_Node, &iface);
 	this->convert = iface;
-#endif
 	this->target = this->convert;
 
 	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
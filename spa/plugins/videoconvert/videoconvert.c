@@ -0,0 +1,1483 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <semaphore.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/cpu.h>
+#include <spa/support/log.h>
+#include <spa/support/thread.h>
+#include <spa/utils/result.h>
+#include <spa/utils/list.h>
+#include <spa/utils/names.h>
+#include <spa/utils/string.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/node/keys.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/param/param.h>
+#include <spa/param/latency-utils.h>
+#include <spa/pod/filter.h>
+#include <spa/debug/types.h>
+#include <spa/param/video/type-info.h>
+
+#include "video-ops.h"
+
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT log_topic
+static struct spa_log_topic *log_topic = &SPA_LOG_TOPIC(0, "spa.videoconvert");
+
+#define DEFAULT_WIDTH		640
+#define DEFAULT_HEIGHT		480
+#define DEFAULT_FRAMERATE	25
+#define MAX_SIZE		16384
+
+#define MAX_ALIGN	VIDEO_OPS_MAX_ALIGN
+#define MAX_BUFFERS	32
+#define MAX_PORTS	1
+#define MAX_THREADS	16
+
+/* frames smaller than this are not split into slices */
+#define DEFAULT_SLICE_PIXELS	(1280 * 720)
+
+struct buffer {
+	uint32_t id;
+#define BUFFER_FLAG_QUEUED	(1<<0)
+	uint32_t flags;
+	struct spa_list link;
+	struct spa_buffer *buf;
+	struct spa_meta_header *h;
+};
+
+struct port {
+	uint32_t direction;
+	uint32_t id;
+
+	struct spa_io_buffers *io;
+
+	uint64_t info_all;
+	struct spa_port_info info;
+#define IDX_EnumFormat	0
+#define IDX_Meta	1
+#define IDX_IO		2
+#define IDX_Format	3
+#define IDX_Buffers	4
+#define IDX_Latency	5
+#define N_PORT_PARAMS	6
+	struct spa_param_info params[N_PORT_PARAMS];
+
+	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
+
+	struct spa_video_info format;
+	const struct format_info *finfo;
+	unsigned int have_format:1;
+
+	int32_t stride;
+	uint32_t size;
+
+	struct spa_list queue;
+};
+
+struct dir {
+	struct port ports[MAX_PORTS];
+	uint32_t n_ports;
+
+	enum spa_direction direction;
+	enum spa_param_port_config_mode mode;
+
+	struct spa_video_info format;
+	unsigned int have_format:1;
+	unsigned int have_profile:1;
+	struct spa_latency_info latency;
+};
+
+struct impl;
+
+struct worker {
+	struct impl *impl;
+	struct spa_thread *thread;
+	sem_t sem;
+};
+
+/* a pool of threads that each convert a slice of the frame. The data thread
+ * never blocks on the workers: it wakes them up and then converts the slices
+ * that no worker has claimed yet itself. It only waits for the slices that a
+ * worker is converting, the workers run with realtime priority. */
+struct slices {
+	uint32_t next;			/* next slice to claim */
+	uint32_t done;			/* number of converted slices */
+	uint32_t n_slices;
+	const struct video_frame *dst;
+	const struct video_frame *src;
+
+	uint32_t n_workers;
+	struct worker workers[MAX_THREADS];
+	bool running;
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct spa_log *log;
+	struct spa_cpu *cpu;
+	struct spa_thread_utils *thread_utils;
+
+	uint32_t cpu_flags;
+	uint32_t max_align;
+
+	uint64_t info_all;
+	struct spa_node_info info;
+#define IDX_EnumPortConfig	0
+#define IDX_PortConfig		1
+#define N_NODE_PARAMS		2
+	struct spa_param_info params[N_NODE_PARAMS];
+
+	struct spa_hook_list hooks;
+
+	struct dir dir[2];
+
+	struct convert conv;
+	uint32_t n_threads;
+	uint32_t slice_pixels;
+	struct slices slices;
+
+	unsigned int started:1;
+	unsigned int setup:1;
+};
+
+#define CHECK_PORT(this,d,p)		((p) < this->dir[d].n_ports)
+#define GET_PORT(this,d,p)		(&this->dir[d].ports[p])
+#define GET_IN_PORT(this,p)		GET_PORT(this,SPA_DIRECTION_INPUT,p)
+#define GET_OUT_PORT(this,p)		GET_PORT(this,SPA_DIRECTION_OUTPUT,p)
+
+static void emit_node_info(struct impl *this, bool full)
+{
+	uint64_t old = full ? this->info.change_mask : 0;
+
+	if (full)
+		this->info.change_mask = this->info_all;
+	if (this->info.change_mask) {
+		if (this->info.change_mask & SPA_NODE_CHANGE_MASK_PARAMS) {
+			SPA_FOR_EACH_ELEMENT_VAR(this->params, p) {
+				if (p->user > 0) {
+					p->flags ^= SPA_PARAM_INFO_SERIAL;
+					p->user = 0;
+				}
+			}
+		}
+		spa_node_emit_info(&this->hooks, &this->info);
+		this->info.change_mask = old;
+	}
+}
+
+static void emit_port_info(struct impl *this, struct port *port, bool full)
+{
+	uint64_t old = full ? port->info.change_mask : 0;
+
+	if (full)
+		port->info.change_mask = port->info_all;
+	if (port->info.change_mask) {
+		if (port->info.change_mask & SPA_PORT_CHANGE_MASK_PARAMS) {
+			SPA_FOR_EACH_ELEMENT_VAR(port->params, p) {
+				if (p->user > 0) {
+					p->flags ^= SPA_PARAM_INFO_SERIAL;
+					p->user = 0;
+				}
+			}
+		}
+		spa_node_emit_port_info(&this->hooks, port->direction, port->id, &port->info);
+		port->info.change_mask = old;
+	}
+}
+
+static int init_port(struct impl *this, enum spa_direction direction, uint32_t port_id)
+{
+	struct port *port = GET_PORT(this, direction, port_id);
+
+	spa_assert(port_id < MAX_PORTS);
+
+	port->direction = direction;
+	port->id = port_id;
+
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = SPA_PORT_FLAG_NO_REF |
+		SPA_PORT_FLAG_DYNAMIC_DATA;
+	port->params[IDX_EnumFormat] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[IDX_Meta] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
+	port->params[IDX_IO] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[IDX_Format] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[IDX_Buffers] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->params[IDX_Latency] = SPA_PARAM_INFO(SPA_PARAM_Latency, SPA_PARAM_INFO_READWRITE);
+	port->info.params = port->params;
+	port->info.n_params = N_PORT_PARAMS;
+
+	port->n_buffers = 0;
+	port->have_format = false;
+	spa_list_init(&port->queue);
+
+	spa_log_info(this->log, "%p: add port %d:%d", this, direction, port_id);
+	emit_port_info(this, port, true);
+
+	return 0;
+}
+
+static int impl_node_enum_params(void *object, int seq,
+				 uint32_t id, uint32_t start, uint32_t num,
+				 const struct spa_pod *filter)
+{
+	struct impl *this = object;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[4096];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumPortConfig:
+	{
+		struct dir *dir;
+		switch (result.index) {
+		case 0:
+			dir = &this->dir[SPA_DIRECTION_INPUT];
+			break;
+		case 1:
+			dir = &this->dir[SPA_DIRECTION_OUTPUT];
+			break;
+		default:
+			return 0;
+		}
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamPortConfig, id,
+			SPA_PARAM_PORT_CONFIG_direction, SPA_POD_Id(dir->direction),
+			SPA_PARAM_PORT_CONFIG_mode,      SPA_POD_CHOICE_ENUM_Id(4,
+				SPA_PARAM_PORT_CONFIG_MODE_none,
+				SPA_PARAM_PORT_CONFIG_MODE_none,
+				SPA_PARAM_PORT_CONFIG_MODE_dsp,
+				SPA_PARAM_PORT_CONFIG_MODE_convert));
+		break;
+	}
+	case SPA_PARAM_PortConfig:
+	{
+		struct dir *dir;
+		struct spa_pod_frame f[1];
+
+		switch (result.index) {
+		case 0:
+			dir = &this->dir[SPA_DIRECTION_INPUT];
+			break;
+		case 1:
+			dir = &this->dir[SPA_DIRECTION_OUTPUT];
+			break;
+		default:
+			return 0;
+		}
+		spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_ParamPortConfig, id);
+		spa_pod_builder_add(&b,
+			SPA_PARAM_PORT_CONFIG_direction, SPA_POD_Id(dir->direction),
+			SPA_PARAM_PORT_CONFIG_mode,      SPA_POD_Id(dir->mode),
+			0);
+
+		if (dir->have_format) {
+			spa_pod_builder_prop(&b, SPA_PARAM_PORT_CONFIG_format, 0);
+			spa_format_video_raw_build(&b, SPA_PARAM_PORT_CONFIG_format,
+					&dir->format.info.raw);
+		}
+		param = spa_pod_builder_pop(&b, &f[0]);
+		break;
+	}
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_log_debug(this->log, "%p: io %d %p/%zd", this, id, data, size);
+
+	switch (id) {
+	case SPA_IO_Position:
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int reconfigure_mode(struct impl *this, enum spa_param_port_config_mode mode,
+		enum spa_direction direction)
+{
+	struct dir *dir;
+	uint32_t i;
+
+	dir = &this->dir[direction];
+
+	if (dir->have_profile && dir->mode == mode)
+		return 0;
+
+	spa_log_info(this->log, "%p: port config direction:%d mode:%d %d", this,
+			direction, mode, dir->n_ports);
+
+	for (i = 0; i < dir->n_ports; i++)
+		spa_node_emit_port_info(&this->hooks, direction, i, NULL);
+
+	this->setup = false;
+	dir->have_profile = true;
+	dir->have_format = false;
+	dir->mode = mode;
+
+	switch (mode) {
+	case SPA_PARAM_PORT_CONFIG_MODE_dsp:
+	case SPA_PARAM_PORT_CONFIG_MODE_convert:
+		/* there is no planar DSP format for video, both modes
+		 * expose one port with raw video */
+		dir->n_ports = 1;
+		init_port(this, direction, 0);
+		break;
+	case SPA_PARAM_PORT_CONFIG_MODE_none:
+		dir->n_ports = 0;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+
+	this->info.change_mask |= SPA_NODE_CHANGE_MASK_FLAGS | SPA_NODE_CHANGE_MASK_PARAMS;
+	this->info.flags &= ~SPA_NODE_FLAG_NEED_CONFIGURE;
+	this->params[IDX_PortConfig].user++;
+	return 0;
+}
+
+static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	if (param == NULL)
+		return 0;
+
+	switch (id) {
+	case SPA_PARAM_PortConfig:
+	{
+		enum spa_direction direction;
+		enum spa_param_port_config_mode mode;
+		int res;
+
+		if (spa_pod_parse_object(param,
+				SPA_TYPE_OBJECT_ParamPortConfig, NULL,
+				SPA_PARAM_PORT_CONFIG_direction,	SPA_POD_Id(&direction),
+				SPA_PARAM_PORT_CONFIG_mode,		SPA_POD_Id(&mode)) < 0)
+			return -EINVAL;
+
+		if (direction > SPA_DIRECTION_OUTPUT)
+			return -EINVAL;
+
+		if ((res = reconfigure_mode(this, mode, direction)) < 0)
+			return res;
+
+		emit_node_info(this, false);
+		break;
+	}
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static void convert_slices(struct impl *this)
+{
+	struct slices *s = &this->slices;
+	uint32_t index;
+
+	while ((index = __atomic_fetch_add(&s->next, 1, __ATOMIC_ACQUIRE)) < s->n_slices) {
+		convert_process(&this->conv, s->dst, s->src, index, s->n_slices);
+		__atomic_fetch_add(&s->done, 1, __ATOMIC_RELEASE);
+	}
+}
+
+static void *worker_thread(void *data)
+{
+	struct worker *w = data;
+	struct impl *this = w->impl;
+	struct slices *s = &this->slices;
+
+	while (true) {
+		while (sem_wait(&w->sem) < 0 && errno == EINTR);
+		if (!__atomic_load_n(&s->running, __ATOMIC_ACQUIRE))
+			break;
+		convert_slices(this);
+	}
+	return NULL;
+}
+
+static int start_workers(struct impl *this)
+{
+	struct slices *s = &this->slices;
+	uint32_t i;
+	char name[32];
+
+	if (this->thread_utils == NULL) {
+		spa_log_warn(this->log, "%p: no thread utils, converting without slices",
+				this);
+		return 0;
+	}
+
+	s->running = true;
+
+	for (i = 0; i < this->n_threads; i++) {
+		struct worker *w = &s->workers[i];
+		struct spa_dict_item items[1];
+
+		snprintf(name, sizeof(name), "videoconvert-%u", i);
+		items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, name);
+
+		w->impl = this;
+		sem_init(&w->sem, 0, 0);
+		w->thread = spa_thread_utils_create(this->thread_utils,
+				&SPA_DICT_INIT_ARRAY(items), worker_thread, w);
+		if (w->thread == NULL) {
+			spa_log_warn(this->log, "%p: can't create worker thread: %m",
+					this);
+			sem_destroy(&w->sem);
+			break;
+		}
+		spa_thread_utils_acquire_rt(this->thread_utils, w->thread, -1);
+		s->n_workers++;
+	}
+	/* claiming a slice fails until the first frame */
+	s->next = s->n_slices = s->n_workers + 1;
+
+	spa_log_info(this->log, "%p: started %d slice threads", this, s->n_workers);
+	return 0;
+}
+
+static void stop_workers(struct impl *this)
+{
+	struct slices *s = &this->slices;
+	uint32_t i;
+
+	if (!s->running)
+		return;
+
+	__atomic_store_n(&s->running, false, __ATOMIC_RELEASE);
+
+	for (i = 0; i < s->n_workers; i++) {
+		struct worker *w = &s->workers[i];
+		sem_post(&w->sem);
+		spa_thread_utils_join(this->thread_utils, w->thread, NULL);
+		sem_destroy(&w->sem);
+	}
+	s->n_workers = 0;
+}
+
+static void convert_frame(struct impl *this, const struct video_frame *dst,
+		const struct video_frame *src)
+{
+	struct slices *s = &this->slices;
+	uint32_t i;
+
+	if (s->n_workers == 0 ||
+	    this->conv.dst_width * this->conv.dst_height < this->slice_pixels) {
+		convert_process(&this->conv, dst, src, 0, 1);
+		return;
+	}
+
+	/* all slices of the previous frame are done, workers that wake up
+	 * late can't claim a slice until the next store */
+	s->dst = dst;
+	s->src = src;
+	s->done = 0;
+	__atomic_store_n(&s->next, 0, __ATOMIC_RELEASE);
+
+	for (i = 0; i < s->n_workers; i++)
+		sem_post(&s->workers[i].sem);
+
+	convert_slices(this);
+
+	/* only the slices that a worker is still converting are left */
+	while (__atomic_load_n(&s->done, __ATOMIC_ACQUIRE) < s->n_slices);
+}
+
+static int setup_convert(struct impl *this)
+{
+	struct dir *in, *out;
+	struct spa_video_info_raw *ri, *ro;
+	int res;
+
+	in = &this->dir[SPA_DIRECTION_INPUT];
+	out = &this->dir[SPA_DIRECTION_OUTPUT];
+
+	if (!in->have_format || !out->have_format)
+		return -EIO;
+
+	if (this->setup)
+		return 0;
+
+	ri = &in->format.info.raw;
+	ro = &out->format.info.raw;
+
+	if (this->conv.free)
+		convert_free(&this->conv);
+
+	spa_zero(this->conv);
+	this->conv.src_fmt = ri->format;
+	this->conv.dst_fmt = ro->format;
+	this->conv.src_width = ri->size.width;
+	this->conv.src_height = ri->size.height;
+	this->conv.dst_width = ro->size.width;
+	this->conv.dst_height = ro->size.height;
+	this->conv.color_matrix = video_format_info(ri->format)->family == FAMILY_YUV ?
+		ri->color_matrix : ro->color_matrix;
+	this->conv.cpu_flags = this->cpu_flags;
+	this->conv.n_slices = this->slices.n_workers + 1;
+
+	if ((res = convert_init(&this->conv)) < 0) {
+		spa_log_error(this->log, "%p: can't convert %s %dx%d -> %s %dx%d: %s", this,
+				spa_debug_type_find_short_name(spa_type_video_format, ri->format),
+				ri->size.width, ri->size.height,
+				spa_debug_type_find_short_name(spa_type_video_format, ro->format),
+				ro->size.width, ro->size.height, spa_strerror(res));
+		return res;
+	}
+
+	spa_log_info(this->log, "%p: got converter %s %dx%d -> %s %dx%d using %s "
+			"cpu-flags:%08x passthrough:%d slices:%d", this,
+			spa_debug_type_find_short_name(spa_type_video_format, ri->format),
+			ri->size.width, ri->size.height,
+			spa_debug_type_find_short_name(spa_type_video_format, ro->format),
+			ro->size.width, ro->size.height,
+			this->conv.func_name, this->conv.cpu_flags,
+			this->conv.is_passthrough, this->conv.n_slices);
+
+	this->setup = true;
+
+	emit_node_info(this, false);
+
+	return 0;
+}
+
+static int impl_node_send_command(void *object, const struct spa_command *command)
+{
+	struct impl *this = object;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	switch (SPA_NODE_COMMAND_ID(command)) {
+	case SPA_NODE_COMMAND_Start:
+		if (this->started)
+			return 0;
+		if ((res = setup_convert(this)) < 0)
+			return res;
+		this->started = true;
+		break;
+	case SPA_NODE_COMMAND_Suspend:
+		this->setup = false;
+		SPA_FALLTHROUGH;
+	case SPA_NODE_COMMAND_Pause:
+		this->started = false;
+		break;
+	case SPA_NODE_COMMAND_Flush:
+		/* the conversion keeps no state between frames */
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	return 0;
+}
+
+static int
+impl_node_add_listener(void *object,
+		struct spa_hook *listener,
+		const struct spa_node_events *events,
+		void *data)
+{
+	struct impl *this = object;
+	uint32_t i;
+	struct spa_hook_list save;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_log_trace(this->log, "%p: add listener %p", this, listener);
+	spa_hook_list_isolate(&this->hooks, &save, listener, events, data);
+
+	emit_node_info(this, true);
+	for (i = 0; i < this->dir[SPA_DIRECTION_INPUT].n_ports; i++) {
+		emit_port_info(this, GET_IN_PORT(this, i), true);
+	}
+	for (i = 0; i < this->dir[SPA_DIRECTION_OUTPUT].n_ports; i++) {
+		emit_port_info(this, GET_OUT_PORT(this, i), true);
+	}
+	spa_hook_list_join(&this->hooks, &save);
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(void *object,
+			const struct spa_node_callbacks *callbacks,
+			void *user_data)
+{
+	return 0;
+}
+
+static int impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int port_enum_formats(void *object,
+			     enum spa_direction direction, uint32_t port_id,
+			     uint32_t index,
+			     struct spa_pod **param,
+			     struct spa_pod_builder *builder)
+{
+	struct impl *this = object;
+	struct dir *other = &this->dir[SPA_DIRECTION_REVERSE(direction)];
+	struct spa_pod_frame f[2];
+	struct spa_rectangle size = SPA_RECTANGLE(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+	uint32_t i;
+
+	switch (index) {
+	case 0:
+		spa_pod_builder_push_object(builder, &f[0],
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+		spa_pod_builder_add(builder,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			0);
+
+		/* prefer the format of the other side, this avoids a conversion */
+		spa_pod_builder_prop(builder, SPA_FORMAT_VIDEO_format, 0);
+		spa_pod_builder_push_choice(builder, &f[1], SPA_CHOICE_Enum, 0);
+		spa_pod_builder_id(builder, other->have_format ?
+				other->format.info.raw.format : video_formats[0]);
+		for (i = 0; i < n_video_formats; i++)
+			spa_pod_builder_id(builder, video_formats[i]);
+		spa_pod_builder_pop(builder, &f[1]);
+
+		if (other->have_format)
+			size = other->format.info.raw.size;
+
+		spa_pod_builder_add(builder,
+			SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+							&size,
+							&SPA_RECTANGLE(1, 1),
+							&SPA_RECTANGLE(MAX_SIZE, MAX_SIZE)),
+			0);
+
+		/* we don't change the framerate */
+		if (other->have_format)
+			spa_pod_builder_add(builder,
+				SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(
+						&other->format.info.raw.framerate),
+				0);
+		else
+			spa_pod_builder_add(builder,
+				SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+						&SPA_FRACTION(DEFAULT_FRAMERATE, 1),
+						&SPA_FRACTION(0, 1),
+						&SPA_FRACTION(INT32_MAX, 1)),
+				0);
+
+		*param = spa_pod_builder_pop(builder, &f[0]);
+		break;
+	default:
+		return 0;
+	}
+	return 1;
+}
+
+/* Get the plane pointers and strides of a frame with the given stride of
+ * the first plane, the other planes follow the first one. Returns the
+ * size of the frame. */
+static uint32_t get_planes(const struct format_info *info, uint32_t height,
+		int32_t stride, void *data, struct video_frame *frame)
+{
+	uint32_t i, size = 0;
+
+	for (i = 0; i < info->n_planes; i++) {
+		int32_t s = i == 0 ? stride :
+			(int32_t)((stride >> info->wsub[i]) * info->pstride[i] / info->pstride[0]);
+		uint32_t h = (height + (1u << info->hsub[i]) - 1) >> info->hsub[i];
+
+		frame->data[i] = SPA_PTROFF(data, size, void);
+		frame->stride[i] = s;
+		size += s * h;
+	}
+	return size;
+}
+
+static int32_t calc_stride(const struct format_info *info, uint32_t width)
+{
+	uint32_t w = (width + (1u << info->wsub[0]) - 1) >> info->wsub[0];
+	return SPA_ROUND_UP_N(w * info->pstride[0], 4);
+}
+
+static int
+impl_node_port_enum_params(void *object, int seq,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t id, uint32_t start, uint32_t num,
+			   const struct spa_pod *filter)
+{
+	struct impl *this = object;
+	struct port *port;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[2048];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+
+	spa_log_debug(this->log, "%p: enum params port %d.%d %d %u",
+			this, direction, port_id, seq, id);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	result.id = id;
+	result.next = start;
+      next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		if ((res = port_enum_formats(object, direction, port_id, result.index, &param, &b)) <= 0)
+			return res;
+		break;
+	case SPA_PARAM_Format:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_format_video_raw_build(&b, id, &port->format.info.raw);
+		break;
+	case SPA_PARAM_Buffers:
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port->size),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port->stride),
+			SPA_PARAM_BUFFERS_align,   SPA_POD_Int(this->max_align));
+		break;
+	case SPA_PARAM_Meta:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamMeta, id,
+				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+	case SPA_PARAM_Latency:
+		switch (result.index) {
+		case 0: case 1:
+			param = spa_latency_build(&b, id, &this->dir[result.index].latency);
+			break;
+		default:
+			return 0;
+		}
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_debug(this->log, "%p: clear buffers %p", this, port);
+		port->n_buffers = 0;
+		spa_list_init(&port->queue);
+	}
+	return 0;
+}
+
+static int port_set_latency(void *object,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   uint32_t flags,
+			   const struct spa_pod *latency)
+{
+	struct impl *this = object;
+	struct port *port, *oport;
+	enum spa_direction other = SPA_DIRECTION_REVERSE(direction);
+	uint32_t i;
+
+	spa_log_debug(this->log, "%p: set latency direction:%d id:%d",
+			this, direction, port_id);
+
+	port = GET_PORT(this, direction, port_id);
+
+	if (latency == NULL) {
+		this->dir[other].latency = SPA_LATENCY_INFO(other);
+	} else {
+		struct spa_latency_info info;
+		if (spa_latency_parse(latency, &info) < 0 ||
+		    info.direction != other)
+			return -EINVAL;
+		this->dir[other].latency = info;
+	}
+
+	for (i = 0; i < this->dir[other].n_ports; i++) {
+		oport = GET_PORT(this, other, i);
+		oport->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+		oport->params[IDX_Latency].user++;
+		emit_port_info(this, oport, false);
+	}
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	port->params[IDX_Latency].user++;
+	emit_port_info(this, port, false);
+	return 0;
+}
+
+static int port_set_format(void *object,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   uint32_t flags,
+			   const struct spa_pod *format)
+{
+	struct impl *this = object;
+	struct port *port;
+	struct dir *dir = &this->dir[direction];
+	int res;
+
+	port = GET_PORT(this, direction, port_id);
+
+	spa_log_debug(this->log, "%p: set format", this);
+
+	if (format == NULL) {
+		port->have_format = false;
+		dir->have_format = false;
+		this->setup = false;
+		clear_buffers(this, port);
+	} else {
+		struct spa_video_info info = { 0 };
+		struct video_frame frame;
+		const struct format_info *finfo;
+
+		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0) {
+			spa_log_error(this->log, "can't parse format %s", spa_strerror(res));
+			return res;
+		}
+		if (info.media_type != SPA_MEDIA_TYPE_video ||
+		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw) {
+			spa_log_error(this->log, "unexpected types %d/%d",
+					info.media_type, info.media_subtype);
+			return -EINVAL;
+		}
+		if ((res = spa_format_video_raw_parse(format, &info.info.raw)) < 0) {
+			spa_log_error(this->log, "can't parse format %s", spa_strerror(res));
+			return res;
+		}
+		if ((finfo = video_format_info(info.info.raw.format)) == NULL ||
+		    info.info.raw.size.width == 0 ||
+		    info.info.raw.size.height == 0 ||
+		    info.info.raw.size.width > MAX_SIZE ||
+		    info.info.raw.size.height > MAX_SIZE) {
+			spa_log_error(this->log, "invalid format:%d size:%dx%d",
+					info.info.raw.format, info.info.raw.size.width,
+					info.info.raw.size.height);
+			return -EINVAL;
+		}
+		port->finfo = finfo;
+		port->stride = calc_stride(finfo, info.info.raw.size.width);
+		port->size = get_planes(finfo, info.info.raw.size.height,
+				port->stride, NULL, &frame);
+		port->format = info;
+		port->have_format = true;
+
+		dir->format = info;
+		dir->have_format = true;
+		this->setup = false;
+
+		spa_log_debug(this->log, "%p: %d stride:%d size:%d", this,
+				port_id, port->stride, port->size);
+	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->params[IDX_Format] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[IDX_Buffers] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[IDX_Format] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[IDX_Buffers] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
+	/* the formats of the other side depend on our format */
+	dir = &this->dir[SPA_DIRECTION_REVERSE(direction)];
+	if (dir->n_ports > 0) {
+		port = GET_PORT(this, dir->direction, 0);
+		port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+		port->params[IDX_EnumFormat].user++;
+		emit_port_info(this, port, false);
+	}
+	return 0;
+}
+
+static int
+impl_node_port_set_param(void *object,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this = object;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_log_debug(this->log, "%p: set param port %d.%d %u",
+			this, direction, port_id, id);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	switch (id) {
+	case SPA_PARAM_Latency:
+		return port_set_latency(this, direction, port_id, flags, param);
+	case SPA_PARAM_Format:
+		return port_set_format(this, direction, port_id, flags, param);
+	default:
+		return -ENOENT;
+	}
+}
+
+static void queue_buffer(struct impl *this, struct port *port, uint32_t id)
+{
+	struct buffer *b = &port->buffers[id];
+
+	spa_log_trace_fp(this->log, "%p: queue buffer %d on port %d %d",
+			this, id, port->id, b->flags);
+	if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_QUEUED))
+		return;
+
+	spa_list_append(&port->queue, &b->link);
+	SPA_FLAG_SET(b->flags, BUFFER_FLAG_QUEUED);
+}
+
+static struct buffer *dequeue_buffer(struct impl *this, struct port *port)
+{
+	struct buffer *b;
+
+	if (spa_list_is_empty(&port->queue))
+		return NULL;
+
+	b = spa_list_first(&port->queue, struct buffer, link);
+	spa_list_remove(&b->link);
+	SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_QUEUED);
+	spa_log_trace_fp(this->log, "%p: dequeue buffer %d on port %d %u",
+			this, b->id, port->id, b->flags);
+	return b;
+}
+
+static int
+impl_node_port_use_buffers(void *object,
+			   enum spa_direction direction,
+			   uint32_t port_id,
+			   uint32_t flags,
+			   struct spa_buffer **buffers,
+			   uint32_t n_buffers)
+{
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i, j;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	spa_log_debug(this->log, "%p: use buffers %d on port %d:%d",
+			this, n_buffers, direction, port_id);
+
+	clear_buffers(this, port);
+
+	if (n_buffers > 0 && !port->have_format)
+		return -EIO;
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b;
+		uint32_t n_datas = buffers[i]->n_datas;
+		struct spa_data *d = buffers[i]->datas;
+
+		b = &port->buffers[i];
+		b->id = i;
+		b->flags = 0;
+		b->buf = buffers[i];
+		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+
+		if (n_datas < 1) {
+			spa_log_error(this->log, "%p: invalid blocks %d on buffer %d",
+					this, n_datas, i);
+			return -EINVAL;
+		}
+		for (j = 0; j < n_datas; j++) {
+			if (d[j].data == NULL) {
+				spa_log_error(this->log, "%p: invalid memory %d on buffer %d %d %p",
+						this, j, i, d[j].type, d[j].data);
+				return -EINVAL;
+			}
+			if (!SPA_IS_ALIGNED(d[j].data, this->max_align)) {
+				spa_log_warn(this->log, "%p: memory %d on buffer %d not aligned",
+						this, j, i);
+			}
+		}
+		if (direction == SPA_DIRECTION_OUTPUT)
+			queue_buffer(this, port, i);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int
+impl_node_port_set_io(void *object,
+		      enum spa_direction direction, uint32_t port_id,
+		      uint32_t id, void *data, size_t size)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	spa_log_debug(this->log, "%p: set io %d on port %d:%d %p",
+			this, id, direction, port_id, data);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
+	switch (id) {
+	case SPA_IO_Buffers:
+		port->io = data;
+		break;
+	case SPA_IO_RateMatch:
+		break;
+	default:
+		return -ENOENT;
+	}
+	return 0;
+}
+
+static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(CHECK_PORT(this, SPA_DIRECTION_OUTPUT, port_id), -EINVAL);
+
+	port = GET_OUT_PORT(this, port_id);
+	queue_buffer(this, port, buffer_id);
+
+	return 0;
+}
+
+/* Get the planes of a buffer. Buffers either have one data block with all
+ * planes or one data block per plane. */
+static uint32_t get_frame(struct port *port, struct buffer *b, bool input,
+		struct video_frame *frame)
+{
+	const struct format_info *info = port->finfo;
+	struct spa_data *d = b->buf->datas;
+	uint32_t i, size = 0;
+
+	if (b->buf->n_datas >= info->n_planes && info->n_planes > 1) {
+		for (i = 0; i < info->n_planes; i++) {
+			uint32_t offs = input ? SPA_MIN(d[i].chunk->offset, d[i].maxsize) : 0;
+			int32_t stride = input ? d[i].chunk->stride : 0;
+			struct video_frame f;
+
+			if (stride == 0)
+				get_planes(info, port->format.info.raw.size.height,
+						port->stride, NULL, &f);
+			frame->data[i] = SPA_PTROFF(d[i].data, offs, void);
+			frame->stride[i] = stride ? stride : f.stride[i];
+			size = SPA_MAX(size, offs);
+		}
+		return d[0].maxsize;
+	} else {
+		uint32_t offs = input ? SPA_MIN(d[0].chunk->offset, d[0].maxsize) : 0;
+		int32_t stride = input && d[0].chunk->stride ? d[0].chunk->stride : port->stride;
+
+		size = get_planes(info, port->format.info.raw.size.height, stride,
+				SPA_PTROFF(d[0].data, offs, void), frame);
+		return size <= d[0].maxsize - offs ? size : 0;
+	}
+}
+
+static void set_chunks(struct port *port, struct buffer *b, const struct video_frame *frame,
+		uint32_t size)
+{
+	const struct format_info *info = port->finfo;
+	struct spa_data *d = b->buf->datas;
+	uint32_t i;
+
+	if (b->buf->n_datas >= info->n_planes && info->n_planes > 1) {
+		for (i = 0; i < info->n_planes; i++) {
+			d[i].chunk->offset = 0;
+			d[i].chunk->size = d[i].maxsize;
+			d[i].chunk->stride = frame->stride[i];
+			d[i].chunk->flags = 0;
+		}
+	} else {
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = size;
+		d[0].chunk->stride = frame->stride[0];
+		d[0].chunk->flags = 0;
+	}
+}
+
+static int impl_node_process(void *object)
+{
+	struct impl *this = object;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *inio, *outio;
+	struct buffer *sbuf, *dbuf;
+	struct video_frame src, dst;
+	uint32_t size;
+	int res;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+
+	if (SPA_UNLIKELY(!CHECK_PORT(this, SPA_DIRECTION_INPUT, 0) ||
+	    !CHECK_PORT(this, SPA_DIRECTION_OUTPUT, 0)))
+		return -EIO;
+
+	in_port = GET_IN_PORT(this, 0);
+	out_port = GET_OUT_PORT(this, 0);
+
+	if (SPA_UNLIKELY((inio = in_port->io) == NULL ||
+	    (outio = out_port->io) == NULL))
+		return -EIO;
+
+	spa_log_trace_fp(this->log, "%p: status %p %d %d -> %p %d %d", this,
+			inio, inio->status, inio->buffer_id,
+			outio, outio->status, outio->buffer_id);
+
+	if (SPA_UNLIKELY(outio->status == SPA_STATUS_HAVE_DATA))
+		return SPA_STATUS_HAVE_DATA;
+
+	/* recycle */
+	if (SPA_LIKELY(outio->buffer_id < out_port->n_buffers)) {
+		queue_buffer(this, out_port, outio->buffer_id);
+		outio->buffer_id = SPA_ID_INVALID;
+	}
+	if (SPA_UNLIKELY(inio->status != SPA_STATUS_HAVE_DATA))
+		return outio->status = inio->status;
+
+	if (SPA_UNLIKELY(inio->buffer_id >= in_port->n_buffers))
+		return inio->status = -EINVAL;
+
+	if (SPA_UNLIKELY(!this->setup)) {
+		if ((res = setup_convert(this)) < 0)
+			return res;
+	}
+
+	sbuf = &in_port->buffers[inio->buffer_id];
+	inio->status = SPA_STATUS_NEED_DATA;
+
+	if (SPA_UNLIKELY(get_frame(in_port, sbuf, true, &src) == 0)) {
+		spa_log_trace_fp(this->log, "%p: short input buffer %d", this, sbuf->id);
+		return SPA_STATUS_NEED_DATA;
+	}
+
+	if (SPA_UNLIKELY((dbuf = dequeue_buffer(this, out_port)) == NULL)) {
+		spa_log_trace_fp(this->log, "%p: out of buffers", this);
+		return -EPIPE;
+	}
+
+	if ((size = get_frame(out_port, dbuf, false, &dst)) == 0) {
+		spa_log_trace_fp(this->log, "%p: short output buffer %d", this, dbuf->id);
+		queue_buffer(this, out_port, dbuf->id);
+		return SPA_STATUS_NEED_DATA;
+	}
+
+	if (this->conv.is_passthrough &&
+	    SPA_FLAG_IS_SET(dbuf->buf->datas[0].flags, SPA_DATA_FLAG_DYNAMIC) &&
+	    dbuf->buf->n_datas == 1 && sbuf->buf->n_datas == 1 &&
+	    src.stride[0] == dst.stride[0]) {
+		/* same format and layout, just point to the input data */
+		dbuf->buf->datas[0].data = src.data[0];
+		dst = src;
+	} else {
+		convert_frame(this, &dst, &src);
+	}
+	set_chunks(out_port, dbuf, &dst, size);
+
+	if (sbuf->h && dbuf->h)
+		*dbuf->h = *sbuf->h;
+
+	outio->buffer_id = dbuf->id;
+	outio->status = SPA_STATUS_HAVE_DATA;
+
+	return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+}
+
+static const struct spa_node_methods impl_node = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = impl_node_add_listener,
+	.set_callbacks = impl_node_set_callbacks,
+	.enum_params = impl_node_enum_params,
+	.set_param = impl_node_set_param,
+	.set_io = impl_node_set_io,
+	.send_command = impl_node_send_command,
+	.add_port = impl_node_add_port,
+	.remove_port = impl_node_remove_port,
+	.port_enum_params = impl_node_port_enum_params,
+	.port_set_param = impl_node_port_set_param,
+	.port_use_buffers = impl_node_port_use_buffers,
+	.port_set_io = impl_node_port_set_io,
+	.port_reuse_buffer = impl_node_port_reuse_buffer,
+	.process = impl_node_process,
+};
+
+static int impl_get_interface(struct spa_handle *handle, const char *type, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (spa_streq(type, SPA_TYPE_INTERFACE_Node))
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	stop_workers(this);
+
+	if (this->conv.free)
+		convert_free(&this->conv);
+
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	uint32_t i;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	spa_log_topic_init(this->log, log_topic);
+
+	this->max_align = MAX_ALIGN;
+	this->cpu = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
+	this->thread_utils = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_ThreadUtils);
+	if (this->cpu) {
+		this->cpu_flags = spa_cpu_get_flags(this->cpu);
+		this->max_align = SPA_MIN(MAX_ALIGN, spa_cpu_get_max_align(this->cpu));
+	}
+
+	this->slice_pixels = DEFAULT_SLICE_PIXELS;
+
+	for (i = 0; info && i < info->n_items; i++) {
+		const char *k = info->items[i].key;
+		const char *s = info->items[i].value;
+		if (spa_streq(k, "convert.threads"))
+			spa_atou32(s, &this->n_threads, 0);
+		else if (spa_streq(k, "convert.slice-pixels"))
+			spa_atou32(s, &this->slice_pixels, 0);
+	}
+	this->n_threads = SPA_MIN(this->n_threads, (uint32_t)MAX_THREADS);
+
+	this->dir[SPA_DIRECTION_INPUT].direction = SPA_DIRECTION_INPUT;
+	this->dir[SPA_DIRECTION_INPUT].latency = SPA_LATENCY_INFO(SPA_DIRECTION_INPUT);
+	this->dir[SPA_DIRECTION_OUTPUT].direction = SPA_DIRECTION_OUTPUT;
+	this->dir[SPA_DIRECTION_OUTPUT].latency = SPA_LATENCY_INFO(SPA_DIRECTION_OUTPUT);
+
+	this->node.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE,
+			&impl_node, this);
+	spa_hook_list_init(&this->hooks);
+
+	this->info_all = SPA_NODE_CHANGE_MASK_FLAGS |
+			SPA_NODE_CHANGE_MASK_PARAMS;
+	this->info = SPA_NODE_INFO_INIT();
+	this->info.max_input_ports = MAX_PORTS;
+	this->info.max_output_ports = MAX_PORTS;
+	this->info.flags = SPA_NODE_FLAG_RT |
+		SPA_NODE_FLAG_IN_PORT_CONFIG |
+		SPA_NODE_FLAG_OUT_PORT_CONFIG |
+		SPA_NODE_FLAG_NEED_CONFIGURE;
+	this->params[IDX_EnumPortConfig] = SPA_PARAM_INFO(SPA_PARAM_EnumPortConfig, SPA_PARAM_INFO_READ);
+	this->params[IDX_PortConfig] = SPA_PARAM_INFO(SPA_PARAM_PortConfig, SPA_PARAM_INFO_READWRITE);
+	this->info.params = this->params;
+	this->info.n_params = N_NODE_PARAMS;
+
+	if (this->n_threads > 0)
+		start_workers(this);
+
+	reconfigure_mode(this, SPA_PARAM_PORT_CONFIG_MODE_convert, SPA_DIRECTION_INPUT);
+	reconfigure_mode(this, SPA_PARAM_PORT_CONFIG_MODE_convert, SPA_DIRECTION_OUTPUT);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+	return 1;
+}
+
+const struct spa_handle_factory spa_videoconvert_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_VIDEO_CONVERT,
+	NULL,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info,
+};
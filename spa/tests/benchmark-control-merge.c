@@ -0,0 +1,174 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+#include <spa/pod/builder.h>
+#include <spa/control/merge.h>
+
+#define MAX_COUNT 1000
+#define MAX_PORTS 64
+#define QUANTUM 256
+#define BUFFER_SIZE (64 * 1024)
+
+static uint8_t in_data[MAX_PORTS][BUFFER_SIZE];
+static uint8_t out_data[BUFFER_SIZE];
+
+static struct spa_pod_sequence *gen_sequence(uint8_t *data, uint32_t n_events)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(data, BUFFER_SIZE);
+	struct spa_pod_frame f;
+	uint32_t i, offset = 0;
+
+	spa_pod_builder_push_sequence(&b, &f, 0);
+	for (i = 0; i < n_events; i++) {
+		uint8_t ev[3];
+
+		offset += random() % (2 * QUANTUM / n_events + 1);
+		ev[0] = 0x80 | ((random() % 8) << 4) | (random() % 2);
+		ev[1] = random() % 128;
+		ev[2] = random() % 128;
+
+		spa_pod_builder_control(&b, SPA_MIN(offset, QUANTUM - 1u), SPA_CONTROL_Midi);
+		spa_pod_builder_bytes(&b, ev, sizeof(ev));
+	}
+	return spa_pod_builder_pop(&b, &f);
+}
+
+/* the linear scan over all sequences for each event */
+static uint32_t merge_scan(struct spa_pod_sequence **seq, uint32_t n_seq)
+{
+	struct spa_pod_control *ctrl[MAX_PORTS];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(out_data, sizeof(out_data));
+	struct spa_pod_frame f;
+	uint32_t i, count = 0;
+
+	for (i = 0; i < n_seq; i++)
+		ctrl[i] = spa_pod_control_first(&seq[i]->body);
+
+	spa_pod_builder_push_sequence(&b, &f, 0);
+	while (true) {
+		struct spa_pod_control *next = NULL;
+		uint32_t next_index = 0;
+
+		for (i = 0; i < n_seq; i++) {
+			if (!spa_pod_control_is_inside(&seq[i]->body,
+					SPA_POD_BODY_SIZE(seq[i]), ctrl[i]))
+				continue;
+
+			if (next == NULL || spa_control_compare(ctrl[i], next) <= 0) {
+				next = ctrl[i];
+				next_index = i;
+			}
+		}
+		if (next == NULL)
+			break;
+
+		spa_pod_builder_control(&b, next->offset, next->type);
+		spa_pod_builder_primitive(&b, &next->value);
+		count++;
+
+		ctrl[next_index] = spa_pod_control_next(ctrl[next_index]);
+	}
+	spa_pod_builder_pop(&b, &f);
+	return count;
+}
+
+static uint32_t merge_heap(struct spa_pod_sequence **seq, uint32_t n_seq)
+{
+	struct spa_control_merge_item items[MAX_PORTS];
+	struct spa_control_merge merge;
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(out_data, sizeof(out_data));
+	struct spa_pod_frame f;
+	struct spa_pod_control *next;
+	uint32_t count = 0, last = 0;
+
+	spa_pod_builder_push_sequence(&b, &f, 0);
+	spa_control_merge_init(&merge, items, seq, n_seq);
+	while ((next = spa_control_merge_peek(&merge)) != NULL) {
+		assert(next->offset >= last);
+		last = next->offset;
+
+		spa_pod_builder_control(&b, next->offset, next->type);
+		spa_pod_builder_primitive(&b, &next->value);
+		count++;
+
+		spa_control_merge_advance(&merge);
+	}
+	spa_pod_builder_pop(&b, &f);
+	return count;
+}
+
+static inline uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void test_merge(uint32_t n_seq, uint32_t n_events)
+{
+	struct spa_pod_sequence *seq[MAX_PORTS];
+	uint64_t t1, t2, t3;
+	uint32_t i, c1 = 0, c2 = 0;
+
+	for (i = 0; i < n_seq; i++)
+		seq[i] = gen_sequence(in_data[i], n_events);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++)
+		c1 = merge_scan(seq, n_seq);
+	t2 = get_time();
+	for (i = 0; i < MAX_COUNT; i++)
+		c2 = merge_heap(seq, n_seq);
+	t3 = get_time();
+
+	assert(c1 == n_seq * n_events);
+	assert(c1 == c2);
+
+	fprintf(stderr, "ports %2u events %3u: scan %8.1fns heap %8.1fns per cycle, %f speedup\n",
+			n_seq, n_events,
+			(double)(t2 - t1) / MAX_COUNT, (double)(t3 - t2) / MAX_COUNT,
+			(double)(t2 - t1) / (t3 - t2));
+}
+
+int main(int argc, char *argv[])
+{
+	/* warmup */
+	test_merge(8, 16);
+
+	test_merge(1, 64);
+	test_merge(2, 64);
+	test_merge(8, 16);
+	test_merge(8, 128);
+	test_merge(32, 32);
+	test_merge(64, 8);
+	test_merge(64, 64);
+
+	return 0;
+}
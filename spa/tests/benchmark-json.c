@@ -0,0 +1,206 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+
+#include <spa/utils/json.h>
+#include <spa/utils/string.h>
+
+#define MAX_RULES	1000
+
+struct data {
+	const char *name;
+	char *json;
+	size_t size;
+};
+
+/* a config with the structure of the daemon and session manager configs,
+ * with comments, indentation, rules and long quoted strings */
+static void gen_config(struct data *d)
+{
+	char *buf;
+	size_t size;
+	FILE *f;
+	int i;
+
+	f = open_memstream(&buf, &size);
+
+	fprintf(f, "# generated config\n\ncontext.properties = {\n");
+	for (i = 0; i < MAX_RULES / 10; i++)
+		fprintf(f, "    #default.clock.property.%d = %d\n"
+			   "    support.property.%d      = \"value with some spaces %d\"\n", i, i, i, i);
+	fprintf(f, "}\n\nmonitor.rules = [\n");
+	for (i = 0; i < MAX_RULES; i++) {
+		fprintf(f,
+			"    {\n"
+			"        # match the device and the node with the same serial\n"
+			"        matches = [\n"
+			"            {\n"
+			"                device.name = \"~alsa_card.usb-Generic_USB_Audio_%08d-00\"\n"
+			"                node.description = \"USB Audio Device %d Analog Stereo\"\n"
+			"            }\n"
+			"        ]\n"
+			"        actions = {\n"
+			"            update-props = {\n"
+			"                api.alsa.period-size   = %d\n"
+			"                api.alsa.headroom      = %d\n"
+			"                session.suspend-timeout-seconds = 0\n"
+			"                node.latency = \"%d/48000\"\n"
+			"                audio.position = [ FL FR RL RR FC LFE ]\n"
+			"            }\n"
+			"        }\n"
+			"    }\n", i, i, 256 + i, i % 1024, 1024 + i);
+	}
+	fprintf(f, "]\n");
+	fclose(f);
+
+	d->name = "generated";
+	d->json = buf;
+	d->size = size;
+}
+
+static int load_file(struct data *d, const char *filename)
+{
+	FILE *f;
+	long size;
+
+	if ((f = fopen(filename, "r")) == NULL)
+		return -errno;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	d->name = filename;
+	d->json = malloc(size);
+	d->size = fread(d->json, 1, size, f);
+	fclose(f);
+	return 0;
+}
+
+static int walk(struct spa_json *it)
+{
+	struct spa_json sub;
+	const char *value;
+	int len, count = 0;
+
+	while ((len = spa_json_next(it, &value)) > 0) {
+		count++;
+		if (spa_json_is_container(value, len)) {
+			spa_json_enter(it, &sub);
+			count += walk(&sub);
+		}
+	}
+	return count;
+}
+
+/* go over all tokens, like when loading a config */
+static void test_walk(struct data *d)
+{
+	struct timespec ts;
+	uint64_t t1, t2, count;
+	struct spa_json it;
+	int res = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	for (count = 0;; count++) {
+		spa_json_init(&it, d->json, d->size);
+		res = walk(&it);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "%s: walk %d tokens: elapsed %"PRIu64" count %"PRIu64" = %"PRIu64" MB/sec\n",
+			d->name, res, t2 - t1, count,
+			count * d->size * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1) / (1024 * 1024));
+}
+
+/* only go over the top level, skipping the containers, like when looking
+ * up a section or evaluating a rule that doesn't match */
+static void test_skip(struct data *d)
+{
+	struct timespec ts;
+	uint64_t t1, t2, count;
+	struct spa_json it;
+	const char *value;
+	int len, res = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	for (count = 0;; count++) {
+		spa_json_init(&it, d->json, d->size);
+		for (res = 0; (len = spa_json_next(&it, &value)) > 0; res++) {
+			if (spa_json_is_container(value, len))
+				spa_json_container_len(&it, value, len);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "%s: skip %d tokens: elapsed %"PRIu64" count %"PRIu64" = %"PRIu64" MB/sec\n",
+			d->name, res, t2 - t1, count,
+			count * d->size * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1) / (1024 * 1024));
+}
+
+int main(int argc, char *argv[])
+{
+	static char metadata[] = "{ \"name\": \"alsa_output.pci-0000_00_1f.3.analog-stereo\" }";
+	struct data d;
+	int i;
+
+	/* a small metadata value */
+	d = (struct data) { "metadata", metadata, strlen(metadata) };
+	test_walk(&d);
+
+	gen_config(&d);
+	fprintf(stderr, "%s: %zd bytes\n", d.name, d.size);
+	test_walk(&d);
+	test_skip(&d);
+	free(d.json);
+
+	/* the installed configs can be passed on the command line */
+	for (i = 1; i < argc; i++) {
+		if (load_file(&d, argv[i]) < 0) {
+			fprintf(stderr, "can't load %s: %m\n", argv[i]);
+			continue;
+		}
+		test_walk(&d);
+		test_skip(&d);
+		free(d.json);
+	}
+	return 0;
+}
@@ -0,0 +1,141 @@
+/* Spa
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <limits.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/log.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+
+#define MAX_COUNT 100000
+/* messages per burst, small enough to not overflow the deferred ring */
+#define BURST 200
+
+static const struct spa_handle_factory *find_factory(const char *name)
+{
+	const char *dir;
+	char path[PATH_MAX];
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	uint32_t index = 0;
+
+	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL) {
+		fprintf(stderr, "SPA_PLUGIN_DIR not set\n");
+		return NULL;
+	}
+	snprintf(path, sizeof(path), "%s/support/libspa-support.so", dir);
+
+	if ((hnd = dlopen(path, RTLD_NOW)) == NULL) {
+		fprintf(stderr, "can't load %s: %s\n", path, dlerror());
+		return NULL;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		fprintf(stderr, "can't find enum function\n");
+		return NULL;
+	}
+	while (enum_func(&factory, &index) > 0) {
+		if (spa_streq(factory->name, name))
+			return factory;
+	}
+	fprintf(stderr, "can't find factory %s\n", name);
+	return NULL;
+}
+
+static inline uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int test_log(const struct spa_handle_factory *factory, bool deferred)
+{
+	struct spa_handle *handle;
+	struct spa_log *log;
+	struct spa_dict_item items[3];
+	void *iface;
+	uint64_t t1, elapsed = 0;
+	uint32_t i, j;
+	int res;
+
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, "/dev/null");
+	items[1] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_TIMESTAMP, "true");
+	items[2] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_DEFERRED, deferred ? "true" : "false");
+
+	handle = calloc(1, spa_handle_factory_get_size(factory, NULL));
+	if ((res = spa_handle_factory_init(factory, handle,
+			&SPA_DICT_INIT_ARRAY(items), NULL, 0)) < 0) {
+		fprintf(stderr, "can't make logger: %s\n", spa_strerror(res));
+		return res;
+	}
+	spa_handle_get_interface(handle, SPA_TYPE_INTERFACE_Log, &iface);
+	log = iface;
+	log->level = SPA_LOG_LEVEL_TRACE;
+
+	for (i = 0; i < MAX_COUNT; i += BURST) {
+		t1 = get_time();
+		for (j = 0; j < BURST; j++)
+			spa_log_info(log, "%p: node %s cycle %u position %"PRIu64" rate %f",
+					handle, "alsa_output.pci-0000_00_1f.3", i + j,
+					(uint64_t)(i + j) * 1024, 1.000012);
+		elapsed += get_time() - t1;
+
+		/* let the formatter thread catch up */
+		if (deferred)
+			usleep(10000);
+	}
+	fprintf(stderr, "%s: elapsed %"PRIu64" count %u = %.1f ns/call\n",
+			deferred ? "deferred" : "direct  ", elapsed, MAX_COUNT,
+			(double)elapsed / MAX_COUNT);
+
+	spa_handle_clear(handle);
+	free(handle);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct spa_handle_factory *factory;
+
+	if ((factory = find_factory(SPA_NAME_SUPPORT_LOG)) == NULL)
+		return -1;
+
+	/* warmup */
+	test_log(factory, false);
+
+	test_log(factory, false);
+	test_log(factory, true);
+
+	return 0;
+}
@@ -33,6 +33,7 @@
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
 #include <spa/param/video/format-utils.h>
+#include <spa/param/profiler-utils.h>
 #include <spa/debug/pod.h>
 
 #define MAX_COUNT 10000000
@@ -284,11 +285,256 @@ static void test_parser(void)
 			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
 }
 
+/* a fixated raw video format with a layout that is known at compile time */
+struct video_format_layout {
+	struct spa_pod_object pod;
+	struct { uint32_t key, flags; struct spa_pod_id value; } media_type;
+	struct { uint32_t key, flags; struct spa_pod_id value; } media_subtype;
+	struct { uint32_t key, flags; struct spa_pod_id value; } format;
+	struct { uint32_t key, flags; struct spa_pod_rectangle value; } size;
+	struct { uint32_t key, flags; struct spa_pod_fraction value; } framerate;
+};
+
+#define VIDEO_FORMAT_LAYOUT_INIT(f,s,r)							\
+	((struct video_format_layout) {							\
+		{ { sizeof(struct video_format_layout) - sizeof(struct spa_pod),	\
+		    SPA_TYPE_Object }, { SPA_TYPE_OBJECT_Format, 0 } },			\
+		{ SPA_FORMAT_mediaType, 0, SPA_POD_INIT_Id(SPA_MEDIA_TYPE_video) },	\
+		{ SPA_FORMAT_mediaSubtype, 0, SPA_POD_INIT_Id(SPA_MEDIA_SUBTYPE_raw) },	\
+		{ SPA_FORMAT_VIDEO_format, 0, SPA_POD_INIT_Id(f) },			\
+		{ SPA_FORMAT_VIDEO_size, 0, SPA_POD_INIT_Rectangle(s) },		\
+		{ SPA_FORMAT_VIDEO_framerate, 0, SPA_POD_INIT_Fraction(r) } })
+
+static struct spa_pod *build_fixed_format(struct spa_pod_builder *b)
+{
+	return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, 0,
+			SPA_FORMAT_mediaType,	    SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_Id(SPA_VIDEO_FORMAT_I420),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&SPA_RECTANGLE(320, 240)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&SPA_FRACTION(25,1)));
+}
+
+static void test_builder_fixed(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct timespec ts;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_builder_fixed() : ");
+	for (count = 0; count < MAX_COUNT; count++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+		build_fixed_format(&b);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
+static void test_builder_layout(void)
+{
+	uint8_t buffer[1024], check[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct timespec ts;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+
+	spa_pod_builder_init(&b, check, sizeof(check));
+	build_fixed_format(&b);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_builder_layout() : ");
+	for (count = 0; count < MAX_COUNT; count++) {
+		struct video_format_layout l = VIDEO_FORMAT_LAYOUT_INIT(SPA_VIDEO_FORMAT_I420,
+				SPA_RECTANGLE(320, 240), SPA_FRACTION(25, 1));
+
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+		spa_pod_builder_layout(&b, &l, sizeof(l));
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+
+	spa_assert(memcmp(buffer, check, sizeof(struct video_format_layout)) == 0);
+}
+
+static void test_parser_fixed(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct timespec ts;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+	struct spa_pod *fmt;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	fmt = build_fixed_format(&b);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_parser_fixed() : ");
+	for (count = 0; count < MAX_COUNT; count++) {
+		struct {
+			uint32_t media_type;
+			uint32_t media_subtype;
+			uint32_t format;
+			struct spa_rectangle size;
+			struct spa_fraction framerate;
+		} vals;
+
+		spa_zero(vals);
+
+		spa_pod_parse_object(fmt,
+			SPA_TYPE_OBJECT_Format, NULL,
+			SPA_FORMAT_mediaType,	    SPA_POD_Id(&vals.media_type),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(&vals.media_subtype),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_Id(&vals.format),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&vals.size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&vals.framerate));
+
+		spa_assert(vals.format == SPA_VIDEO_FORMAT_I420);
+		spa_assert(vals.size.width == 320 && vals.size.height == 240);
+		spa_assert(vals.framerate.num == 25 && vals.framerate.denom == 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
+static void test_parser_layout(void)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct timespec ts;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+	struct spa_pod *fmt;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	fmt = build_fixed_format(&b);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_parser_layout() : ");
+	for (count = 0; count < MAX_COUNT; count++) {
+		struct video_format_layout l = VIDEO_FORMAT_LAYOUT_INIT(0,
+				SPA_RECTANGLE(0, 0), SPA_FRACTION(0, 0));
+		struct spa_pod_parser p;
+
+		spa_pod_parser_pod(&p, fmt);
+		spa_assert(spa_pod_parser_get_layout(&p, &l, sizeof(l)) == 0);
+
+		spa_assert(l.format.value.value == SPA_VIDEO_FORMAT_I420);
+		spa_assert(l.size.value.value.width == 320 && l.size.value.value.height == 240);
+		spa_assert(l.framerate.value.value.num == 25 && l.framerate.value.value.denom == 1);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
+static void test_profiler_clock(bool layout)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = { NULL, };
+	struct spa_io_clock clock, c;
+	struct timespec ts;
+	uint64_t t1, t2;
+	uint64_t count = 0;
+
+	spa_zero(clock);
+	snprintf(clock.name, sizeof(clock.name), "clock.system.monotonic");
+	clock.rate = SPA_FRACTION(1, 48000);
+	clock.duration = 1024;
+	clock.rate_diff = 1.0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	fprintf(stderr, "test_profiler_clock(%s) : ", layout ? "layout" : "varargs");
+	for (count = 0; count < MAX_COUNT; count++) {
+		struct spa_pod *pod = (struct spa_pod *)buffer;
+
+		clock.position = count;
+
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		if (layout) {
+			spa_profiler_clock_build(&b, &clock);
+			spa_profiler_clock_parse(pod, &c);
+		} else {
+			spa_pod_builder_add_struct(&b,
+				SPA_POD_Int(clock.flags),
+				SPA_POD_Int(clock.id),
+				SPA_POD_String(clock.name),
+				SPA_POD_Long(clock.nsec),
+				SPA_POD_Fraction(&clock.rate),
+				SPA_POD_Long(clock.position),
+				SPA_POD_Long(clock.duration),
+				SPA_POD_Long(clock.delay),
+				SPA_POD_Double(clock.rate_diff),
+				SPA_POD_Long(clock.next_nsec));
+			spa_pod_parse_struct(pod,
+				SPA_POD_Int(&c.flags),
+				SPA_POD_Int(&c.id),
+				SPA_POD_Stringn(c.name, sizeof(c.name)),
+				SPA_POD_Long(&c.nsec),
+				SPA_POD_Fraction(&c.rate),
+				SPA_POD_Long(&c.position),
+				SPA_POD_Long(&c.duration),
+				SPA_POD_Long(&c.delay),
+				SPA_POD_Double(&c.rate_diff),
+				SPA_POD_Long(&c.next_nsec));
+		}
+		spa_assert(c.position == count);
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+		if (t2 - t1 > 1 * SPA_NSEC_PER_SEC)
+			break;
+	}
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
 int main(int argc, char *argv[])
 {
 	test_builder();
 	test_builder2();
 	test_parse();
 	test_parser();
+	test_builder_fixed();
+	test_builder_layout();
+	test_parser_fixed();
+	test_parser_layout();
+	test_profiler_clock(false);
+	test_profiler_clock(true);
 	return 0;
 }
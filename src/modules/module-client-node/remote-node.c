@@ -267,6 +267,10 @@ static int client_node_transport(void *_data,
 
 	clean_transport(data);
 
+	if (size < sizeof(struct pw_node_activation)) {
+		pw_log_warn("remote-node %p: activation size %u too small", proxy, size);
+		return -EINVAL;
+	}
 	data->activation = pw_mempool_map_id(data->pool, mem_id,
 				PW_MEMMAP_FLAG_READWRITE, offset, size, NULL);
 	if (data->activation == NULL) {
@@ -902,6 +906,10 @@ client_node_set_activation(void *_data,
 	if (memid == SPA_ID_INVALID) {
 		mm = ptr = NULL;
 		size = 0;
+	} else if (size < sizeof(struct pw_node_activation)) {
+		pw_log_warn("node %p: activation size %u too small", node, size);
+		res = -EINVAL;
+		goto error_exit;
 	} else {
 		mm = pw_mempool_map_id(data->pool, memid,
 				PW_MEMMAP_FLAG_READWRITE, offset, size, NULL);
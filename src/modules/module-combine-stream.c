@@ -62,6 +62,9 @@
  * - `combine.mode` = capture | playback | sink | source, default sink
  * - `combine.props = {}`: properties to be passed to the sink/source
  * - `stream.props = {}`: properties to be passed to the streams
+ * - `combine.direct`: in sink mode, link the combine sink directly to the
+ *                     target sinks instead of copying into a stream per target,
+ *                     default false. See below.
  *
  * ## General options
  *
@@ -85,6 +88,16 @@
  * - `combine.audio.position`: map the combine audio positions to the stream positions.
  *                     combine input channels are mapped one-by-one to stream output channels.
  *
+ * ## Direct mode
+ *
+ * By default, the combine sink copies each channel into a new playback stream
+ * for every target sink. With `combine.direct = true`, the combine sink is made
+ * with monitor ports. Each channel of a target sink is linked directly to
+ * the monitor port of its `combine.audio.position` channel. Targets then read
+ * the same read-only monitor buffer and nothing is copied per target. Only
+ * target ports with a matching `audio.position` channel are linked, there is
+ * no remixing. Targets must use the DSP port configuration.
+ *
  * ## Example configuration
  *
  *\code{.unparsed}
@@ -226,7 +239,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"[ audio.position=<channel map, default:"DEFAULT_POSITION"> ] "		\
 			"[ combine.props=<properties> ] "						\
 			"[ stream.props=<properties> ] "					\
-			"[ stream.rules=<properties> ] "
+			"[ stream.rules=<properties> ] "					\
+			"[ combine.direct=<link the targets to the sink monitor> ] "
 
 
 static const struct spa_dict_item module_props[] = {
@@ -269,11 +283,33 @@ struct impl {
 	struct spa_audio_info_raw info;
 
 	unsigned int do_disconnect:1;
+	unsigned int direct:1;
+
+	struct pw_proxy *combine_node;
+	struct spa_hook combine_node_listener;
+	const char *combine_name;
+	struct spa_list ports;
 
 	struct spa_list streams;
 	uint32_t n_streams;
 };
 
+/* a port of the combine sink or a target sink in direct mode */
+struct port {
+	struct spa_list link;
+	uint32_t id;
+	uint32_t node_id;
+	uint32_t channel;
+	unsigned int is_input:1;
+	unsigned int is_monitor:1;
+};
+
+struct stream_link {
+	struct pw_proxy *proxy;
+	uint32_t output_port;
+	uint32_t input_port;
+};
+
 struct stream {
 	uint32_t id;
 
@@ -286,6 +322,7 @@ struct stream {
 
 	struct spa_audio_info_raw info;
 	uint32_t remap[SPA_AUDIO_MAX_CHANNELS];
+	struct stream_link links[SPA_AUDIO_MAX_CHANNELS];
 
 	unsigned int ready:1;
 	unsigned int added:1;
@@ -365,12 +402,35 @@ static int do_remove_stream(struct spa_loop *loop, bool async, uint32_t seq,
 	return 0;
 }
 
+static void destroy_link(struct stream_link *l)
+{
+	if (l->proxy) {
+		pw_proxy_destroy(l->proxy);
+		l->proxy = NULL;
+	}
+	l->output_port = l->input_port = SPA_ID_INVALID;
+}
+
 static void destroy_stream(struct stream *s)
 {
+	struct port *p, *t;
+	uint32_t i;
+
 	pw_log_debug("destroy stream %d", s->id);
 
 	pw_data_loop_invoke(s->impl->data_loop, do_remove_stream, 0, NULL, 0, true, s);
 
+	for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++)
+		destroy_link(&s->links[i]);
+
+	/* forget the ports of the target */
+	spa_list_for_each_safe(p, t, &s->impl->ports, link) {
+		if (p->node_id == s->id) {
+			spa_list_remove(&p->link);
+			free(p);
+		}
+	}
+
 	if (s->stream) {
 		spa_hook_remove(&s->stream_listener);
 		pw_stream_destroy(s->stream);
@@ -426,6 +486,125 @@ static const struct pw_stream_events stream_events = {
 	.state_changed = stream_state_changed,
 };
 
+static struct port *find_port(struct impl *impl, uint32_t node_id, bool is_input,
+		bool is_monitor, uint32_t channel)
+{
+	struct port *p;
+	spa_list_for_each(p, &impl->ports, link) {
+		if (p->node_id == node_id && p->is_input == is_input &&
+		    p->is_monitor == is_monitor && p->channel == channel)
+			return p;
+	}
+	return NULL;
+}
+
+/* link the combine monitor ports to the target ports of a stream in
+ * direct mode, ports that are not known yet are linked later */
+static void link_stream(struct stream *s)
+{
+	struct impl *impl = s->impl;
+	uint32_t i;
+
+	if (impl->combine_id == SPA_ID_INVALID)
+		return;
+
+	for (i = 0; i < s->info.channels; i++) {
+		struct stream_link *l = &s->links[i];
+		struct port *out, *in;
+		char val[4][16];
+
+		if (l->proxy != NULL || s->remap[i] >= impl->info.channels)
+			continue;
+
+		if ((out = find_port(impl, impl->combine_id, false, true,
+				impl->info.position[s->remap[i]])) == NULL)
+			continue;
+		if ((in = find_port(impl, s->id, true, false, s->info.position[i])) == NULL)
+			continue;
+
+		snprintf(val[0], sizeof(val[0]), "%u", impl->combine_id);
+		snprintf(val[1], sizeof(val[1]), "%u", out->id);
+		snprintf(val[2], sizeof(val[2]), "%u", s->id);
+		snprintf(val[3], sizeof(val[3]), "%u", in->id);
+
+		pw_log_info("link %d: %s:%s -> %s:%s", i, val[0], val[1], val[2], val[3]);
+
+		l->proxy = pw_core_create_object(impl->core,
+				"link-factory",
+				PW_TYPE_INTERFACE_Link,
+				PW_VERSION_LINK,
+				&SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+					{ PW_KEY_LINK_OUTPUT_NODE, val[0] },
+					{ PW_KEY_LINK_OUTPUT_PORT, val[1] },
+					{ PW_KEY_LINK_INPUT_NODE, val[2] },
+					{ PW_KEY_LINK_INPUT_PORT, val[3] },
+					{ PW_KEY_LINK_PASSIVE, "true" },
+					{ PW_KEY_OBJECT_LINGER, "false" } })), 0);
+		if (l->proxy == NULL) {
+			pw_log_error("can't create link: %m");
+			continue;
+		}
+		l->output_port = out->id;
+		l->input_port = in->id;
+	}
+}
+
+static void link_streams(struct impl *impl)
+{
+	struct stream *s;
+	spa_list_for_each(s, &impl->streams, link)
+		link_stream(s);
+}
+
+static void add_port(struct impl *impl, uint32_t id, const struct spa_dict *props)
+{
+	struct port *p;
+	const char *str;
+	uint32_t node_id;
+
+	if ((str = spa_dict_lookup(props, PW_KEY_NODE_ID)) == NULL)
+		return;
+
+	/* only keep the ports of the combine sink and the targets, their
+	 * node globals are announced before the ports */
+	node_id = atoi(str);
+	if (node_id != impl->combine_id && find_stream(impl, node_id) == NULL)
+		return;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return;
+
+	p->id = id;
+	p->node_id = node_id;
+	p->is_input = spa_streq(spa_dict_lookup(props, PW_KEY_PORT_DIRECTION), "in");
+	p->is_monitor = spa_atob(spa_dict_lookup(props, PW_KEY_PORT_MONITOR));
+	if ((str = spa_dict_lookup(props, PW_KEY_AUDIO_CHANNEL)) != NULL)
+		p->channel = channel_from_name(str);
+	else
+		p->channel = SPA_AUDIO_CHANNEL_UNKNOWN;
+
+	spa_list_append(&impl->ports, &p->link);
+
+	link_streams(impl);
+}
+
+static void remove_port(struct impl *impl, struct port *p)
+{
+	struct stream *s;
+	uint32_t i;
+
+	spa_list_for_each(s, &impl->streams, link) {
+		for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++) {
+			struct stream_link *l = &s->links[i];
+			if (l->output_port == p->id || l->input_port == p->id)
+				destroy_link(l);
+		}
+	}
+	spa_list_remove(&p->link);
+	free(p);
+}
+
 struct stream_info {
 	struct impl *impl;
 	uint32_t id;
@@ -486,6 +665,14 @@ static int create_stream(struct stream_info *info)
 		pw_log_info("remap %d -> %d", i, s->remap[i]);
 	}
 
+	if (impl->direct) {
+		for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++)
+			s->links[i].output_port = s->links[i].input_port = SPA_ID_INVALID;
+		pw_data_loop_invoke(impl->data_loop, do_add_stream, 0, NULL, 0, true, s);
+		link_stream(s);
+		return 0;
+	}
+
 	str = pw_properties_get(impl->props, PW_KEY_NODE_DESCRIPTION);
 	if (str == NULL)
 		str = pw_properties_get(impl->props, PW_KEY_NODE_NAME);
@@ -580,11 +767,25 @@ static void registry_event_global(void *data, uint32_t id,
 	const char *str;
 	struct stream_info info;
 
-	if (!spa_streq(type, PW_TYPE_INTERFACE_Node) || props == NULL)
+	if (props == NULL)
+		return;
+
+	if (impl->direct && spa_streq(type, PW_TYPE_INTERFACE_Port)) {
+		add_port(impl, id, props);
+		return;
+	}
+	if (!spa_streq(type, PW_TYPE_INTERFACE_Node))
 		return;
 
 	if (id == impl->combine_id)
 		return;
+	if (impl->direct && spa_streq(spa_dict_lookup(props, PW_KEY_NODE_NAME),
+				impl->combine_name)) {
+		/* the ports of the combine sink can come before the bound
+		 * event of the proxy */
+		impl->combine_id = id;
+		return;
+	}
 
 	spa_zero(info);
 	info.impl = impl;
@@ -607,6 +808,16 @@ static void registry_event_global_remove(void *data, uint32_t id)
 {
 	struct impl *impl = data;
 	struct stream *s;
+	struct port *p;
+
+	if (impl->direct) {
+		spa_list_for_each(p, &impl->ports, link) {
+			if (p->id == id) {
+				remove_port(impl, p);
+				return;
+			}
+		}
+	}
 
 	s = find_stream(impl, id);
 	if (s == NULL)
@@ -768,6 +979,75 @@ static const struct pw_stream_events combine_events = {
 	.state_changed = combine_state_changed,
 };
 
+static void combine_node_bound(void *data, uint32_t global_id)
+{
+	struct impl *impl = data;
+
+	impl->combine_id = global_id;
+	pw_log_info("got combine id %d", impl->combine_id);
+	link_streams(impl);
+}
+
+static void combine_node_removed(void *data)
+{
+	struct impl *impl = data;
+	pw_impl_module_schedule_destroy(impl->module);
+}
+
+static void combine_node_destroy(void *data)
+{
+	struct impl *impl = data;
+	spa_hook_remove(&impl->combine_node_listener);
+	impl->combine_node = NULL;
+}
+
+static const struct pw_proxy_events combine_node_events = {
+	PW_VERSION_PROXY_EVENTS,
+	.bound = combine_node_bound,
+	.removed = combine_node_removed,
+	.destroy = combine_node_destroy,
+};
+
+/* in direct mode, the combine sink is a null sink with monitor ports that
+ * are linked to the targets */
+static int create_combine_node(struct impl *impl)
+{
+	struct pw_properties *props = impl->combine_props;
+	uint32_t i;
+
+	impl->combine_props = NULL;
+
+	pw_properties_set(props, PW_KEY_FACTORY_NAME, "support.null-audio-sink");
+	if (pw_properties_get(props, "adapter.auto-port-config") == NULL)
+		pw_properties_set(props, "adapter.auto-port-config",
+				"{ mode = dsp monitor = true position = preserve }");
+	if (pw_properties_get(props, SPA_KEY_AUDIO_POSITION) == NULL) {
+		char pos[SPA_AUDIO_MAX_CHANNELS * 8];
+		struct spa_strbuf buf;
+
+		spa_strbuf_init(&buf, pos, sizeof(pos));
+		spa_strbuf_append(&buf, "[");
+		for (i = 0; i < impl->info.channels; i++)
+			spa_strbuf_append(&buf, " %s", spa_debug_type_find_short_name(
+					spa_type_audio_channel, impl->info.position[i]));
+		spa_strbuf_append(&buf, " ]");
+		pw_properties_set(props, SPA_KEY_AUDIO_POSITION, pos);
+	}
+
+	impl->combine_node = pw_core_create_object(impl->core,
+			"adapter", PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+			&props->dict, 0);
+	pw_properties_free(props);
+
+	if (impl->combine_node == NULL)
+		return -errno;
+
+	pw_proxy_add_listener(impl->combine_node,
+			&impl->combine_node_listener,
+			&combine_node_events, impl);
+	return 0;
+}
+
 static int create_combine(struct impl *impl)
 {
 	int res;
@@ -853,12 +1133,20 @@ static const struct pw_proxy_events core_proxy_events = {
 static void impl_destroy(struct impl *impl)
 {
 	struct stream *s;
+	struct port *p;
 
 	spa_list_consume(s, &impl->streams, link)
 		destroy_stream(s);
 
 	if (impl->combine)
 		pw_stream_destroy(impl->combine);
+	if (impl->combine_node)
+		pw_proxy_destroy(impl->combine_node);
+
+	spa_list_consume(p, &impl->ports, link) {
+		spa_list_remove(&p->link);
+		free(p);
+	}
 
 	if (impl->registry) {
 		spa_hook_remove(&impl->registry_listener);
@@ -922,6 +1210,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->data_loop = pw_context_get_data_loop(context);
 
 	spa_list_init(&impl->streams);
+	spa_list_init(&impl->ports);
+	impl->combine_id = SPA_ID_INVALID;
 
 	if (args == NULL)
 		args = "";
@@ -1009,6 +1299,13 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	parse_audio_info(impl->combine_props, &impl->info);
 
+	impl->direct = pw_properties_get_bool(props, "combine.direct", false);
+	if (impl->direct && impl->mode != MODE_SINK) {
+		pw_log_warn("combine.direct is only supported in sink mode");
+		impl->direct = false;
+	}
+	impl->combine_name = pw_properties_get(props, PW_KEY_NODE_NAME);
+
 	copy_props(props, impl->stream_props, PW_KEY_NODE_GROUP);
 	copy_props(props, impl->stream_props, PW_KEY_NODE_VIRTUAL);
 	copy_props(props, impl->stream_props, PW_KEY_NODE_LINK_GROUP);
@@ -1044,7 +1341,11 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 			&impl->core_listener,
 			&core_events, impl);
 
-	if ((res = create_combine(impl)) < 0)
+	if (impl->direct)
+		res = create_combine_node(impl);
+	else
+		res = create_combine(impl);
+	if (res < 0)
 		goto error;
 
 	impl->registry = pw_core_get_registry(impl->core, PW_VERSION_REGISTRY, 0);
@@ -38,6 +38,7 @@
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
 #include <spa/utils/json.h>
+#include <spa/utils/mailbox.h>
 #include <spa/support/cpu.h>
 #include <spa/param/latency-utils.h>
 #include <spa/pod/dynamic.h>
@@ -73,6 +74,14 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
  * - `filter.graph = []`: a description of the filter graph to run, see below
  * - `capture.props = {}`: properties to be passed to the input stream
  * - `playback.props = {}`: properties to be passed to the output stream
+ * - `filter.workers = <int>`: the number of extra realtime threads used to
+ *   process the graph, default 0. See below.
+ * - `filter.lazy = <bool>`: only create the filter instances when the streams
+ *   start to run, default false. Until then, no plugin instances are created
+ *   and no IR files are loaded.
+ * - `filter.idle-timeout = <int>`: destroy the filter instances when the streams
+ *   have not been running for this many seconds, default 0 (never). They are
+ *   created again when the streams start.
  *
  * ## Filter graph description
  *
@@ -191,6 +200,10 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
  * - `bq_notch` a notch filter.
  * - `bq_allpass` an allpass filter.
  *
+ * The instances of a biquad in all channels, and chains of biquads where the
+ * output of one biquad is only linked to the input of the next biquad, are
+ * processed together with SIMD instructions when available.
+ *
  * ### Convolver
  *
  * The convolver can be used to apply an impulse response to a signal. It is usually used
@@ -241,6 +254,12 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
  * - `offset`  The sample offset in the file as the start of the IR.
  * - `length`  The number of samples to use as the IR.
  * - `channel` The channel to use from the file as the IR.
+ * - `cache`   Store the processed IR in the user cache directory so that the
+ *             next load does not need to read, resample and transform the file
+ *             again. Default false.
+ *
+ * Convolvers with the same IR, like the copies of a node or the same node in
+ * other filter-chains in the process, share the transformed IR in memory.
  *
  * ### Delay
  *
@@ -273,6 +292,19 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
  * - `max-delay` the maximum delay in seconds. The "Delay (s)" parameter will
  *              be clamped to this value.
  *
+ * ## Workers
+ *
+ * By default the whole graph is processed in the data thread. With
+ * `filter.workers = <n>`, n extra realtime threads help to process the
+ * copies of the nodes and the nodes that don't depend on each other in
+ * parallel. The cycle completes when all nodes have run. This only pays off
+ * for graphs that are expensive enough, like many channels or long
+ * convolutions.
+ *
+ * The `filter.workers.load` property on the playback stream contains the
+ * fraction of time each thread spent processing, starting with the data
+ * thread. It is updated every second.
+ *
  * ## General options
  *
  * Options with well-known behavior. Most options can be added to the global
@@ -417,7 +449,10 @@ static const struct spa_dict_item module_props[] = {
 				"    outputs = [ <portname> ... ] "
 				"] "
 				"[ capture.props=<properties> ] "
-				"[ playback.props=<properties> ] " },
+				"[ playback.props=<properties> ] "
+				"[ filter.workers=<number of worker threads> ] "
+				"[ filter.lazy=<bool> ] "
+				"[ filter.idle-timeout=<seconds> ] " },
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
 };
 
@@ -428,6 +463,8 @@ static const struct spa_dict_item module_props[] = {
 #include <getopt.h>
 #include <limits.h>
 #include <math.h>
+#include <semaphore.h>
+#include <time.h>
 
 #include <spa/utils/result.h>
 #include <spa/pod/builder.h>
@@ -435,12 +472,15 @@ static const struct spa_dict_item module_props[] = {
 #include <spa/param/audio/raw.h>
 
 #include <pipewire/pipewire.h>
+#include <pipewire/thread.h>
 
 #define MAX_HNDL 64
+#define MAX_STAGES 16
+#define MAX_WORKERS 8u
 #define MAX_SAMPLES 8192
+#define MAX_SPIN 1024
 
 static float silence_data[MAX_SAMPLES];
-static float discard_data[MAX_SAMPLES];
 
 struct plugin {
 	struct spa_list link;
@@ -482,7 +522,8 @@ struct port {
 	uint32_t n_links;
 	uint32_t external;
 
-	float control_data;
+	float control_value;		/* current value, main thread */
+	float control_data;		/* value used by the plugin, data thread */
 	float *audio_data[MAX_HNDL];
 };
 
@@ -502,6 +543,7 @@ struct node {
 
 	uint32_t n_hndl;
 	void *hndl[MAX_HNDL];
+	uint32_t run_id[MAX_HNDL];	/* graph_run of each handle */
 
 	unsigned int n_deps;
 	unsigned int visited:1;
@@ -530,6 +572,35 @@ struct graph_hndl {
 	void **hndl;
 };
 
+/* a node in all channels, run with run_multi when multi is not NULL,
+ * or a single handle. */
+struct graph_run {
+	const struct fc_descriptor *desc;
+	void **hndl;
+	uint32_t n_stages;
+	uint32_t n_chains;
+	void ***multi;
+	void **instance;
+	struct node *node;		/* first node and handle of the run */
+	uint32_t index;
+};
+
+/* scheduling state of a graph_run when running with workers */
+struct graph_task {
+	uint32_t n_deps;
+	uint32_t pending;
+	uint32_t n_succ;
+	uint32_t *succ;
+};
+
+struct graph_worker {
+	struct graph *graph;
+	struct spa_thread *thread;
+	sem_t wakeup;			/* posted when the run we wait for is ready */
+	uint64_t busy;			/* nsec spent running tasks */
+	uint64_t last_busy;		/* main thread */
+};
+
 struct graph {
 	struct impl *impl;
 
@@ -545,8 +616,40 @@ struct graph {
 	uint32_t n_hndl;
 	struct graph_hndl *hndl;
 
+	uint32_t n_run;
+	struct graph_run *run;
+	void ***run_hndl;
+	void **run_instance;
+
 	uint32_t n_control;
 	struct port **control_port;
+
+	/* control values from the main thread, n_control floats per slot */
+	struct spa_mailbox control_mailbox;
+	float *control_values;
+
+	/* the data thread is worker 0, the others are woken up with sem
+	 * to take runs from the ready queue until all runs are done. A worker
+	 * that needs to wait for a slot of the ready queue puts itself in
+	 * waiter and sleeps on its wakeup sem, the data thread waits for the
+	 * last run on done_sem. */
+	uint32_t n_workers;
+	struct graph_worker workers[MAX_WORKERS + 1];
+	struct graph_task *task;
+	uint32_t *task_succ;
+	uint32_t *ready;
+	uint32_t *waiter;		/* worker index + 1 waiting for a slot */
+	uint32_t head;
+	uint32_t tail;
+	uint32_t done;
+	uint32_t n_samples;
+	sem_t sem;
+	sem_t done_sem;
+	bool running;
+	uint64_t last_time;
+
+	unsigned int instantiated:1;
+	bool active;			/* data thread, instances can be used */
 };
 
 struct impl {
@@ -578,6 +681,13 @@ struct impl {
 
 	long unsigned rate;
 
+	struct pw_loop *data_loop;
+	struct spa_source *load_timer;
+
+	bool lazy;
+	uint32_t idle_timeout;
+	struct spa_source *idle_timer;
+
 	struct graph graph;
 };
 
@@ -598,15 +708,147 @@ static void capture_process(void *d)
 	pw_stream_trigger_process(impl->playback);
 }
 
+static void graph_sync_controls(struct graph *graph)
+{
+	uint32_t i;
+	float *values;
+
+	if (SPA_LIKELY(!spa_mailbox_fetch(&graph->control_mailbox)))
+		return;
+
+	values = &graph->control_values[
+		spa_mailbox_read_index(&graph->control_mailbox) * graph->n_control];
+	for (i = 0; i < graph->n_control; i++)
+		graph->control_port[i]->control_data = values[i];
+}
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static inline void graph_run_one(struct graph_run *run, uint32_t n_samples)
+{
+	uint32_t i;
+
+	if (SPA_LIKELY(run->multi == NULL)) {
+		run->desc->run(*run->hndl, n_samples);
+	} else {
+		for (i = 0; i < run->n_chains * run->n_stages; i++)
+			run->instance[i] = *run->multi[i];
+		run->desc->run_multi(run->instance, run->n_stages,
+				run->n_chains, n_samples);
+	}
+}
+
+/* wait until the run in slot \a h of the ready queue is known. Spin for
+ * a short while because the runs are usually short, then sleep until the
+ * worker that fills the slot wakes us up. */
+static uint32_t graph_wait_ready(struct graph *graph, struct graph_worker *w, uint32_t h)
+{
+	uint32_t t, spin, id = w - graph->workers + 1;
+
+	for (spin = 0; spin < MAX_SPIN; spin++) {
+		if ((t = __atomic_load_n(&graph->ready[h], __ATOMIC_ACQUIRE)) != SPA_ID_INVALID)
+			return t;
+	}
+	__atomic_store_n(&graph->waiter[h], id, __ATOMIC_SEQ_CST);
+	if ((t = __atomic_load_n(&graph->ready[h], __ATOMIC_SEQ_CST)) == SPA_ID_INVALID) {
+		while (sem_wait(&w->wakeup) < 0 && errno == EINTR);
+		t = __atomic_load_n(&graph->ready[h], __ATOMIC_ACQUIRE);
+	} else if (__atomic_exchange_n(&graph->waiter[h], 0, __ATOMIC_SEQ_CST) == 0) {
+		/* the slot was filled after all but the other worker already
+		 * took us out of waiter, consume its wakeup */
+		while (sem_wait(&w->wakeup) < 0 && errno == EINTR);
+	}
+	return t;
+}
+
+/* put run \a t in the ready queue and wake up the worker that waits
+ * for this slot */
+static void graph_push_ready(struct graph *graph, uint32_t t)
+{
+	uint32_t idx, id;
+
+	idx = __atomic_fetch_add(&graph->tail, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&graph->ready[idx], t, __ATOMIC_SEQ_CST);
+
+	if ((id = __atomic_exchange_n(&graph->waiter[idx], 0, __ATOMIC_SEQ_CST)) != 0)
+		sem_post(&graph->workers[id - 1].wakeup);
+}
+
+/* take runs from the ready queue until all of them are taken, runs
+ * become ready when all the runs they depend on are done. */
+static void graph_run_tasks(struct graph *graph, struct graph_worker *w)
+{
+	uint32_t h, t, i, s, n_run = graph->n_run;
+	struct graph_task *task;
+	uint64_t t1, t2;
+
+	while ((h = __atomic_fetch_add(&graph->head, 1, __ATOMIC_ACQUIRE)) < n_run) {
+		t = graph_wait_ready(graph, w, h);
+
+		t1 = get_time_ns();
+		graph_run_one(&graph->run[t], graph->n_samples);
+		t2 = get_time_ns();
+		__atomic_store_n(&w->busy, w->busy + t2 - t1, __ATOMIC_RELAXED);
+
+		task = &graph->task[t];
+		for (i = 0; i < task->n_succ; i++) {
+			s = task->succ[i];
+			if (__atomic_sub_fetch(&graph->task[s].pending, 1, __ATOMIC_ACQ_REL) == 0)
+				graph_push_ready(graph, s);
+		}
+		if (__atomic_add_fetch(&graph->done, 1, __ATOMIC_ACQ_REL) == n_run)
+			sem_post(&graph->done_sem);
+	}
+}
+
+static void graph_run_parallel(struct graph *graph, uint32_t n_samples)
+{
+	uint32_t i, tail = 0, spin, n_run = graph->n_run;
+
+	graph->n_samples = n_samples;
+	for (i = 0; i < n_run; i++) {
+		graph->task[i].pending = graph->task[i].n_deps;
+		graph->ready[i] = SPA_ID_INVALID;
+		graph->waiter[i] = 0;
+	}
+	for (i = 0; i < n_run; i++) {
+		if (graph->task[i].n_deps == 0)
+			graph->ready[tail++] = i;
+	}
+	graph->tail = tail;
+	graph->done = 0;
+	__atomic_store_n(&graph->head, 0, __ATOMIC_RELEASE);
+
+	for (i = 0; i < graph->n_workers; i++)
+		sem_post(&graph->sem);
+
+	graph_run_tasks(graph, &graph->workers[0]);
+
+	/* the last run posts done_sem, consume it every cycle */
+	for (spin = 0; spin < MAX_SPIN; spin++) {
+		if (__atomic_load_n(&graph->done, __ATOMIC_ACQUIRE) == n_run)
+			break;
+	}
+	while (sem_wait(&graph->done_sem) < 0 && errno == EINTR);
+}
+
 static void playback_process(void *d)
 {
 	struct impl *impl = d;
 	struct pw_buffer *in, *out;
 	struct graph *graph = &impl->graph;
-	uint32_t i, j, insize = 0, outsize = 0, n_hndl = graph->n_hndl;
+	uint32_t i, j, insize = 0, outsize = 0, n_run = graph->n_run;
 	int32_t stride = 0;
 	struct graph_port *port;
 	struct spa_data *bd;
+	bool active = graph->active;
+
+	graph_sync_controls(graph);
 
 	if ((in = pw_stream_dequeue_buffer(impl->capture)) == NULL)
 		pw_log_debug("%p: out of capture buffers: %m", impl);
@@ -627,7 +869,7 @@ static void playback_process(void *d)
 
 		while (j < graph->n_input) {
 			port = &graph->input[j++];
-			if (port->desc)
+			if (port->desc && active)
 				port->desc->connect_port(*port->hndl, port->port,
 					SPA_PTROFF(bd->data, offs, void));
 			if (!port->next)
@@ -646,7 +888,7 @@ static void playback_process(void *d)
 
 		port = i < graph->n_output ? &graph->output[i] : NULL;
 
-		if (port && port->desc)
+		if (port && port->desc && active)
 			port->desc->connect_port(*port->hndl, port->port, bd->data);
 		else
 			memset(bd->data, 0, outsize);
@@ -659,9 +901,13 @@ static void playback_process(void *d)
 	pw_log_trace_fp("%p: stride:%d in:%d out:%d requested:%"PRIu64" (%"PRIu64")", impl,
 			stride, insize, outsize, out->requested, out->requested * stride);
 
-	for (i = 0; i < n_hndl; i++) {
-		struct graph_hndl *hndl = &graph->hndl[i];
-		hndl->desc->run(*hndl->hndl, outsize / sizeof(float));
+	if (SPA_UNLIKELY(!active)) {
+		/* not instantiated yet, output is silence */
+	} else if (graph->running) {
+		graph_run_parallel(graph, outsize / sizeof(float));
+	} else {
+		for (i = 0; i < n_run; i++)
+			graph_run_one(&graph->run[i], outsize / sizeof(float));
 	}
 
 done:
@@ -851,11 +1097,11 @@ static struct spa_pod *get_props_param(struct graph *graph, struct spa_pod_build
 
 		spa_pod_builder_string(b, name);
 		if (p->hint & FC_HINT_BOOLEAN) {
-			spa_pod_builder_bool(b, port->control_data <= 0.0f ? false : true);
+			spa_pod_builder_bool(b, port->control_value <= 0.0f ? false : true);
 		} else if (p->hint & FC_HINT_INTEGER) {
-			spa_pod_builder_int(b, port->control_data);
+			spa_pod_builder_int(b, port->control_value);
 		} else {
-			spa_pod_builder_float(b, port->control_data);
+			spa_pod_builder_float(b, port->control_value);
 		}
 	}
 	spa_pod_builder_pop(b, &f[1]);
@@ -875,10 +1121,28 @@ static int set_control_value(struct node *node, const char *name, float *value)
 	node = port->node;
 	desc = node->desc;
 
-	old = port->control_data;
-	port->control_data = value ? *value : desc->default_control[port->idx];
-	pw_log_info("control %d ('%s') from %f to %f", port->idx, name, old, port->control_data);
-	return old == port->control_data ? 0 : 1;
+	old = port->control_value;
+	port->control_value = value ? *value : desc->default_control[port->idx];
+	pw_log_info("control %d ('%s') from %f to %f", port->idx, name, old, port->control_value);
+	return old == port->control_value ? 0 : 1;
+}
+
+/* post the current control values to the data thread, they are applied
+ * at the start of the next cycle */
+static void graph_update_controls(struct graph *graph)
+{
+	uint32_t i;
+	float *values;
+
+	if (graph->control_values == NULL)
+		return;
+
+	values = &graph->control_values[
+		spa_mailbox_write_index(&graph->control_mailbox) * graph->n_control];
+	for (i = 0; i < graph->n_control; i++)
+		values[i] = graph->control_port[i]->control_value;
+
+	spa_mailbox_publish(&graph->control_mailbox);
 }
 
 static int parse_params(struct graph *graph, const struct spa_pod *pod)
@@ -954,6 +1218,8 @@ static void param_props_changed(struct impl *impl, const struct spa_pod *param)
 		struct spa_pod_dynamic_builder b;
 		const struct spa_pod *params[1];
 
+		graph_update_controls(graph);
+
 		spa_pod_dynamic_builder_init(&b, buffer, sizeof(buffer), 4096);
 		params[0] = get_props_param(graph, &b.b);
 
@@ -981,17 +1247,85 @@ static void param_latency_changed(struct impl *impl, const struct spa_pod *param
 		pw_stream_update_params(impl->playback, params, 1);
 }
 
+static int do_set_active(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct graph *graph = user_data;
+	graph->active = *(bool*)data;
+	return 0;
+}
+
+/* make sure the data thread is not using the instances when we change them */
+static void graph_set_active(struct impl *impl, bool active)
+{
+	if (impl->graph.active == active)
+		return;
+	pw_loop_invoke(impl->data_loop, do_set_active, 0, &active, sizeof(active),
+			true, &impl->graph);
+}
+
+static int graph_start(struct impl *impl)
+{
+	int res;
+
+	graph_set_active(impl, false);
+	if ((res = graph_instantiate(&impl->graph)) < 0)
+		return res;
+	graph_set_active(impl, true);
+	return 0;
+}
+
+static void graph_stop(struct impl *impl)
+{
+	graph_set_active(impl, false);
+	graph_cleanup(&impl->graph);
+}
+
+static void idle_timeout(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+
+	if ((impl->capture && pw_stream_get_state(impl->capture, NULL) == PW_STREAM_STATE_STREAMING) ||
+	    (impl->playback && pw_stream_get_state(impl->playback, NULL) == PW_STREAM_STATE_STREAMING))
+		return;
+
+	pw_log_info("module %p: idle for %us, destroy instances", impl, impl->idle_timeout);
+	graph_stop(impl);
+}
+
+static void update_idle_timer(struct impl *impl, bool enable)
+{
+	struct pw_loop *loop = pw_context_get_main_loop(impl->context);
+	struct timespec value = { impl->idle_timeout, 0 };
+
+	if (impl->idle_timer == NULL)
+		return;
+	pw_loop_update_timer(loop, impl->idle_timer, enable ? &value : NULL, NULL, false);
+}
+
 static void state_changed(void *data, enum pw_stream_state old,
 		enum pw_stream_state state, const char *error)
 {
 	struct impl *impl = data;
 	struct graph *graph = &impl->graph;
+	int res;
 
 	switch (state) {
 	case PW_STREAM_STATE_PAUSED:
 		pw_stream_flush(impl->playback, false);
 		pw_stream_flush(impl->capture, false);
 		graph_reset(graph);
+		if (graph->instantiated)
+			update_idle_timer(impl, true);
+		break;
+	case PW_STREAM_STATE_STREAMING:
+		update_idle_timer(impl, false);
+		if (!graph->instantiated && impl->rate != 0) {
+			pw_log_info("module %p: streaming, create instances", impl);
+			if ((res = graph_start(impl)) < 0)
+				pw_stream_set_error(impl->capture, res, "can't start graph: %s",
+						spa_strerror(res));
+		}
 		break;
 	case PW_STREAM_STATE_UNCONNECTED:
 		pw_log_info("module %p: unconnected", impl);
@@ -1014,7 +1348,7 @@ static void param_changed(void *data, uint32_t id, const struct spa_pod *param)
 	switch (id) {
 	case SPA_PARAM_Format:
 		if (param == NULL) {
-			graph_cleanup(graph);
+			graph_stop(impl);
 		} else {
 			struct spa_audio_info_raw info;
 			spa_zero(info);
@@ -1025,7 +1359,9 @@ static void param_changed(void *data, uint32_t id, const struct spa_pod *param)
 				goto error;
 			}
 			impl->rate = info.rate;
-			if ((res = graph_instantiate(graph)) < 0)
+			if (impl->lazy && !graph->instantiated)
+				break;
+			if ((res = graph_start(impl)) < 0)
 				goto error;
 		}
 		break;
@@ -1625,7 +1961,8 @@ static int load_node(struct graph *graph, struct spa_json *json)
 		port->external = SPA_ID_INVALID;
 		port->p = desc->control[i];
 		spa_list_init(&port->link_list);
-		port->control_data = desc->default_control[i];
+		port->control_value = desc->default_control[i];
+		port->control_data = port->control_value;
 	}
 	for (i = 0; i < desc->n_notify; i++) {
 		struct port *port = &node->notify_port[i];
@@ -1704,6 +2041,7 @@ static void graph_cleanup(struct graph *graph)
 	struct node *node;
 	spa_list_for_each(node, &graph->node_list, link)
 		node_cleanup(node);
+	graph->instantiated = false;
 }
 
 static int graph_instantiate(struct graph *graph)
@@ -1718,14 +2056,14 @@ static int graph_instantiate(struct graph *graph)
 	int res;
 
 	spa_list_for_each(node, &graph->node_list, link) {
-		float *sd = silence_data, *dd = discard_data;
+		float *sd = silence_data;
 
 		node_cleanup(node);
 
 		desc = node->desc;
 		d = desc->desc;
 		if (d->flags & FC_DESCRIPTOR_SUPPORTS_NULL_DATA)
-			sd = dd = NULL;
+			sd = NULL;
 
 		for (i = 0; i < node->n_hndl; i++) {
 			pw_log_info("instantiate %s %d rate:%lu", d->name, i, impl->rate);
@@ -1759,6 +2097,7 @@ static int graph_instantiate(struct graph *graph)
 			}
 			for (j = 0; j < desc->n_control; j++) {
 				port = &node->control_port[j];
+				port->control_data = port->control_value;
 				d->connect_port(node->hndl[i], port->p, &port->control_data);
 			}
 			for (j = 0; j < desc->n_notify; j++) {
@@ -1769,6 +2108,7 @@ static int graph_instantiate(struct graph *graph)
 				d->activate(node->hndl[i]);
 		}
 	}
+	graph->instantiated = true;
 	return 0;
 error:
 	graph_cleanup(graph);
@@ -1787,6 +2127,284 @@ static struct node *find_next_node(struct graph *graph)
 	return NULL;
 }
 
+/* find the node that can be run in the same run_multi call after node. It
+ * needs to use the same run_multi function and its only input should be
+ * the only output of node. */
+static struct node *find_next_stage(struct graph *graph, struct node *node)
+{
+	struct descriptor *desc = node->desc, *pdesc;
+	struct port *port, *peer;
+	struct link *link;
+	uint32_t i;
+
+	if (desc->n_output != 1 || node == spa_list_last(&graph->node_list, struct node, link))
+		return NULL;
+	port = &node->output_port[0];
+	if (port->n_links != 1 || port->external != SPA_ID_INVALID)
+		return NULL;
+
+	link = spa_list_first(&port->link_list, struct link, output_link);
+	peer = link->input;
+	pdesc = peer->node->desc;
+	if (peer->node->disabled || pdesc->n_input != 1 ||
+	    peer != &peer->node->input_port[0] ||
+	    peer->external != SPA_ID_INVALID ||
+	    peer->node == spa_list_first(&graph->node_list, struct node, link) ||
+	    pdesc->desc->run_multi != desc->desc->run_multi)
+		return NULL;
+	for (i = 0; i < pdesc->n_control; i++) {
+		if (peer->node->control_port[i].n_links > 0)
+			return NULL;
+	}
+	return peer->node;
+}
+
+/* with workers, the channels of a multi run are split in slices so that
+ * each thread can take one of them. */
+static uint32_t get_slice_size(struct graph *graph, uint32_t n_hndl)
+{
+	uint32_t n_slices, size;
+
+	if (graph->n_workers == 0)
+		return n_hndl;
+	n_slices = SPA_MIN(graph->n_workers + 1, n_hndl);
+	size = (n_hndl + n_slices - 1) / n_slices;
+	/* keep the SIMD lanes of run_multi filled */
+	if (size > 4)
+		size = SPA_ROUND_UP_N(size, 4);
+	return size;
+}
+
+static void setup_graph_run(struct graph *graph, struct node **sorted, uint32_t n_sorted,
+		uint32_t n_hndl)
+{
+	struct node *stages[MAX_STAGES], *next;
+	struct graph_run *run;
+	uint32_t i, j, k, n_stages, n_multi = 0, slice, n_chains;
+	const struct fc_descriptor *d;
+
+	graph->n_run = 0;
+	for (i = 0; i < n_sorted; i++) {
+		if (sorted[i] == NULL)
+			continue;
+
+		d = sorted[i]->desc->desc;
+		n_stages = 0;
+		stages[n_stages++] = sorted[i];
+		if (d->run_multi != NULL) {
+			while (n_stages < MAX_STAGES &&
+			    (next = find_next_stage(graph, stages[n_stages-1])) != NULL) {
+				for (j = i + 1; j < n_sorted; j++)
+					if (sorted[j] == next)
+						sorted[j] = NULL;
+				stages[n_stages++] = next;
+			}
+		}
+		if (d->run_multi == NULL || (n_stages == 1 && n_hndl == 1)) {
+			for (j = 0; j < n_hndl; j++) {
+				sorted[i]->run_id[j] = graph->n_run;
+				run = &graph->run[graph->n_run++];
+				run->desc = d;
+				run->hndl = &sorted[i]->hndl[j];
+				run->n_stages = 1;
+				run->n_chains = 1;
+				run->node = sorted[i];
+				run->index = j;
+			}
+			continue;
+		}
+
+		pw_log_info("run %d stages of %s in %d channels together",
+				n_stages, sorted[i]->name, n_hndl);
+
+		slice = get_slice_size(graph, n_hndl);
+		for (j = 0; j < n_hndl; j += n_chains) {
+			n_chains = SPA_MIN(slice, n_hndl - j);
+
+			run = &graph->run[graph->n_run];
+			run->desc = d;
+			run->n_stages = n_stages;
+			run->n_chains = n_chains;
+			run->multi = &graph->run_hndl[n_multi];
+			run->instance = &graph->run_instance[n_multi];
+			run->node = sorted[i];
+			run->index = j;
+			for (k = 0; k < n_chains * n_stages; k++) {
+				run->multi[k] = &stages[k % n_stages]->hndl[j + k / n_stages];
+				stages[k % n_stages]->run_id[j + k / n_stages] = graph->n_run;
+			}
+			n_multi += n_chains * n_stages;
+			graph->n_run++;
+		}
+	}
+}
+
+static int task_edge_compare(const void *a, const void *b)
+{
+	const uint64_t *ea = a, *eb = b;
+	return *ea < *eb ? -1 : *ea > *eb;
+}
+
+/* make the tasks of the runs, each run depends on the runs that produce
+ * the inputs and controls of its first node */
+static int setup_graph_tasks(struct graph *graph)
+{
+	struct graph_run *run;
+	struct port *ports;
+	struct link *link;
+	struct node *peer;
+	uint64_t *edges, e;
+	uint32_t i, j, k, p, n_ports, n_edges = 0, n_succ = 0, from, to;
+
+	if (graph->n_workers == 0)
+		return 0;
+
+	for (i = 0; i < graph->n_run; i++) {
+		run = &graph->run[i];
+		for (j = 0; j < run->node->desc->n_input; j++)
+			n_edges += run->node->input_port[j].n_links * run->n_chains;
+		for (j = 0; j < run->node->desc->n_control; j++)
+			n_edges += run->node->control_port[j].n_links * run->n_chains;
+	}
+
+	graph->task = calloc(graph->n_run, sizeof(struct graph_task));
+	graph->ready = calloc(graph->n_run, sizeof(uint32_t));
+	graph->waiter = calloc(graph->n_run, sizeof(uint32_t));
+	edges = calloc(n_edges + 1, sizeof(uint64_t));
+	n_edges = 0;
+	if (graph->task == NULL || graph->ready == NULL ||
+	    graph->waiter == NULL || edges == NULL) {
+		free(edges);
+		return -errno;
+	}
+
+	for (i = 0; i < graph->n_run; i++) {
+		run = &graph->run[i];
+		for (p = 0; p < 2; p++) {
+			ports = p == 0 ? run->node->input_port : run->node->control_port;
+			n_ports = p == 0 ? run->node->desc->n_input : run->node->desc->n_control;
+			for (j = 0; j < n_ports; j++) {
+				spa_list_for_each(link, &ports[j].link_list, input_link) {
+					peer = link->output->node;
+					if (peer->disabled)
+						continue;
+					for (k = 0; k < run->n_chains; k++) {
+						from = peer->run_id[run->index + k];
+						edges[n_edges++] = ((uint64_t)from << 32) | i;
+					}
+				}
+			}
+		}
+	}
+	qsort(edges, n_edges, sizeof(uint64_t), task_edge_compare);
+
+	graph->task_succ = calloc(n_edges + 1, sizeof(uint32_t));
+	if (graph->task_succ == NULL) {
+		free(edges);
+		return -errno;
+	}
+	for (i = 0; i < n_edges; i++) {
+		e = edges[i];
+		if (i > 0 && e == edges[i-1])
+			continue;
+		from = e >> 32;
+		to = e & 0xffffffff;
+		if (graph->task[from].n_succ++ == 0)
+			graph->task[from].succ = &graph->task_succ[n_succ];
+		graph->task_succ[n_succ++] = to;
+		graph->task[to].n_deps++;
+	}
+	free(edges);
+
+	for (i = 0; i < graph->n_run; i++)
+		pw_log_debug("task %d: %s[%d] deps:%d succ:%d", i, graph->run[i].node->name,
+				graph->run[i].index, graph->task[i].n_deps, graph->task[i].n_succ);
+	return 0;
+}
+
+static void *graph_worker_start(void *data)
+{
+	struct graph_worker *w = data;
+	struct graph *graph = w->graph;
+
+	while (true) {
+		while (sem_wait(&graph->sem) < 0 && errno == EINTR);
+		if (!__atomic_load_n(&graph->running, __ATOMIC_ACQUIRE))
+			break;
+		graph_run_tasks(graph, w);
+	}
+	return NULL;
+}
+
+static void graph_stop_workers(struct graph *graph);
+
+static int graph_start_workers(struct graph *graph)
+{
+	struct graph_worker *w;
+	uint32_t i;
+	int res;
+
+	if (graph->n_workers == 0)
+		return 0;
+
+	if (sem_init(&graph->sem, 0, 0) < 0)
+		return -errno;
+	if (sem_init(&graph->done_sem, 0, 0) < 0 ||
+	    sem_init(&graph->workers[0].wakeup, 0, 0) < 0) {
+		res = -errno;
+		sem_destroy(&graph->sem);
+		sem_destroy(&graph->done_sem);
+		return res;
+	}
+
+	graph->head = graph->n_run;
+	graph->running = true;
+	graph->last_time = get_time_ns();
+	graph->workers[0].graph = graph;
+
+	for (i = 1; i <= graph->n_workers; i++) {
+		w = &graph->workers[i];
+		w->graph = graph;
+		if (sem_init(&w->wakeup, 0, 0) < 0) {
+			res = -errno;
+			goto error;
+		}
+		w->thread = pw_thread_utils_create(NULL, graph_worker_start, w);
+		if (w->thread == NULL) {
+			res = -errno;
+			sem_destroy(&w->wakeup);
+			goto error;
+		}
+		pw_thread_utils_acquire_rt(w->thread, -1);
+	}
+	pw_log_info("running graph with %d workers", graph->n_workers);
+	return 0;
+
+error:
+	pw_log_error("can't create worker thread: %s", spa_strerror(res));
+	graph->n_workers = i - 1;
+	graph_stop_workers(graph);
+	return res;
+}
+
+static void graph_stop_workers(struct graph *graph)
+{
+	uint32_t i;
+
+	if (!graph->running)
+		return;
+
+	__atomic_store_n(&graph->running, false, __ATOMIC_RELEASE);
+	for (i = 0; i < graph->n_workers; i++)
+		sem_post(&graph->sem);
+	for (i = 1; i <= graph->n_workers; i++)
+		pw_thread_utils_join(graph->workers[i].thread, NULL);
+	for (i = 0; i <= graph->n_workers; i++)
+		sem_destroy(&graph->workers[i].wakeup);
+	sem_destroy(&graph->sem);
+	sem_destroy(&graph->done_sem);
+}
+
 static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_json *outputs)
 {
 	struct impl *impl = graph->impl;
@@ -1795,7 +2413,8 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 	struct link *link;
 	struct graph_port *gp;
 	struct graph_hndl *gh;
-	uint32_t i, j, n_nodes, n_input, n_output, n_control, n_hndl = 0;
+	struct node **sorted = NULL;
+	uint32_t i, j, n_nodes, n_input, n_output, n_control, n_hndl = 0, n_sorted = 0;
 	int res;
 	struct descriptor *desc;
 	const struct fc_descriptor *d;
@@ -2007,8 +2626,14 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 	/* order all nodes based on dependencies */
 	graph->n_hndl = 0;
 	graph->hndl = calloc(n_nodes * n_hndl, sizeof(struct graph_hndl));
+	graph->run = calloc(n_nodes * n_hndl, sizeof(struct graph_run));
+	graph->run_hndl = calloc(n_nodes * n_hndl, sizeof(void **));
+	graph->run_instance = calloc(n_nodes * n_hndl, sizeof(void *));
+	sorted = calloc(n_nodes, sizeof(struct node *));
 	graph->n_control = 0;
 	graph->control_port = calloc(n_control, sizeof(struct port *));
+	graph->control_values = calloc(n_control * SPA_MAILBOX_SLOTS, sizeof(float));
+	spa_mailbox_init(&graph->control_mailbox);
 	while (true) {
 		if ((node = find_next_node(graph)) == NULL)
 			break;
@@ -2022,6 +2647,7 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 				gh->hndl = &node->hndl[i];
 				gh->desc = d;
 			}
+			sorted[n_sorted++] = node;
 		}
 		for (i = 0; i < desc->n_output; i++) {
 			spa_list_for_each(link, &node->output_port[i].link_list, output_link)
@@ -2034,8 +2660,11 @@ static int setup_graph(struct graph *graph, struct spa_json *inputs, struct spa_
 			graph->n_control++;
 		}
 	}
-	res = 0;
+	/* group the nodes that can run together */
+	setup_graph_run(graph, sorted, n_sorted, n_hndl);
+	res = setup_graph_tasks(graph);
 error:
+	free(sorted);
 	return res;
 }
 
@@ -2126,6 +2755,9 @@ static void graph_free(struct graph *graph)
 {
 	struct link *link;
 	struct node *node;
+
+	graph_stop_workers(graph);
+
 	spa_list_consume(link, &graph->link_list, link)
 		link_free(link);
 	spa_list_consume(node, &graph->node_list, link)
@@ -2133,7 +2765,15 @@ static void graph_free(struct graph *graph)
 	free(graph->input);
 	free(graph->output);
 	free(graph->hndl);
+	free(graph->run);
+	free(graph->run_hndl);
+	free(graph->run_instance);
+	free(graph->task);
+	free(graph->task_succ);
+	free(graph->ready);
+	free(graph->waiter);
 	free(graph->control_port);
+	free(graph->control_values);
 }
 
 static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
@@ -2169,6 +2809,42 @@ static const struct pw_proxy_events core_proxy_events = {
 	.destroy = core_destroy,
 };
 
+/* publish the fraction of time each thread spent running the graph,
+ * the first value is for the data thread */
+static void load_timer(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	struct graph *graph = &impl->graph;
+	struct graph_worker *w;
+	struct spa_strbuf s;
+	uint64_t now, busy, elapsed;
+	char str[64 * (MAX_WORKERS + 1)], val[64];
+	uint32_t i;
+
+	now = get_time_ns();
+	elapsed = now - graph->last_time;
+	graph->last_time = now;
+	if (elapsed == 0 || impl->playback == NULL)
+		return;
+
+	spa_strbuf_init(&s, str, sizeof(str));
+	spa_strbuf_append(&s, "[");
+	for (i = 0; i <= graph->n_workers; i++) {
+		w = &graph->workers[i];
+		busy = __atomic_load_n(&w->busy, __ATOMIC_RELAXED);
+		spa_json_format_float(val, sizeof(val),
+				(float)(busy - w->last_busy) / elapsed);
+		spa_strbuf_append(&s, " %s", val);
+		w->last_busy = busy;
+	}
+	spa_strbuf_append(&s, " ]");
+
+	pw_log_debug("%p: worker load %s", impl, str);
+	pw_stream_update_properties(impl->playback, &SPA_DICT_INIT_ARRAY(
+				((struct spa_dict_item[]) {
+					{ "filter.workers.load", str } })));
+}
+
 static void impl_destroy(struct impl *impl)
 {
 	/* disconnect both streams before destroying any of them */
@@ -2185,6 +2861,13 @@ static void impl_destroy(struct impl *impl)
 	if (impl->core && impl->do_disconnect)
 		pw_core_disconnect(impl->core);
 
+	if (impl->load_timer)
+		pw_loop_destroy_source(pw_context_get_main_loop(impl->context),
+				impl->load_timer);
+	if (impl->idle_timer)
+		pw_loop_destroy_source(pw_context_get_main_loop(impl->context),
+				impl->idle_timer);
+
 	pw_properties_free(impl->capture_props);
 	pw_properties_free(impl->playback_props);
 	graph_free(&impl->graph);
@@ -2296,6 +2979,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	impl->module = module;
 	impl->context = context;
+	impl->data_loop = pw_data_loop_get_loop(pw_context_get_data_loop(context));
 	impl->graph.impl = impl;
 
 	spa_list_init(&impl->plugin_list);
@@ -2367,10 +3051,35 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 		pw_properties_setf(impl->playback_props, PW_KEY_MEDIA_NAME, "%s output",
 				pw_properties_get(impl->playback_props, PW_KEY_NODE_DESCRIPTION));
 
+	impl->graph.n_workers = SPA_MIN(pw_properties_get_uint32(props,
+				"filter.workers", 0), MAX_WORKERS);
+	impl->lazy = pw_properties_get_bool(props, "filter.lazy", false);
+	impl->idle_timeout = pw_properties_get_uint32(props, "filter.idle-timeout", 0);
+	if (impl->idle_timeout > 0) {
+		impl->idle_timer = pw_loop_add_timer(pw_context_get_main_loop(context),
+				idle_timeout, impl);
+		if (impl->idle_timer == NULL) {
+			res = -errno;
+			pw_log_error("can't create idle timer: %m");
+			goto error;
+		}
+	}
+
 	if ((res = load_graph(&impl->graph, props)) < 0) {
 		pw_log_error("can't load graph: %s", spa_strerror(res));
 		goto error;
 	}
+	if ((res = graph_start_workers(&impl->graph)) < 0) {
+		pw_log_error("can't start workers: %s", spa_strerror(res));
+		goto error;
+	}
+	if (impl->graph.n_workers > 0) {
+		struct pw_loop *loop = pw_context_get_main_loop(impl->context);
+		struct timespec value = { 1, 0 }, interval = { 1, 0 };
+		impl->load_timer = pw_loop_add_timer(loop, load_timer, impl);
+		if (impl->load_timer != NULL)
+			pw_loop_update_timer(loop, impl->load_timer, &value, &interval, false);
+	}
 
 	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
 	if (impl->core == NULL) {
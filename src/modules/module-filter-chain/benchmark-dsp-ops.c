@@ -0,0 +1,239 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+
+#include "dsp-ops.h"
+
+#define MAX_SAMPLES	1024
+#define MAX_CHANNELS	16
+#define MAX_BQ		10
+
+#define MAX_COUNT	200
+
+typedef void (*biquadn_func_t) (struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_src, uint32_t n_samples);
+
+struct stats {
+	uint32_t n_samples;
+	uint32_t n_channels;
+	uint32_t n_bq;
+	uint64_t perf;
+	const char *name;
+	const char *impl;
+};
+
+static uint32_t cpu_flags;
+
+static float samp_in[MAX_CHANNELS][MAX_SAMPLES];
+static float samp_out[MAX_CHANNELS][MAX_SAMPLES];
+static float samp_ref[MAX_CHANNELS][MAX_SAMPLES];
+
+static struct biquad bq_data[MAX_CHANNELS * MAX_BQ];
+
+static const uint32_t sample_sizes[] = { 13, 256, 1024 };
+static const uint32_t channel_counts[] = { 1, 2, 6, 8, 16 };
+static const uint32_t bq_counts[] = { 1, 4, 10 };
+
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * \
+			SPA_N_ELEMENTS(bq_counts) * 4
+
+static uint32_t n_results = 0;
+static struct stats results[MAX_RESULTS];
+
+static int errors = 0;
+
+static void setup_biquads(uint32_t n_channels, uint32_t n_bq)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < n_channels; i++) {
+		for (j = 0; j < n_bq; j++) {
+			struct biquad *bq = &bq_data[i * n_bq + j];
+			biquad_set(bq, j == 0 ? BQ_LOWSHELF : BQ_PEAKING,
+					(j + 1) * 0.08, 0.7 + i * 0.1, -6.0 + j);
+			bq->x1 = bq->x2 = bq->y1 = bq->y2 = 0.0f;
+		}
+	}
+}
+
+/* what the graph did before, one biquad_run per channel and section */
+static void biquad_run_single(struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, j;
+	for (i = 0; i < n_src; i++) {
+		for (j = 0; j < n_bq; j++)
+			dsp_biquad_run_c(ops, bq[i * n_bq + j], out[i],
+					j == 0 ? in[i] : out[i], n_samples);
+	}
+}
+
+static void run_test1(const char *name, const char *impl, biquadn_func_t func,
+		uint32_t n_channels, uint32_t n_bq, uint32_t n_samples)
+{
+	struct biquad *bq[MAX_CHANNELS * MAX_BQ];
+	const float *ip[MAX_CHANNELS];
+	float *op[MAX_CHANNELS];
+	struct timespec ts;
+	uint64_t count, t1, t2;
+	uint32_t i, j;
+
+	for (i = 0; i < n_channels; i++) {
+		ip[i] = samp_in[i];
+		op[i] = samp_out[i];
+	}
+	for (i = 0; i < n_channels * n_bq; i++)
+		bq[i] = &bq_data[i];
+
+	/* check the output of the first run against the reference */
+	setup_biquads(n_channels, n_bq);
+	func(NULL, bq, n_bq, op, ip, n_channels, n_samples);
+	for (i = 0; i < n_channels; i++) {
+		for (j = 0; j < n_samples; j++) {
+			if (fabsf(samp_out[i][j] - samp_ref[i][j]) > 1e-4f) {
+				fprintf(stderr, "%s %s: channel %d sample %d: %f != %f\n",
+						name, impl, i, j, samp_out[i][j], samp_ref[i][j]);
+				errors++;
+				break;
+			}
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	count = 0;
+	for (i = 0; i < MAX_COUNT; i++) {
+		func(NULL, bq, n_bq, op, ip, n_channels, n_samples);
+		count++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	spa_assert(n_results < MAX_RESULTS);
+
+	results[n_results++] = (struct stats) {
+		.n_samples = n_samples,
+		.n_channels = n_channels,
+		.n_bq = n_bq,
+		.perf = count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1),
+		.name = name,
+		.impl = impl
+	};
+}
+
+static void make_reference(uint32_t n_channels, uint32_t n_bq, uint32_t n_samples)
+{
+	struct biquad *bq[MAX_CHANNELS * MAX_BQ];
+	const float *ip[MAX_CHANNELS];
+	float *op[MAX_CHANNELS];
+	uint32_t i;
+
+	for (i = 0; i < n_channels; i++) {
+		ip[i] = samp_in[i];
+		op[i] = samp_ref[i];
+	}
+	for (i = 0; i < n_channels * n_bq; i++)
+		bq[i] = &bq_data[i];
+
+	setup_biquads(n_channels, n_bq);
+	biquad_run_single(NULL, bq, n_bq, op, ip, n_channels, n_samples);
+}
+
+static void test_biquadn(void)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(sample_sizes, s) {
+		SPA_FOR_EACH_ELEMENT_VAR(channel_counts, c) {
+			SPA_FOR_EACH_ELEMENT_VAR(bq_counts, b) {
+				make_reference(*c, *b, *s);
+
+				run_test1("biquad_run", "c", biquad_run_single, *c, *b, *s);
+				run_test1("biquadn_run", "c", dsp_biquadn_run_c, *c, *b, *s);
+#if defined (HAVE_SSE)
+				if (cpu_flags & SPA_CPU_FLAG_SSE)
+					run_test1("biquadn_run", "sse", dsp_biquadn_run_sse, *c, *b, *s);
+#endif
+#if defined (HAVE_AVX)
+				if (cpu_flags & SPA_CPU_FLAG_AVX)
+					run_test1("biquadn_run", "avx", dsp_biquadn_run_avx, *c, *b, *s);
+#endif
+			}
+		}
+	}
+}
+
+static int compare_func(const void *_a, const void *_b)
+{
+	const struct stats *a = _a, *b = _b;
+	int diff;
+	if ((diff = a->n_samples - b->n_samples) != 0) return diff;
+	if ((diff = a->n_channels - b->n_channels) != 0) return diff;
+	if ((diff = a->n_bq - b->n_bq) != 0) return diff;
+	if ((diff = b->perf - a->perf) != 0) return diff;
+	return 0;
+}
+
+static uint32_t get_cpu_flags(void)
+{
+	uint32_t flags = 0;
+#if defined (__i386__) || defined (__x86_64__)
+	if (__builtin_cpu_supports("sse"))
+		flags |= SPA_CPU_FLAG_SSE;
+	if (__builtin_cpu_supports("avx"))
+		flags |= SPA_CPU_FLAG_AVX;
+#endif
+	return flags;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t i, j;
+
+	cpu_flags = get_cpu_flags();
+	printf("got get CPU flags %d\n", cpu_flags);
+
+	srand(0);
+	for (i = 0; i < MAX_CHANNELS; i++)
+		for (j = 0; j < MAX_SAMPLES; j++)
+			samp_in[i][j] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+
+	test_biquadn();
+
+	qsort(results, n_results, sizeof(struct stats), compare_func);
+
+	for (i = 0; i < n_results; i++) {
+		struct stats *s = &results[i];
+		fprintf(stderr, "%-12."PRIu64" \t%-16.16s %s \t samples %d, channels %d, biquads %d\n",
+				s->perf, s->name, s->impl, s->n_samples, s->n_channels, s->n_bq);
+	}
+	return errors ? -1 : 0;
+}
@@ -26,12 +26,18 @@
 
 #include <float.h>
 #include <math.h>
+#include <pwd.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #ifdef HAVE_SNDFILE
 #include <sndfile.h>
 #endif
 
 #include <spa/utils/json.h>
+#include <spa/utils/list.h>
 #include <spa/utils/result.h>
+#include <spa/utils/string.h>
 #include <spa/support/cpu.h>
 #include <spa/plugins/audioconvert/resample.h>
 
@@ -53,6 +59,7 @@ struct builtin {
 	float *port[64];
 
 	struct biquad bq;
+	enum biquad_type type;
 	float freq;
 	float Q;
 	float gain;
@@ -262,11 +269,38 @@ static struct fc_port bq_ports[] = {
 	},
 };
 
-static void bq_run(struct builtin *impl, unsigned long samples, int type)
+static const struct {
+	const char *name;
+	enum biquad_type type;
+} bq_types[] = {
+	{ "bq_lowpass", BQ_LOWPASS },
+	{ "bq_highpass", BQ_HIGHPASS },
+	{ "bq_bandpass", BQ_BANDPASS },
+	{ "bq_lowshelf", BQ_LOWSHELF },
+	{ "bq_highshelf", BQ_HIGHSHELF },
+	{ "bq_peaking", BQ_PEAKING },
+	{ "bq_notch", BQ_NOTCH },
+	{ "bq_allpass", BQ_ALLPASS },
+};
+
+static void *bq_instantiate(const struct fc_descriptor * Descriptor,
+		unsigned long SampleRate, int index, const char *config)
+{
+	struct builtin *impl;
+
+	if ((impl = builtin_instantiate(Descriptor, SampleRate, index, config)) == NULL)
+		return NULL;
+
+	impl->type = BQ_NONE;
+	SPA_FOR_EACH_ELEMENT_VAR(bq_types, t) {
+		if (spa_streq(t->name, Descriptor->name))
+			impl->type = t->type;
+	}
+	return impl;
+}
+
+static void bq_update(struct builtin *impl)
 {
-	struct biquad *bq = &impl->bq;
-	float *out = impl->port[0];
-	float *in = impl->port[1];
 	float freq = impl->port[2][0];
 	float Q = impl->port[3][0];
 	float gain = impl->port[4][0];
@@ -275,172 +309,326 @@ static void bq_run(struct builtin *impl, unsigned long samples, int type)
 		impl->freq = freq;
 		impl->Q = Q;
 		impl->gain = gain;
-		biquad_set(bq, type, freq * 2 / impl->rate, Q, gain);
+		biquad_set(&impl->bq, impl->type, freq * 2 / impl->rate, Q, gain);
 	}
-	dsp_ops_biquad_run(dsp_ops, bq, out, in, samples);
 }
 
-/** bq_lowpass */
-static void bq_lowpass_run(void * Instance, unsigned long SampleCount)
+static void bq_run(void * Instance, unsigned long SampleCount)
 {
 	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_LOWPASS);
+	bq_update(impl);
+	dsp_ops_biquad_run(dsp_ops, &impl->bq, impl->port[0], impl->port[1], SampleCount);
 }
 
+/* chains of biquads, possibly of different types, in all channels are
+ * processed together with the multichannel biquad function */
+static void bq_run_multi(void **Instance, uint32_t n_stages, uint32_t n_chains,
+		unsigned long SampleCount)
+{
+	struct biquad *bq[n_chains * n_stages];
+	float *out[n_chains];
+	const float *in[n_chains];
+	struct builtin *impl;
+	uint32_t i, j;
+
+	for (i = 0; i < n_chains; i++) {
+		for (j = 0; j < n_stages; j++) {
+			impl = Instance[i * n_stages + j];
+			bq_update(impl);
+			bq[i * n_stages + j] = &impl->bq;
+		}
+		impl = Instance[i * n_stages];
+		in[i] = impl->port[1];
+		impl = Instance[i * n_stages + n_stages - 1];
+		out[i] = impl->port[0];
+	}
+	dsp_ops_biquadn_run(dsp_ops, bq, n_stages, out, in, n_chains, SampleCount);
+}
+
+/** bq_lowpass */
 static const struct fc_descriptor bq_lowpass_desc = {
 	.name = "bq_lowpass",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_lowpass_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** bq_highpass */
-static void bq_highpass_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_HIGHPASS);
-}
-
 static const struct fc_descriptor bq_highpass_desc = {
 	.name = "bq_highpass",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_highpass_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** bq_bandpass */
-static void bq_bandpass_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_BANDPASS);
-}
-
 static const struct fc_descriptor bq_bandpass_desc = {
 	.name = "bq_bandpass",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_bandpass_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** bq_lowshelf */
-static void bq_lowshelf_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_LOWSHELF);
-}
-
 static const struct fc_descriptor bq_lowshelf_desc = {
 	.name = "bq_lowshelf",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_lowshelf_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** bq_highshelf */
-static void bq_highshelf_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_HIGHSHELF);
-}
-
 static const struct fc_descriptor bq_highshelf_desc = {
 	.name = "bq_highshelf",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_highshelf_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** bq_peaking */
-static void bq_peaking_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_PEAKING);
-}
-
 static const struct fc_descriptor bq_peaking_desc = {
 	.name = "bq_peaking",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_peaking_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** bq_notch */
-static void bq_notch_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_NOTCH);
-}
-
 static const struct fc_descriptor bq_notch_desc = {
 	.name = "bq_notch",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_notch_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 
 /** bq_allpass */
-static void bq_allpass_run(void * Instance, unsigned long SampleCount)
-{
-	struct builtin *impl = Instance;
-	bq_run(impl, SampleCount, BQ_ALLPASS);
-}
-
 static const struct fc_descriptor bq_allpass_desc = {
 	.name = "bq_allpass",
 
 	.n_ports = 5,
 	.ports = bq_ports,
 
-	.instantiate = builtin_instantiate,
+	.instantiate = bq_instantiate,
 	.connect_port = builtin_connect_port,
-	.run = bq_allpass_run,
+	.run = bq_run,
+	.run_multi = bq_run_multi,
 	.cleanup = builtin_cleanup,
 };
 
 /** convolve */
+struct ir_cache {
+	struct spa_list link;
+	int ref;
+	char *key;
+	struct convolver_ir *ir;
+};
+
+/* IR spectra shared between all convolvers with the same IR, convolvers
+ * of different filter-chains can be made from different threads */
+static struct spa_list ir_cache_list = { &ir_cache_list, &ir_cache_list };
+static pthread_mutex_t ir_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
 struct convolver_impl {
 	unsigned long rate;
 	float *port[64];
 
+	struct ir_cache *cache;
 	struct convolver *conv;
 };
 
+/* must be called with ir_cache_lock */
+static struct ir_cache *ir_cache_find(const char *key)
+{
+	struct ir_cache *c;
+	spa_list_for_each(c, &ir_cache_list, link) {
+		if (spa_streq(c->key, key))
+			return c;
+	}
+	return NULL;
+}
+
+/* find the IR for key and take a ref on it */
+static struct ir_cache *ir_cache_get(const char *key)
+{
+	struct ir_cache *c;
+
+	pthread_mutex_lock(&ir_cache_lock);
+	if ((c = ir_cache_find(key)) != NULL)
+		c->ref++;
+	pthread_mutex_unlock(&ir_cache_lock);
+	return c;
+}
+
+/* add the IR for key, takes ownership of ir. When the IR was added in
+ * the meantime, ir is freed and the cached IR is used. */
+static struct ir_cache *ir_cache_add(const char *key, struct convolver_ir *ir)
+{
+	struct ir_cache *c;
+
+	pthread_mutex_lock(&ir_cache_lock);
+	if ((c = ir_cache_find(key)) != NULL) {
+		c->ref++;
+		convolver_ir_free(ir);
+		goto done;
+	}
+	if ((c = calloc(1, sizeof(*c))) == NULL)
+		goto error;
+	if ((c->key = strdup(key)) == NULL) {
+		free(c);
+		c = NULL;
+		goto error;
+	}
+	c->ref = 1;
+	c->ir = ir;
+	spa_list_append(&ir_cache_list, &c->link);
+done:
+	pthread_mutex_unlock(&ir_cache_lock);
+	return c;
+error:
+	pthread_mutex_unlock(&ir_cache_lock);
+	convolver_ir_free(ir);
+	return NULL;
+}
+
+static void ir_cache_unref(struct ir_cache *c)
+{
+	pthread_mutex_lock(&ir_cache_lock);
+	if (--c->ref > 0) {
+		pthread_mutex_unlock(&ir_cache_lock);
+		return;
+	}
+	spa_list_remove(&c->link);
+	pthread_mutex_unlock(&ir_cache_lock);
+
+	convolver_ir_free(c->ir);
+	free(c->key);
+	free(c);
+}
+
+static int make_cache_dir(char *path, size_t size)
+{
+	const char *dir, *sub;
+	struct passwd pwd, *result = NULL;
+	char buffer[4096], *p;
+	int len;
+
+	if ((dir = getenv("XDG_CACHE_HOME")) != NULL) {
+		sub = "pipewire/filter-chain";
+	} else {
+		if ((dir = getenv("HOME")) == NULL &&
+		    getpwuid_r(getuid(), &pwd, buffer, sizeof(buffer), &result) == 0)
+			dir = result ? result->pw_dir : NULL;
+		if (dir == NULL)
+			return -ENOENT;
+		sub = ".cache/pipewire/filter-chain";
+	}
+	len = snprintf(path, size, "%s/%s", dir, sub);
+	if (len < 0 || (size_t)len >= size)
+		return -ENAMETOOLONG;
+
+	for (p = path + 1; (p = strchr(p, '/')) != NULL; p++) {
+		*p = '\0';
+		if (mkdir(path, 0700) < 0 && errno != EEXIST)
+			return -errno;
+		*p = '/';
+	}
+	if (mkdir(path, 0700) < 0 && errno != EEXIST)
+		return -errno;
+	return 0;
+}
+
+static uint64_t hash_string(const char *str)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	while (*str) {
+		h ^= (unsigned char)*str++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/* the disk cache key also contains the size and modification time of the
+ * files so that the cache is refreshed when they change */
+static int get_disk_cache(const char *key, char **filenames, char *path, size_t path_size,
+		char **disk_key)
+{
+	struct spa_strbuf b;
+	struct stat st;
+	char *k;
+	size_t size, len;
+	int i, res;
+
+	size = strlen(key) + MAX_RATES * 64 + 1;
+	if ((k = malloc(size)) == NULL)
+		return -errno;
+
+	spa_strbuf_init(&b, k, size);
+	spa_strbuf_append(&b, "%s", key);
+	for (i = 0; i < (int)MAX_RATES && filenames[i]; i++) {
+		if (stat(filenames[i], &st) == 0)
+			spa_strbuf_append(&b, " %"PRIi64":%"PRIi64":%ld",
+					(int64_t)st.st_size, (int64_t)st.st_mtim.tv_sec,
+					st.st_mtim.tv_nsec);
+	}
+	if ((res = make_cache_dir(path, path_size)) < 0)
+		goto error;
+
+	len = strlen(path);
+	if (snprintf(path + len, path_size - len, "/%016"PRIx64".ir",
+				hash_string(k)) >= (int)(path_size - len)) {
+		res = -ENAMETOOLONG;
+		goto error;
+	}
+	*disk_key = k;
+	return 0;
+error:
+	free(k);
+	return res;
+}
+
 #ifdef HAVE_SNDFILE
 static float *read_samples_from_sf(SNDFILE *f, SF_INFO info, float gain, int delay,
 		int offset, int length, int channel, long unsigned *rate, int *n_samples) {
@@ -642,9 +830,13 @@ error:
 static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 		unsigned long SampleRate, int index, const char *config)
 {
-	struct convolver_impl *impl;
+	struct convolver_impl *impl = NULL;
+	struct convolver_ir *ir = NULL;
+	struct spa_strbuf b;
 	float *samples;
-	int offset = 0, length = 0, channel = index, n_samples, len;
+	char cache_key[MAX_RATES * 256 + 256], cache_path[PATH_MAX], *disk_key = NULL;
+	bool disk_cache = false, is_file;
+	int offset = 0, length = 0, channel = index, n_samples, len, res;
 	uint32_t i = 0;
 	struct spa_json it[3];
 	const char *val;
@@ -733,6 +925,12 @@ static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 				return NULL;
 			}
 		}
+		else if (spa_streq(key, "cache")) {
+			if (spa_json_get_bool(&it[1], &disk_cache) <= 0) {
+				pw_log_error("convolver:cache requires a boolean");
+				return NULL;
+			}
+		}
 		else if (spa_json_next(&it[1], &val) < 0)
 			break;
 	}
@@ -746,36 +944,15 @@ static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 	if (offset < 0)
 		offset = 0;
 
-	if (spa_streq(filenames[0], "/hilbert")) {
-		samples = create_hilbert(filenames[0], gain, delay, offset,
-				length, &n_samples);
-	} else if (spa_streq(filenames[0], "/dirac")) {
-		samples = create_dirac(filenames[0], gain, delay, offset,
-				length, &n_samples);
-	} else {
-		rate = SampleRate;
-		samples = read_closest(filenames, gain, delay, offset,
-				length, channel, &rate, &n_samples);
-		if (samples != NULL && rate != SampleRate)
-			samples = resample_buffer(samples, &n_samples,
-					rate, SampleRate, resample_quality);
-	}
-	if (samples == NULL) {
-		errno = ENOENT;
-		return NULL;
-	}
-
-	for (i = 0; i < MAX_RATES; i++)
-		if (filenames[i])
-			free(filenames[i]);
-
-	if (blocksize <= 0)
-		blocksize = SPA_CLAMP(n_samples, 64, 256);
-	if (tailsize <= 0)
-		tailsize = SPA_CLAMP(4096, blocksize, 32768);
+	is_file = !spa_streq(filenames[0], "/hilbert") &&
+		!spa_streq(filenames[0], "/dirac");
 
-	pw_log_info("using n_samples:%u %d:%d blocksize", n_samples,
-			blocksize, tailsize);
+	spa_strbuf_init(&b, cache_key, sizeof(cache_key));
+	for (i = 0; i < MAX_RATES && filenames[i]; i++)
+		spa_strbuf_append(&b, "%s|", filenames[i]);
+	spa_strbuf_append(&b, "channel:%d rate:%lu gain:%a delay:%d offset:%d length:%d "
+			"quality:%d block:%d tail:%d", is_file ? channel : 0, SampleRate, gain, delay,
+			offset, length, resample_quality, blocksize, tailsize);
 
 	impl = calloc(1, sizeof(*impl));
 	if (impl == NULL)
@@ -783,16 +960,73 @@ static void * convolver_instantiate(const struct fc_descriptor * Descriptor,
 
 	impl->rate = SampleRate;
 
-	impl->conv = convolver_new(dsp_ops, blocksize, tailsize, samples, n_samples);
+	if ((impl->cache = ir_cache_get(cache_key)) != NULL) {
+		pw_log_info("using cached IR for %s", filenames[0]);
+		goto done;
+	}
+
+	if (disk_cache && is_file && get_disk_cache(cache_key, filenames, cache_path,
+				sizeof(cache_path), &disk_key) == 0) {
+		if ((ir = convolver_ir_load(dsp_ops, disk_key, cache_path)) != NULL)
+			pw_log_info("loaded IR for %s from %s", filenames[0], cache_path);
+	}
+
+	if (ir == NULL) {
+		if (spa_streq(filenames[0], "/hilbert")) {
+			samples = create_hilbert(filenames[0], gain, delay, offset,
+					length, &n_samples);
+		} else if (spa_streq(filenames[0], "/dirac")) {
+			samples = create_dirac(filenames[0], gain, delay, offset,
+					length, &n_samples);
+		} else {
+			rate = SampleRate;
+			samples = read_closest(filenames, gain, delay, offset,
+					length, channel, &rate, &n_samples);
+			if (samples != NULL && rate != SampleRate)
+				samples = resample_buffer(samples, &n_samples,
+						rate, SampleRate, resample_quality);
+		}
+		if (samples == NULL) {
+			errno = ENOENT;
+			goto error;
+		}
+
+		if (blocksize <= 0)
+			blocksize = SPA_CLAMP(n_samples, 64, 256);
+		if (tailsize <= 0)
+			tailsize = SPA_CLAMP(4096, blocksize, 32768);
+
+		pw_log_info("using n_samples:%u %d:%d blocksize", n_samples,
+				blocksize, tailsize);
+
+		ir = convolver_ir_new(dsp_ops, blocksize, tailsize, samples, n_samples);
+		free(samples);
+		if (ir == NULL)
+			goto error;
+
+		if (disk_key != NULL &&
+		    (res = convolver_ir_save(ir, disk_key, cache_path)) < 0)
+			pw_log_warn("can't save IR to %s: %s", cache_path, spa_strerror(res));
+	}
+	if ((impl->cache = ir_cache_add(cache_key, ir)) == NULL)
+		goto error;
+done:
+	impl->conv = convolver_new_ir(dsp_ops, impl->cache->ir);
 	if (impl->conv == NULL)
 		goto error;
 
-	free(samples);
+	free(disk_key);
+	for (i = 0; i < MAX_RATES; i++)
+		free(filenames[i]);
 
 	return impl;
 error:
-	free(samples);
+	if (impl && impl->cache)
+		ir_cache_unref(impl->cache);
 	free(impl);
+	free(disk_key);
+	for (i = 0; i < MAX_RATES; i++)
+		free(filenames[i]);
 	return NULL;
 }
 
@@ -808,6 +1042,8 @@ static void convolver_cleanup(void * Instance)
 	struct convolver_impl *impl = Instance;
 	if (impl->conv)
 		convolver_free(impl->conv);
+	if (impl->cache)
+		ir_cache_unref(impl->cache);
 	free(impl);
 }
 
@@ -28,10 +28,37 @@
 
 #include <spa/utils/defs.h>
 
+#include <errno.h>
+#include <limits.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pffft.h"
 
 static struct dsp_ops *dsp;
 
+/* the spectra of the segments of a part of the IR, read-only after
+ * creation so that it can be shared between convolvers */
+struct ir_part {
+	int blockSize;
+	int segSize;
+	int segCount;
+	int fftComplexSize;
+
+	float **segmentsIr;
+};
+
+struct convolver_ir {
+	int headBlockSize;
+	int tailBlockSize;
+	struct ir_part *head;
+	struct ir_part *tail0;
+	struct ir_part *tail;
+};
+
 struct convolver1 {
 	int blockSize;
 	int segSize;
@@ -109,10 +136,55 @@ static void convolver1_reset(struct convolver1 *conv)
 	conv->current = 0;
 }
 
-static struct convolver1 *convolver1_new(int block, const float *ir, int irlen)
+static void ir_part_free(struct ir_part *part)
 {
-	struct convolver1 *conv;
 	int i;
+	if (part == NULL)
+		return;
+	for (i = 0; i < part->segCount; i++)
+		fft_cpx_free(part->segmentsIr[i]);
+	free(part->segmentsIr);
+	free(part);
+}
+
+static struct ir_part *ir_part_alloc(int blockSize, int segCount)
+{
+	struct ir_part *part;
+	int i;
+
+	part = calloc(1, sizeof(*part));
+	if (part == NULL)
+		return NULL;
+
+	if (segCount == 0)
+		return part;
+
+	part->blockSize = blockSize;
+	part->segSize = 2 * part->blockSize;
+	part->fftComplexSize = (part->segSize / 2) + 1;
+
+	part->segmentsIr = calloc(sizeof(float*), segCount);
+	if (part->segmentsIr == NULL)
+		goto error;
+
+	for (i = 0; i < segCount; i++) {
+		part->segmentsIr[i] = fft_cpx_alloc(part->fftComplexSize);
+		if (part->segmentsIr[i] == NULL)
+			goto error;
+		part->segCount++;
+	}
+	return part;
+error:
+	ir_part_free(part);
+	return NULL;
+}
+
+static struct ir_part *ir_part_new(int block, const float *ir, int irlen)
+{
+	struct ir_part *part;
+	float *fft_buffer = NULL;
+	void *fft = NULL;
+	int i, blockSize;
 
 	if (block == 0)
 		return NULL;
@@ -120,17 +192,58 @@ static struct convolver1 *convolver1_new(int block, const float *ir, int irlen)
 	while (irlen > 0 && fabs(ir[irlen-1]) < 0.000001f)
 		irlen--;
 
+	blockSize = next_power_of_two(block);
+	part = ir_part_alloc(blockSize, (irlen + blockSize - 1) / blockSize);
+	if (part == NULL || irlen == 0)
+		return part;
+
+	fft = dsp_ops_fft_new(dsp, part->segSize, true);
+	if (fft == NULL)
+		goto error;
+
+	fft_buffer = fft_alloc(part->segSize);
+	if (fft_buffer == NULL)
+		goto error;
+
+	for (i = 0; i < part->segCount; i++) {
+		int left = irlen - (i * part->blockSize);
+		int copy = SPA_MIN(part->blockSize, left);
+
+		dsp_ops_copy(dsp, fft_buffer, &ir[i * part->blockSize], copy);
+		if (copy < part->segSize)
+			dsp_ops_clear(dsp, fft_buffer + copy, part->segSize - copy);
+
+	        dsp_ops_fft_run(dsp, fft, 1, fft_buffer, part->segmentsIr[i]);
+	}
+	fft_free(fft_buffer);
+	dsp_ops_fft_free(dsp, fft);
+
+	return part;
+error:
+	if (fft)
+		dsp_ops_fft_free(dsp, fft);
+	fft_free(fft_buffer);
+	ir_part_free(part);
+	return NULL;
+}
+
+static struct convolver1 *convolver1_new(const struct ir_part *part)
+{
+	struct convolver1 *conv;
+	int i;
+
 	conv = calloc(1, sizeof(*conv));
 	if (conv == NULL)
 		return NULL;
 
-	if (irlen == 0)
+	if (part->segCount == 0)
 		return conv;
 
-	conv->blockSize = next_power_of_two(block);
-	conv->segSize = 2 * conv->blockSize;
-	conv->segCount = (irlen + conv->blockSize-1) / conv->blockSize;
-	conv->fftComplexSize = (conv->segSize / 2) + 1;
+	conv->blockSize = part->blockSize;
+	conv->segSize = part->segSize;
+	conv->segCount = part->segCount;
+	conv->fftComplexSize = part->fftComplexSize;
+	conv->segmentsIr = part->segmentsIr;
 
 	conv->fft = dsp_ops_fft_new(dsp, conv->segSize, true);
 	if (conv->fft == NULL)
@@ -144,21 +257,9 @@ static struct convolver1 *convolver1_new(int block, const float *ir, int irlen)
 		goto error;
 
 	conv->segments = calloc(sizeof(float*), conv->segCount);
-	conv->segmentsIr = calloc(sizeof(float*), conv->segCount);
-
-	for (i = 0; i < conv->segCount; i++) {
-		int left = irlen - (i * conv->blockSize);
-		int copy = SPA_MIN(conv->blockSize, left);
-
+	for (i = 0; i < conv->segCount; i++)
 		conv->segments[i] = fft_cpx_alloc(conv->fftComplexSize);
-		conv->segmentsIr[i] = fft_cpx_alloc(conv->fftComplexSize);
 
-		dsp_ops_copy(dsp, conv->fft_buffer, &ir[i * conv->blockSize], copy);
-		if (copy < conv->segSize)
-			dsp_ops_clear(dsp, conv->fft_buffer + copy, conv->segSize - copy);
-
-	        dsp_ops_fft_run(dsp, conv->fft, 1, conv->fft_buffer, conv->segmentsIr[i]);
-	}
 	conv->pre_mult = fft_cpx_alloc(conv->fftComplexSize);
 	conv->conv = fft_cpx_alloc(conv->fftComplexSize);
 	conv->overlap = fft_alloc(conv->blockSize);
@@ -181,10 +282,8 @@ error:
 static void convolver1_free(struct convolver1 *conv)
 {
 	int i;
-	for (i = 0; i < conv->segCount; i++) {
+	for (i = 0; i < conv->segCount; i++)
 		fft_cpx_free(conv->segments[i]);
-		fft_cpx_free(conv->segmentsIr[i]);
-	}
 	if (conv->fft)
 		dsp_ops_fft_free(dsp, conv->fft);
 	if (conv->ifft)
@@ -192,7 +291,6 @@ static void convolver1_free(struct convolver1 *conv)
 	if (conv->fft_buffer)
 		fft_free(conv->fft_buffer);
 	free(conv->segments);
-	free(conv->segmentsIr);
 	fft_cpx_free(conv->pre_mult);
 	fft_cpx_free(conv->conv);
 	fft_free(conv->overlap);
@@ -274,6 +372,9 @@ static int convolver1_run(struct convolver1 *conv, const float *input, float *ou
 
 struct convolver
 {
+	struct convolver_ir *ir;
+	bool own_ir;
+
 	int headBlockSize;
 	int tailBlockSize;
 	struct convolver1 *headConvolver;
@@ -306,9 +407,10 @@ void convolver_reset(struct convolver *conv)
 	conv->precalculatedPos = 0;
 }
 
-struct convolver *convolver_new(struct dsp_ops *dsp_ops, int head_block, int tail_block, const float *ir, int irlen)
+struct convolver_ir *convolver_ir_new(struct dsp_ops *dsp_ops, int head_block, int tail_block,
+		const float *ir, int irlen)
 {
-	struct convolver *conv;
+	struct convolver_ir *cir;
 	int head_ir_len;
 
 	dsp = dsp_ops;
@@ -323,31 +425,218 @@ struct convolver *convolver_new(struct dsp_ops *dsp_ops, int head_block, int tai
 	while (irlen > 0 && fabs(ir[irlen-1]) < 0.000001f)
 		irlen--;
 
+	cir = calloc(1, sizeof(*cir));
+	if (cir == NULL)
+		return NULL;
+
+	if (irlen == 0)
+		return cir;
+
+	cir->headBlockSize = next_power_of_two(head_block);
+	cir->tailBlockSize = next_power_of_two(tail_block);
+
+	head_ir_len = SPA_MIN(irlen, cir->tailBlockSize);
+	if ((cir->head = ir_part_new(cir->headBlockSize, ir, head_ir_len)) == NULL)
+		goto error;
+
+	if (irlen > cir->tailBlockSize) {
+		int conv1IrLen = SPA_MIN(irlen - cir->tailBlockSize, cir->tailBlockSize);
+		cir->tail0 = ir_part_new(cir->headBlockSize, ir + cir->tailBlockSize, conv1IrLen);
+		if (cir->tail0 == NULL)
+			goto error;
+	}
+
+	if (irlen > 2 * cir->tailBlockSize) {
+		int tailIrLen = irlen - (2 * cir->tailBlockSize);
+		cir->tail = ir_part_new(cir->tailBlockSize, ir + (2 * cir->tailBlockSize), tailIrLen);
+		if (cir->tail == NULL)
+			goto error;
+	}
+	return cir;
+error:
+	convolver_ir_free(cir);
+	return NULL;
+}
+
+void convolver_ir_free(struct convolver_ir *ir)
+{
+	ir_part_free(ir->head);
+	ir_part_free(ir->tail0);
+	ir_part_free(ir->tail);
+	free(ir);
+}
+
+#define IR_MAGIC	"PWCONVIR"
+#define IR_VERSION	1u
+
+/* the spectra are stored in the internal layout of pffft, which depends on
+ * the SIMD size, so the file is only valid on the same machine */
+struct ir_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t simd_size;
+	uint32_t key_size;
+	int32_t headBlockSize;
+	int32_t tailBlockSize;
+	uint32_t n_parts;
+};
+
+struct ir_part_header {
+	int32_t blockSize;
+	int32_t segCount;
+};
+
+int convolver_ir_save(struct convolver_ir *ir, const char *key, const char *filename)
+{
+	struct ir_part *parts[3] = { ir->head, ir->tail0, ir->tail };
+	struct ir_header hdr;
+	struct ir_part_header phdr;
+	char tmp[PATH_MAX];
+	FILE *f;
+	int i, j, res = 0;
+
+	spa_zero(hdr);
+	memcpy(hdr.magic, IR_MAGIC, sizeof(hdr.magic));
+	hdr.version = IR_VERSION;
+	hdr.simd_size = pffft_simd_size();
+	hdr.key_size = strlen(key);
+	hdr.headBlockSize = ir->headBlockSize;
+	hdr.tailBlockSize = ir->tailBlockSize;
+	for (i = 0; i < 3 && parts[i]; i++)
+		hdr.n_parts++;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp-%d", filename, getpid()) >= (int)sizeof(tmp))
+		return -ENAMETOOLONG;
+
+	if ((f = fopen(tmp, "we")) == NULL)
+		return -errno;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    fwrite(key, hdr.key_size, 1, f) != 1)
+		goto error;
+
+	for (i = 0; i < (int)hdr.n_parts; i++) {
+		phdr.blockSize = parts[i]->blockSize;
+		phdr.segCount = parts[i]->segCount;
+		if (fwrite(&phdr, sizeof(phdr), 1, f) != 1)
+			goto error;
+		for (j = 0; j < parts[i]->segCount; j++) {
+			if (fwrite(parts[i]->segmentsIr[j], sizeof(float) * 2,
+					parts[i]->fftComplexSize, f) != (size_t)parts[i]->fftComplexSize)
+				goto error;
+		}
+	}
+	if (fclose(f) != 0) {
+		f = NULL;
+		goto error;
+	}
+	if (rename(tmp, filename) < 0) {
+		res = -errno;
+		unlink(tmp);
+	}
+	return res;
+error:
+	res = -errno;
+	if (f)
+		fclose(f);
+	unlink(tmp);
+	return res ? res : -EIO;
+}
+
+struct convolver_ir *convolver_ir_load(struct dsp_ops *dsp_ops, const char *key, const char *filename)
+{
+	struct convolver_ir *ir = NULL;
+	struct ir_part **parts[3];
+	struct ir_header hdr;
+	struct ir_part_header phdr;
+	char *fkey = NULL;
+	FILE *f;
+	int i, j;
+
+	dsp = dsp_ops;
+
+	if ((f = fopen(filename, "re")) == NULL)
+		return NULL;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, IR_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.version != IR_VERSION ||
+	    hdr.simd_size != (uint32_t)pffft_simd_size() ||
+	    hdr.key_size != strlen(key) ||
+	    hdr.n_parts > 3)
+		goto error;
+
+	if ((fkey = malloc(hdr.key_size)) == NULL ||
+	    fread(fkey, hdr.key_size, 1, f) != 1 ||
+	    memcmp(fkey, key, hdr.key_size) != 0)
+		goto error;
+
+	if ((ir = calloc(1, sizeof(*ir))) == NULL)
+		goto error;
+	ir->headBlockSize = hdr.headBlockSize;
+	ir->tailBlockSize = hdr.tailBlockSize;
+
+	parts[0] = &ir->head;
+	parts[1] = &ir->tail0;
+	parts[2] = &ir->tail;
+	for (i = 0; i < (int)hdr.n_parts; i++) {
+		if (fread(&phdr, sizeof(phdr), 1, f) != 1 ||
+		    phdr.blockSize <= 0 || phdr.segCount < 0 ||
+		    phdr.blockSize != next_power_of_two(phdr.blockSize))
+			goto error;
+		if ((*parts[i] = ir_part_alloc(phdr.blockSize, phdr.segCount)) == NULL)
+			goto error;
+		for (j = 0; j < phdr.segCount; j++) {
+			if (fread((*parts[i])->segmentsIr[j], sizeof(float) * 2,
+					(*parts[i])->fftComplexSize, f) != (size_t)(*parts[i])->fftComplexSize)
+				goto error;
+		}
+	}
+	free(fkey);
+	fclose(f);
+	return ir;
+error:
+	if (ir)
+		convolver_ir_free(ir);
+	free(fkey);
+	fclose(f);
+	return NULL;
+}
+
+struct convolver *convolver_new_ir(struct dsp_ops *dsp_ops, struct convolver_ir *ir)
+{
+	struct convolver *conv;
+
+	dsp = dsp_ops;
+
 	conv = calloc(1, sizeof(*conv));
 	if (conv == NULL)
 		return NULL;
 
-	if (irlen == 0)
+	conv->ir = ir;
+	if (ir->head == NULL)
 		return conv;
 
-	conv->headBlockSize = next_power_of_two(head_block);
-	conv->tailBlockSize = next_power_of_two(tail_block);
+	conv->headBlockSize = ir->headBlockSize;
+	conv->tailBlockSize = ir->tailBlockSize;
 
-	head_ir_len = SPA_MIN(irlen, conv->tailBlockSize);
-	conv->headConvolver = convolver1_new(conv->headBlockSize, ir, head_ir_len);
+	if ((conv->headConvolver = convolver1_new(ir->head)) == NULL)
+		goto error;
 
-	if (irlen > conv->tailBlockSize) {
-		int conv1IrLen = SPA_MIN(irlen - conv->tailBlockSize, conv->tailBlockSize);
-		conv->tailConvolver0 = convolver1_new(conv->headBlockSize, ir + conv->tailBlockSize, conv1IrLen);
+	if (ir->tail0) {
+		conv->tailConvolver0 = convolver1_new(ir->tail0);
 		conv->tailOutput0 = fft_alloc(conv->tailBlockSize);
 		conv->tailPrecalculated0 = fft_alloc(conv->tailBlockSize);
+		if (conv->tailConvolver0 == NULL)
+			goto error;
 	}
 
-	if (irlen > 2 * conv->tailBlockSize) {
-		int tailIrLen = irlen - (2 * conv->tailBlockSize);
-		conv->tailConvolver = convolver1_new(conv->tailBlockSize, ir + (2 * conv->tailBlockSize), tailIrLen);
+	if (ir->tail) {
+		conv->tailConvolver = convolver1_new(ir->tail);
 		conv->tailOutput = fft_alloc(conv->tailBlockSize);
 		conv->tailPrecalculated = fft_alloc(conv->tailBlockSize);
+		if (conv->tailConvolver == NULL)
+			goto error;
 	}
 
 	if (conv->tailConvolver0 || conv->tailConvolver)
@@ -355,6 +644,25 @@ struct convolver *convolver_new(struct dsp_ops *dsp_ops, int head_block, int tai
 
 	convolver_reset(conv);
 
+	return conv;
+error:
+	convolver_free(conv);
+	return NULL;
+}
+
+struct convolver *convolver_new(struct dsp_ops *dsp_ops, int head_block, int tail_block, const float *ir, int irlen)
+{
+	struct convolver_ir *cir;
+	struct convolver *conv;
+
+	if ((cir = convolver_ir_new(dsp_ops, head_block, tail_block, ir, irlen)) == NULL)
+		return NULL;
+
+	if ((conv = convolver_new_ir(dsp_ops, cir)) == NULL) {
+		convolver_ir_free(cir);
+		return NULL;
+	}
+	conv->own_ir = true;
 	return conv;
 }
 
@@ -371,6 +679,8 @@ void convolver_free(struct convolver *conv)
 	fft_free(conv->tailOutput);
 	fft_free(conv->tailPrecalculated);
 	fft_free(conv->tailInput);
+	if (conv->own_ir)
+		convolver_ir_free(conv->ir);
 	free(conv);
 }
 
@@ -27,7 +27,14 @@
 
 #include "dsp-ops.h"
 
+struct convolver_ir *convolver_ir_new(struct dsp_ops *dsp, int block, int tail, const float *ir, int irlen);
+void convolver_ir_free(struct convolver_ir *ir);
+
+int convolver_ir_save(struct convolver_ir *ir, const char *key, const char *filename);
+struct convolver_ir *convolver_ir_load(struct dsp_ops *dsp, const char *key, const char *filename);
+
 struct convolver *convolver_new(struct dsp_ops *dsp, int block, int tail, const float *ir, int irlen);
+struct convolver *convolver_new_ir(struct dsp_ops *dsp, struct convolver_ir *ir);
 void convolver_free(struct convolver *conv);
 
 void convolver_reset(struct convolver *conv);
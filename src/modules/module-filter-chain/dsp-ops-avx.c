@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 
 #include <spa/utils/defs.h>
 
@@ -83,3 +84,119 @@ void dsp_sum_avx(struct dsp_ops *ops, float *r, const float *a, const float *b,
 		_mm_store_ss(&r[n], in[0]);
 	}
 }
+
+struct biquadn_avx {
+	__m256 b0, b1, b2, a1, a2;
+};
+
+static inline __m256 biquadn_sample_avx(const struct biquadn_avx *c, __m256 *h1, __m256 *h2,
+		uint32_t n_bq, __m256 x)
+{
+	uint32_t s;
+	__m256 y;
+
+	for (s = 0; s < n_bq; s++) {
+		y = _mm256_mul_ps(c[s].b0, x);
+		y = _mm256_add_ps(y, _mm256_mul_ps(c[s].b1, h1[s]));
+		y = _mm256_add_ps(y, _mm256_mul_ps(c[s].b2, h2[s]));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(c[s].a1, h1[s+1]));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(c[s].a2, h2[s+1]));
+		h2[s] = h1[s];
+		h1[s] = x;
+		x = y;
+	}
+	h2[n_bq] = h1[n_bq];
+	h1[n_bq] = x;
+	return x;
+}
+
+static void biquadn_run_8_avx(struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_samples)
+{
+	struct biquadn_avx c[n_bq];
+	__m256 h1[n_bq + 1], h2[n_bq + 1], x[4];
+	__m128 lo[4], hi[4];
+	float t1[8], t2[8];
+	uint32_t i, j, s, unrolled;
+
+#define LANES(s,f)	_mm256_setr_ps(bq[s]->f, bq[n_bq+s]->f, bq[2*n_bq+s]->f,	\
+		bq[3*n_bq+s]->f, bq[4*n_bq+s]->f, bq[5*n_bq+s]->f,		\
+		bq[6*n_bq+s]->f, bq[7*n_bq+s]->f)
+	for (s = 0; s < n_bq; s++) {
+		c[s].b0 = LANES(s, b0);
+		c[s].b1 = LANES(s, b1);
+		c[s].b2 = LANES(s, b2);
+		c[s].a1 = LANES(s, a1);
+		c[s].a2 = LANES(s, a2);
+		h1[s+1] = LANES(s, y1);
+		h2[s+1] = LANES(s, y2);
+	}
+	h1[0] = LANES(0, x1);
+	h2[0] = LANES(0, x2);
+#undef LANES
+
+	/* blocks of 4 samples, transposed in 2 halves of 4 channels */
+	unrolled = n_samples & ~3;
+	for (i = 0; i < unrolled; i += 4) {
+		for (j = 0; j < 4; j++) {
+			lo[j] = _mm_loadu_ps(&in[j][i]);
+			hi[j] = _mm_loadu_ps(&in[j+4][i]);
+		}
+		_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+		_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+
+		for (j = 0; j < 4; j++) {
+			x[j] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[j]), hi[j], 1);
+			x[j] = biquadn_sample_avx(c, h1, h2, n_bq, x[j]);
+			lo[j] = _mm256_castps256_ps128(x[j]);
+			hi[j] = _mm256_extractf128_ps(x[j], 1);
+		}
+
+		_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+		_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+		for (j = 0; j < 4; j++) {
+			_mm_storeu_ps(&out[j][i], lo[j]);
+			_mm_storeu_ps(&out[j+4][i], hi[j]);
+		}
+	}
+	for (; i < n_samples; i++) {
+		for (j = 0; j < 8; j++)
+			t1[j] = in[j][i];
+		x[0] = biquadn_sample_avx(c, h1, h2, n_bq, _mm256_loadu_ps(t1));
+		_mm256_storeu_ps(t1, x[0]);
+		for (j = 0; j < 8; j++)
+			out[j][i] = t1[j];
+	}
+
+#define F(x) (-FLT_MIN < (x) && (x) < FLT_MIN ? 0.0f : (x))
+	for (s = 0; s <= n_bq; s++) {
+		_mm256_storeu_ps(t1, h1[s]);
+		_mm256_storeu_ps(t2, h2[s]);
+		for (j = 0; j < 8; j++) {
+			if (s > 0) {
+				bq[j*n_bq+s-1]->y1 = F(t1[j]);
+				bq[j*n_bq+s-1]->y2 = F(t2[j]);
+			}
+			if (s < n_bq) {
+				bq[j*n_bq+s]->x1 = F(t1[j]);
+				bq[j*n_bq+s]->x2 = F(t2[j]);
+			}
+		}
+	}
+#undef F
+}
+
+void dsp_biquadn_run_avx(struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i = 0;
+
+	if (n_bq > 0) {
+		for (; i + 8 <= n_src; i += 8)
+			biquadn_run_8_avx(&bq[i * n_bq], n_bq, &out[i], &in[i], n_samples);
+	}
+	/* the sse version does the remaining groups of 4 and falls back to c */
+	if (i < n_src)
+		dsp_biquadn_run_sse(ops, &bq[i * n_bq], n_bq, &out[i], &in[i],
+				n_src - i, n_samples);
+}
@@ -134,6 +134,23 @@ void dsp_biquad_run_c(struct dsp_ops *ops, struct biquad *bq,
 #undef F
 }
 
+void dsp_biquadn_run_c(struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < n_src; i++) {
+		if (n_bq == 0) {
+			if (out[i] != in[i])
+				spa_memcpy(out[i], in[i], n_samples * sizeof(float));
+			continue;
+		}
+		dsp_biquad_run_c(ops, bq[i * n_bq], out[i], in[i], n_samples);
+		for (j = 1; j < n_bq; j++)
+			dsp_biquad_run_c(ops, bq[i * n_bq + j], out[i], out[i], n_samples);
+	}
+}
+
 void dsp_sum_c(struct dsp_ops *ops, float * dst,
 		const float * SPA_RESTRICT a, const float * SPA_RESTRICT b, uint32_t n_samples)
 {
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 
 #include <spa/utils/defs.h>
 
@@ -90,6 +91,116 @@ void dsp_mix_gain_sse(struct dsp_ops *ops,
 	}
 }
 
+/* coefficients and history of a cascade, one lane per channel. The output
+ * history of a section is the input history of the next section. */
+struct biquadn_sse {
+	__m128 b0, b1, b2, a1, a2;
+};
+
+static inline __m128 biquadn_sample_sse(const struct biquadn_sse *c, __m128 *h1, __m128 *h2,
+		uint32_t n_bq, __m128 x)
+{
+	uint32_t s;
+	__m128 y;
+
+	for (s = 0; s < n_bq; s++) {
+		y = _mm_mul_ps(c[s].b0, x);
+		y = _mm_add_ps(y, _mm_mul_ps(c[s].b1, h1[s]));
+		y = _mm_add_ps(y, _mm_mul_ps(c[s].b2, h2[s]));
+		y = _mm_sub_ps(y, _mm_mul_ps(c[s].a1, h1[s+1]));
+		y = _mm_sub_ps(y, _mm_mul_ps(c[s].a2, h2[s+1]));
+		h2[s] = h1[s];
+		h1[s] = x;
+		x = y;
+	}
+	h2[n_bq] = h1[n_bq];
+	h1[n_bq] = x;
+	return x;
+}
+
+static void biquadn_run_4_sse(struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_samples)
+{
+	struct biquadn_sse c[n_bq];
+	__m128 h1[n_bq + 1], h2[n_bq + 1], x[4];
+	float t1[4], t2[4];
+	uint32_t i, s, unrolled;
+
+#define LANES(s,f)	_mm_setr_ps(bq[s]->f, bq[n_bq+s]->f, bq[2*n_bq+s]->f, bq[3*n_bq+s]->f)
+	for (s = 0; s < n_bq; s++) {
+		c[s].b0 = LANES(s, b0);
+		c[s].b1 = LANES(s, b1);
+		c[s].b2 = LANES(s, b2);
+		c[s].a1 = LANES(s, a1);
+		c[s].a2 = LANES(s, a2);
+		h1[s+1] = LANES(s, y1);
+		h2[s+1] = LANES(s, y2);
+	}
+	h1[0] = LANES(0, x1);
+	h2[0] = LANES(0, x2);
+#undef LANES
+
+	unrolled = n_samples & ~3;
+	for (i = 0; i < unrolled; i += 4) {
+		x[0] = _mm_loadu_ps(&in[0][i]);
+		x[1] = _mm_loadu_ps(&in[1][i]);
+		x[2] = _mm_loadu_ps(&in[2][i]);
+		x[3] = _mm_loadu_ps(&in[3][i]);
+		_MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+
+		x[0] = biquadn_sample_sse(c, h1, h2, n_bq, x[0]);
+		x[1] = biquadn_sample_sse(c, h1, h2, n_bq, x[1]);
+		x[2] = biquadn_sample_sse(c, h1, h2, n_bq, x[2]);
+		x[3] = biquadn_sample_sse(c, h1, h2, n_bq, x[3]);
+
+		_MM_TRANSPOSE4_PS(x[0], x[1], x[2], x[3]);
+		_mm_storeu_ps(&out[0][i], x[0]);
+		_mm_storeu_ps(&out[1][i], x[1]);
+		_mm_storeu_ps(&out[2][i], x[2]);
+		_mm_storeu_ps(&out[3][i], x[3]);
+	}
+	for (; i < n_samples; i++) {
+		x[0] = _mm_setr_ps(in[0][i], in[1][i], in[2][i], in[3][i]);
+		x[0] = biquadn_sample_sse(c, h1, h2, n_bq, x[0]);
+		_mm_storeu_ps(t1, x[0]);
+		out[0][i] = t1[0];
+		out[1][i] = t1[1];
+		out[2][i] = t1[2];
+		out[3][i] = t1[3];
+	}
+
+#define F(x) (-FLT_MIN < (x) && (x) < FLT_MIN ? 0.0f : (x))
+	for (s = 0; s <= n_bq; s++) {
+		_mm_storeu_ps(t1, h1[s]);
+		_mm_storeu_ps(t2, h2[s]);
+		for (i = 0; i < 4; i++) {
+			if (s > 0) {
+				bq[i*n_bq+s-1]->y1 = F(t1[i]);
+				bq[i*n_bq+s-1]->y2 = F(t2[i]);
+			}
+			if (s < n_bq) {
+				bq[i*n_bq+s]->x1 = F(t1[i]);
+				bq[i*n_bq+s]->x2 = F(t2[i]);
+			}
+		}
+	}
+#undef F
+}
+
+void dsp_biquadn_run_sse(struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,
+		float *out[], const float *in[], uint32_t n_src, uint32_t n_samples)
+{
+	uint32_t i = 0;
+
+	if (n_bq > 0) {
+		for (; i + 4 <= n_src; i += 4)
+			biquadn_run_4_sse(&bq[i * n_bq], n_bq, &out[i], &in[i], n_samples);
+	}
+	if (i < n_src)
+		dsp_biquadn_run_c(ops, &bq[i * n_bq], n_bq, &out[i], &in[i],
+				n_src - i, n_samples);
+}
+
 void dsp_sum_sse(struct dsp_ops *ops, float *r, const float *a, const float *b, uint32_t n_samples)
 {
 	uint32_t n, unrolled;
@@ -42,6 +42,8 @@ struct dsp_ops_funcs {
 			float gain[], uint32_t n_src, uint32_t n_samples);
 	void (*biquad_run) (struct dsp_ops *ops, struct biquad *bq,
 			float *out, const float *in, uint32_t n_samples);
+	void (*biquadn_run) (struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,
+			float *out[], const float *in[], uint32_t n_src, uint32_t n_samples);
 	void (*sum) (struct dsp_ops *ops,
 			float * dst, const float * SPA_RESTRICT a,
 			const float * SPA_RESTRICT b, uint32_t n_samples);
@@ -77,6 +79,7 @@ int dsp_ops_init(struct dsp_ops *ops);
 #define dsp_ops_copy(ops,...)		(ops)->funcs.copy(ops, __VA_ARGS__)
 #define dsp_ops_mix_gain(ops,...)	(ops)->funcs.mix_gain(ops, __VA_ARGS__)
 #define dsp_ops_biquad_run(ops,...)	(ops)->funcs.biquad_run(ops, __VA_ARGS__)
+#define dsp_ops_biquadn_run(ops,...)	(ops)->funcs.biquadn_run(ops, __VA_ARGS__)
 #define dsp_ops_sum(ops,...)		(ops)->funcs.sum(ops, __VA_ARGS__)
 
 #define dsp_ops_fft_new(ops,...)	(ops)->funcs.fft_new(ops, __VA_ARGS__)
@@ -96,6 +99,11 @@ void dsp_mix_gain_##arch(struct dsp_ops *ops, void * SPA_RESTRICT dst,	\
 #define MAKE_BIQUAD_RUN_FUNC(arch) \
 void dsp_biquad_run_##arch (struct dsp_ops *ops, struct biquad *bq,	\
 	float *out, const float *in, uint32_t n_samples)
+/* run n_src channels through a cascade of n_bq biquads each. bq[c * n_bq + s]
+ * is section s of channel c. in and out can be the same. */
+#define MAKE_BIQUADN_RUN_FUNC(arch) \
+void dsp_biquadn_run_##arch (struct dsp_ops *ops, struct biquad *bq[], uint32_t n_bq,	\
+	float *out[], const float *in[], uint32_t n_src, uint32_t n_samples)
 #define MAKE_SUM_FUNC(arch) \
 void dsp_sum_##arch (struct dsp_ops *ops, float * SPA_RESTRICT dst, \
 	const float * SPA_RESTRICT a, const float * SPA_RESTRICT b, uint32_t n_samples)
@@ -121,6 +129,7 @@ MAKE_CLEAR_FUNC(c);
 MAKE_COPY_FUNC(c);
 MAKE_MIX_GAIN_FUNC(c);
 MAKE_BIQUAD_RUN_FUNC(c);
+MAKE_BIQUADN_RUN_FUNC(c);
 MAKE_SUM_FUNC(c);
 
 MAKE_FFT_NEW_FUNC(c);
@@ -131,9 +140,11 @@ MAKE_FFT_CMULADD_FUNC(c);
 
 #if defined (HAVE_SSE)
 MAKE_MIX_GAIN_FUNC(sse);
+MAKE_BIQUADN_RUN_FUNC(sse);
 MAKE_SUM_FUNC(sse);
 #endif
 #if defined (HAVE_AVX)
+MAKE_BIQUADN_RUN_FUNC(avx);
 MAKE_SUM_FUNC(avx);
 #endif
 
@@ -88,6 +88,14 @@ struct fc_descriptor {
 	void (*deactivate) (void *instance);
 
 	void (*run) (void *instance, unsigned long SampleCount);
+
+	/* optional, run n_chains chains of n_stages instances at once. instance
+	 * holds n_chains * n_stages instances, stage s of chain c is at index
+	 * c * n_stages + s. Each stage has 1 audio input and 1 audio output,
+	 * only the input of the first stage and the output of the last stage
+	 * of a chain are used. */
+	void (*run_multi) (void **instance, uint32_t n_stages, uint32_t n_chains,
+			unsigned long SampleCount);
 };
 
 static inline void fc_plugin_free(struct fc_plugin *plugin)
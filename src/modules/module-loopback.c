@@ -54,7 +54,9 @@
  * ## Module Options
  *
  * - `node.description`: a human readable name for the loopback streams
- * - `target.delay.sec`: delay in seconds as float (Since 0.3.60)
+ * - `target.delay.sec`: delay in seconds as float (Since 0.3.60). Without a
+ *   delay the samples are copied directly from the capture buffer to the
+ *   playback buffer, the delay buffer is only used when a delay is set.
  * - `capture.props = {}`: properties to be passed to the input stream
  * - `playback.props = {}`: properties to be passed to the output stream
  *
@@ -34,12 +34,17 @@
 
 #include <spa/utils/result.h>
 #include <spa/utils/ringbuffer.h>
-#include <spa/param/profiler.h>
+#include <spa/pod/dynamic.h>
+#include <spa/param/profiler-utils.h>
 
 #include <pipewire/private.h>
 #include <pipewire/impl.h>
 #include <pipewire/extensions/profiler.h>
 
+#if defined(F_ADD_SEALS) && !defined(F_SEAL_FUTURE_WRITE)
+#define F_SEAL_FUTURE_WRITE	0x0010
+#endif
+
 /** \page page_module_profiler PipeWire Module: Profiler
  *
  * The profiler module provides a Profiler interface for applications that
@@ -48,14 +53,32 @@
  * Use tools like pw-top and pw-profiler to collect profiling information
  * about the pipewire graph.
  *
+ * Clients normally receive the profiling data as Profiler objects in profile
+ * events that are sent every second. Clients of version 4 also receive the
+ * wakeup, processing and cycle time histograms of the nodes in these events,
+ * see SPA_PROFILER_nodeHistogram. With the start_ring method, a client can
+ * instead map a shared memory ring with a fixed layout record for the driver
+ * and each of its followers, for every cycle. The ring is written by the data
+ * thread and is read without involving the daemon, see
+ * struct pw_profiler_ring and pw_profiler_ring_read(). Clients can only map
+ * the ring read-only.
+ *
+ * ## Module Options
+ *
+ * - `profiler.ring.records`: the number of records in the shared ring,
+ *    rounded up to a power of 2. Default 16384.
+ *
  * ## Example configuration
  *
- * The module has no arguments and is usually added to the config file of
- * the main pipewire daemon.
+ * The module is usually added to the config file of the main pipewire daemon.
  *
  *\code{.unparsed}
  * context.modules = [
- * { name = libpipewire-module-profiler }
+ * { name = libpipewire-module-profiler
+ *   args = {
+ *     #profiler.ring.records = 16384
+ *   }
+ * }
  * ]
  *\endcode
  *
@@ -75,6 +98,8 @@ PW_LOG_TOPIC(mod_topic, "mod." NAME);
 #define MIN_FLUSH		(16 * 1024)
 #define DEFAULT_IDLE		5
 #define DEFAULT_INTERVAL	1
+#define DEFAULT_RING_RECORDS	16384
+#define MAX_RING_RECORDS	(1u << 20)
 
 int pw_protocol_native_ext_profiler_init(struct pw_context *context);
 
@@ -83,6 +108,8 @@ int pw_protocol_native_ext_profiler_init(struct pw_context *context);
 
 #define pw_profiler_resource_profile(r,...)        \
         pw_profiler_resource(r,profile,0,__VA_ARGS__)
+#define pw_profiler_resource_ring(r,...)        \
+        pw_profiler_resource(r,ring,1,__VA_ARGS__)
 
 static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_AUTHOR, "Wim Taymans <wim.taymans@gmail.com>" },
@@ -102,11 +129,23 @@ struct impl {
 
 	int64_t count;
 	uint32_t busy;
+	uint32_t pod_users;
+	uint32_t ring_users;
 	uint32_t empty;
 	struct spa_source *flush_timeout;
 	unsigned int flushing:1;
 	unsigned int listening:1;
 
+	uint32_t n_records;
+	struct pw_memblock *ring_mem;
+
+	struct {
+		unsigned int pods:1;
+		struct pw_profiler_ring *ring;
+		uint32_t n_records;
+		uint64_t index;
+	} rt;
+
 	struct spa_ringbuffer buffer;
 	uint8_t tmp[TMP_BUFFER];
 	uint8_t data[MAX_BUFFER];
@@ -119,6 +158,10 @@ struct resource_data {
 
 	struct pw_resource *resource;
 	struct spa_hook resource_listener;
+	struct spa_hook object_listener;
+
+	struct pw_memblock *mem;
+	unsigned int ring:1;
 };
 
 static void start_flush(struct impl *impl)
@@ -150,6 +193,67 @@ static void stop_flush(struct impl *impl)
 	impl->flushing = false;
 }
 
+static void add_histogram(struct spa_pod_builder *b, const struct pw_node_histogram *h)
+{
+	uint32_t n;
+
+	for (n = PW_NODE_HISTOGRAM_BUCKETS; n > 0 && h->buckets[n-1] == 0; n--);
+
+	spa_pod_builder_long(b, h->max);
+	spa_pod_builder_array(b, sizeof(int64_t), SPA_TYPE_Long, n, h->buckets);
+}
+
+static void send_histograms(struct impl *impl, struct pw_resource *resource)
+{
+	struct spa_pod_dynamic_builder b;
+	struct spa_pod_frame f[3];
+	struct pw_impl_node *n;
+	struct pw_resource *r;
+	struct spa_pod *pod;
+	uint8_t buffer[4096];
+
+	spa_pod_dynamic_builder_init(&b, buffer, sizeof(buffer), 16384);
+
+	spa_pod_builder_push_struct(&b.b, &f[0]);
+	spa_pod_builder_push_object(&b.b, &f[1],
+			SPA_TYPE_OBJECT_Profiler, 0);
+
+	spa_list_for_each(n, &impl->context->node_list, link) {
+		if (n->info.id == SPA_ID_INVALID)
+			continue;
+		if (n->histogram.wakeup.max == 0 && n->histogram.cycle.max == 0)
+			continue;
+
+		spa_pod_builder_prop(&b.b, SPA_PROFILER_nodeHistogram, 0);
+		spa_pod_builder_push_struct(&b.b, &f[2]);
+		spa_pod_builder_int(&b.b, n->info.id);
+		spa_pod_builder_int(&b.b, PW_NODE_HISTOGRAM_MIN_SHIFT);
+		spa_pod_builder_int(&b.b, PW_NODE_HISTOGRAM_SUB_SHIFT);
+		add_histogram(&b.b, &n->histogram.wakeup);
+		add_histogram(&b.b, &n->histogram.process);
+		add_histogram(&b.b, &n->histogram.cycle);
+		spa_pod_builder_pop(&b.b, &f[2]);
+	}
+	spa_pod_builder_pop(&b.b, &f[1]);
+	pod = spa_pod_builder_pop(&b.b, &f[0]);
+
+	if (pod == NULL) {
+		pw_log_warn("%p: can't build histograms", impl);
+		goto done;
+	}
+	if (resource != NULL) {
+		pw_profiler_resource_profile(resource, pod);
+		goto done;
+	}
+	spa_list_for_each(r, &impl->global->resource_list, link) {
+		struct resource_data *d = pw_resource_get_user_data(r);
+		if (!d->ring && r->version >= 4)
+			pw_profiler_resource_profile(r, pod);
+	}
+done:
+	spa_pod_dynamic_builder_clean(&b);
+}
+
 static void flush_timeout(void *data, uint64_t expirations)
 {
 	struct impl *impl = data;
@@ -177,13 +281,99 @@ static void flush_timeout(void *data, uint64_t expirations)
 			SPA_PTROFF(p, sizeof(struct spa_pod_struct), void), avail);
 	spa_ringbuffer_read_update(&impl->buffer, idx + avail);
 
-	spa_list_for_each(resource, &impl->global->resource_list, link)
-		pw_profiler_resource_profile(resource, &p->pod);
+	spa_list_for_each(resource, &impl->global->resource_list, link) {
+		struct resource_data *d = pw_resource_get_user_data(resource);
+		if (!d->ring)
+			pw_profiler_resource_profile(resource, &p->pod);
+	}
+	send_histograms(impl, NULL);
 }
 
-static void context_do_profile(void *data, struct pw_impl_node *node)
+static inline struct pw_profiler_record *ring_begin(struct impl *impl)
+{
+	struct pw_profiler_ring *ring = impl->rt.ring;
+	struct pw_profiler_record *r;
+
+	/* don't trust the header, the memory is shared with the clients */
+	r = SPA_PTROFF(ring, sizeof(struct pw_profiler_ring) +
+			(impl->rt.index & (impl->rt.n_records - 1)) *
+			sizeof(struct pw_profiler_record), struct pw_profiler_record);
+	__atomic_store_n(&r->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return r;
+}
+
+static inline void ring_end(struct impl *impl, struct pw_profiler_record *r)
+{
+	__atomic_store_n(&r->seq, ++impl->rt.index, __ATOMIC_RELEASE);
+}
+
+static void do_profile_ring(struct impl *impl, struct pw_impl_node *node)
+{
+	struct pw_node_activation *a = node->rt.activation;
+	struct spa_io_position *pos = &a->position;
+	struct pw_profiler_record *r;
+	struct pw_node_target *t;
+
+	r = ring_begin(impl);
+	*r = (struct pw_profiler_record) {
+		.cycle = impl->count,
+		.flags = PW_PROFILER_RECORD_FLAG_DRIVER,
+		.id = node->info.id,
+		.driver_id = node->info.id,
+		.status = a->status,
+		.prev_signal_time = a->prev_signal_time,
+		.signal_time = a->signal_time,
+		.awake_time = a->awake_time,
+		.finish_time = a->finish_time,
+		.latency = node->latency,
+		.clock_nsec = pos->clock.nsec,
+		.clock_position = pos->clock.position,
+		.clock_duration = pos->clock.duration,
+		.clock_delay = pos->clock.delay,
+		.clock_rate_diff = pos->clock.rate_diff,
+		.clock_rate = pos->clock.rate,
+		.xrun_count = a->xrun_count,
+		.cpu_load = { a->cpu_load[0], a->cpu_load[1], a->cpu_load[2] },
+	};
+	ring_end(impl, r);
+
+	spa_list_for_each(t, &node->rt.target_list, link) {
+		struct pw_impl_node *n = t->node;
+		struct pw_node_activation *na;
+		struct spa_fraction latency;
+
+		if (n == NULL || n == node)
+			continue;
+
+		latency = n->latency;
+		if (n->force_quantum != 0)
+			latency.num = n->force_quantum;
+		if (n->force_rate != 0)
+			latency.denom = n->force_rate;
+		else if (n->rate.denom != 0)
+			latency.denom = n->rate.denom;
+
+		na = n->rt.activation;
+		r = ring_begin(impl);
+		*r = (struct pw_profiler_record) {
+			.cycle = impl->count,
+			.id = n->info.id,
+			.driver_id = node->info.id,
+			.status = na->status,
+			.prev_signal_time = a->signal_time,
+			.signal_time = na->signal_time,
+			.awake_time = na->awake_time,
+			.finish_time = na->finish_time,
+			.latency = latency,
+		};
+		ring_end(impl, r);
+	}
+	__atomic_store_n(&impl->rt.ring->write_index, impl->rt.index, __ATOMIC_RELEASE);
+}
+
+static void do_profile_pod(struct impl *impl, struct pw_impl_node *node)
 {
-	struct impl *impl = data;
 	struct spa_pod_builder b;
 	struct spa_pod_frame f[2];
 	struct pw_node_activation *a = node->rt.activation;
@@ -192,45 +382,30 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 	int32_t filled;
 	uint32_t idx, avail;
 
-	if (SPA_FLAG_IS_SET(pos->clock.flags, SPA_IO_CLOCK_FLAG_FREEWHEEL))
-		return;
-
 	spa_pod_builder_init(&b, impl->tmp, sizeof(impl->tmp));
 	spa_pod_builder_push_object(&b, &f[0],
 			SPA_TYPE_OBJECT_Profiler, 0);
 
 	spa_pod_builder_prop(&b, SPA_PROFILER_info, 0);
-	spa_pod_builder_add_struct(&b,
-			SPA_POD_Long(impl->count),
-			SPA_POD_Float(a->cpu_load[0]),
-			SPA_POD_Float(a->cpu_load[1]),
-			SPA_POD_Float(a->cpu_load[2]),
-			SPA_POD_Int(a->xrun_count));
+	spa_profiler_info_build(&b, &SPA_PROFILER_INFO(
+			.counter = impl->count,
+			.cpu_load = { a->cpu_load[0], a->cpu_load[1], a->cpu_load[2] },
+			.xrun_count = a->xrun_count));
 
 	spa_pod_builder_prop(&b, SPA_PROFILER_clock, 0);
-	spa_pod_builder_add_struct(&b,
-			SPA_POD_Int(pos->clock.flags),
-			SPA_POD_Int(pos->clock.id),
-			SPA_POD_String(pos->clock.name),
-			SPA_POD_Long(pos->clock.nsec),
-			SPA_POD_Fraction(&pos->clock.rate),
-			SPA_POD_Long(pos->clock.position),
-			SPA_POD_Long(pos->clock.duration),
-			SPA_POD_Long(pos->clock.delay),
-			SPA_POD_Double(pos->clock.rate_diff),
-			SPA_POD_Long(pos->clock.next_nsec));
-
+	spa_profiler_clock_build(&b, &pos->clock);
 
 	spa_pod_builder_prop(&b, SPA_PROFILER_driverBlock, 0);
-	spa_pod_builder_add_struct(&b,
-			SPA_POD_Int(node->info.id),
-			SPA_POD_String(node->name),
-			SPA_POD_Long(a->prev_signal_time),
-			SPA_POD_Long(a->signal_time),
-			SPA_POD_Long(a->awake_time),
-			SPA_POD_Long(a->finish_time),
-			SPA_POD_Int(a->status),
-			SPA_POD_Fraction(&node->latency));
+	spa_profiler_block_build(&b, &SPA_PROFILER_BLOCK(
+			.id = node->info.id,
+			.name = node->name,
+			.prev_signal = a->prev_signal_time,
+			.signal = a->signal_time,
+			.awake = a->awake_time,
+			.finish = a->finish_time,
+			.status = a->status,
+			.latency = node->latency,
+			.n_dead = node->n_dead), true);
 
 	spa_list_for_each(t, &node->rt.target_list, link) {
 		struct pw_impl_node *n = t->node;
@@ -250,30 +425,30 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 
 		na = n->rt.activation;
 		spa_pod_builder_prop(&b, SPA_PROFILER_followerBlock, 0);
-		spa_pod_builder_add_struct(&b,
-			SPA_POD_Int(n->info.id),
-			SPA_POD_String(n->name),
-			SPA_POD_Long(a->signal_time),
-			SPA_POD_Long(na->signal_time),
-			SPA_POD_Long(na->awake_time),
-			SPA_POD_Long(na->finish_time),
-			SPA_POD_Int(na->status),
-			SPA_POD_Fraction(&latency));
+		spa_profiler_block_build(&b, &SPA_PROFILER_BLOCK(
+				.id = n->info.id,
+				.name = n->name,
+				.prev_signal = a->signal_time,
+				.signal = na->signal_time,
+				.awake = na->awake_time,
+				.finish = na->finish_time,
+				.status = na->status,
+				.latency = latency), false);
 	}
 	spa_pod_builder_pop(&b, &f[0]);
 
 	if (b.state.offset > sizeof(impl->tmp))
-		goto done;
+		return;
 
 	filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
 	if (filled < 0 || filled > MAX_BUFFER) {
 		pw_log_warn("%p: queue xrun %d", impl, filled);
-		goto done;
+		return;
 	}
 	avail = MAX_BUFFER - filled;
 	if (avail < b.state.offset) {
 		pw_log_warn("%p: queue full %d < %d", impl, avail, b.state.offset);
-		goto done;
+		return;
 	}
 	spa_ringbuffer_write_data(&impl->buffer,
 			impl->data, MAX_BUFFER,
@@ -283,7 +458,21 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 
 	if (!impl->flushing || filled + b.state.offset > MIN_FLUSH)
 		start_flush(impl);
-done:
+}
+
+static void context_do_profile(void *data, struct pw_impl_node *node)
+{
+	struct impl *impl = data;
+	struct spa_io_position *pos = &node->rt.activation->position;
+
+	if (SPA_FLAG_IS_SET(pos->clock.flags, SPA_IO_CLOCK_FLAG_FREEWHEEL))
+		return;
+
+	if (impl->rt.ring)
+		do_profile_ring(impl, node);
+	if (impl->rt.pods)
+		do_profile_pod(impl, node);
+
 	impl->count++;
 }
 
@@ -310,9 +499,37 @@ static void stop_listener(struct impl *impl)
 	}
 }
 
+static int do_update_rt(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	impl->rt.pods = impl->pod_users > 0;
+	impl->rt.ring = impl->ring_users > 0 ? impl->ring_mem->map->ptr : NULL;
+	return 0;
+}
+
+static void update_rt(struct impl *impl)
+{
+	pw_loop_invoke(impl->context->data_loop,
+			do_update_rt, SPA_ID_INVALID, NULL, 0, true, impl);
+}
+
 static void resource_destroy(void *data)
 {
-	struct impl *impl = data;
+	struct resource_data *d = data;
+	struct impl *impl = d->impl;
+
+	if (d->ring) {
+		impl->ring_users--;
+		pw_memblock_unref(d->mem);
+	} else {
+		impl->pod_users--;
+	}
+	spa_hook_remove(&d->resource_listener);
+	spa_hook_remove(&d->object_listener);
+
+	update_rt(impl);
+
 	if (--impl->busy == 0) {
 		pw_log_info("%p: stopping profiler", impl);
 		stop_listener(impl);
@@ -324,6 +541,78 @@ static const struct pw_resource_events resource_events = {
 	.destroy = resource_destroy,
 };
 
+static int ensure_ring(struct impl *impl)
+{
+	struct pw_profiler_ring *ring;
+
+	if (impl->ring_mem != NULL)
+		return 0;
+
+	impl->ring_mem = pw_mempool_alloc(impl->context->pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_MAP,
+			SPA_DATA_MemFd, sizeof(struct pw_profiler_ring) +
+			impl->n_records * sizeof(struct pw_profiler_record));
+	if (impl->ring_mem == NULL)
+		return -errno;
+
+#ifdef F_ADD_SEALS
+	/* our own mapping stays writable, the clients can only make read-only
+	 * mappings of the ring */
+	if (fcntl(impl->ring_mem->fd, F_ADD_SEALS, F_SEAL_GROW | F_SEAL_SHRINK |
+				F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0)
+		pw_log_warn("%p: can't seal ring: %m", impl);
+#endif
+
+	ring = impl->ring_mem->map->ptr;
+	ring->magic = PW_PROFILER_RING_MAGIC;
+	ring->version = PW_PROFILER_RING_VERSION;
+	ring->record_size = sizeof(struct pw_profiler_record);
+	ring->n_records = impl->n_records;
+	ring->offset = sizeof(struct pw_profiler_ring);
+	impl->rt.n_records = impl->n_records;
+
+	pw_log_info("%p: ring with %u records", impl, impl->n_records);
+	return 0;
+}
+
+static int profiler_start_ring(void *object)
+{
+	struct resource_data *d = object;
+	struct impl *impl = d->impl;
+	struct pw_impl_client *client = pw_resource_get_client(d->resource);
+	int res;
+
+	if (d->ring)
+		return 0;
+
+	if ((res = ensure_ring(impl)) < 0)
+		goto error;
+
+	d->mem = pw_mempool_import(client->pool,
+			PW_MEMBLOCK_FLAG_READABLE | PW_MEMBLOCK_FLAG_DONT_CLOSE,
+			impl->ring_mem->type, impl->ring_mem->fd);
+	if (d->mem == NULL) {
+		res = -errno;
+		goto error;
+	}
+	d->ring = true;
+	impl->pod_users--;
+	impl->ring_users++;
+	update_rt(impl);
+
+	pw_profiler_resource_ring(d->resource, d->mem->id, 0, impl->ring_mem->size);
+	return 0;
+error:
+	pw_resource_errorf(d->resource, res, "can't create ring: %s", spa_strerror(res));
+	return res;
+}
+
+static const struct pw_profiler_methods profiler_methods = {
+	PW_VERSION_PROFILER_METHODS,
+	.start_ring = profiler_start_ring,
+};
+
 static int
 do_start(struct spa_loop *loop,
 		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -354,7 +643,15 @@ global_bind(void *object, struct pw_impl_client *client, uint32_t permissions,
 	pw_global_add_resource(global, resource);
 
 	pw_resource_add_listener(resource, &data->resource_listener,
-			&resource_events, impl);
+			&resource_events, data);
+	pw_resource_add_object_listener(resource, &data->object_listener,
+			&profiler_methods, data);
+
+	impl->pod_users++;
+	update_rt(impl);
+
+	if (version >= 4)
+		send_histograms(impl, resource);
 
 	if (++impl->busy == 1) {
 		pw_log_info("%p: starting profiler", impl);
@@ -378,6 +675,9 @@ static void module_destroy(void *data)
 
 	pw_loop_destroy_source(pw_context_get_main_loop(impl->context), impl->flush_timeout);
 
+	if (impl->ring_mem)
+		pw_memblock_unref(impl->ring_mem);
+
 	free(impl);
 }
 
@@ -409,6 +709,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	struct pw_properties *props;
 	struct impl *impl;
 	struct pw_loop *main_loop = pw_context_get_main_loop(context);
+	uint32_t i;
 	static const char * const keys[] = {
 		PW_KEY_OBJECT_SERIAL,
 		NULL
@@ -432,6 +733,12 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->context = context;
 	impl->properties = props;
 
+	impl->n_records = pw_properties_get_uint32(props, "profiler.ring.records",
+			DEFAULT_RING_RECORDS);
+	impl->n_records = SPA_CLAMP(impl->n_records, 64u, MAX_RING_RECORDS);
+	for (i = 64; i < impl->n_records; i <<= 1);
+	impl->n_records = i;
+
 	spa_ringbuffer_init(&impl->buffer);
 
 	impl->global = pw_global_new(context,
@@ -45,6 +45,7 @@
 #include <spa/pod/iter.h>
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
+#include <spa/utils/probe.h>
 
 #ifdef HAVE_SYSTEMD
 #include <systemd/sd-daemon.h>
@@ -356,9 +357,11 @@ process_messages(struct client_data *data)
 		}
 
 		resource->refcount++;
+		spa_probe(pipewire, server_dispatch, client, msg->id, msg->opcode, msg->size);
 		pw_protocol_native_connection_enter(conn);
 		res = demarshal[msg->opcode].func(resource, msg);
 		pw_protocol_native_connection_leave(conn);
+		spa_probe(pipewire, server_dispatch_done, client, msg->id, msg->opcode, res);
 		pw_resource_unref(resource);
 
 		if (res < 0) {
@@ -962,9 +965,11 @@ process_remote(struct client *impl)
 			continue;
 		}
 		proxy->refcount++;
+		spa_probe(pipewire, client_dispatch, this, msg->id, msg->opcode, msg->size);
 		pw_protocol_native_connection_enter(conn);
 		res = demarshal[msg->opcode].func(proxy, msg);
 		pw_protocol_native_connection_leave(conn);
+		spa_probe(pipewire, client_dispatch_done, this, msg->id, msg->opcode, res);
 		pw_proxy_unref(proxy);
 
 		if (res < 0) {
@@ -35,6 +35,7 @@
 #include <sys/wait.h>
 #include <dirent.h>
 #include <regex.h>
+#include <pthread.h>
 #ifdef HAVE_PWD_H
 #include <pwd.h>
 #endif
@@ -1014,6 +1015,87 @@ int pw_context_conf_update_props(struct pw_context *context,
 }
 
 
+/*
+ * Match rules are compiled once into a pw_conf_rules. Keys are interned so
+ * that each key is looked up only once in the properties, regexes are
+ * compiled once and the actions are located in advance.
+ */
+#define MATCH_NULL	0	/* key must not exist */
+#define MATCH_STRING	1	/* value must be equal */
+#define MATCH_REGEX	2	/* value must match the regex */
+#define MATCH_INVALID	3	/* invalid regex, never matches */
+
+struct rule_match {
+	uint32_t key;			/* index in keys */
+	uint32_t type;
+	char *value;
+	regex_t *regex;
+};
+
+struct rule_object {
+	uint32_t first_match;
+	uint32_t n_matches;
+};
+
+struct rule_action {
+	char *key;
+	const char *val;
+	size_t len;
+};
+
+struct rule {
+	uint32_t first_object;
+	uint32_t n_objects;
+	uint32_t first_action;
+	uint32_t n_actions;
+};
+
+struct pw_conf_rules {
+	int ref;
+	const char *source;		/* the string the rules were compiled from */
+	char *str;			/* our copy, the actions point into this */
+	size_t len;
+	struct pw_array keys;
+	struct pw_array matches;
+	struct pw_array objects;
+	struct pw_array actions;
+	struct pw_array rules;
+};
+
+#define MAX_STACK_KEYS	64
+
+static int intern_key(struct pw_conf_rules *rules, const char *key)
+{
+	char **k, **keys = rules->keys.data;
+	uint32_t i, n_keys = pw_array_get_len(&rules->keys, char *);
+
+	for (i = 0; i < n_keys; i++) {
+		if (spa_streq(keys[i], key))
+			return i;
+	}
+	if ((k = pw_array_add(&rules->keys, sizeof(char *))) == NULL)
+		return -errno;
+	if ((*k = strdup(key)) == NULL) {
+		pw_array_remove(&rules->keys, k);
+		return -errno;
+	}
+	return n_keys;
+}
+
+static int compile_regex(struct rule_match *m)
+{
+	if ((m->regex = malloc(sizeof(regex_t))) == NULL)
+		return -errno;
+	if (regcomp(m->regex, m->value + 1, REG_EXTENDED | REG_NOSUB) != 0) {
+		pw_log_warn("invalid regex '%s'", m->value + 1);
+		free(m->regex);
+		m->regex = NULL;
+		m->type = MATCH_INVALID;
+		return -EINVAL;
+	}
+	return 0;
+}
+
 /*
  * {
  *     # all keys must match the value. ~ in value starts regex.
@@ -1021,56 +1103,93 @@ int pw_context_conf_update_props(struct pw_context *context,
  *     ...
  * }
  */
-static bool find_match(struct spa_json *arr, const struct spa_dict *props)
+static int compile_match(struct pw_conf_rules *rules, struct spa_json *arr, struct rule *r)
 {
 	struct spa_json it[1];
 
+	r->first_object = pw_array_get_len(&rules->objects, struct rule_object);
+	r->n_objects = 0;
+
 	while (spa_json_enter_object(arr, &it[0]) > 0) {
-		char key[256], val[1024];
-		const char *str, *value;
-		int match = 0, fail = 0;
-		int len;
+		struct rule_object *o;
+		char key[256];
+
+		if ((o = pw_array_add(&rules->objects, sizeof(*o))) == NULL)
+			return -errno;
+		o->first_match = pw_array_get_len(&rules->matches, struct rule_match);
+		o->n_matches = 0;
+		r->n_objects++;
 
 		while (spa_json_get_string(&it[0], key, sizeof(key)) > 0) {
-			bool success = false;
+			struct rule_match *m;
+			const char *value;
+			char *val = NULL;
+			int len, k, res;
 
 			if ((len = spa_json_next(&it[0], &value)) <= 0)
 				break;
 
-			str = spa_dict_lookup(props, key);
-
-			if (spa_json_is_null(value, len)) {
-				success = str == NULL;
-			} else {
-				if (spa_json_parse_stringn(value, len, val, sizeof(val)) < 0)
+			if (!spa_json_is_null(value, len)) {
+				if ((val = malloc(len + 1)) == NULL)
+					return -errno;
+				if (spa_json_parse_stringn(value, len, val, len + 1) < 0) {
+					free(val);
 					continue;
-				value = val;
-				len = strlen(val);
-			}
-			if (str != NULL) {
-				if (value[0] == '~') {
-					regex_t preg;
-					if (regcomp(&preg, value+1, REG_EXTENDED | REG_NOSUB) == 0) {
-						if (regexec(&preg, str, 0, NULL, 0) == 0)
-							success = true;
-						regfree(&preg);
-					}
-				} else if (strncmp(str, value, len) == 0 &&
-				    strlen(str) == (size_t)len) {
-					success = true;
 				}
 			}
-			if (success) {
-				match++;
-				pw_log_debug("'%s' match '%s' < > '%.*s'", key, str, len, value);
+			if ((k = intern_key(rules, key)) < 0 ||
+			    (m = pw_array_add(&rules->matches, sizeof(*m))) == NULL) {
+				free(val);
+				return k < 0 ? k : -errno;
+			}
+			m->key = k;
+			m->value = val;
+			m->regex = NULL;
+			o->n_matches++;
+
+			if (val == NULL) {
+				m->type = MATCH_NULL;
+			} else if (val[0] == '~') {
+				m->type = MATCH_REGEX;
+				if ((res = compile_regex(m)) < 0 && res != -EINVAL)
+					return res;
+			} else {
+				m->type = MATCH_STRING;
 			}
-			else
-				fail++;
 		}
-		if (match > 0 && fail == 0)
-			return true;
 	}
-	return false;
+	return 0;
+}
+
+static int compile_actions(struct pw_conf_rules *rules, struct spa_json *actions, struct rule *r)
+{
+	char key[64];
+	const char *val;
+	int len;
+
+	r->first_action = pw_array_get_len(&rules->actions, struct rule_action);
+	r->n_actions = 0;
+
+	while (spa_json_get_string(actions, key, sizeof(key)) > 0) {
+		struct rule_action *a;
+
+		if ((len = spa_json_next(actions, &val)) <= 0)
+			break;
+
+		if (spa_json_is_container(val, len))
+			len = spa_json_container_len(actions, val, len);
+
+		if ((a = pw_array_add(&rules->actions, sizeof(*a))) == NULL)
+			return -errno;
+		if ((a->key = strdup(key)) == NULL) {
+			pw_array_remove(&rules->actions, a);
+			return -errno;
+		}
+		a->val = val;
+		a->len = len;
+		r->n_actions++;
+	}
+	return 0;
 }
 
 /**
@@ -1093,30 +1212,29 @@ static bool find_match(struct spa_json *arr, const struct spa_dict *props)
  *     }
  * ]
  */
-SPA_EXPORT
-int pw_conf_match_rules(const char *str, size_t len, const char *location,
-		const struct spa_dict *props,
-		int (*callback) (void *data, const char *location, const char *action,
-			const char *str, size_t len),
-		void *data)
+static int compile_rules(struct pw_conf_rules *rules)
 {
 	const char *val;
 	struct spa_json it[4], actions;
+	int res;
 
-	spa_json_init(&it[0], str, len);
+	spa_json_init(&it[0], rules->str, strlen(rules->str));
 	if (spa_json_enter_array(&it[0], &it[1]) < 0)
 		return 0;
 
 	while (spa_json_enter_object(&it[1], &it[2]) > 0) {
 		char key[64];
 		bool have_match = false, have_actions = false;
+		struct rule r, *rp;
 
+		spa_zero(r);
 		while (spa_json_get_string(&it[2], key, sizeof(key)) > 0) {
 			if (spa_streq(key, "matches")) {
 				if (spa_json_enter_array(&it[2], &it[3]) < 0)
 					break;
-
-				have_match = find_match(&it[3], props);
+				if ((res = compile_match(rules, &it[3], &r)) < 0)
+					return res;
+				have_match = true;
 			}
 			else if (spa_streq(key, "actions")) {
 				if (spa_json_enter_object(&it[2], &actions) > 0)
@@ -1128,35 +1246,287 @@ int pw_conf_match_rules(const char *str, size_t len, const char *location,
 		if (!have_match || !have_actions)
 			continue;
 
-		while (spa_json_get_string(&actions, key, sizeof(key)) > 0) {
-			int res, len;
-			pw_log_debug("action %s", key);
+		if ((res = compile_actions(rules, &actions, &r)) < 0)
+			return res;
+		if ((rp = pw_array_add(&rules->rules, sizeof(r))) == NULL)
+			return -errno;
+		*rp = r;
+	}
+	return 0;
+}
+
+struct pw_conf_rules *pw_conf_rules_new(const char *str, size_t len)
+{
+	struct pw_conf_rules *rules;
+	int res;
+
+	rules = calloc(1, sizeof(*rules));
+	if (rules == NULL)
+		return NULL;
+
+	rules->ref = 1;
+	rules->source = str;
+	rules->len = len;
+	pw_array_init(&rules->keys, 64);
+	pw_array_init(&rules->matches, 256);
+	pw_array_init(&rules->objects, 64);
+	pw_array_init(&rules->actions, 256);
+	pw_array_init(&rules->rules, 256);
+
+	if ((rules->str = strndup(str, len)) == NULL) {
+		res = -errno;
+		goto error;
+	}
+	if ((res = compile_rules(rules)) < 0)
+		goto error;
+
+	pw_log_debug("%p: compiled %zd rules %zd keys", rules,
+			pw_array_get_len(&rules->rules, struct rule),
+			pw_array_get_len(&rules->keys, char *));
+	return rules;
+error:
+	pw_conf_rules_free(rules);
+	errno = -res;
+	return NULL;
+}
+
+void pw_conf_rules_free(struct pw_conf_rules *rules)
+{
+	struct rule_match *m;
+	struct rule_action *a;
+	char **k;
+
+	pw_array_for_each(k, &rules->keys)
+		free(*k);
+	pw_array_for_each(m, &rules->matches) {
+		if (m->regex) {
+			regfree(m->regex);
+			free(m->regex);
+		}
+		free(m->value);
+	}
+	pw_array_for_each(a, &rules->actions)
+		free(a->key);
+	pw_array_clear(&rules->keys);
+	pw_array_clear(&rules->matches);
+	pw_array_clear(&rules->objects);
+	pw_array_clear(&rules->actions);
+	pw_array_clear(&rules->rules);
+	free(rules->str);
+	free(rules);
+}
+
+static const char key_unknown[] = "";
+
+static bool object_matches(struct pw_conf_rules *rules, struct rule_object *o,
+		const struct spa_dict *props, const char **values)
+{
+	struct rule_match *m = pw_array_get_unchecked(&rules->matches,
+			o->first_match, struct rule_match);
+	char **keys = rules->keys.data;
+	uint32_t i;
+
+	/* an empty object never matches */
+	if (o->n_matches == 0)
+		return false;
+
+	for (i = 0; i < o->n_matches; i++, m++) {
+		const char *str = values[m->key];
+		bool success = false;
+
+		if (str == key_unknown)
+			str = values[m->key] = spa_dict_lookup(props, keys[m->key]);
+
+		switch (m->type) {
+		case MATCH_NULL:
+			success = str == NULL || spa_streq(str, "null");
+			break;
+		case MATCH_STRING:
+			success = spa_streq(str, m->value);
+			break;
+		case MATCH_REGEX:
+			success = str != NULL && regexec(m->regex, str, 0, NULL, 0) == 0;
+			break;
+		default:
+			break;
+		}
+		if (!success)
+			return false;
+
+		pw_log_debug("'%s' match '%s' < > '%s'", keys[m->key], str, m->value);
+	}
+	return true;
+}
 
-			if ((len = spa_json_next(&actions, &val)) <= 0)
+int pw_conf_rules_match(struct pw_conf_rules *rules, const char *location,
+		const struct spa_dict *props,
+		int (*callback) (void *data, const char *location, const char *action,
+			const char *str, size_t len),
+		void *data)
+{
+	const char *stack_values[MAX_STACK_KEYS], **values = stack_values;
+	uint32_t i, j, n_keys = pw_array_get_len(&rules->keys, char *);
+	struct rule *r;
+	int res = 0;
+
+	if (n_keys > MAX_STACK_KEYS &&
+	    (values = malloc(n_keys * sizeof(char *))) == NULL)
+		return -errno;
+
+	/* keys are looked up in the properties when first needed */
+	for (i = 0; i < n_keys; i++)
+		values[i] = key_unknown;
+
+	pw_array_for_each(r, &rules->rules) {
+		struct rule_object *o = pw_array_get_unchecked(&rules->objects,
+				r->first_object, struct rule_object);
+		struct rule_action *a = pw_array_get_unchecked(&rules->actions,
+				r->first_action, struct rule_action);
+
+		for (i = 0; i < r->n_objects; i++, o++) {
+			if (object_matches(rules, o, props, values))
 				break;
+		}
+		if (i == r->n_objects)
+			continue;
+
+		for (j = 0; j < r->n_actions; j++, a++) {
+			pw_log_debug("action %s", a->key);
+			if ((res = callback(data, location, a->key, a->val, a->len)) < 0)
+				goto done;
+		}
+	}
+	res = 0;
+done:
+	if (values != stack_values)
+		free(values);
+	return res;
+}
 
-			if (spa_json_is_container(val, len))
-				len = spa_json_container_len(&actions, val, len);
+/* Rules passed to pw_conf_match_rules() are usually the same for many
+ * objects, keep the last compiled ones around. */
+#define MAX_CACHED_RULES	8
 
-			if ((res = callback(data, location, key, val, len)) < 0)
-				return res;
+static struct {
+	pthread_mutex_t lock;
+	uint32_t next;
+	struct pw_conf_rules *rules[MAX_CACHED_RULES];
+} rules_cache = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void rules_cache_unref(struct pw_conf_rules *rules)
+{
+	bool free_rules;
+
+	pthread_mutex_lock(&rules_cache.lock);
+	free_rules = --rules->ref == 0;
+	pthread_mutex_unlock(&rules_cache.lock);
+
+	if (free_rules)
+		pw_conf_rules_free(rules);
+}
+
+static struct pw_conf_rules *rules_cache_get(const char *str, size_t len)
+{
+	struct pw_conf_rules *rules, *old;
+	uint32_t i;
+
+	pthread_mutex_lock(&rules_cache.lock);
+	for (i = 0; i < MAX_CACHED_RULES; i++) {
+		rules = rules_cache.rules[i];
+		if (rules != NULL && rules->len == len &&
+		    memcmp(rules->str, str, len) == 0) {
+			rules->ref++;
+			pthread_mutex_unlock(&rules_cache.lock);
+			return rules;
 		}
 	}
-	return 0;
+	pthread_mutex_unlock(&rules_cache.lock);
+
+	if ((rules = pw_conf_rules_new(str, len)) == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&rules_cache.lock);
+	old = rules_cache.rules[rules_cache.next];
+	rules_cache.rules[rules_cache.next] = rules;
+	rules_cache.next = (rules_cache.next + 1) % MAX_CACHED_RULES;
+	rules->ref++;
+	pthread_mutex_unlock(&rules_cache.lock);
+
+	if (old)
+		rules_cache_unref(old);
+	return rules;
+}
+
+void pw_conf_rules_cache_clear(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < MAX_CACHED_RULES; i++) {
+		struct pw_conf_rules *rules = rules_cache.rules[i];
+		rules_cache.rules[i] = NULL;
+		if (rules)
+			rules_cache_unref(rules);
+	}
+	rules_cache.next = 0;
+}
+
+SPA_EXPORT
+int pw_conf_match_rules(const char *str, size_t len, const char *location,
+		const struct spa_dict *props,
+		int (*callback) (void *data, const char *location, const char *action,
+			const char *str, size_t len),
+		void *data)
+{
+	struct pw_conf_rules *rules;
+	int res;
+
+	if ((rules = rules_cache_get(str, len)) == NULL)
+		return -errno;
+	res = pw_conf_rules_match(rules, location, props, callback, data);
+	rules_cache_unref(rules);
+	return res;
 }
 
 struct match {
+	struct pw_context *context;
 	const struct spa_dict *props;
 	int (*matched) (void *data, const char *location, const char *action,
 			const char *val, size_t len);
 	void *data;
 };
 
+/* the config of the context does not change, compile the rules of a section
+ * only once and keep them around. */
+static struct pw_conf_rules *find_conf_rules(struct pw_context *context,
+		const char *str, size_t len)
+{
+	struct pw_conf_rules **rp, *rules;
+
+	pw_array_for_each(rp, &context->conf_rules) {
+		if ((*rp)->source == str)
+			return *rp;
+	}
+	if ((rules = pw_conf_rules_new(str, len)) == NULL)
+		return NULL;
+	if ((rp = pw_array_add(&context->conf_rules, sizeof(rules))) == NULL) {
+		pw_conf_rules_free(rules);
+		return NULL;
+	}
+	*rp = rules;
+	return rules;
+}
+
 static int match_rules(void *data, const char *location, const char *section,
 		const char *str, size_t len)
 {
 	struct match *match = data;
-	return pw_conf_match_rules(str, len, location,
+	struct pw_conf_rules *rules;
+
+	if ((rules = find_conf_rules(match->context, str, len)) == NULL)
+		return -errno;
+	return pw_conf_rules_match(rules, location,
 		match->props, match->matched, match->data);
 }
 
@@ -1168,6 +1538,7 @@ int pw_context_conf_section_match_rules(struct pw_context *context, const char *
 		void *data)
 {
 	struct match match = {
+		.context = context,
 		.props = props,
 		.matched = callback,
 		.data = data };
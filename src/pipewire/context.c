@@ -51,14 +51,30 @@ PW_LOG_TOPIC_EXTERN(log_context);
 #define PW_LOG_TOPIC_DEFAULT log_context
 
 /** \cond */
+/* the data loop invoke queue is 32KiB and a non-blocking invoke takes less
+ * than 128 bytes in it, this leaves half of the queue for the others */
+#define MAX_PENDING_INVOKES	128
+
 struct impl {
 	struct pw_context this;
 	struct spa_handle *dbus_handle;
 	struct spa_plugin_loader plugin_loader;
+	struct spa_thread_utils thread_utils;
 	unsigned int recalc:1;
 	unsigned int recalc_pending:1;
+	unsigned int recalc_full:1;
+	unsigned int recalc_scheduled:1;
+	uint32_t pending_invokes;		/* non-blocking invokes in the data loop */
+
+	struct spa_source *recalc_event;
+	struct spa_list recalc_list;		/* queued nodes */
+	struct pw_array collected;		/* nodes visited in the last recalc */
+	struct pw_array drivers;		/* drivers of the collected component */
+	struct pw_impl_node *target;		/* target for unassigned nodes */
 };
 
+static void do_recalc_queued(void *data, uint64_t count);
+
 
 struct factory_entry {
 	regex_t regex;
@@ -159,6 +175,58 @@ static void init_plugin_loader(struct impl *impl)
 		impl);
 }
 
+/* plugins get the thread utils that the realtime module sets on the context
+ * later, or the default ones */
+static inline struct spa_thread_utils *get_thread_utils(struct impl *impl)
+{
+	return impl->this.thread_utils ? impl->this.thread_utils : pw_thread_utils_get();
+}
+
+static struct spa_thread *impl_thread_utils_create(void *object,
+		const struct spa_dict *props, void *(*start)(void*), void *arg)
+{
+	return spa_thread_utils_create(get_thread_utils(object), props, start, arg);
+}
+
+static int impl_thread_utils_join(void *object, struct spa_thread *thread, void **retval)
+{
+	return spa_thread_utils_join(get_thread_utils(object), thread, retval);
+}
+
+static int impl_thread_utils_get_rt_range(void *object, const struct spa_dict *props,
+		int *min, int *max)
+{
+	return spa_thread_utils_get_rt_range(get_thread_utils(object), props, min, max);
+}
+
+static int impl_thread_utils_acquire_rt(void *object, struct spa_thread *thread, int priority)
+{
+	return spa_thread_utils_acquire_rt(get_thread_utils(object), thread, priority);
+}
+
+static int impl_thread_utils_drop_rt(void *object, struct spa_thread *thread)
+{
+	return spa_thread_utils_drop_rt(get_thread_utils(object), thread);
+}
+
+static const struct spa_thread_utils_methods impl_thread_utils = {
+	SPA_VERSION_THREAD_UTILS_METHODS,
+	.create = impl_thread_utils_create,
+	.join = impl_thread_utils_join,
+	.get_rt_range = impl_thread_utils_get_rt_range,
+	.acquire_rt = impl_thread_utils_acquire_rt,
+	.drop_rt = impl_thread_utils_drop_rt,
+};
+
+static void init_thread_utils(struct impl *impl)
+{
+	impl->thread_utils.iface = SPA_INTERFACE_INIT(
+		SPA_TYPE_INTERFACE_ThreadUtils,
+		SPA_VERSION_THREAD_UTILS,
+		&impl_thread_utils,
+		impl);
+}
+
 static int do_data_loop_setup(struct spa_loop *loop, bool async, uint32_t seq,
 		const void *data, size_t size, void *user_data)
 {
@@ -211,8 +279,12 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 		this->user_data = SPA_PTROFF(impl, sizeof(struct impl), void);
 
 	pw_array_init(&this->factory_lib, 32);
+	pw_array_init(&this->conf_rules, 32);
 	pw_array_init(&this->objects, 32);
+	pw_array_init(&impl->collected, 64);
+	pw_array_init(&impl->drivers, 16);
 	pw_map_init(&this->globals, 128, 32);
+	spa_list_init(&impl->recalc_list);
 
 	spa_list_init(&this->core_impl_list);
 	spa_list_init(&this->protocol_list);
@@ -314,8 +386,14 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 		res = -errno;
 		goto error_free;
 	}
+	impl->recalc_event = pw_loop_add_event(this->main_loop, do_recalc_queued, impl);
+	if (impl->recalc_event == NULL) {
+		res = -errno;
+		goto error_free;
+	}
 
 	init_plugin_loader(impl);
+	init_thread_utils(impl);
 
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_System, this->main_loop->system);
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Loop, this->main_loop->loop);
@@ -323,6 +401,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataSystem, this->data_system);
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataLoop, this->data_loop->loop);
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_PluginLoader, &impl->plugin_loader);
+	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_ThreadUtils, &impl->thread_utils);
 
 	if ((str = pw_properties_get(properties, "support.dbus")) == NULL ||
 	    pw_properties_parse_bool(str)) {
@@ -406,6 +485,7 @@ void pw_context_destroy(struct pw_context *context)
 	struct pw_resource *resource;
 	struct pw_impl_node *node;
 	struct factory_entry *entry;
+	struct pw_conf_rules **rules;
 	struct pw_impl_metadata *metadata;
 	struct pw_impl_core *core_impl;
 
@@ -454,6 +534,9 @@ void pw_context_destroy(struct pw_context *context)
 	if (context->work_queue)
 		pw_work_queue_destroy(context->work_queue);
 
+	if (impl->recalc_event)
+		pw_loop_destroy_source(context->main_loop, impl->recalc_event);
+
 	pw_properties_free(context->properties);
 	pw_properties_free(context->conf);
 
@@ -468,7 +551,13 @@ void pw_context_destroy(struct pw_context *context)
 	}
 	pw_array_clear(&context->factory_lib);
 
+	pw_array_for_each(rules, &context->conf_rules)
+		pw_conf_rules_free(*rules);
+	pw_array_clear(&context->conf_rules);
+
 	pw_array_clear(&context->objects);
+	pw_array_clear(&impl->collected);
+	pw_array_clear(&impl->drivers);
 
 	pw_map_clear(&context->globals);
 
@@ -630,6 +719,69 @@ SPA_PRINTF_FUNC(7, 8) int pw_context_debug_port_params(struct pw_context *this,
         return 0;
 }
 
+static int port_enum_formats(struct pw_context *context, struct pw_impl_port *port,
+		uint32_t *index, const struct spa_pod *filter, struct spa_pod **param,
+		struct spa_pod_builder *builder)
+{
+	if (context->settings.link_format_cache)
+		return pw_impl_port_enum_params_sync(port, SPA_PARAM_EnumFormat,
+				index, filter, param, builder);
+	return spa_node_port_enum_params_sync(port->node->node,
+			port->direction, port->port_id,
+			SPA_PARAM_EnumFormat, index, filter, param, builder);
+}
+
+/* The format found for two ports only depends on their EnumFormat params.
+ * The output port remembers the last format with the global serial of the
+ * input port, which is never reused, and the EnumFormat serial of the input
+ * port. The cache is cleared when the EnumFormat of the output port or the
+ * graph rate changes. */
+static inline uint64_t port_serial(struct pw_impl_port *port)
+{
+	return port->global ? port->global->serial : SPA_ID_INVALID;
+}
+
+static int format_cache_get(struct pw_context *context,
+		struct pw_impl_port *output, struct pw_impl_port *input,
+		struct spa_pod **format, struct spa_pod_builder *builder)
+{
+	struct spa_pod *f;
+	uint32_t offset = builder->state.offset;
+
+	pw_impl_port_check_rate(output);
+	pw_impl_port_check_rate(input);
+
+	f = output->format_cache.format;
+	if (!context->settings.link_format_cache || f == NULL ||
+	    port_serial(input) == SPA_ID_INVALID ||
+	    output->format_cache.peer != port_serial(input) ||
+	    output->format_cache.peer_format_serial != input->format_serial)
+		return 0;
+
+	if (spa_pod_builder_raw_padded(builder, f, SPA_POD_SIZE(f)) < 0)
+		return 0;
+
+	*format = spa_pod_builder_deref(builder, offset);
+	pw_log_debug("%p: cached format:", context);
+	pw_log_format(SPA_LOG_LEVEL_DEBUG, *format);
+	return 1;
+}
+
+static void format_cache_put(struct pw_context *context,
+		struct pw_impl_port *output, struct pw_impl_port *input,
+		const struct spa_pod *format)
+{
+	free(output->format_cache.format);
+	spa_zero(output->format_cache);
+
+	if (!context->settings.link_format_cache || port_serial(input) == SPA_ID_INVALID)
+		return;
+
+	output->format_cache.peer = port_serial(input);
+	output->format_cache.peer_format_serial = input->format_serial;
+	output->format_cache.format = spa_pod_copy(format);
+}
+
 /** Find a common format between two ports
  *
  * \param context a context object
@@ -692,9 +844,7 @@ int pw_context_find_format(struct pw_context *context,
 		pw_log_debug("%p: Got output format:", context);
 		pw_log_format(SPA_LOG_LEVEL_DEBUG, filter);
 
-		if ((res = spa_node_port_enum_params_sync(input->node->node,
-						     input->direction, input->port_id,
-						     SPA_PARAM_EnumFormat, &iidx,
+		if ((res = port_enum_formats(context, input, &iidx,
 						     filter, format, builder)) <= 0) {
 			if (res == -ENOENT || res == 0) {
 				pw_log_debug("%p: no input format filter, using output format: %s",
@@ -721,9 +871,7 @@ int pw_context_find_format(struct pw_context *context,
 		pw_log_debug("%p: Got input format:", context);
 		pw_log_format(SPA_LOG_LEVEL_DEBUG, filter);
 
-		if ((res = spa_node_port_enum_params_sync(output->node->node,
-						     output->direction, output->port_id,
-						     SPA_PARAM_EnumFormat, &oidx,
+		if ((res = port_enum_formats(context, output, &oidx,
 						     filter, format, builder)) <= 0) {
 			if (res == -ENOENT || res == 0) {
 				pw_log_debug("%p: no output format filter, using input format: %s",
@@ -735,13 +883,14 @@ int pw_context_find_format(struct pw_context *context,
 			}
 		}
 	} else if (in_state == PW_IMPL_PORT_STATE_CONFIGURE && out_state == PW_IMPL_PORT_STATE_CONFIGURE) {
+		/* both ports need a format, try the last one found with the same
+		 * input port and formats first */
+		if ((res = format_cache_get(context, output, input, format, builder)) != 0)
+			return res;
 	      again:
-		/* both ports need a format */
 		pw_log_debug("%p: do enum input %d", context, iidx);
 		spa_pod_builder_init(&fb, fbuf, sizeof(fbuf));
-		if ((res = spa_node_port_enum_params_sync(input->node->node,
-						     input->direction, input->port_id,
-						     SPA_PARAM_EnumFormat, &iidx,
+		if ((res = port_enum_formats(context, input, &iidx,
 						     NULL, &filter, &fb)) != 1) {
 			if (res == -ENOENT) {
 				pw_log_debug("%p: no input filter", context);
@@ -757,9 +906,7 @@ int pw_context_find_format(struct pw_context *context,
 		pw_log_debug("%p: enum output %d with filter: %p", context, oidx, filter);
 		pw_log_format(SPA_LOG_LEVEL_DEBUG, filter);
 
-		if ((res = spa_node_port_enum_params_sync(output->node->node,
-						     output->direction, output->port_id,
-						     SPA_PARAM_EnumFormat, &oidx,
+		if ((res = port_enum_formats(context, output, &oidx,
 						     filter, format, builder)) != 1) {
 			if (res == 0 && filter != NULL) {
 				oidx = 0;
@@ -771,6 +918,8 @@ int pw_context_find_format(struct pw_context *context,
 
 		pw_log_debug("%p: Got filtered:", context);
 		pw_log_format(SPA_LOG_LEVEL_DEBUG, *format);
+
+		format_cache_put(context, output, input, *format);
 	} else {
 		res = -EBADF;
 		*error = spa_aprintf("error bad node state");
@@ -783,6 +932,49 @@ error:
 	return res;
 }
 
+struct async_invoke {
+	struct impl *impl;
+	spa_invoke_func_t func;
+	void *user_data;
+};
+
+static int do_async_invoke(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	const struct async_invoke *a = data;
+	int res;
+
+	res = a->func(loop, async, seq, NULL, 0, a->user_data);
+	__atomic_sub_fetch(&a->impl->pending_invokes, 1, __ATOMIC_SEQ_CST);
+	return res;
+}
+
+/** Invoke \a func in \a loop without waiting for it
+ *
+ * The invokes that are still pending in the loop are counted. When a burst of
+ * link changes is handled in one recalc, the invoke queue of the loop could
+ * overflow so we first wait for the pending invokes when there are too many.
+ */
+int pw_context_invoke_async(struct pw_context *context, struct pw_loop *loop,
+		spa_invoke_func_t func, void *user_data)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct async_invoke a = { impl, func, user_data };
+	int res;
+
+	/* the blocking invoke is queued after the pending ones */
+	if (__atomic_load_n(&impl->pending_invokes, __ATOMIC_SEQ_CST) >= MAX_PENDING_INVOKES)
+		pw_loop_invoke(loop, NULL, SPA_ID_INVALID, NULL, 0, true, NULL);
+
+	__atomic_add_fetch(&impl->pending_invokes, 1, __ATOMIC_SEQ_CST);
+	res = pw_loop_invoke(loop, do_async_invoke, SPA_ID_INVALID, &a, sizeof(a), false, NULL);
+	if (res < 0) {
+		__atomic_sub_fetch(&impl->pending_invokes, 1, __ATOMIC_SEQ_CST);
+		pw_log_warn("%p: invoke failed: %s", context, spa_strerror(res));
+	}
+	return res;
+}
+
 static int ensure_state(struct pw_impl_node *node, bool running)
 {
 	enum pw_node_state state = node->info.state;
@@ -896,6 +1088,7 @@ static void remove_from_driver(struct pw_context *context, struct spa_list *node
 	spa_list_consume(n, nodes, sort_link) {
 		spa_list_remove(&n->sort_link);
 		pw_impl_node_set_driver(n, NULL);
+		n->dead = false;
 		ensure_state(n, false);
 	}
 }
@@ -981,68 +1174,328 @@ static uint32_t find_best_rate(const uint32_t *rates, uint32_t n_rates, uint32_t
 	return best;
 }
 
-/* here we evaluate the complete state of the graph.
- *
- * It roughly operates in 3 stages:
- *
- * 1. go over all drivers and collect the nodes that need to be scheduled with the
- *    driver. This include all nodes that have an active link with the driver or
- *    with a node already scheduled with the driver.
- *
- * 2. go over all nodes that are not assigned to a driver. The ones that require
- *    a driver are moved to some random active driver found in step 1.
- *
- * 3. go over all drivers again, collect the quantum/rate of all followers, select
- *    the desired final value and activate the followers and then the driver.
- *
- * A complete graph evaluation is performed for each change that is made to the
- * graph, such as making/destroying links, adding/removing nodes, property changes such
- * as quantum/rate changes or metadata changes.
- */
-int pw_context_recalc_graph(struct pw_context *context, const char *reason)
+static bool node_has_outputs(struct pw_impl_node *node)
 {
-	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
-	struct settings *settings = &context->settings;
-	struct pw_impl_node *n, *s, *target, *fallback;
+	struct pw_impl_port *p;
+	spa_list_for_each(p, &node->output_ports, link) {
+		/* monitor ports are optional outputs, they don't make
+		 * the node a producer */
+		if (!pw_properties_get_bool(p->properties, PW_KEY_PORT_MONITOR, false))
+			return true;
+	}
+	return false;
+}
+
+static bool node_is_live(struct pw_impl_node *driver, struct pw_impl_node *node)
+{
+	struct pw_impl_port *p;
+	struct pw_impl_link *l;
+	struct pw_impl_node *t;
+
+	/* a node is live when one of its output links goes to a live node */
+	spa_list_for_each(p, &node->output_ports, link) {
+		spa_list_for_each(l, &p->links, output_link) {
+			t = l->input->node;
+			if (l->prepared && t->active && !t->dead &&
+			    t->driver_node == driver)
+				return true;
+		}
+	}
+	/* or when a node in the same group is live */
+	if (node->group[0] == '\0')
+		return false;
+
+	spa_list_for_each(t, &driver->follower_list, follower_link) {
+		if (t != node && t->active && !t->dead &&
+		    spa_streq(t->group, node->group))
+			return true;
+	}
+	return false;
+}
+
+/* Find the followers of a driver that can't reach a sink. We start by
+ * marking all nodes that produce output as dead, everything else (the
+ * driver, sinks and nodes that always need processing) is live. Then we
+ * mark nodes live when they are linked to a live node until nothing
+ * changes. A group is only a sink when none of its nodes has outputs. */
+static uint32_t mark_dead_nodes(struct pw_context *context, struct pw_impl_node *driver)
+{
+	struct pw_impl_node *s, *t;
+	uint32_t n_dead = 0;
+	bool changed;
+
+	spa_list_for_each(s, &driver->follower_list, follower_link)
+		s->dead = s != driver && s->active && !s->always_process &&
+			node_has_outputs(s);
+
+	spa_list_for_each(s, &driver->follower_list, follower_link) {
+		if (s == driver || !s->active || s->always_process ||
+		    s->dead || s->group[0] == '\0')
+			continue;
+		spa_list_for_each(t, &driver->follower_list, follower_link) {
+			if (t != s && t->dead && spa_streq(t->group, s->group)) {
+				s->dead = true;
+				break;
+			}
+		}
+	}
+	do {
+		changed = false;
+		spa_list_for_each(s, &driver->follower_list, follower_link) {
+			if (s->dead && node_is_live(driver, s)) {
+				s->dead = false;
+				changed = true;
+			}
+		}
+	} while (changed);
+
+	spa_list_for_each(s, &driver->follower_list, follower_link) {
+		if (s->dead) {
+			pw_log_debug("%p: driver %p: skip dead follower %p '%s'",
+					context, driver, s, s->name);
+			n_dead++;
+		}
+	}
+	return n_dead;
+}
+
+struct recalc_info {
 	const uint32_t *rates;
-	uint32_t max_quantum, min_quantum, def_quantum, lim_quantum, rate_quantum;
 	uint32_t n_rates, def_rate;
-	bool freewheel = false, global_force_rate, global_force_quantum;
-	struct spa_list collect;
+	uint32_t max_quantum, min_quantum, def_quantum, lim_quantum, rate_quantum;
+	bool global_force_rate, global_force_quantum;
+};
 
-	pw_log_info("%p: busy:%d reason:%s", context, impl->recalc, reason);
+static void get_recalc_info(struct pw_context *context, struct recalc_info *info)
+{
+	get_quantums(context, &info->def_quantum, &info->min_quantum, &info->max_quantum,
+			&info->lim_quantum, &info->rate_quantum);
+	info->rates = get_rates(context, &info->def_rate, &info->n_rates,
+			&info->global_force_rate);
+	info->global_force_quantum = info->rate_quantum == 0;
+}
 
-	if (impl->recalc) {
-		impl->recalc_pending = true;
-		return -EBUSY;
+/* assign final quantum and set state for the followers and the driver,
+ * returns -EAGAIN when the driver was reconfigured and the graph needs
+ * to be recalculated */
+static int recalc_driver(struct pw_context *context, struct pw_impl_node *n,
+		const struct recalc_info *info)
+{
+	struct settings *settings = &context->settings;
+	struct pw_impl_node *s;
+	bool running = false, lock_quantum = false, lock_rate = false;
+	struct spa_fraction latency = SPA_FRACTION(0, 0);
+	struct spa_fraction max_latency = SPA_FRACTION(0, 0);
+	struct spa_fraction rate = SPA_FRACTION(0, 0);
+	uint32_t quantum, target_rate, current_rate;
+	uint64_t quantum_stamp = 0, rate_stamp = 0;
+	bool force_rate, force_quantum;
+	const uint32_t *node_rates;
+	uint32_t node_n_rates, node_def_rate;
+	uint32_t node_max_quantum, node_min_quantum, node_def_quantum, node_rate_quantum;
+
+	node_def_quantum = info->def_quantum;
+	node_min_quantum = info->min_quantum;
+	node_max_quantum = info->max_quantum;
+	node_rate_quantum = info->rate_quantum;
+	force_quantum = info->global_force_quantum;
+
+	node_def_rate = info->def_rate;
+	node_n_rates = info->n_rates;
+	node_rates = info->rates;
+	force_rate = info->global_force_rate;
+
+	/* collect quantum and rate */
+	spa_list_for_each(s, &n->follower_list, follower_link) {
+
+		if (!s->moved) {
+			/* We only try to enforce the lock flags for nodes that
+			 * are not recently moved between drivers. The nodes that
+			 * are moved should try to enforce their quantum on the
+			 * new driver. */
+			lock_quantum |= s->lock_quantum;
+			lock_rate |= s->lock_rate;
+		}
+		if (!info->global_force_quantum && s->force_quantum > 0 &&
+		    s->stamp > quantum_stamp) {
+			node_def_quantum = node_min_quantum = node_max_quantum = s->force_quantum;
+			node_rate_quantum = 0;
+			quantum_stamp = s->stamp;
+			force_quantum = true;
+		}
+		if (!info->global_force_rate && s->force_rate > 0 &&
+		    s->stamp > rate_stamp) {
+			node_def_rate = s->force_rate;
+			node_n_rates = 1;
+			node_rates = &s->force_rate;
+			force_rate = true;
+			rate_stamp = s->stamp;
+		}
+
+		/* smallest latencies */
+		if (latency.denom == 0 ||
+		    (s->latency.denom > 0 &&
+		     fraction_compare(&s->latency, &latency) < 0))
+			latency = s->latency;
+		if (max_latency.denom == 0 ||
+		    (s->max_latency.denom > 0 &&
+		     fraction_compare(&s->max_latency, &max_latency) < 0))
+			max_latency = s->max_latency;
+
+		/* largest rate */
+		if (rate.denom == 0 ||
+		    (s->rate.denom > 0 &&
+		     fraction_compare(&s->rate, &rate) > 0))
+			rate = s->rate;
+
+		if (s->active)
+			running = !n->passive;
+
+		pw_log_debug("%p: follower %p running:%d passive:%d rate:%u/%u latency %u/%u '%s'",
+			context, s, running, s->passive, rate.num, rate.denom,
+			latency.num, latency.denom, s->name);
+
+		s->moved = false;
 	}
 
-again:
-	impl->recalc = true;
+	if (force_quantum)
+		lock_quantum = false;
+	if (force_rate)
+		lock_rate = false;
+
+	if (n->reconfigure)
+		running = true;
+
+	current_rate = n->current_rate.denom;
+	if (lock_rate || n->reconfigure ||
+	    (!force_rate &&
+	    (n->info.state > PW_NODE_STATE_IDLE)))
+		/* when someone wants us to lock the rate of this driver or
+		 * when the driver is busy and we don't need to force a rate,
+		 * keep the current rate */
+		target_rate = current_rate;
+	else {
+		/* Here we are allowed to change the rate of the driver.
+		 * Start with the default rate. If the desired rate is
+		 * allowed, switch to it */
+		target_rate = node_def_rate;
+		if (rate.denom != 0 && rate.num == 1)
+			target_rate = find_best_rate(node_rates, node_n_rates,
+					rate.denom, target_rate);
+	}
+
+	if (target_rate != current_rate) {
+		bool do_reconfigure = false;
+		/* we doing a rate switch */
+		pw_log_info("(%s-%u) state:%s new rate:%u->%u",
+				n->name, n->info.id,
+				pw_node_state_as_string(n->info.state),
+				n->current_rate.denom,
+				target_rate);
+
+		if (force_rate) {
+			if (settings->clock_rate_update_mode == CLOCK_RATE_UPDATE_MODE_HARD)
+				do_reconfigure = true;
+		} else {
+			if (n->info.state >= PW_NODE_STATE_SUSPENDED)
+				do_reconfigure = true;
+		}
+		if (do_reconfigure)
+			reconfigure_driver(context, n);
+
+		/* we're setting the pending rate. This will become the new
+		 * current rate in the next iteration of the graph. */
+		n->current_rate = SPA_FRACTION(1, target_rate);
+		n->current_pending = true;
+		current_rate = target_rate;
+		/* we might be suspended now and the links need to be prepared again */
+		if (do_reconfigure)
+			return -EAGAIN;
+	}
 
-	get_quantums(context, &def_quantum, &min_quantum, &max_quantum, &lim_quantum, &rate_quantum);
-	rates = get_rates(context, &def_rate, &n_rates, &global_force_rate);
+	if (node_rate_quantum != 0 && current_rate != node_rate_quantum) {
+		/* the quantum values are scaled with the current rate */
+		node_def_quantum = node_def_quantum * current_rate / node_rate_quantum;
+		node_min_quantum = node_min_quantum * current_rate / node_rate_quantum;
+		node_max_quantum = node_max_quantum * current_rate / node_rate_quantum;
+	}
 
-	global_force_quantum = rate_quantum == 0;
+	/* calculate desired quantum */
+	if (max_latency.denom != 0) {
+		uint32_t tmp = (max_latency.num * current_rate / max_latency.denom);
+		if (tmp < node_max_quantum)
+			node_max_quantum = tmp;
+	}
 
-	/* start from all drivers and group all nodes that are linked
-	 * to it. Some nodes are not (yet) linked to anything and they
-	 * will end up 'unassigned' to a driver. Other nodes are drivers
-	 * and if they have active followers, we can use them to schedule
-	 * the unassigned nodes. */
-	target = fallback = NULL;
-	spa_list_for_each(n, &context->driver_list, driver_link) {
-		if (n->exported)
+	quantum = node_def_quantum;
+	if (latency.denom != 0)
+		quantum = (latency.num * current_rate / latency.denom);
+	quantum = SPA_CLAMP(quantum, node_min_quantum, node_max_quantum);
+	quantum = SPA_MIN(quantum, info->lim_quantum);
+
+	if (settings->clock_power_of_two_quantum)
+		quantum = flp2(quantum);
+
+	if (running && quantum != n->current_quantum && !lock_quantum) {
+		pw_log_info("(%s-%u) new quantum:%"PRIu64"->%u",
+				n->name, n->info.id,
+				n->current_quantum,
+				quantum);
+		/* this is the new pending quantum */
+		n->current_quantum = quantum;
+		n->current_pending = true;
+	}
+
+	if (n->info.state < PW_NODE_STATE_RUNNING && n->current_pending) {
+		/* the driver node is not actually running and we have a
+		 * pending change. Apply the change to the position now so
+		 * that we have the right values when we change the node
+		 * states of the driver and followers to RUNNING below */
+		pw_log_debug("%p: apply duration:%"PRIu64" rate:%u/%u", context,
+				n->current_quantum, n->current_rate.num,
+				n->current_rate.denom);
+		n->rt.position->clock.duration = n->current_quantum;
+		n->rt.position->clock.rate = n->current_rate;
+		n->current_pending = false;
+	}
+
+	pw_log_debug("%p: driver %p running:%d passive:%d quantum:%u '%s'",
+			context, n, running, n->passive, quantum, n->name);
+
+	/* followers without a path to a sink are not scheduled, they
+	 * are picked up again when a consumer is linked and we
+	 * recalculate the graph */
+	if (settings->link_skip_dead_nodes && running) {
+		n->n_dead = mark_dead_nodes(context, n);
+	} else {
+		spa_list_for_each(s, &n->follower_list, follower_link)
+			s->dead = false;
+		n->n_dead = 0;
+	}
+
+	/* first change the node states of the followers to the new target */
+	spa_list_for_each(s, &n->follower_list, follower_link) {
+		if (s == n)
 			continue;
+		pw_log_debug("%p: follower %p: active:%d dead:%d '%s'",
+				context, s, s->active, s->dead, s->name);
+		ensure_state(s, running && !s->dead);
+	}
+	/* now that all the followers are ready, start the driver */
+	ensure_state(n, running);
 
-		if (!n->visited) {
-			spa_list_init(&collect);
-			collect_nodes(context, n, &collect);
-			move_to_driver(context, &collect, n);
-		}
-		/* from now on we are only interested in active driving nodes.
-		 * We're going to see if there are active followers. */
-		if (!n->driving || !n->active)
+	return 0;
+}
+
+/* Find the driver for unassigned nodes, this is the first active driving
+ * node with active followers or else the first active driving node. */
+static struct pw_impl_node *find_target(struct pw_context *context, bool *freewheel)
+{
+	struct pw_impl_node *n, *s, *target = NULL, *fallback = NULL;
+
+	*freewheel = false;
+	spa_list_for_each(n, &context->driver_list, driver_link) {
+		if (n->exported || !n->driving || !n->active)
 			continue;
 
 		/* first active driving node is fallback */
@@ -1061,14 +1514,74 @@ again:
 				if (target == NULL)
 					target = n;
 				if (n->freewheel)
-					freewheel = true;
+					*freewheel = true;
 				break;
 			}
 		}
 	}
 	/* no active node, use fallback driving node */
-	if (target == NULL)
-		target = fallback;
+	return target ? target : fallback;
+}
+
+/* assign a group of nodes without a driver to the target when one of the
+ * nodes needs a driver. Else remove them from the driver and stop them. */
+static void assign_group(struct pw_context *context, struct pw_impl_node *node,
+		struct spa_list *collect, struct pw_impl_node *target)
+{
+	struct pw_impl_node *t, *driver = NULL;
+
+	pw_log_debug("%p: unassigned node %p: '%s' active:%d want_driver:%d target:%p",
+			context, node, node->name, node->active, node->want_driver, target);
+
+	spa_list_for_each(t, collect, sort_link) {
+		/* is any active and want a driver or it want process */
+		if ((t->want_driver && t->active && !node->passive) ||
+		    t->always_process)
+			driver = target;
+	}
+	if (driver != NULL) {
+		/* driver needed for this group */
+		driver->passive = false;
+		move_to_driver(context, collect, driver);
+	} else {
+		/* no driver, make sure the nodes stops */
+		remove_from_driver(context, collect);
+	}
+}
+
+static int recalc_graph(struct pw_context *context)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct pw_impl_node *n, *target;
+	struct recalc_info info;
+	struct spa_list collect;
+	bool freewheel;
+
+	/* everything is recalculated, drop the queued nodes */
+	spa_list_consume(n, &impl->recalc_list, recalc_link) {
+		spa_list_remove(&n->recalc_link);
+		n->recalc_queued = false;
+	}
+	impl->recalc_full = false;
+
+again:
+	get_recalc_info(context, &info);
+
+	/* start from all drivers and group all nodes that are linked
+	 * to it. Some nodes are not (yet) linked to anything and they
+	 * will end up 'unassigned' to a driver. Other nodes are drivers
+	 * and if they have active followers, we can use them to schedule
+	 * the unassigned nodes. */
+	spa_list_for_each(n, &context->driver_list, driver_link) {
+		if (n->exported || n->visited)
+			continue;
+
+		spa_list_init(&collect);
+		collect_nodes(context, n, &collect);
+		move_to_driver(context, &collect, n);
+	}
+	target = find_target(context, &freewheel);
+	impl->target = target;
 
 	/* update the freewheel status */
 	if (context->freewheeling != freewheel)
@@ -1080,33 +1593,13 @@ again:
 	 * group that needs a driver. Else we remove them from a driver
 	 * and stop them. */
 	spa_list_for_each(n, &context->node_list, link) {
-		struct pw_impl_node *t, *driver;
-
 		if (n->exported || n->visited)
 			continue;
 
-		pw_log_debug("%p: unassigned node %p: '%s' active:%d want_driver:%d target:%p",
-				context, n, n->name, n->active, n->want_driver, target);
-
 		/* collect all nodes in this group */
 		spa_list_init(&collect);
 		collect_nodes(context, n, &collect);
-
-		driver = NULL;
-		spa_list_for_each(t, &collect, sort_link) {
-			/* is any active and want a driver or it want process */
-			if ((t->want_driver && t->active && !n->passive) ||
-			    t->always_process)
-				driver = target;
-		}
-		if (driver != NULL) {
-			/* driver needed for this group */
-			driver->passive = false;
-			move_to_driver(context, &collect, driver);
-		} else {
-			/* no driver, make sure the nodes stops */
-			remove_from_driver(context, &collect);
-		}
+		assign_group(context, n, &collect, target);
 	}
 	/* clean up the visited flag now */
 	spa_list_for_each(n, &context->node_list, link)
@@ -1114,208 +1607,337 @@ again:
 
 	/* assign final quantum and set state for followers and drivers */
 	spa_list_for_each(n, &context->driver_list, driver_link) {
-		bool running = false, lock_quantum = false, lock_rate = false;
-		struct spa_fraction latency = SPA_FRACTION(0, 0);
-		struct spa_fraction max_latency = SPA_FRACTION(0, 0);
-		struct spa_fraction rate = SPA_FRACTION(0, 0);
-		uint32_t quantum, target_rate, current_rate;
-		uint64_t quantum_stamp = 0, rate_stamp = 0;
-		bool force_rate, force_quantum;
-		const uint32_t *node_rates;
-		uint32_t node_n_rates, node_def_rate;
-		uint32_t node_max_quantum, node_min_quantum, node_def_quantum, node_rate_quantum;
-
+		n->recalc = false;
 		if (!n->driving || n->exported)
 			continue;
+		if (recalc_driver(context, n, &info) == -EAGAIN)
+			goto again;
+	}
+	return 0;
+}
 
-		node_def_quantum = def_quantum;
-		node_min_quantum = min_quantum;
-		node_max_quantum = max_quantum;
-		node_rate_quantum = rate_quantum;
-		force_quantum = global_force_quantum;
+static inline void mark_driver(struct pw_impl_node *node)
+{
+	if (node->driver)
+		node->recalc = true;
+}
 
-		node_def_rate = def_rate;
-		node_n_rates = n_rates;
-		node_rates = rates;
-		force_rate = global_force_rate;
+/* collect the nodes connected to node and move them to their driver. The
+ * groups without a driver are added to the unassigned list. */
+static int collect_component(struct pw_context *context, struct pw_impl_node *node,
+		struct spa_list *unassigned, struct pw_array *starts)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct pw_impl_node *t, *driver = NULL, *d, **drivers;
+	uint32_t i, n_drivers;
+	void **p;
+	struct spa_list collect;
+	int res = 0;
 
-		/* collect quantum and rate */
-		spa_list_for_each(s, &n->follower_list, follower_link) {
+	if (node->visited || node->exported)
+		return 0;
 
-			if (!s->moved) {
-				/* We only try to enforce the lock flags for nodes that
-				 * are not recently moved between drivers. The nodes that
-				 * are moved should try to enforce their quantum on the
-				 * new driver. */
-				lock_quantum |= s->lock_quantum;
-				lock_rate |= s->lock_rate;
-			}
-			if (!global_force_quantum && s->force_quantum > 0 &&
-			    s->stamp > quantum_stamp) {
-				node_def_quantum = node_min_quantum = node_max_quantum = s->force_quantum;
-				node_rate_quantum = 0;
-				quantum_stamp = s->stamp;
-				force_quantum = true;
-			}
-			if (!global_force_rate && s->force_rate > 0 &&
-			    s->stamp > rate_stamp) {
-				node_def_rate = s->force_rate;
-				node_n_rates = 1;
-				node_rates = &s->force_rate;
-				force_rate = true;
-				rate_stamp = s->stamp;
-			}
+	spa_list_init(&collect);
+	collect_nodes(context, node, &collect);
 
-			/* smallest latencies */
-			if (latency.denom == 0 ||
-			    (s->latency.denom > 0 &&
-			     fraction_compare(&s->latency, &latency) < 0))
-				latency = s->latency;
-			if (max_latency.denom == 0 ||
-			    (s->max_latency.denom > 0 &&
-			     fraction_compare(&s->max_latency, &max_latency) < 0))
-				max_latency = s->max_latency;
-
-			/* largest rate */
-			if (rate.denom == 0 ||
-			    (s->rate.denom > 0 &&
-			     fraction_compare(&s->rate, &rate) > 0))
-				rate = s->rate;
-
-			if (s->active)
-				running = !n->passive;
-
-			pw_log_debug("%p: follower %p running:%d passive:%d rate:%u/%u latency %u/%u '%s'",
-				context, s, running, s->passive, rate.num, rate.denom,
-				latency.num, latency.denom, s->name);
-
-			s->moved = false;
+	/* all collected nodes need to be added so that their visited flag
+	 * is cleared, also when we fall back to a full recalculation */
+	pw_array_reset(&impl->drivers);
+	spa_list_for_each(t, &collect, sort_link) {
+		pw_array_add_ptr(&impl->collected, t);
+		mark_driver(t->driver_node);
+		if (!t->driver || t->exported || res < 0)
+			continue;
+		if ((p = pw_array_add(&impl->drivers, sizeof(void*))) == NULL)
+			res = -errno;
+		else
+			*p = t;
+	}
+	/* the caller falls back to a full recalculation */
+	if (res < 0)
+		return res;
+	drivers = impl->drivers.data;
+	n_drivers = pw_array_get_len(&impl->drivers, struct pw_impl_node *);
+	/* the first driver in the driver list takes the nodes, like in a full
+	 * recalculation */
+	if (n_drivers == 1) {
+		driver = drivers[0];
+	} else if (n_drivers > 1) {
+		spa_list_for_each(d, &context->driver_list, driver_link) {
+			for (i = 0; i < n_drivers; i++)
+				if (drivers[i] == d)
+					break;
+			if (i < n_drivers) {
+				driver = d;
+				break;
+			}
 		}
+	}
+	if (driver != NULL) {
+		/* the passive state of the group is in the start node */
+		driver->passive = node->passive;
+		mark_driver(driver);
+		move_to_driver(context, &collect, driver);
+	} else {
+		pw_array_add_ptr(starts, node);
+		spa_list_insert_list(unassigned->prev, &collect);
+	}
+	return 0;
+}
+
+static int collect_peers(struct pw_context *context, struct pw_impl_node *node,
+		struct spa_list *unassigned, struct pw_array *starts)
+{
+	struct pw_impl_node *t;
+	struct pw_impl_port *p;
+	struct pw_impl_link *l;
+	int res;
+
+	if ((res = collect_component(context, node, unassigned, starts)) < 0)
+		return res;
+
+	/* the nodes that were connected through this node might be
+	 * disconnected now */
+	spa_list_for_each(p, &node->input_ports, link) {
+		spa_list_for_each(l, &p->links, input_link)
+			if ((res = collect_component(context, l->output->node,
+							unassigned, starts)) < 0)
+				return res;
+	}
+	spa_list_for_each(p, &node->output_ports, link) {
+		spa_list_for_each(l, &p->links, output_link)
+			if ((res = collect_component(context, l->input->node,
+							unassigned, starts)) < 0)
+				return res;
+	}
+	spa_list_for_each(t, &node->follower_list, follower_link)
+		if ((res = collect_component(context, t, unassigned, starts)) < 0)
+			return res;
+
+	if ((res = collect_component(context, node->driver_node, unassigned, starts)) < 0)
+		return res;
+
+	/* an inactive node does not join its group anymore */
+	if (node->active || node->group[0] == '\0')
+		return 0;
+
+	spa_list_for_each(t, &context->node_list, link) {
+		if (t != node && spa_streq(t->group, node->group) &&
+		    (res = collect_component(context, t, unassigned, starts)) < 0)
+			return res;
+	}
+	return 0;
+}
+
+/* Recalculate only the part of the graph that is connected to the queued
+ * nodes. Returns -EAGAIN when a full recalculation is needed. */
+static int recalc_queued(struct pw_context *context)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct pw_impl_node *n, *t, *next, *target, **np;
+	struct spa_list unassigned;
+	struct pw_array starts;
+	struct recalc_info info;
+	uint32_t i, n_starts;
+	bool freewheel, changed;
+	int res = 0;
 
-		if (force_quantum)
-			lock_quantum = false;
-		if (force_rate)
-			lock_rate = false;
-
-		if (n->reconfigure)
-			running = true;
-
-		current_rate = n->current_rate.denom;
-		if (lock_rate || n->reconfigure ||
-		    (!force_rate &&
-		    (n->info.state > PW_NODE_STATE_IDLE)))
-			/* when someone wants us to lock the rate of this driver or
-			 * when the driver is busy and we don't need to force a rate,
-			 * keep the current rate */
-			target_rate = current_rate;
-		else {
-			/* Here we are allowed to change the rate of the driver.
-			 * Start with the default rate. If the desired rate is
-			 * allowed, switch to it */
-			target_rate = node_def_rate;
-			if (rate.denom != 0 && rate.num == 1)
-				target_rate = find_best_rate(node_rates, node_n_rates,
-						rate.denom, target_rate);
+	spa_list_init(&unassigned);
+	pw_array_init(&starts, 64);
+
+	spa_list_consume(n, &impl->recalc_list, recalc_link) {
+		spa_list_remove(&n->recalc_link);
+		n->recalc_queued = false;
+
+		if (res >= 0 && !n->exported)
+			res = collect_peers(context, n, &unassigned, &starts);
+	}
+	/* the drivers that lost nodes need to be collected again to find
+	 * their new passive state */
+	do {
+		changed = false;
+		spa_list_for_each(n, &context->driver_list, driver_link) {
+			if (res < 0)
+				break;
+			if (!n->recalc || n->visited || n->exported)
+				continue;
+			res = collect_component(context, n, &unassigned, &starts);
+			changed = true;
 		}
+	} while (changed && res >= 0);
 
-		if (target_rate != current_rate) {
-			bool do_reconfigure = false;
-			/* we doing a rate switch */
-			pw_log_info("(%s-%u) state:%s new rate:%u->%u",
-					n->name, n->info.id,
-					pw_node_state_as_string(n->info.state),
-					n->current_rate.denom,
-					target_rate);
-
-			if (force_rate) {
-				if (settings->clock_rate_update_mode == CLOCK_RATE_UPDATE_MODE_HARD)
-					do_reconfigure = true;
-			} else {
-				if (n->info.state >= PW_NODE_STATE_SUSPENDED)
-					do_reconfigure = true;
+	if (res < 0)
+		goto done;
+
+	/* nodes that were assigned to a driver before and were not collected
+	 * now keep the driver running */
+	spa_list_for_each(n, &context->driver_list, driver_link) {
+		if (!n->recalc)
+			continue;
+		spa_list_for_each(t, &n->follower_list, follower_link) {
+			if (t != n && !t->visited && t->active) {
+				n->passive = false;
+				break;
 			}
-			if (do_reconfigure)
-				reconfigure_driver(context, n);
-
-			/* we're setting the pending rate. This will become the new
-			 * current rate in the next iteration of the graph. */
-			n->current_rate = SPA_FRACTION(1, target_rate);
-			n->current_pending = true;
-			current_rate = target_rate;
-			/* we might be suspended now and the links need to be prepared again */
-			if (do_reconfigure)
-				goto again;
 		}
+	}
 
-		if (node_rate_quantum != 0 && current_rate != node_rate_quantum) {
-			/* the quantum values are scaled with the current rate */
-			node_def_quantum = node_def_quantum * current_rate / node_rate_quantum;
-			node_min_quantum = node_min_quantum * current_rate / node_rate_quantum;
-			node_max_quantum = node_max_quantum * current_rate / node_rate_quantum;
-		}
+	/* when the target for unassigned nodes changed, all unassigned
+	 * nodes need to move */
+	target = find_target(context, &freewheel);
+	if (target != impl->target) {
+		res = -EAGAIN;
+		goto done;
+	}
+	if (context->freewheeling != freewheel)
+		context_set_freewheel(context, freewheel);
 
-		/* calculate desired quantum */
-		if (max_latency.denom != 0) {
-			uint32_t tmp = (max_latency.num * current_rate / max_latency.denom);
-			if (tmp < node_max_quantum)
-				node_max_quantum = tmp;
-		}
+	/* the unassigned groups are in the list in the same order as their
+	 * start nodes */
+	n_starts = pw_array_get_len(&starts, struct pw_impl_node *);
+	np = starts.data;
+	for (i = 0; i < n_starts; i++) {
+		struct spa_list collect;
 
-		quantum = node_def_quantum;
-		if (latency.denom != 0)
-			quantum = (latency.num * current_rate / latency.denom);
-		quantum = SPA_CLAMP(quantum, node_min_quantum, node_max_quantum);
-		quantum = SPA_MIN(quantum, lim_quantum);
-
-		if (settings->clock_power_of_two_quantum)
-			quantum = flp2(quantum);
-
-		if (running && quantum != n->current_quantum && !lock_quantum) {
-			pw_log_info("(%s-%u) new quantum:%"PRIu64"->%u",
-					n->name, n->info.id,
-					n->current_quantum,
-					quantum);
-			/* this is the new pending quantum */
-			n->current_quantum = quantum;
-			n->current_pending = true;
+		next = i + 1 < n_starts ? np[i + 1] : NULL;
+		spa_list_init(&collect);
+		spa_list_consume(t, &unassigned, sort_link) {
+			if (t == next)
+				break;
+			spa_list_remove(&t->sort_link);
+			spa_list_append(&collect, &t->sort_link);
 		}
+		assign_group(context, np[i], &collect, target);
+	}
+	if (target != NULL)
+		mark_driver(target);
 
-		if (n->info.state < PW_NODE_STATE_RUNNING && n->current_pending) {
-			/* the driver node is not actually running and we have a
-			 * pending change. Apply the change to the position now so
-			 * that we have the right values when we change the node
-			 * states of the driver and followers to RUNNING below */
-			pw_log_debug("%p: apply duration:%"PRIu64" rate:%u/%u", context,
-					n->current_quantum, n->current_rate.num,
-					n->current_rate.denom);
-			n->rt.position->clock.duration = n->current_quantum;
-			n->rt.position->clock.rate = n->current_rate;
-			n->current_pending = false;
-		}
+	get_recalc_info(context, &info);
 
-		pw_log_debug("%p: driver %p running:%d passive:%d quantum:%u '%s'",
-				context, n, running, n->passive, quantum, n->name);
+	/* only recalculate the drivers that changed */
+	spa_list_for_each(n, &context->driver_list, driver_link) {
+		if (!n->recalc)
+			continue;
+		n->recalc = false;
+		if (!n->driving || n->exported)
+			continue;
+		if ((res = recalc_driver(context, n, &info)) < 0)
+			break;
+	}
+done:
+	if (res < 0) {
+		/* the full recalculation will pick up everything */
+		spa_list_consume(t, &unassigned, sort_link)
+			spa_list_remove(&t->sort_link);
+	}
+	pw_array_for_each(np, &impl->collected)
+		(*np)->visited = false;
+	pw_array_reset(&impl->collected);
+	pw_array_clear(&starts);
 
-		/* first change the node states of the followers to the new target */
-		spa_list_for_each(s, &n->follower_list, follower_link) {
-			if (s == n)
-				continue;
-			pw_log_debug("%p: follower %p: active:%d '%s'",
-					context, s, s->active, s->name);
-			ensure_state(s, running);
-		}
-		/* now that all the followers are ready, start the driver */
-		ensure_state(n, running);
+	return res;
+}
+
+/* here we evaluate the complete state of the graph.
+ *
+ * It roughly operates in 3 stages:
+ *
+ * 1. go over all drivers and collect the nodes that need to be scheduled with the
+ *    driver. This include all nodes that have an active link with the driver or
+ *    with a node already scheduled with the driver.
+ *
+ * 2. go over all nodes that are not assigned to a driver. The ones that require
+ *    a driver are moved to some random active driver found in step 1.
+ *
+ * 3. go over all drivers again, collect the quantum/rate of all followers, select
+ *    the desired final value and activate the followers and then the driver.
+ *
+ * This complete evaluation is performed for property changes such as
+ * quantum/rate changes or metadata changes and when the incremental evaluation
+ * can't be used. Making/destroying links and adding/removing nodes queue the
+ * affected nodes instead and recalc_queued() only evaluates their part of the
+ * graph, see pw_context_queue_recalc().
+ */
+int pw_context_recalc_graph(struct pw_context *context, const char *reason)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+
+	pw_log_info("%p: busy:%d reason:%s", context, impl->recalc, reason);
+
+	if (impl->recalc) {
+		impl->recalc_pending = true;
+		return -EBUSY;
 	}
-	impl->recalc = false;
-	if (impl->recalc_pending) {
+	do {
+		impl->recalc = true;
 		impl->recalc_pending = false;
-		goto again;
-	}
+		recalc_graph(context);
+		impl->recalc = false;
+	} while (impl->recalc_pending);
 
 	return 0;
 }
 
+static void do_recalc_queued(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct pw_context *context = &impl->this;
+	int res;
+
+	impl->recalc_scheduled = false;
+
+	if (impl->recalc_full || !context->settings.link_incremental_recalc) {
+		pw_context_recalc_graph(context, "queued");
+		return;
+	}
+	if (spa_list_is_empty(&impl->recalc_list))
+		return;
+
+	pw_log_info("%p: recalc queued nodes", context);
+
+	impl->recalc = true;
+	res = recalc_queued(context);
+	impl->recalc = false;
+
+	if (res < 0 || impl->recalc_pending)
+		pw_context_recalc_graph(context, res == -EAGAIN ?
+				"target changed" : "queued");
+}
+
+/** Queue a recalculation of the graph around \a node
+ *
+ * The graph is recalculated once in the next main loop iteration for
+ * all the queued nodes. When \a node is NULL, the complete graph is
+ * recalculated.
+ */
+void pw_context_queue_recalc(struct pw_context *context, struct pw_impl_node *node,
+		const char *reason)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+
+	pw_log_debug("%p: node:%p reason:%s", context, node, reason);
+
+	if (node == NULL)
+		impl->recalc_full = true;
+	else if (!node->recalc_queued) {
+		node->recalc_queued = true;
+		spa_list_append(&impl->recalc_list, &node->recalc_link);
+	}
+	if (!impl->recalc_scheduled) {
+		impl->recalc_scheduled = true;
+		pw_loop_signal_event(context->main_loop, impl->recalc_event);
+	}
+}
+
+/** Remove \a node from the queued nodes */
+void pw_context_dequeue_recalc(struct pw_context *context, struct pw_impl_node *node)
+{
+	if (node->recalc_queued) {
+		spa_list_remove(&node->recalc_link);
+		node->recalc_queued = false;
+	}
+}
+
 SPA_EXPORT
 int pw_context_add_spa_lib(struct pw_context *context,
 		const char *factory_regexp, const char *lib)
@@ -29,6 +29,9 @@
 extern "C" {
 #endif
 
+#include <string.h>
+#include <errno.h>
+
 #include <spa/utils/defs.h>
 
 /** \defgroup pw_profiler Profiler
@@ -41,34 +44,63 @@ extern "C" {
  */
 #define PW_TYPE_INTERFACE_Profiler		PW_TYPE_INFO_INTERFACE_BASE "Profiler"
 
-#define PW_VERSION_PROFILER			3
+#define PW_VERSION_PROFILER			4
 struct pw_profiler;
 
 #define PW_EXTENSION_MODULE_PROFILER		PIPEWIRE_MODULE_PREFIX "module-profiler"
 
 #define PW_PROFILER_EVENT_PROFILE		0
-#define PW_PROFILER_EVENT_NUM			1
+#define PW_PROFILER_EVENT_RING			1
+#define PW_PROFILER_EVENT_NUM			2
 
 /** \ref pw_profiler events */
 struct pw_profiler_events {
-#define PW_VERSION_PROFILER_EVENTS		0
+#define PW_VERSION_PROFILER_EVENTS		1
 	uint32_t version;
 
+	/**
+	 * Profiling data
+	 *
+	 * A Struct with SPA_TYPE_OBJECT_Profiler objects. Since version 4,
+	 * objects with the SPA_PROFILER_nodeHistogram of the nodes are also
+	 * sent, once when bound and then with the other profiling data.
+	 */
 	void (*profile) (void *data, const struct spa_pod *pod);
+	/**
+	 * The profiler ring is available, since version 1:4
+	 *
+	 * Emitted after start_ring. The memory is added to the core mempool
+	 * and can be mapped read-only with pw_mempool_map_id() and
+	 * PW_MEMMAP_FLAG_READ. It contains a struct pw_profiler_ring.
+	 *
+	 * \param mem_id the id of the memory in the core mempool
+	 * \param offset the offset of the ring in the memory
+	 * \param size the size of the ring
+	 */
+	void (*ring) (void *data, uint32_t mem_id, uint32_t offset, uint32_t size);
 };
 
 #define PW_PROFILER_METHOD_ADD_LISTENER		0
-#define PW_PROFILER_METHOD_NUM			1
+#define PW_PROFILER_METHOD_START_RING		1
+#define PW_PROFILER_METHOD_NUM			2
 
 /** \ref pw_profiler methods */
 struct pw_profiler_methods {
-#define PW_VERSION_PROFILER_METHODS		0
+#define PW_VERSION_PROFILER_METHODS		1
 	uint32_t version;
 
 	int (*add_listener) (void *object,
 			struct spa_hook *listener,
 			const struct pw_profiler_events *events,
 			void *data);
+	/**
+	 * Receive the profiling data in a shared memory ring instead
+	 * of profile events, since version 1:4
+	 *
+	 * The ring event is emitted with the memory of the ring. No more
+	 * profile events are sent to this profiler.
+	 */
+	int (*start_ring) (void *object);
 };
 
 #define pw_profiler_method(o,method,version,...)			\
@@ -81,6 +113,157 @@ struct pw_profiler_methods {
 })
 
 #define pw_profiler_add_listener(c,...)		pw_profiler_method(c,add_listener,0,__VA_ARGS__)
+#define pw_profiler_start_ring(c)		pw_profiler_method(c,start_ring,1)
+
+#define PW_PROFILER_RING_MAGIC		0x50575052u	/* "PWPR" */
+#define PW_PROFILER_RING_VERSION	1
+
+/** The header of the shared profiler ring.
+ *
+ * The ring is written by the data thread of the daemon, one record for
+ * the driver and one for each of its followers per cycle. Readers map
+ * the ring read-only and keep their own read index, see
+ * pw_profiler_ring_read(). */
+struct pw_profiler_ring {
+	uint32_t magic;			/**< PW_PROFILER_RING_MAGIC */
+	uint32_t version;		/**< PW_PROFILER_RING_VERSION */
+	uint32_t record_size;		/**< size of a record, at least the size of
+					  *  struct pw_profiler_record for this version */
+	uint32_t n_records;		/**< number of records, a power of 2 */
+	uint32_t offset;		/**< offset of the first record */
+	uint32_t padding[11];
+	uint64_t write_index;		/**< number of records written */
+	uint64_t padding2[7];
+};
+
+/** A record in the profiler ring. New fields are only added at the end. */
+struct pw_profiler_record {
+	uint64_t seq;			/**< the index of the record + 1, 0 while
+					  *  the record is being written */
+	uint64_t cycle;			/**< cycle counter of the profiler */
+#define PW_PROFILER_RECORD_FLAG_DRIVER	(1<<0)	/**< the record of the driver,
+						  *  the clock fields are valid */
+	uint32_t flags;
+	uint32_t id;			/**< node id */
+	uint32_t driver_id;		/**< node id of the driver */
+	int32_t status;			/**< activation status */
+	uint64_t prev_signal_time;	/**< previous signal time of the driver, for
+					  *  followers the signal time of the driver */
+	uint64_t signal_time;
+	uint64_t awake_time;
+	uint64_t finish_time;
+	struct spa_fraction latency;	/**< latency of the node */
+	uint64_t clock_nsec;
+	uint64_t clock_position;
+	uint64_t clock_duration;
+	int64_t clock_delay;
+	double clock_rate_diff;
+	struct spa_fraction clock_rate;
+	uint32_t xrun_count;
+	float cpu_load[3];
+};
+
+/** Read the next record from the profiler ring.
+ *
+ * \param ring the mapped ring
+ * \param index the read index, 0 to start at the oldest record and
+ *   ring->write_index to only read new records
+ * \param record the record to fill
+ * \return 1 when a record was read, 0 when there are no new records
+ *   and -EPIPE when records were lost because the reader was too slow. The
+ *   index is then moved to the next record that can be read. */
+static inline int pw_profiler_ring_read(const struct pw_profiler_ring *ring,
+		uint64_t *index, struct pw_profiler_record *record)
+{
+	const struct pw_profiler_record *r;
+	uint64_t windex, seq;
+
+	windex = __atomic_load_n(&ring->write_index, __ATOMIC_ACQUIRE);
+	if (*index == windex)
+		return 0;
+	if (windex - *index > ring->n_records) {
+		*index = windex - ring->n_records;
+		return -EPIPE;
+	}
+	r = SPA_PTROFF(ring, ring->offset +
+			(*index & (ring->n_records - 1)) * ring->record_size,
+			const struct pw_profiler_record);
+
+	seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+	if (seq == *index + 1) {
+		memcpy(record, r, sizeof(*record));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&r->seq, __ATOMIC_RELAXED) == seq) {
+			(*index)++;
+			return 1;
+		}
+	}
+	/* overwritten by the writer */
+	(*index)++;
+	return -EPIPE;
+}
+
+/** Get the lower bound in nanoseconds of a bucket in the histograms of
+ * SPA_PROFILER_nodeHistogram.
+ *
+ * \param min_shift the min_shift of the histogram
+ * \param sub_shift the sub_shift of the histogram
+ * \param index the bucket index
+ * \return the smallest value that is counted in the bucket */
+static inline uint64_t pw_profiler_histogram_bound(uint32_t min_shift, uint32_t sub_shift,
+		uint32_t index)
+{
+	uint32_t i, shift;
+
+	if (index == 0)
+		return 0;
+	i = index - 1;
+	shift = min_shift + (i >> sub_shift);
+	if (sub_shift > shift || shift >= 64 - sub_shift)
+		return UINT64_MAX;
+	return (uint64_t)((1u << sub_shift) + (i & ((1u << sub_shift) - 1))) << (shift - sub_shift);
+}
+
+/** Get a percentile from the histograms of SPA_PROFILER_nodeHistogram.
+ *
+ * \param buckets the bucket counters
+ * \param n_buckets the number of buckets
+ * \param min_shift the min_shift of the histogram
+ * \param sub_shift the sub_shift of the histogram
+ * \param max the largest value, UINT64_MAX when unknown
+ * \param percentile the percentile, between 0.0 and 100.0
+ * \return the upper bound in nanoseconds of the bucket with the percentile, at
+ *   most max, or 0 when the histogram is empty. The max is used for the last
+ *   bucket. */
+static inline uint64_t pw_profiler_histogram_percentile(const uint64_t *buckets,
+		uint32_t n_buckets, uint32_t min_shift, uint32_t sub_shift,
+		uint64_t max, double percentile)
+{
+	uint64_t total = 0, sum = 0, target;
+	double t;
+	uint32_t i;
+
+	for (i = 0; i < n_buckets; i++)
+		total += buckets[i];
+	if (total == 0)
+		return 0;
+
+	t = total * percentile / 100.0;
+	target = (uint64_t)t;
+	if (target < t || target == 0)
+		target++;
+
+	for (i = 0; i < n_buckets; i++) {
+		sum += buckets[i];
+		if (sum >= target)
+			break;
+	}
+	/* the max is in the last bucket, which also collects the values
+	 * above the range of the histogram */
+	if (i + 1 >= n_buckets && max != UINT64_MAX)
+		return max;
+	return SPA_MIN(pw_profiler_histogram_bound(min_shift, sub_shift, i + 1), max);
+}
 
 #define PW_KEY_PROFILER_NAME		"profiler.name"
 
@@ -88,6 +88,13 @@ static void info_changed(struct pw_impl_link *link)
 	link->info.change_mask = 0;
 }
 
+static void queue_recalc(struct pw_impl_link *link, const char *reason)
+{
+	struct impl *impl = SPA_CONTAINER_OF(link, struct impl, this);
+	pw_context_queue_recalc(link->context, impl->onode, reason);
+	pw_context_queue_recalc(link->context, impl->inode, reason);
+}
+
 static void link_update_state(struct pw_impl_link *link, enum pw_link_state state, int res, char *error)
 {
 	struct impl *impl = SPA_CONTAINER_OF(link, struct impl, this);
@@ -130,11 +137,11 @@ static void link_update_state(struct pw_impl_link *link, enum pw_link_state stat
 	if (old < PW_LINK_STATE_PAUSED && state == PW_LINK_STATE_PAUSED) {
 		link->prepared = true;
 		link->preparing = false;
-		pw_context_recalc_graph(link->context, "link prepared");
+		queue_recalc(link, "link prepared");
 	} else if (old == PW_LINK_STATE_PAUSED && state < PW_LINK_STATE_PAUSED) {
 		link->prepared = false;
 		link->preparing = false;
-		pw_context_recalc_graph(link->context, "link unprepared");
+		queue_recalc(link, "link unprepared");
 	} else if (state == PW_LINK_STATE_INIT) {
 		link->prepared = false;
 		link->preparing = false;
@@ -633,8 +640,8 @@ int pw_impl_link_activate(struct pw_impl_link *this)
 			return res;
 		impl->io_set = true;
 	}
-	pw_loop_invoke(this->output->node->data_loop,
-	       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
+	pw_context_invoke_async(this->context, this->output->node->data_loop,
+			do_activate_link, this);
 
 	impl->activated = true;
 	pw_log_info("(%s) activated", this->name);
@@ -1434,7 +1441,7 @@ void pw_impl_link_destroy(struct pw_impl_link *link)
 	}
 
 	if (link->prepared)
-		pw_context_recalc_graph(link->context, "link destroy");
+		queue_recalc(link, "link destroy");
 
 	pw_log_debug("%p: free", impl);
 	pw_impl_link_emit_free(link);
@@ -36,6 +36,7 @@
 #include <spa/node/utils.h>
 #include <spa/debug/types.h>
 #include <spa/utils/string.h>
+#include <spa/utils/probe.h>
 
 #include "pipewire/impl-node.h"
 #include "pipewire/private.h"
@@ -175,6 +176,10 @@ do_node_add(struct spa_loop *loop, bool async, uint32_t seq, const void *data, s
 
 		spa_loop_add_source(loop, &this->source);
 		add_node(this, driver);
+
+		/* don't measure the time the driver was stopped as a cycle */
+		if (this == driver)
+			this->rt.activation->signal_time = 0;
 	}
 	return 0;
 }
@@ -221,10 +226,13 @@ static int idle_node(struct pw_impl_node *this)
 			pw_node_state_as_string(impl->pending_state),
 			this->pause_on_idle);
 
-	if (impl->pending_state <= PW_NODE_STATE_IDLE)
+	/* dead nodes are always paused so that their driver doesn't
+	 * schedule them anymore, also when they are already idle */
+	if (impl->pending_state <= PW_NODE_STATE_IDLE &&
+	    !(this->dead && this->added))
 		return 0;
 
-	if (!this->pause_on_idle)
+	if (!this->pause_on_idle && !this->dead)
 		return 0;
 
 	node_deactivate(this);
@@ -791,7 +799,7 @@ int pw_impl_node_register(struct pw_impl_node *this,
 		pw_impl_port_register(port, NULL);
 
 	if (this->active)
-		pw_context_recalc_graph(context, "register active node");
+		pw_context_queue_recalc(context, this, "register active node");
 
 	return 0;
 
@@ -910,7 +918,7 @@ static void check_properties(struct pw_impl_node *node)
 	const char *str, *recalc_reason = NULL;
 	struct spa_fraction frac;
 	uint32_t value;
-	bool driver;
+	bool driver, recalc_all = false;
 
 	if ((str = pw_properties_get(node->properties, PW_KEY_PRIORITY_DRIVER))) {
 		node->priority_driver = pw_properties_parse_int(str);
@@ -940,6 +948,7 @@ static void check_properties(struct pw_impl_node *node)
 				spa_list_remove(&node->driver_link);
 		}
 		recalc_reason = "driver changed";
+		recalc_all = true;
 	}
 
 	/* not scheduled automatically so we add an additional required trigger */
@@ -955,6 +964,7 @@ static void check_properties(struct pw_impl_node *node)
 		snprintf(node->group, sizeof(node->group), "%s", str);
 		node->freewheel = spa_streq(node->group, "pipewire.freewheel");
 		recalc_reason = "group changed";
+		recalc_all = true;
 	}
 
 
@@ -1023,7 +1033,7 @@ static void check_properties(struct pw_impl_node *node)
 			recalc_reason, node->active);
 
 	if (recalc_reason != NULL && node->active)
-		pw_context_recalc_graph(context, recalc_reason);
+		pw_context_queue_recalc(context, recalc_all ? NULL : node, recalc_reason);
 }
 
 static const char *str_status(uint32_t status)
@@ -1086,6 +1096,7 @@ static inline int resume_node(struct pw_impl_node *this, int status)
 	activation->finish_time = nsec;
 
 	pw_log_trace_fp("%p: trigger peers %"PRIu64, this, nsec);
+	spa_probe(pipewire, node_finish, this->info.id, status, nsec);
 
 	spa_list_for_each(t, &this->rt.target_list, link) {
 		struct pw_node_activation *a = t->activation;
@@ -1097,6 +1108,8 @@ static inline int resume_node(struct pw_impl_node *this, int status)
 		if (pw_node_activation_state_dec(state, 1)) {
 			a->status = PW_NODE_ACTIVATION_TRIGGERED;
 			a->signal_time = nsec;
+			spa_probe(pipewire, node_signal, this->info.id,
+					t->node ? t->node->info.id : SPA_ID_INVALID, nsec);
 			t->signal_func(t->data);
 		}
 	}
@@ -1115,6 +1128,34 @@ static inline void calculate_stats(struct pw_impl_node *this,  struct pw_node_ac
 	}
 }
 
+static inline void update_histograms(struct pw_impl_node *this, struct pw_node_activation *a)
+{
+	struct pw_node_target *t;
+
+	if (SPA_LIKELY(a->prev_signal_time != 0 && a->signal_time > a->prev_signal_time))
+		pw_node_histogram_add(&this->histogram.cycle, a->signal_time - a->prev_signal_time);
+	if (SPA_LIKELY(a->awake_time >= a->signal_time && a->finish_time >= a->awake_time)) {
+		pw_node_histogram_add(&this->histogram.wakeup, a->awake_time - a->signal_time);
+		pw_node_histogram_add(&this->histogram.process, a->finish_time - a->awake_time);
+	}
+
+	spa_list_for_each(t, &this->rt.target_list, link) {
+		struct pw_node_activation *ta = t->activation;
+
+		if (t->node == NULL || t->node == this)
+			continue;
+		/* only the followers that completed in this cycle */
+		if (ta->status != PW_NODE_ACTIVATION_FINISHED ||
+		    ta->signal_time < a->signal_time ||
+		    ta->awake_time < ta->signal_time ||
+		    ta->finish_time < ta->awake_time)
+			continue;
+
+		pw_node_histogram_add(&t->node->histogram.wakeup, ta->awake_time - ta->signal_time);
+		pw_node_histogram_add(&t->node->histogram.process, ta->finish_time - ta->awake_time);
+	}
+}
+
 static inline int process_node(void *data)
 {
 	struct pw_impl_node *this = data;
@@ -1129,6 +1170,7 @@ static inline int process_node(void *data)
 	a->awake_time = SPA_TIMESPEC_TO_NSEC(&ts);
 
 	pw_log_trace_fp("%p: process %"PRIu64, this, a->awake_time);
+	spa_probe(pipewire, node_process, this->info.id, a->signal_time, a->awake_time);
 
 	/* when transport sync is not supported, just clear the flag */
 	if (!this->transport_sync)
@@ -1161,6 +1203,7 @@ static inline int process_node(void *data)
 
 		/* calculate CPU time */
 		calculate_stats(this, a);
+		update_histograms(this, a);
 
 		pw_log_trace_fp("%p: graph completed wait:%"PRIu64" run:%"PRIu64
 				" busy:%"PRIu64" period:%"PRIu64" cpu:%f:%f:%f", this,
@@ -1169,6 +1212,8 @@ static inline int process_node(void *data)
 				a->finish_time - a->signal_time,
 				a->signal_time - a->prev_signal_time,
 				a->cpu_load[0], a->cpu_load[1], a->cpu_load[2]);
+		spa_probe(pipewire, graph_complete, this->info.id, a->prev_signal_time,
+				a->signal_time, a->awake_time, a->finish_time);
 
 		pw_context_driver_emit_complete(this->context, this);
 
@@ -1468,7 +1513,7 @@ static void node_info(void *data, const struct spa_node_info *info)
 		emit_params(node, changed_ids, n_changed_ids);
 
 	if (flags_changed)
-		pw_context_recalc_graph(node->context, "node flags changed");
+		pw_context_queue_recalc(node->context, node, "node flags changed");
 }
 
 static void node_port_info(void *data, enum spa_direction direction, uint32_t port_id,
@@ -1739,6 +1784,8 @@ again:
 
 		update_position(node, all_ready);
 
+		spa_probe(pipewire, cycle_start, node->info.id,
+				a->position.clock.nsec, a->position.clock.duration);
 		pw_context_driver_emit_start(node->context, node);
 	}
 	if (SPA_UNLIKELY(node->driver && !node->driving))
@@ -1870,7 +1917,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 {
 	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
 	struct pw_impl_port *port;
-	struct pw_impl_node *follower;
+	struct pw_impl_node *follower, *driver;
 	struct pw_context *context = node->context;
 	bool active, had_driver;
 
@@ -1887,7 +1934,8 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 	pw_impl_node_emit_destroy(node);
 
 	pw_log_debug("%p: driver node %p", impl, node->driver_node);
-	had_driver = node != node->driver_node;
+	driver = node->driver_node;
+	had_driver = node != driver;
 
 	/* remove ourself as a follower from the driver node */
 	spa_list_remove(&node->follower_link);
@@ -1896,6 +1944,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 	spa_list_consume(follower, &node->follower_list, follower_link) {
 		pw_log_debug("%p: reassign follower %p", impl, follower);
 		pw_impl_node_set_driver(follower, NULL);
+		pw_context_queue_recalc(context, follower, "driver destroy");
 	}
 
 	if (node->registered) {
@@ -1920,9 +1969,15 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 		pw_global_destroy(node->global);
 	}
 
-	if (active || had_driver)
-		pw_context_recalc_graph(context,
-				"active node destroy");
+	/* links were removed when destroying the ports and queued our peers,
+	 * we can't be queued anymore */
+	pw_context_dequeue_recalc(context, node);
+
+	if ((active || had_driver) &&
+	    (node->driver || node->group[0] != '\0'))
+		pw_context_queue_recalc(context, NULL, "active node destroy");
+	else if (had_driver)
+		pw_context_queue_recalc(context, driver, "active node destroy");
 
 	pw_log_debug("%p: free", node);
 	pw_impl_node_emit_free(node);
@@ -2295,7 +2350,7 @@ int pw_impl_node_set_active(struct pw_impl_node *node, bool active)
 		pw_impl_node_emit_active_changed(node, active);
 
 		if (node->registered)
-			pw_context_recalc_graph(node->context,
+			pw_context_queue_recalc(node->context, node,
 					active ? "node activate" : "node deactivate");
 		else if (!active && node->exported)
 			pw_loop_invoke(node->data_loop, do_node_remove, 1, NULL, 0, true, node);
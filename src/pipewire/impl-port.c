@@ -411,6 +411,14 @@ static int process_latency_param(void *data, int seq,
 	return 0;
 }
 
+static void clear_format_cache(struct pw_impl_port *port)
+{
+	/* formats found with this port are no longer valid */
+	port->format_serial++;
+	free(port->format_cache.format);
+	spa_zero(port->format_cache);
+}
+
 static void update_info(struct pw_impl_port *port, const struct spa_port_info *info)
 {
 	uint32_t changed_ids[MAX_PARAMS], n_changed_ids = 0;
@@ -453,6 +461,9 @@ static void update_info(struct pw_impl_port *port, const struct spa_port_info *i
 				changed_ids[n_changed_ids++] = id;
 
 			switch (id) {
+			case SPA_PARAM_EnumFormat:
+				clear_format_cache(port);
+				break;
 			case SPA_PARAM_Latency:
 				port->have_latency_param =
 					SPA_FLAG_IS_SET(info->params[i].flags, SPA_PARAM_INFO_WRITE);
@@ -1169,6 +1180,8 @@ void pw_impl_port_destroy(struct pw_impl_port *port)
 	pw_param_clear(&impl->param_list, SPA_ID_INVALID);
 	pw_param_clear(&impl->pending_list, SPA_ID_INVALID);
 
+	free(port->format_cache.format);
+
 	pw_map_clear(&port->mix_port_map);
 
 	pw_properties_free(port->properties);
@@ -1235,6 +1248,8 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 	if (pi == NULL)
 		return -ENOENT;
 
+	pw_impl_port_check_rate(port);
+
 	if (max == 0)
 		max = UINT32_MAX;
 
@@ -1295,6 +1310,95 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 	return res;
 }
 
+/* Nodes like audioconvert use the rate of the graph in the params they
+ * enumerate, the cached params are only valid for one rate. */
+void pw_impl_port_check_rate(struct pw_impl_port *port)
+{
+	uint32_t i, rate;
+
+	if (port->node == NULL)
+		return;
+
+	rate = port->node->driver_node->rt.activation->position.clock.rate.denom;
+	if (rate == port->format_rate)
+		return;
+
+	pw_log_debug("%p: graph rate %u -> %u, clear cached params", port,
+			port->format_rate, rate);
+	port->format_rate = rate;
+
+	for (i = 0; i < port->info.n_params; i++)
+		port->info.params[i].user = 0;
+	clear_format_cache(port);
+}
+
+struct result_sync_data {
+	struct spa_pod_builder *builder;
+	struct spa_pod *param;
+	uint32_t next;
+	int res;
+};
+
+static int result_sync(void *data, int seq, uint32_t id, uint32_t index, uint32_t next,
+		struct spa_pod *param)
+{
+	struct result_sync_data *d = data;
+	uint32_t offset = d->builder->state.offset;
+	if (spa_pod_builder_raw_padded(d->builder, param, SPA_POD_SIZE(param)) < 0)
+		return d->res = -ENOSPC;
+	d->next = next;
+	d->param = spa_pod_builder_deref(d->builder, offset);
+	return 0;
+}
+
+static int result_ignore(void *data, int seq, uint32_t id, uint32_t index, uint32_t next,
+		struct spa_pod *param)
+{
+	return 0;
+}
+
+int pw_impl_port_enum_params_sync(struct pw_impl_port *port, uint32_t param_id,
+			uint32_t *index, const struct spa_pod *filter,
+			struct spa_pod **param, struct spa_pod_builder *builder)
+{
+	struct impl *impl = SPA_CONTAINER_OF(port, struct impl, this);
+	struct result_sync_data data = { builder, NULL, 0, 0 };
+	struct spa_param_info *pi;
+	int res;
+
+	pw_impl_port_check_rate(port);
+
+	pi = pw_param_info_find(port->info.params, port->info.n_params, param_id);
+	if (pi == NULL || !impl->cache_params)
+		goto uncached;
+
+	if (pi->user != 1) {
+		/* fill the cache with all params, the node only needs to
+		 * enumerate them again when the params change */
+		pw_param_clear(&impl->param_list, param_id);
+		res = pw_impl_port_for_each_param(port, 0, param_id, 0, 0,
+				NULL, result_ignore, NULL);
+		if (res < 0 || pi->user != 1) {
+			pi->user = 0;
+			goto uncached;
+		}
+	}
+	if ((res = pw_impl_port_for_each_param(port, 0, param_id, *index, 1,
+				filter, result_sync, &data)) < 0)
+		return res;
+	if (data.param == NULL)
+		return data.res;
+
+	*index = data.next;
+	*param = data.param;
+	return 1;
+
+uncached:
+	return spa_node_port_enum_params_sync(port->node->node,
+			port->direction, port->port_id,
+			param_id, index, filter, param, builder);
+}
+
 struct param_filter {
 	struct pw_impl_port *in_port;
 	struct pw_impl_port *out_port;
@@ -1549,7 +1653,7 @@ static int negotiate_mixer_buffers(struct pw_impl_port *port, uint32_t flags,
 			     0, buffers, n_buffers);
 	}
 	if (!port->added && n_buffers > 0) {
-		pw_loop_invoke(node->data_loop, do_add_port, SPA_ID_INVALID, NULL, 0, false, port);
+		pw_context_invoke_async(node->context, node->data_loop, do_add_port, port);
 		port->added = true;
 	}
 	return res;
@@ -296,6 +296,10 @@ extern "C" {
 #define PW_KEY_STREAM_DONT_REMIX	"stream.dont-remix"	/**< don't remix channels */
 #define PW_KEY_STREAM_CAPTURE_SINK	"stream.capture.sink"	/**< Try to capture the sink output instead of
 								  *  source output */
+#define PW_KEY_STREAM_RING_SIZE		"stream.ring.size"	/**< The size of the ring of a stream with
+								  *  PW_STREAM_FLAG_RING as a fraction of
+								  *  a second, like 4800/48000. The
+								  *  default is 1/10 */
 
 /** Media */
 #define PW_KEY_MEDIA_TYPE		"media.type"		/**< Media type, one of
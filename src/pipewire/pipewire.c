@@ -578,7 +578,7 @@ SPA_EXPORT
 void pw_init(int *argc, char **argv[])
 {
 	const char *str;
-	struct spa_dict_item items[6];
+	struct spa_dict_item items[7];
 	uint32_t n_items;
 	struct spa_dict info;
 	struct support *support = &global_support;
@@ -628,6 +628,8 @@ void pw_init(int *argc, char **argv[])
 		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_LEVEL, level);
 		if ((str = getenv("PIPEWIRE_LOG")) != NULL)
 			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, str);
+		if ((str = getenv("PIPEWIRE_LOG_DEFERRED")) != NULL && spa_atob(str))
+			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_DEFERRED, "true");
 		if ((patterns = parse_pw_debug_env()) != NULL)
 			items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_PATTERNS, patterns);
 		info = SPA_DICT_INIT(items, n_items);
@@ -695,6 +697,8 @@ void pw_deinit(void)
 	if (--support->init_count > 0)
 		goto done;
 
+	pw_conf_rules_cache_clear();
+
 	pthread_mutex_lock(&support_lock);
 	pw_log_set(NULL);
 
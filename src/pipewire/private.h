@@ -66,6 +66,9 @@ struct settings {
 	unsigned int clock_power_of_two_quantum:1;
 	unsigned int check_quantum:1;
 	unsigned int check_rate:1;
+	unsigned int link_skip_dead_nodes:1;
+	unsigned int link_incremental_recalc:1;
+	unsigned int link_format_cache:1;
 #define CLOCK_RATE_UPDATE_MODE_HARD 0
 #define CLOCK_RATE_UPDATE_MODE_SOFT 1
 	int clock_rate_update_mode;
@@ -478,6 +481,7 @@ struct pw_context {
 	struct spa_support support[16];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
 	struct pw_array factory_lib;	/**< mapping of factory_name regexp to library */
+	struct pw_array conf_rules;	/**< compiled match rules of the config sections */
 
 	struct pw_array objects;	/**< objects */
 
@@ -588,6 +592,36 @@ struct pw_node_target {
 	unsigned int active:1;
 };
 
+/* log-scale histogram of durations in nanoseconds. Bucket 0 has the values
+ * below 1 << MIN_SHIFT, after that each power of 2 is split in
+ * 1 << SUB_SHIFT buckets. The last bucket also collects all larger values. */
+#define PW_NODE_HISTOGRAM_MIN_SHIFT	10
+#define PW_NODE_HISTOGRAM_SUB_SHIFT	3
+#define PW_NODE_HISTOGRAM_BUCKETS	160
+
+struct pw_node_histogram {
+	uint64_t max;					/* largest value */
+	uint64_t buckets[PW_NODE_HISTOGRAM_BUCKETS];
+};
+
+static inline void pw_node_histogram_add(struct pw_node_histogram *h, uint64_t val)
+{
+	uint32_t msb, idx;
+
+	if (val < (1ull << PW_NODE_HISTOGRAM_MIN_SHIFT)) {
+		idx = 0;
+	} else {
+		msb = 63 - __builtin_clzll(val);
+		idx = ((msb - PW_NODE_HISTOGRAM_MIN_SHIFT) << PW_NODE_HISTOGRAM_SUB_SHIFT) +
+			((val >> (msb - PW_NODE_HISTOGRAM_SUB_SHIFT)) &
+			 ((1u << PW_NODE_HISTOGRAM_SUB_SHIFT) - 1)) + 1;
+		idx = SPA_MIN(idx, PW_NODE_HISTOGRAM_BUCKETS - 1u);
+	}
+	h->buckets[idx]++;
+	if (val > h->max)
+		h->max = val;
+}
+
 struct pw_node_activation {
 #define PW_NODE_ACTIVATION_NOT_TRIGGERED	0
 #define PW_NODE_ACTIVATION_TRIGGERED		1
@@ -718,6 +752,9 @@ struct pw_impl_node {
 	unsigned int pause_on_idle:1;	/**< Pause processing when IDLE */
 	unsigned int suspend_on_idle:1;
 	unsigned int reconfigure:1;
+	unsigned int dead:1;		/**< the node has no path to a sink */
+	unsigned int recalc_queued:1;	/**< the node is queued for a graph recalc */
+	unsigned int recalc:1;		/**< driver needs a quantum/state update */
 
 	uint32_t port_user_data_size;	/**< extra size for port user data */
 
@@ -727,6 +764,7 @@ struct pw_impl_node {
 	struct spa_list follower_link;
 
 	struct spa_list sort_link;	/**< link used to sort nodes */
+	struct spa_list recalc_link;	/**< link in queued recalc nodes */
 
 	struct spa_node *node;		/**< SPA node implementation */
 	struct spa_hook listener;
@@ -746,6 +784,7 @@ struct pw_impl_node {
 	uint32_t force_quantum;			/**< forced quantum */
 	uint32_t force_rate;			/**< forced rate */
 	uint32_t stamp;				/**< stamp of last update */
+	uint32_t n_dead;			/**< dead followers skipped by this driver */
 	struct spa_source source;		/**< source to remotely trigger this node */
 	struct pw_memblock *activation;
 	struct {
@@ -765,6 +804,14 @@ struct pw_impl_node {
 
 		struct ratelimit rate_limit;
 	} rt;
+	struct {
+		struct pw_node_histogram wakeup;	/* signal to awake */
+		struct pw_node_histogram process;	/* awake to finish */
+		struct pw_node_histogram cycle;		/* signal to signal, for drivers */
+	} histogram;				/**< timing histograms, updated by the driver
+						  *  when the graph completes. Not in the
+						  *  activation, that is shared with clients
+						  *  of other versions */
 	struct spa_fraction current_rate;
 	uint64_t current_quantum;
 
@@ -882,6 +929,14 @@ struct pw_impl_port {
 	struct spa_latency_info latency[2];	/**< latencies */
 	unsigned int have_latency_param:1;
 
+	uint32_t format_serial;		/**< incremented when EnumFormat changes */
+	uint32_t format_rate;		/**< graph rate of the cached params */
+	struct {
+		uint64_t peer;			/**< global serial of the input port */
+		uint32_t peer_format_serial;
+		struct spa_pod *format;
+	} format_cache;			/**< last format found with an input port */
+
 	void *owner_data;		/**< extra owner data */
 	void *user_data;                /**< extra user data */
 };
@@ -1178,6 +1233,11 @@ int pw_proxy_init(struct pw_proxy *proxy, const char *type, uint32_t version);
 void pw_proxy_remove(struct pw_proxy *proxy);
 
 int pw_context_recalc_graph(struct pw_context *context, const char *reason);
+void pw_context_queue_recalc(struct pw_context *context, struct pw_impl_node *node,
+		const char *reason);
+void pw_context_dequeue_recalc(struct pw_context *context, struct pw_impl_node *node);
+int pw_context_invoke_async(struct pw_context *context, struct pw_loop *loop,
+		spa_invoke_func_t func, void *user_data);
 
 void pw_impl_port_update_info(struct pw_impl_port *port, const struct spa_port_info *info);
 
@@ -1212,6 +1272,17 @@ int pw_impl_port_for_each_param(struct pw_impl_port *port,
 					    struct spa_pod *param),
 			   void *data);
 
+/** Get the param at *index that matches filter, like
+ * spa_node_port_enum_params_sync(), from the cached params of the port when
+ * possible. */
+int pw_impl_port_enum_params_sync(struct pw_impl_port *port, uint32_t param_id,
+			uint32_t *index, const struct spa_pod *filter,
+			struct spa_pod **param, struct spa_pod_builder *builder);
+
+/** Invalidate the cached params and formats of the port when the graph
+ * rate changed since they were cached. */
+void pw_impl_port_check_rate(struct pw_impl_port *port);
+
 int pw_impl_port_for_each_filtered_param(struct pw_impl_port *in_port,
 				    struct pw_impl_port *out_port,
 				    int seq,
@@ -1299,6 +1370,17 @@ void pw_settings_init(struct pw_context *context);
 int pw_settings_expose(struct pw_context *context);
 void pw_settings_clean(struct pw_context *context);
 
+struct pw_conf_rules;
+
+struct pw_conf_rules *pw_conf_rules_new(const char *str, size_t len);
+void pw_conf_rules_free(struct pw_conf_rules *rules);
+int pw_conf_rules_match(struct pw_conf_rules *rules, const char *location,
+		const struct spa_dict *props,
+		int (*callback) (void *data, const char *location, const char *action,
+			const char *str, size_t len),
+		void *data);
+void pw_conf_rules_cache_clear(void);
+
 pthread_attr_t *pw_thread_fill_attr(const struct spa_dict *props, pthread_attr_t *attr);
 
 /** \endcond */
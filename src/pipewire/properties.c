@@ -36,46 +36,189 @@ PW_LOG_TOPIC_EXTERN(log_properties);
 #define PW_LOG_TOPIC_DEFAULT log_properties
 
 /** \cond */
+#define INDEX_MIN_ITEMS		16	/* use a linear search for smaller dicts */
+
+struct index_slot {
+	uint32_t hash;
+	uint32_t pos;		/* item index + 1, 0 for an empty slot */
+	const char *key;
+};
+
+/* the items of a properties object */
+struct store {
+	struct pw_array items;
+	struct index_slot *index;	/* open addressing index, NULL when not used */
+	uint32_t index_mask;
+	bool index_sorted;		/* index positions are for the sorted items */
+};
+
 struct properties {
 	struct pw_properties this;
 
-	struct pw_array items;
+	struct store store;
 };
 /** \endcond */
 
-static int add_func(struct pw_properties *this, char *key, char *value)
+static inline uint32_t key_hash(const char *key)
+{
+	uint32_t h = 2166136261u;
+	while (*key)
+		h = (h ^ (uint8_t)*key++) * 16777619u;
+	return h;
+}
+
+static void index_insert(struct index_slot *index, uint32_t mask,
+		uint32_t hash, uint32_t pos, const char *key)
+{
+	uint32_t i = hash & mask;
+	while (index[i].pos != 0)
+		i = (i + 1) & mask;
+	index[i].hash = hash;
+	index[i].pos = pos;
+	index[i].key = key;
+}
+
+static void clear_item(struct spa_dict_item *item)
+{
+	free((char *) item->key);
+	free((char *) item->value);
+}
+
+/* make an index for at least \a n_items, with room to grow */
+static void index_rebuild(struct store *store, uint32_t n_items)
+{
+	struct spa_dict_item *items = store->items.data;
+	uint32_t i, size;
+
+	free(store->index);
+	store->index = NULL;
+	store->index_mask = 0;
+	store->index_sorted = false;
+
+	if (n_items < INDEX_MIN_ITEMS)
+		return;
+
+	for (size = 64; size < n_items * 4; size <<= 1);
+	n_items = pw_array_get_len(&store->items, struct spa_dict_item);
+
+	if ((store->index = calloc(size, sizeof(struct index_slot))) == NULL)
+		return;
+	store->index_mask = size - 1;
+
+	for (i = 0; i < n_items; i++)
+		index_insert(store->index, store->index_mask,
+				key_hash(items[i].key), i + 1, items[i].key);
+}
+
+/* find the index slot of the item with \a key */
+static uint32_t index_find(const struct store *store, const char *key)
+{
+	uint32_t i;
+	for (i = key_hash(key) & store->index_mask; store->index[i].key != key;
+			i = (i + 1) & store->index_mask);
+	return i;
+}
+
+/* remove the slot of \a key, the slots after it in the probe sequence
+ * are shifted back so that they can still be found */
+static void index_remove(struct store *store, const char *key)
+{
+	struct index_slot *index = store->index;
+	uint32_t i, j, k, mask = store->index_mask;
+
+	i = index_find(store, key);
+	for (j = (i + 1) & mask; index[j].pos != 0; j = (j + 1) & mask) {
+		k = index[j].hash & mask;
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		index[i] = index[j];
+		i = j;
+	}
+	index[i].pos = 0;
+	index[i].key = NULL;
+}
+
+static void store_init(struct store *store, int prealloc)
+{
+	pw_array_init(&store->items, 16);
+	pw_array_ensure_size(&store->items, sizeof(struct spa_dict_item) * prealloc);
+	if (prealloc > INDEX_MIN_ITEMS)
+		index_rebuild(store, prealloc);
+}
+
+static void store_clear(struct store *store)
+{
+	struct spa_dict_item *item;
+
+	pw_array_for_each(item, &store->items)
+		clear_item(item);
+	pw_array_clear(&store->items);
+	free(store->index);
+}
+
+/* add a new item, takes ownership of \a value */
+static int add_func(struct pw_properties *this, const char *key, char *value)
 {
 	struct spa_dict_item *item;
 	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	struct store *store = &impl->store;
+	uint32_t n_items, hash = key_hash(key);
+	char *k;
+
+	if (value == NULL || (k = strdup(key)) == NULL)
+		goto error;
 
-	item = pw_array_add(&impl->items, sizeof(struct spa_dict_item));
+	item = pw_array_add(&store->items, sizeof(struct spa_dict_item));
 	if (item == NULL) {
-		free(key);
-		free(value);
-		return -errno;
+		free(k);
+		goto error;
 	}
-
-	item->key = key;
+	item->key = k;
 	item->value = value;
 
-	this->dict.items = impl->items.data;
-	this->dict.n_items++;
-	return 0;
-}
+	this->dict.items = store->items.data;
+	n_items = ++this->dict.n_items;
 
-static void clear_item(struct spa_dict_item *item)
-{
-	free((char *) item->key);
-	free((char *) item->value);
+	if (store->index == NULL || n_items * 2 > store->index_mask + 1)
+		index_rebuild(store, n_items);
+	else
+		index_insert(store->index, store->index_mask, hash, n_items, k);
+	return 0;
+error:
+	free(value);
+	return -ENOMEM;
 }
 
 static int find_index(const struct pw_properties *this, const char *key)
 {
-	const struct spa_dict_item *item;
-	item = spa_dict_lookup_item(&this->dict, key);
-	if (item == NULL)
-		return -1;
-	return item - this->dict.items;
+	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	const struct store *store = &impl->store;
+	const struct spa_dict_item *items = this->dict.items, *item;
+	uint32_t i, hash;
+
+	if (store->index != NULL) {
+		hash = key_hash(key);
+		for (i = hash & store->index_mask; store->index[i].pos != 0;
+				i = (i + 1) & store->index_mask) {
+			const struct index_slot *s = &store->index[i];
+			uint32_t pos = s->pos - 1;
+
+			if (s->hash != hash || !spa_streq(s->key, key))
+				continue;
+			/* spa_dict_qsort() moves the items around but the set
+			 * of keys stays the same */
+			if (SPA_LIKELY(items[pos].key == s->key))
+				return pos;
+			break;
+		}
+		if (store->index[i].pos == 0)
+			return -1;
+	}
+	spa_dict_for_each(item, &this->dict) {
+		if (spa_streq(item->key, key))
+			return item - items;
+	}
+	return -1;
 }
 
 static struct properties *properties_new(int prealloc)
@@ -86,9 +229,7 @@ static struct properties *properties_new(int prealloc)
 	if (impl == NULL)
 		return NULL;
 
-	pw_array_init(&impl->items, 16);
-	pw_array_ensure_size(&impl->items, sizeof(struct spa_dict_item) * prealloc);
-
+	store_init(&impl->store, prealloc);
 	return impl;
 }
 
@@ -113,7 +254,7 @@ struct pw_properties *pw_properties_new(const char *key, ...)
 	while (key != NULL) {
 		value = va_arg(varargs, char *);
 		if (value && key[0])
-			add_func(&impl->this, strdup(key), strdup(value));
+			add_func(&impl->this, key, strdup(value));
 		key = va_arg(varargs, char *);
 	}
 	va_end(varargs);
@@ -139,8 +280,7 @@ struct pw_properties *pw_properties_new_dict(const struct spa_dict *dict)
 	for (i = 0; i < dict->n_items; i++) {
 		const struct spa_dict_item *it = &dict->items[i];
 		if (it->key != NULL && it->key[0] && it->value != NULL)
-			add_func(&impl->this, strdup(it->key),
-				 strdup(it->value));
+			add_func(&impl->this, it->key, strdup(it->value));
 	}
 
 	return &impl->this;
@@ -281,11 +421,16 @@ SPA_EXPORT
 void pw_properties_clear(struct pw_properties *properties)
 {
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
+	struct store *store = &impl->store;
 	struct spa_dict_item *item;
 
-	pw_array_for_each(item, &impl->items)
+	pw_array_for_each(item, &store->items)
 		clear_item(item);
-	pw_array_reset(&impl->items);
+	pw_array_reset(&store->items);
+	free(store->index);
+	store->index = NULL;
+	store->index_mask = 0;
+	store->index_sorted = false;
 	properties->dict.n_items = 0;
 }
 
@@ -373,43 +518,57 @@ void pw_properties_free(struct pw_properties *properties)
 		return;
 
 	impl = SPA_CONTAINER_OF(properties, struct properties, this);
-	pw_properties_clear(properties);
-	pw_array_clear(&impl->items);
+	store_clear(&impl->store);
 	free(impl);
 }
 
 static int do_replace(struct pw_properties *properties, const char *key, char *value, bool copy)
 {
 	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
+	struct store *store = &impl->store;
 	int index;
 
 	if (key == NULL || key[0] == 0)
 		goto exit_noupdate;
 
+	/* the index positions are wrong after a sort, rebuild once */
+	if (store->index != NULL && !store->index_sorted &&
+	    SPA_FLAG_IS_SET(properties->dict.flags, SPA_DICT_FLAG_SORTED)) {
+		index_rebuild(store, properties->dict.n_items);
+		store->index_sorted = true;
+	}
+
 	index = find_index(properties, key);
 
 	if (index == -1) {
 		if (value == NULL)
 			return 0;
-		add_func(properties, strdup(key), copy ? strdup(value) : value);
+		add_func(properties, key, copy ? strdup(value) : value);
 		SPA_FLAG_CLEAR(properties->dict.flags, SPA_DICT_FLAG_SORTED);
+		store->index_sorted = false;
 	} else {
 		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
+		    pw_array_get_unchecked(&store->items, index, struct spa_dict_item);
 
 		if (value && spa_streq(item->value, value))
 			goto exit_noupdate;
 
 		if (value == NULL) {
-			struct spa_dict_item *last = pw_array_get_unchecked(&impl->items,
-						     pw_array_get_len(&impl->items, struct spa_dict_item) - 1,
+			struct spa_dict_item *last = pw_array_get_unchecked(&store->items,
+						     pw_array_get_len(&store->items, struct spa_dict_item) - 1,
 						     struct spa_dict_item);
+			if (store->index != NULL) {
+				index_remove(store, item->key);
+				if (last != item)
+					store->index[index_find(store, last->key)].pos = index + 1;
+			}
 			clear_item(item);
 			item->key = last->key;
 			item->value = last->value;
-			impl->items.size -= sizeof(struct spa_dict_item);
+			store->items.size -= sizeof(struct spa_dict_item);
 			properties->dict.n_items--;
 			SPA_FLAG_CLEAR(properties->dict.flags, SPA_DICT_FLAG_SORTED);
+			store->index_sorted = false;
 		} else {
 			free((char *) item->value);
 			item->value = copy ? strdup(value) : value;
@@ -490,13 +649,12 @@ int pw_properties_setf(struct pw_properties *properties, const char *key, const
 SPA_EXPORT
 const char *pw_properties_get(const struct pw_properties *properties, const char *key)
 {
-	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
 	int index = find_index(properties, key);
 
 	if (index == -1)
 		return NULL;
 
-	return pw_array_get_unchecked(&impl->items, index, struct spa_dict_item)->value;
+	return properties->dict.items[index].value;
 }
 
 /** Fetch a property as uint32_t.
@@ -644,7 +802,6 @@ int pw_properties_fetch_bool(const struct pw_properties *properties, const char
 SPA_EXPORT
 const char *pw_properties_iterate(const struct pw_properties *properties, void **state)
 {
-	struct properties *impl = SPA_CONTAINER_OF(properties, struct properties, this);
 	uint32_t index;
 
 	if (*state == NULL)
@@ -652,12 +809,12 @@ const char *pw_properties_iterate(const struct pw_properties *properties, void *
 	else
 		index = SPA_PTR_TO_INT(*state);
 
-	if (!pw_array_check_index(&impl->items, index, struct spa_dict_item))
+	if (index >= properties->dict.n_items)
 		 return NULL;
 
 	*state = SPA_INT_TO_PTR(index + 1);
 
-	return pw_array_get_unchecked(&impl->items, index, struct spa_dict_item)->key;
+	return properties->dict.items[index].key;
 }
 
 static int encode_string(FILE *f, const char *val)
@@ -56,6 +56,9 @@
 #define DEFAULT_MEM_ALLOW_MLOCK			true
 #define DEFAULT_CHECK_QUANTUM			false
 #define DEFAULT_CHECK_RATE			false
+#define DEFAULT_LINK_SKIP_DEAD_NODES		false
+#define DEFAULT_LINK_INCREMENTAL_RECALC		true
+#define DEFAULT_LINK_FORMAT_CACHE		true
 
 struct impl {
 	struct pw_context *context;
@@ -241,6 +244,12 @@ void pw_settings_init(struct pw_context *this)
 	d->clock_power_of_two_quantum = get_default_bool(p, "clock.power-of-two-quantum",
 			DEFAULT_CLOCK_POWER_OF_TWO_QUANTUM);
 	d->link_max_buffers = get_default_int(p, "link.max-buffers", DEFAULT_LINK_MAX_BUFFERS);
+	d->link_skip_dead_nodes = get_default_bool(p, "link.skip-dead-nodes",
+			DEFAULT_LINK_SKIP_DEAD_NODES);
+	d->link_incremental_recalc = get_default_bool(p, "link.incremental-recalc",
+			DEFAULT_LINK_INCREMENTAL_RECALC);
+	d->link_format_cache = get_default_bool(p, "link.format-cache",
+			DEFAULT_LINK_FORMAT_CACHE);
 	d->mem_warn_mlock = get_default_bool(p, "mem.warn-mlock", DEFAULT_MEM_WARN_MLOCK);
 	d->mem_allow_mlock = get_default_bool(p, "mem.allow-mlock", DEFAULT_MEM_ALLOW_MLOCK);
 
@@ -25,12 +25,14 @@
 #include <errno.h>
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <time.h>
 
 #include <spa/buffer/alloc.h>
 #include <spa/param/props.h>
 #include <spa/param/format-utils.h>
+#include <spa/param/audio/format-utils.h>
 #include <spa/node/io.h>
 #include <spa/node/utils.h>
 #include <spa/utils/ringbuffer.h>
@@ -47,10 +49,12 @@
 PW_LOG_TOPIC_EXTERN(log_stream);
 #define PW_LOG_TOPIC_DEFAULT log_stream
 
-#define MAX_BUFFERS	64
+#define MAX_BUFFERS	64u
 
 #define MASK_BUFFERS	(MAX_BUFFERS-1)
 
+#define DEFAULT_RING_SIZE	"1/10"
+
 static bool mlock_warned = false;
 
 static uint32_t mappable_dataTypes = (1<<SPA_DATA_MemFd);
@@ -77,6 +81,21 @@ struct data {
 	struct spa_hook stream_listener;
 };
 
+/* a single producer, single consumer ring. The process thread is one side,
+ * the application the other */
+struct ring {
+	struct spa_ringbuffer ring;
+	/* for capture, the read index the reader skips to after a flush */
+	uint32_t flush_seq;
+	uint32_t flush_index;
+	uint32_t flush_seen;
+	uint8_t *data;
+	uint32_t size;		/* power of 2 */
+	uint32_t limit;		/* max bytes in the ring */
+	uint32_t stride;
+	uint8_t silence;
+};
+
 struct param {
 	uint32_t id;
 #define PARAM_FLAG_LOCKED	(1 << 0)
@@ -155,6 +174,14 @@ struct stream {
 	struct queue dequeued;
 	struct queue queued;
 
+	/* for PW_STREAM_FLAG_RING, only changed in the data thread. Users
+	 * outside of the data thread hold ring_lock while they use the ring */
+	struct ring *ring;
+	pthread_mutex_t ring_lock;
+	struct spa_fraction ring_size;
+	uint64_t underruns;
+	uint64_t overruns;
+
 	struct data data;
 	uintptr_t seq;
 	struct pw_time time;
@@ -339,6 +366,32 @@ static inline int queue_push(struct stream *stream, struct queue *queue, struct
 	return 0;
 }
 
+static inline int queue_push_n(struct stream *stream, struct queue *queue,
+		struct buffer **buffers, uint32_t n_buffers)
+{
+	uint32_t index, i;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = buffers[i];
+		if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_QUEUED) ||
+		    b->id >= stream->n_buffers) {
+			while (i-- > 0)
+				SPA_FLAG_CLEAR(buffers[i]->flags, BUFFER_FLAG_QUEUED);
+			return -EINVAL;
+		}
+		SPA_FLAG_SET(b->flags, BUFFER_FLAG_QUEUED);
+	}
+
+	spa_ringbuffer_get_write_index(&queue->ring, &index);
+	for (i = 0; i < n_buffers; i++) {
+		queue->incount += buffers[i]->this.size;
+		queue->ids[(index + i) & MASK_BUFFERS] = buffers[i]->id;
+	}
+	spa_ringbuffer_write_update(&queue->ring, index + n_buffers);
+
+	return 0;
+}
+
 static inline bool queue_is_empty(struct stream *stream, struct queue *queue)
 {
 	uint32_t index;
@@ -364,6 +417,27 @@ static inline struct buffer *queue_pop(struct stream *stream, struct queue *queu
 
 	return buffer;
 }
+
+static inline uint32_t queue_pop_n(struct stream *stream, struct queue *queue,
+		struct buffer **buffers, uint32_t n_buffers)
+{
+	uint32_t index, i;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&queue->ring, &index);
+	n_buffers = SPA_MIN(n_buffers, (uint32_t)SPA_MAX(avail, 0));
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &stream->buffers[queue->ids[(index + i) & MASK_BUFFERS]];
+		queue->outcount += b->this.size;
+		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_QUEUED);
+		buffers[i] = b;
+	}
+	spa_ringbuffer_read_update(&queue->ring, index + n_buffers);
+
+	return n_buffers;
+}
+
 static inline void clear_queue(struct stream *stream, struct queue *queue)
 {
 	spa_ringbuffer_init(&queue->ring);
@@ -863,6 +937,126 @@ static int parse_latency(struct pw_stream *stream, const struct spa_pod *param)
 	return 0;
 }
 
+static const struct ring_format {
+	uint32_t format;
+	uint32_t width;
+	uint8_t silence;
+} ring_formats[] = {
+	{ SPA_AUDIO_FORMAT_S8, 1, 0 },
+	{ SPA_AUDIO_FORMAT_U8, 1, 0x80 },
+	{ SPA_AUDIO_FORMAT_S16_LE, 2, 0 },
+	{ SPA_AUDIO_FORMAT_S16_BE, 2, 0 },
+	{ SPA_AUDIO_FORMAT_S24_LE, 3, 0 },
+	{ SPA_AUDIO_FORMAT_S24_BE, 3, 0 },
+	{ SPA_AUDIO_FORMAT_S24_32_LE, 4, 0 },
+	{ SPA_AUDIO_FORMAT_S24_32_BE, 4, 0 },
+	{ SPA_AUDIO_FORMAT_S32_LE, 4, 0 },
+	{ SPA_AUDIO_FORMAT_S32_BE, 4, 0 },
+	{ SPA_AUDIO_FORMAT_F32_LE, 4, 0 },
+	{ SPA_AUDIO_FORMAT_F32_BE, 4, 0 },
+	{ SPA_AUDIO_FORMAT_F64_LE, 8, 0 },
+	{ SPA_AUDIO_FORMAT_F64_BE, 8, 0 },
+};
+
+static int parse_ring_format(struct stream *impl, const struct spa_pod *param, struct ring *r)
+{
+	struct spa_audio_info info = { 0 };
+	const struct ring_format *rf = NULL;
+	uint64_t limit;
+	int res;
+
+	if ((res = spa_format_parse(param, &info.media_type, &info.media_subtype)) < 0)
+		return res;
+	if (info.media_type != SPA_MEDIA_TYPE_audio ||
+	    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		return -ENOTSUP;
+	if ((res = spa_format_audio_raw_parse(param, &info.info.raw)) < 0)
+		return res;
+
+	SPA_FOR_EACH_ELEMENT_VAR(ring_formats, i)
+		if (i->format == info.info.raw.format)
+			rf = i;
+	if (rf == NULL || info.info.raw.rate == 0 || info.info.raw.channels == 0)
+		return -ENOTSUP;
+
+	r->stride = rf->width * info.info.raw.channels;
+	r->silence = rf->silence;
+
+	limit = (uint64_t)impl->ring_size.num * info.info.raw.rate / impl->ring_size.denom;
+	limit = SPA_CLAMP(limit * r->stride, r->stride, 1u << 30);
+	r->limit = SPA_ROUND_DOWN(limit, r->stride);
+	r->size = 1u << (32 - __builtin_clz(r->limit - 1));
+
+	if ((r->data = calloc(1, r->size)) == NULL)
+		return -errno;
+
+	return 0;
+}
+
+static void free_ring(struct ring *r)
+{
+	if (r == NULL)
+		return;
+	free(r->data);
+	free(r);
+}
+
+/* use the ring outside of the data thread, the ring is not freed until
+ * ring_release() */
+static inline struct ring *ring_acquire(struct stream *impl)
+{
+	pthread_mutex_lock(&impl->ring_lock);
+	return __atomic_load_n(&impl->ring, __ATOMIC_ACQUIRE);
+}
+
+static inline void ring_release(struct stream *impl)
+{
+	pthread_mutex_unlock(&impl->ring_lock);
+}
+
+static int
+do_update_ring(struct spa_loop *loop,
+                 bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct stream *impl = user_data;
+	__atomic_store_n(&impl->ring, *(struct ring * const *)data, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void update_ring(struct stream *impl, const struct spa_pod *param)
+{
+	struct ring *r = NULL, *old;
+	int res;
+
+	if (param != NULL) {
+		if ((r = calloc(1, sizeof(*r))) == NULL ||
+		    (res = parse_ring_format(impl, param, r)) < 0) {
+			pw_log_warn("%p: can't use ring: %s", impl,
+					r ? spa_strerror(res) : strerror(errno));
+			free(r);
+			r = NULL;
+		} else {
+			spa_ringbuffer_init(&r->ring);
+			pw_log_debug("%p: ring size:%u limit:%u stride:%u", impl,
+					r->size, r->limit, r->stride);
+		}
+	}
+	pw_log_debug("%p: underruns:%"PRIu64" overruns:%"PRIu64,
+			impl, impl->underruns, impl->overruns);
+
+	/* only this function changes the ring, outside of the data thread */
+	old = impl->ring;
+	pw_loop_invoke(impl->context->data_loop,
+			do_update_ring, 1, &r, sizeof(r), true, impl);
+
+	/* the old ring is no longer visible, wait for a user that still has
+	 * it. Not taken around the invoke, the data thread can be a user. */
+	pthread_mutex_lock(&impl->ring_lock);
+	pthread_mutex_unlock(&impl->ring_lock);
+
+	free_ring(old);
+}
+
 static int impl_port_set_param(void *object,
 			       enum spa_direction direction, uint32_t port_id,
 			       uint32_t id, uint32_t flags,
@@ -889,6 +1083,8 @@ static int impl_port_set_param(void *object,
 	switch (id) {
 	case SPA_PARAM_Format:
 		clear_buffers(stream);
+		if (SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_RING))
+			update_ring(impl, param);
 		break;
 	case SPA_PARAM_Latency:
 		parse_latency(stream, param);
@@ -992,6 +1188,55 @@ static int impl_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffe
 	return 0;
 }
 
+static void ring_push(struct stream *impl, struct buffer *b)
+{
+	struct ring *r = impl->ring;
+	struct spa_data *d = &b->this.buffer->datas[0];
+	uint32_t index, offs, size, avail;
+	int32_t filled;
+
+	if (d->data == NULL)
+		return;
+
+	offs = SPA_MIN(d->chunk->offset, d->maxsize);
+	size = SPA_MIN(d->chunk->size, d->maxsize - offs);
+	size = SPA_ROUND_DOWN(size, r->stride);
+
+	filled = spa_ringbuffer_get_write_index(&r->ring, &index);
+	avail = r->limit - SPA_CLAMP(filled, 0, (int32_t)r->limit);
+	if (size > avail) {
+		/* the reader can't keep up, drop the new data */
+		pw_log_trace_fp("%p: ring overrun %u > %u", impl, size, avail);
+		impl->overruns++;
+		size = avail;
+	}
+	spa_ringbuffer_write_data(&r->ring, r->data, r->size,
+			index & (r->size - 1),
+			SPA_PTROFF(d->data, offs, void), size);
+	spa_ringbuffer_write_update(&r->ring, index + size);
+}
+
+static int process_input_ring(struct stream *impl)
+{
+	struct pw_stream *stream = &impl->this;
+	struct spa_io_buffers *io = impl->io;
+	struct buffer *b;
+
+	if (io->status == SPA_STATUS_HAVE_DATA &&
+	    (b = get_buffer(stream, io->buffer_id)) != NULL) {
+		/* copy and recycle the buffer right away */
+		ring_push(impl, b);
+		copy_position(impl, 0);
+		call_process(impl);
+	}
+	io->status = SPA_STATUS_NEED_DATA;
+
+	if (impl->driving && impl->using_trigger)
+		call_trigger_done(impl);
+
+	return SPA_STATUS_NEED_DATA | SPA_STATUS_HAVE_DATA;
+}
+
 static int impl_node_process_input(void *object)
 {
 	struct stream *impl = object;
@@ -1002,6 +1247,9 @@ static int impl_node_process_input(void *object)
 	if (io == NULL)
 		return -EIO;
 
+	if (impl->ring != NULL)
+		return process_input_ring(impl);
+
 	pw_log_trace_fp("%p: process in status:%d id:%d ticks:%"PRIu64" delay:%"PRIi64,
 			stream, io->status, io->buffer_id, impl->time.ticks, impl->time.delay);
 
@@ -1033,6 +1281,88 @@ static int impl_node_process_input(void *object)
 	return SPA_STATUS_NEED_DATA | SPA_STATUS_HAVE_DATA;
 }
 
+static struct buffer *ring_pull(struct stream *impl)
+{
+	struct ring *r = impl->ring;
+	struct buffer *b;
+	struct spa_data *d;
+	uint32_t index, requested, size, avail;
+	int32_t filled;
+
+	if ((b = queue_pop(impl, &impl->dequeued)) == NULL)
+		return NULL;
+
+	d = &b->this.buffer->datas[0];
+	if (d->data == NULL) {
+		queue_push(impl, &impl->dequeued, b);
+		return NULL;
+	}
+
+	/* slice the quantum, or what the resampler needs, from the ring */
+	requested = impl->rate_match ? impl->rate_match->size : impl->quantum;
+	requested = SPA_MIN(requested * r->stride, SPA_ROUND_DOWN(d->maxsize, r->stride));
+
+	filled = spa_ringbuffer_get_read_index(&r->ring, &index);
+	avail = SPA_CLAMP(filled, 0, (int32_t)r->limit);
+	size = SPA_MIN(requested, avail);
+
+	spa_ringbuffer_read_data(&r->ring, r->data, r->size,
+			index & (r->size - 1), d->data, size);
+	spa_ringbuffer_read_update(&r->ring, index + size);
+
+	if (size < requested) {
+		pw_log_trace_fp("%p: ring underrun %u < %u", impl, size, requested);
+		memset(SPA_PTROFF(d->data, size, void), r->silence, requested - size);
+		impl->underruns++;
+	}
+	d->chunk->offset = 0;
+	d->chunk->size = requested;
+	d->chunk->stride = r->stride;
+	d->chunk->flags = 0;
+	b->this.size = requested / r->stride;
+
+	return b;
+}
+
+static int process_output_ring(struct stream *impl)
+{
+	struct pw_stream *stream = &impl->this;
+	struct spa_io_buffers *io = impl->io;
+	struct buffer *b;
+	uint32_t index;
+
+	if (io->status != SPA_STATUS_HAVE_DATA) {
+		/* recycle old buffer */
+		if ((b = get_buffer(stream, io->buffer_id)) != NULL)
+			queue_push(impl, &impl->dequeued, b);
+
+		if ((impl->draining || impl->drained) &&
+		    spa_ringbuffer_get_read_index(&impl->ring->ring, &index) <= 0) {
+			impl->draining = true;
+			impl->drained = true;
+			io->buffer_id = SPA_ID_INVALID;
+			io->status = SPA_STATUS_DRAINED;
+		} else if ((b = ring_pull(impl)) != NULL) {
+			impl->drained = false;
+			io->buffer_id = b->id;
+			io->status = SPA_STATUS_HAVE_DATA;
+		} else {
+			io->buffer_id = SPA_ID_INVALID;
+			io->status = SPA_STATUS_NEED_DATA;
+		}
+	}
+	copy_position(impl, 0);
+
+	/* let the application know there is space in the ring */
+	if (!impl->draining && !impl->driving)
+		call_process(impl);
+
+	if (impl->driving && impl->using_trigger && io->status != SPA_STATUS_HAVE_DATA)
+		call_trigger_done(impl);
+
+	return io->status;
+}
+
 static int impl_node_process_output(void *object)
 {
 	struct stream *impl = object;
@@ -1045,6 +1375,9 @@ static int impl_node_process_output(void *object)
 	if (io == NULL)
 		return -EIO;
 
+	if (impl->ring != NULL)
+		return process_output_ring(impl);
+
 again:
 	pw_log_trace_fp("%p: process out status:%d id:%d", stream,
 			io->status, io->buffer_id);
@@ -1446,6 +1779,8 @@ stream_new(struct pw_context *context, const char *name,
 		res = -errno;
 		goto error_cleanup;
 	}
+	pthread_mutex_init(&impl->ring_lock, NULL);
+
 	impl->port_props = pw_properties_new(NULL, NULL);
 	if (impl->port_props == NULL) {
 		res = -errno;
@@ -1522,6 +1857,7 @@ stream_new(struct pw_context *context, const char *name,
 	return impl;
 
 error_properties:
+	pthread_mutex_destroy(&impl->ring_lock);
 	pw_properties_free(impl->port_props);
 	free(impl);
 error_cleanup:
@@ -1656,6 +1992,8 @@ void pw_stream_destroy(struct pw_stream *stream)
 		pw_context_destroy(impl->data.context);
 
 	pw_properties_free(impl->port_props);
+	free_ring(impl->ring);
+	pthread_mutex_destroy(&impl->ring_lock);
 	free(impl);
 }
 
@@ -1823,6 +2161,18 @@ pw_stream_connect(struct pw_stream *stream,
 	pw_log_debug("%p: connect target:%d", stream, target_id);
 	impl->direction =
 	    direction == PW_DIRECTION_INPUT ? SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT;
+	if (SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_RING)) {
+		/* the ring is filled from the buffer memory */
+		flags |= PW_STREAM_FLAG_MAP_BUFFERS;
+		if ((str = pw_properties_get(stream->properties, PW_KEY_STREAM_RING_SIZE)) == NULL)
+			str = DEFAULT_RING_SIZE;
+		if (sscanf(str, "%u/%u", &impl->ring_size.num, &impl->ring_size.denom) != 2 ||
+		    impl->ring_size.num == 0 || impl->ring_size.denom == 0) {
+			pw_log_warn("%p: invalid %s '%s', using %s", stream,
+					PW_KEY_STREAM_RING_SIZE, str, DEFAULT_RING_SIZE);
+			impl->ring_size = SPA_FRACTION(1, 10);
+		}
+	}
 	impl->flags = flags;
 	impl->node_methods = impl_node;
 
@@ -2217,6 +2567,7 @@ SPA_EXPORT
 int pw_stream_get_time_n(struct pw_stream *stream, struct pw_time *time, size_t size)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct ring *r;
 	uintptr_t seq1, seq2;
 	uint32_t buffered, quantum, index;
 
@@ -2228,10 +2579,14 @@ int pw_stream_get_time_n(struct pw_stream *stream, struct pw_time *time, size_t
 		seq2 = SEQ_READ(impl->seq);
 	} while (!SEQ_READ_SUCCESS(seq1, seq2));
 
-	if (impl->direction == SPA_DIRECTION_INPUT)
+	if ((r = ring_acquire(impl)) != NULL)
+		time->queued = SPA_MAX(spa_ringbuffer_get_read_index(&r->ring, &index), 0) /
+			r->stride;
+	else if (impl->direction == SPA_DIRECTION_INPUT)
 		time->queued = (int64_t)(time->queued - impl->dequeued.outcount);
 	else
 		time->queued = (int64_t)(impl->queued.incount - time->queued);
+	ring_release(impl);
 
 	time->delay += ((impl->latency.min_quantum + impl->latency.max_quantum) / 2) * quantum;
 	time->delay += (impl->latency.min_rate + impl->latency.max_rate) / 2;
@@ -2312,6 +2667,161 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 	return res;
 }
 
+SPA_EXPORT
+int pw_stream_dequeue_buffers(struct pw_stream *stream, struct pw_buffer **buffers,
+		uint32_t n_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i, n, count = 0;
+
+	n = queue_pop_n(impl, &impl->dequeued, b, SPA_MIN(n_buffers, MAX_BUFFERS));
+
+	for (i = 0; i < n; i++) {
+		if (b[i]->busy && impl->direction == SPA_DIRECTION_OUTPUT) {
+			if (ATOMIC_INC(b[i]->busy->count) > 1) {
+				ATOMIC_DEC(b[i]->busy->count);
+				queue_push(impl, &impl->dequeued, b[i]);
+				pw_log_trace_fp("%p: buffer %d busy", stream, b[i]->id);
+				continue;
+			}
+		}
+		buffers[count++] = &b[i]->this;
+	}
+	pw_log_trace_fp("%p: dequeue %u/%u buffers", stream, count, n_buffers);
+
+	if (count == 0 && n > 0) {
+		errno = EBUSY;
+		return -EBUSY;
+	}
+	return count;
+}
+
+SPA_EXPORT
+int pw_stream_queue_buffers(struct pw_stream *stream, struct pw_buffer **buffers,
+		uint32_t n_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct buffer *b[MAX_BUFFERS];
+	uint32_t i;
+	int res;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -EINVAL;
+
+	for (i = 0; i < n_buffers; i++)
+		b[i] = SPA_CONTAINER_OF(buffers[i], struct buffer, this);
+
+	pw_log_trace_fp("%p: queue %u buffers", stream, n_buffers);
+	if ((res = queue_push_n(impl, &impl->queued, b, n_buffers)) < 0)
+		return res;
+
+	for (i = 0; i < n_buffers; i++)
+		if (b[i]->busy)
+			ATOMIC_DEC(b[i]->busy->count);
+
+	if (n_buffers > 0 && impl->direction == SPA_DIRECTION_OUTPUT &&
+	    impl->driving && !impl->using_trigger) {
+		pw_log_debug("deprecated: use pw_stream_trigger_process() to drive the stream.");
+		res = pw_loop_invoke(impl->context->data_loop,
+			do_trigger_deprecated, 1, NULL, 0, false, impl);
+	}
+	return res;
+}
+
+SPA_EXPORT
+int pw_stream_ring_write(struct pw_stream *stream, const void *data, uint32_t n_frames)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct ring *r;
+	uint32_t index, size;
+	int32_t filled;
+	int res;
+
+	if (!SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_RING) ||
+	    impl->direction != SPA_DIRECTION_OUTPUT)
+		return -ENOTSUP;
+
+	if ((r = ring_acquire(impl)) == NULL) {
+		res = -EAGAIN;
+		goto done;
+	}
+	filled = spa_ringbuffer_get_write_index(&r->ring, &index);
+	size = r->limit - SPA_CLAMP(filled, 0, (int32_t)r->limit);
+	size = SPA_MIN((uint64_t)n_frames * r->stride, size);
+
+	spa_ringbuffer_write_data(&r->ring, r->data, r->size,
+			index & (r->size - 1), data, size);
+	spa_ringbuffer_write_update(&r->ring, index + size);
+	res = size / r->stride;
+done:
+	ring_release(impl);
+	return res;
+}
+
+SPA_EXPORT
+int pw_stream_ring_read(struct pw_stream *stream, void *data, uint32_t n_frames)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	struct ring *r;
+	uint32_t index, size, seq, flush_index;
+	int32_t filled;
+	int res;
+
+	if (!SPA_FLAG_IS_SET(impl->flags, PW_STREAM_FLAG_RING) ||
+	    impl->direction != SPA_DIRECTION_INPUT)
+		return -ENOTSUP;
+
+	if ((r = ring_acquire(impl)) == NULL) {
+		res = -EAGAIN;
+		goto done;
+	}
+	filled = spa_ringbuffer_get_read_index(&r->ring, &index);
+
+	/* skip what was written before a flush */
+	seq = __atomic_load_n(&r->flush_seq, __ATOMIC_ACQUIRE);
+	if (seq != r->flush_seen) {
+		flush_index = __atomic_load_n(&r->flush_index, __ATOMIC_RELAXED);
+		if ((int32_t)(flush_index - index) > 0) {
+			filled -= flush_index - index;
+			index = flush_index;
+			spa_ringbuffer_read_update(&r->ring, index);
+		}
+		r->flush_seen = seq;
+	}
+	size = SPA_CLAMP(filled, 0, (int32_t)r->limit);
+	size = SPA_MIN((uint64_t)n_frames * r->stride, size);
+
+	spa_ringbuffer_read_data(&r->ring, r->data, r->size,
+			index & (r->size - 1), data, size);
+	spa_ringbuffer_read_update(&r->ring, index + size);
+	res = size / r->stride;
+done:
+	ring_release(impl);
+	return res;
+}
+
+/* called from the data thread, which is the reader of a playback ring and
+ * the writer of a capture ring */
+static void flush_ring(struct stream *impl)
+{
+	struct ring *r = impl->ring;
+	uint32_t index;
+	int32_t filled;
+
+	if (r == NULL)
+		return;
+
+	if (impl->direction == SPA_DIRECTION_OUTPUT) {
+		filled = spa_ringbuffer_get_read_index(&r->ring, &index);
+		spa_ringbuffer_read_update(&r->ring, index + SPA_MAX(filled, 0));
+	} else {
+		spa_ringbuffer_get_write_index(&r->ring, &index);
+		__atomic_store_n(&r->flush_index, index, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&r->flush_seq, 1, __ATOMIC_RELEASE);
+	}
+}
+
 static int
 do_flush(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
@@ -2330,6 +2840,8 @@ do_flush(struct spa_loop *loop,
 	impl->queued.outcount = impl->dequeued.incount =
 		impl->dequeued.outcount = impl->queued.incount = 0;
 
+	flush_ring(impl);
+
 	return 0;
 }
 static int
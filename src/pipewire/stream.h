@@ -395,6 +395,14 @@ enum pw_stream_flags {
 							  *  needs to be called. This can be used
 							  *  when the output of the stream depends
 							  *  on input from other streams. */
+	PW_STREAM_FLAG_RING		= (1 << 10),	/**< use an internal ringbuffer for
+							  *  interleaved audio/raw formats. Frames
+							  *  are written with pw_stream_ring_write()
+							  *  or read with pw_stream_ring_read() from
+							  *  any thread. The size of the ring is set
+							  *  with the PW_KEY_STREAM_RING_SIZE property.
+							  *  Implies PW_STREAM_FLAG_MAP_BUFFERS.
+							  *  Since 0.3.66 */
 };
 
 /** Create a new unconneced \ref pw_stream
@@ -501,6 +509,42 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream);
 /** Submit a buffer for playback or recycle a buffer for capture. */
 int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer);
 
+/** Get up to \a n_buffers buffers at once, see pw_stream_dequeue_buffer().
+ * \return the number of buffers placed in \a buffers. Since 0.3.66 */
+int pw_stream_dequeue_buffers(struct pw_stream *stream, struct pw_buffer **buffers,
+		uint32_t n_buffers);
+
+/** Submit or recycle \a n_buffers buffers at once, see pw_stream_queue_buffer().
+ * \return 0 on success or < 0 on error, in which case no buffer was queued.
+ * Since 0.3.66 */
+int pw_stream_queue_buffers(struct pw_stream *stream, struct pw_buffer **buffers,
+		uint32_t n_buffers);
+
+/** Write \a n_frames of interleaved audio to the ring of a playback stream
+ * with PW_STREAM_FLAG_RING. The stream takes a quantum of data from the ring
+ * in each cycle and plays silence when the ring does not have enough data.
+ * This can be called from any thread but not from multiple threads at the
+ * same time.
+ *
+ * pw_time.queued contains the number of frames in the ring.
+ *
+ * \return the number of frames written, this is less than \a n_frames when
+ * the ring is full, -EAGAIN when the format was not negotiated yet or
+ * -ENOTSUP when the stream has no ring or the format is not supported.
+ * Since 0.3.66 */
+int pw_stream_ring_write(struct pw_stream *stream, const void *data, uint32_t n_frames);
+
+/** Read up to \a n_frames of interleaved audio from the ring of a capture
+ * stream with PW_STREAM_FLAG_RING. Data that does not fit in the ring is
+ * dropped. This can be called from any thread but not from multiple threads
+ * at the same time.
+ *
+ * pw_time.queued contains the number of frames in the ring.
+ *
+ * \return the number of frames read or a negative error code, see
+ * pw_stream_ring_write(). Since 0.3.66 */
+int pw_stream_ring_read(struct pw_stream *stream, void *data, uint32_t n_frames);
+
 /** Activate or deactivate the stream */
 int pw_stream_set_active(struct pw_stream *stream, bool active);
 
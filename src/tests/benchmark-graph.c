@@ -0,0 +1,444 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#define MAX_NODES	4096
+#define MAX_DRIVERS	8
+#define CHAIN_LENGTH	4
+
+/* a node that does nothing with one input and one output port */
+struct null_node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	struct spa_node_info info;
+	struct spa_port_info port_info[2];
+	struct spa_param_info port_params[2][4];
+	bool have_format[2];
+	struct pw_impl_node *impl;
+};
+
+static int node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct null_node *n = object;
+	struct spa_hook_list save;
+	uint32_t i;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+
+	spa_node_emit_info(&n->hooks, &n->info);
+	for (i = 0; i < 2; i++)
+		spa_node_emit_port_info(&n->hooks, i == 0 ? SPA_DIRECTION_INPUT :
+				SPA_DIRECTION_OUTPUT, 0, &n->port_info[i]);
+
+	spa_hook_list_join(&n->hooks, &save);
+	return 0;
+}
+
+static int node_set_callbacks(void *object, const struct spa_node_callbacks *callbacks,
+		void *data)
+{
+	return 0;
+}
+
+static int node_sync(void *object, int seq)
+{
+	struct null_node *n = object;
+	spa_node_emit_result(&n->hooks, seq, 0, 0, NULL);
+	return 0;
+}
+
+static int node_enum_params(void *object, int seq, uint32_t id, uint32_t start,
+		uint32_t num, const struct spa_pod *filter)
+{
+	return 0;
+}
+
+static int node_set_param(void *object, uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	return -ENOTSUP;
+}
+
+static int node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int node_port_enum_params(void *object, int seq, enum spa_direction direction,
+		uint32_t port_id, uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	struct null_node *n = object;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+
+	result.id = id;
+	result.next = start;
+next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+	case SPA_PARAM_Format:
+		if (result.index > 0)
+			return 0;
+		if (id == SPA_PARAM_Format && !n->have_format[direction])
+			return -EIO;
+		param = spa_format_audio_raw_build(&b, id,
+				&SPA_AUDIO_INFO_RAW_INIT(
+					.format = SPA_AUDIO_FORMAT_F32P,
+					.rate = 48000,
+					.channels = 1));
+		break;
+	case SPA_PARAM_Buffers:
+		if (result.index > 0)
+			return 0;
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, 8),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(1024 * sizeof(float)),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(sizeof(float)));
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&n->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int node_port_set_param(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t flags, const struct spa_pod *param)
+{
+	struct null_node *n = object;
+
+	if (id != SPA_PARAM_Format)
+		return -ENOENT;
+
+	n->have_format[direction] = param != NULL;
+	return 0;
+}
+
+static int node_port_use_buffers(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t flags, struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	return 0;
+}
+
+static int node_port_set_io(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	return 0;
+}
+
+static int node_process(void *object)
+{
+	return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+}
+
+static const struct spa_node_methods node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = node_add_listener,
+	.set_callbacks = node_set_callbacks,
+	.sync = node_sync,
+	.enum_params = node_enum_params,
+	.set_param = node_set_param,
+	.set_io = node_set_io,
+	.send_command = node_send_command,
+	.add_port = node_add_port,
+	.remove_port = node_remove_port,
+	.port_enum_params = node_port_enum_params,
+	.port_set_param = node_port_set_param,
+	.port_use_buffers = node_port_use_buffers,
+	.port_set_io = node_port_set_io,
+	.port_reuse_buffer = node_port_reuse_buffer,
+	.process = node_process,
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+
+	struct null_node *drivers[MAX_DRIVERS];
+	struct null_node *nodes[MAX_NODES];
+	struct pw_impl_link *links[MAX_NODES];
+	uint32_t n_nodes;
+	uint32_t n_links;
+
+	struct spa_hook link_listener[MAX_NODES];
+	uint32_t n_prepared;
+};
+
+static struct null_node *create_node(struct data *d, const char *name, bool driver)
+{
+	struct null_node *n;
+	uint32_t i;
+
+	n = calloc(1, sizeof(*n));
+	spa_assert_se(n != NULL);
+
+	n->node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &node_methods, n);
+	spa_hook_list_init(&n->hooks);
+
+	n->info = SPA_NODE_INFO_INIT();
+	n->info.max_input_ports = 1;
+	n->info.max_output_ports = 1;
+	n->info.change_mask = SPA_NODE_CHANGE_MASK_FLAGS;
+	n->info.flags = SPA_NODE_FLAG_RT;
+
+	for (i = 0; i < 2; i++) {
+		struct spa_port_info *info = &n->port_info[i];
+		*info = SPA_PORT_INFO_INIT();
+		info->change_mask = SPA_PORT_CHANGE_MASK_FLAGS | SPA_PORT_CHANGE_MASK_PARAMS;
+		info->flags = SPA_PORT_FLAG_NO_REF;
+		n->port_params[i][0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+		n->port_params[i][1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		n->port_params[i][2] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+		n->port_params[i][3] = SPA_PARAM_INFO(SPA_PARAM_IO, 0);
+		info->params = n->port_params[i];
+		info->n_params = 4;
+	}
+
+	n->impl = pw_context_create_node(d->context,
+			pw_properties_new(
+				PW_KEY_NODE_NAME, name,
+				PW_KEY_NODE_DRIVER, driver ? "true" : "false",
+				PW_KEY_NODE_WANT_DRIVER, "true",
+				PW_KEY_NODE_PAUSE_ON_IDLE, "false",
+				NULL), 0);
+	spa_assert_se(n->impl != NULL);
+	spa_assert_se(pw_impl_node_set_implementation(n->impl, &n->node) >= 0);
+	spa_assert_se(pw_impl_node_register(n->impl, NULL) >= 0);
+	pw_impl_node_set_active(n->impl, true);
+	return n;
+}
+
+static void destroy_node(struct null_node *n)
+{
+	pw_impl_node_destroy(n->impl);
+	free(n);
+}
+
+static void link_state_changed(void *data, enum pw_link_state old,
+		enum pw_link_state state, const char *error)
+{
+	struct data *d = data;
+	if (old < PW_LINK_STATE_PAUSED && state >= PW_LINK_STATE_PAUSED)
+		d->n_prepared++;
+	else if (state == PW_LINK_STATE_ERROR)
+		fprintf(stderr, "link error: %s\n", error);
+}
+
+static const struct pw_impl_link_events link_events = {
+	PW_VERSION_IMPL_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static void create_link(struct data *d, struct null_node *out, struct null_node *in)
+{
+	struct pw_impl_link *link;
+
+	link = pw_context_create_link(d->context,
+			pw_impl_node_find_port(out->impl, PW_DIRECTION_OUTPUT, 0),
+			pw_impl_node_find_port(in->impl, PW_DIRECTION_INPUT, 0),
+			NULL, NULL, 0);
+	spa_assert_se(link != NULL);
+	pw_impl_link_add_listener(link, &d->link_listener[d->n_links], &link_events, d);
+	spa_assert_se(pw_impl_link_register(link, NULL) >= 0);
+	d->links[d->n_links++] = link;
+}
+
+static void iterate(struct data *d)
+{
+	/* run the main loop until there is nothing to do */
+	while (pw_loop_iterate(pw_main_loop_get_loop(d->loop), 0) > 0);
+}
+
+/* link the nodes in chains that end in one of the drivers */
+static void link_nodes(struct data *d, bool burst)
+{
+	uint32_t i;
+
+	d->n_links = d->n_prepared = 0;
+	for (i = 0; i < d->n_nodes; i++) {
+		if ((i % CHAIN_LENGTH) == CHAIN_LENGTH - 1 || i == d->n_nodes - 1)
+			create_link(d, d->nodes[i],
+					d->drivers[(i / CHAIN_LENGTH) % MAX_DRIVERS]);
+		else
+			create_link(d, d->nodes[i], d->nodes[i + 1]);
+		if (!burst)
+			iterate(d);
+	}
+	iterate(d);
+	spa_assert_se(d->n_prepared == d->n_links);
+
+	for (i = 0; i < d->n_nodes; i++)
+		spa_assert_se(pw_impl_node_get_info(d->nodes[i]->impl)->state ==
+				PW_NODE_STATE_RUNNING);
+}
+
+static void unlink_nodes(struct data *d, bool burst)
+{
+	uint32_t i;
+
+	for (i = 0; i < d->n_links; i++) {
+		spa_hook_remove(&d->link_listener[i]);
+		pw_impl_link_destroy(d->links[i]);
+		if (!burst)
+			iterate(d);
+	}
+	iterate(d);
+	d->n_links = 0;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void run_test(uint32_t n_nodes, bool incremental)
+{
+	struct data d = { 0 };
+	char name[64];
+	uint64_t t[6];
+	uint32_t i;
+
+	d.loop = pw_main_loop_new(NULL);
+	spa_assert_se(d.loop != NULL);
+	d.context = pw_context_new(pw_main_loop_get_loop(d.loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				"link.incremental-recalc", incremental ? "true" : "false",
+				NULL), 0);
+	spa_assert_se(d.context != NULL);
+
+	for (i = 0; i < MAX_DRIVERS; i++) {
+		snprintf(name, sizeof(name), "driver-%u", i);
+		d.drivers[i] = create_node(&d, name, true);
+	}
+	iterate(&d);
+
+	/* create all the nodes, one by one like clients would */
+	t[0] = get_time_ns();
+	for (i = 0; i < n_nodes; i++) {
+		snprintf(name, sizeof(name), "node-%u", i);
+		d.nodes[i] = create_node(&d, name, false);
+		iterate(&d);
+	}
+	d.n_nodes = n_nodes;
+
+	t[1] = get_time_ns();
+	link_nodes(&d, false);
+	t[2] = get_time_ns();
+	unlink_nodes(&d, false);
+	t[3] = get_time_ns();
+	/* now make all the links at once, the recalculations are
+	 * coalesced */
+	link_nodes(&d, true);
+	t[4] = get_time_ns();
+	unlink_nodes(&d, true);
+	t[5] = get_time_ns();
+
+	fprintf(stderr, "%-12s nodes:%-6u create:%9.3fms link:%9.3fms unlink:%9.3fms "
+			"burst link:%9.3fms burst unlink:%9.3fms\n",
+			incremental ? "incremental" : "full", n_nodes,
+			(t[1] - t[0]) / 1000000.0, (t[2] - t[1]) / 1000000.0,
+			(t[3] - t[2]) / 1000000.0, (t[4] - t[3]) / 1000000.0,
+			(t[5] - t[4]) / 1000000.0);
+
+	for (i = 0; i < d.n_nodes; i++)
+		destroy_node(d.nodes[i]);
+	for (i = 0; i < MAX_DRIVERS; i++)
+		destroy_node(d.drivers[i]);
+
+	pw_context_destroy(d.context);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t sizes[] = { 256, 1024, MAX_NODES };
+	uint32_t i;
+
+	pw_init(&argc, &argv);
+
+	for (i = 0; i < SPA_N_ELEMENTS(sizes); i++) {
+		run_test(sizes[i], false);
+		run_test(sizes[i], true);
+	}
+
+	pw_deinit();
+
+	return 0;
+}
@@ -0,0 +1,439 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#define N_LINKS		2000
+
+/* formats of the sink, like a converter that can take anything. The
+ * streams use the last one so that the whole list needs to be walked. */
+static const uint32_t sink_formats[] = {
+	SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_S8P, SPA_AUDIO_FORMAT_S16P,
+	SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S24P,
+	SPA_AUDIO_FORMAT_F64P, SPA_AUDIO_FORMAT_U8, SPA_AUDIO_FORMAT_S8,
+	SPA_AUDIO_FORMAT_S16_LE, SPA_AUDIO_FORMAT_S16_BE, SPA_AUDIO_FORMAT_U16_LE,
+	SPA_AUDIO_FORMAT_U16_BE, SPA_AUDIO_FORMAT_S24_32_LE, SPA_AUDIO_FORMAT_S24_32_BE,
+	SPA_AUDIO_FORMAT_U24_32_LE, SPA_AUDIO_FORMAT_U24_32_BE, SPA_AUDIO_FORMAT_S32_LE,
+	SPA_AUDIO_FORMAT_S32_BE, SPA_AUDIO_FORMAT_U32_LE, SPA_AUDIO_FORMAT_U32_BE,
+	SPA_AUDIO_FORMAT_S24_LE, SPA_AUDIO_FORMAT_S24_BE, SPA_AUDIO_FORMAT_U24_LE,
+	SPA_AUDIO_FORMAT_U24_BE, SPA_AUDIO_FORMAT_F32_LE, SPA_AUDIO_FORMAT_F32_BE,
+	SPA_AUDIO_FORMAT_F64_LE, SPA_AUDIO_FORMAT_F64_BE, SPA_AUDIO_FORMAT_F32P,
+};
+
+/* a node with one input or one output port that does nothing */
+struct null_node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	struct spa_node_info info;
+	struct spa_port_info port_info;
+	struct spa_param_info port_params[4];
+	enum spa_direction direction;
+	bool have_format;
+	uint32_t n_enum;
+	struct pw_impl_node *impl;
+};
+
+static int node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct null_node *n = object;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+
+	spa_node_emit_info(&n->hooks, &n->info);
+	spa_node_emit_port_info(&n->hooks, n->direction, 0, &n->port_info);
+
+	spa_hook_list_join(&n->hooks, &save);
+	return 0;
+}
+
+static int node_set_callbacks(void *object, const struct spa_node_callbacks *callbacks,
+		void *data)
+{
+	return 0;
+}
+
+static int node_sync(void *object, int seq)
+{
+	struct null_node *n = object;
+	spa_node_emit_result(&n->hooks, seq, 0, 0, NULL);
+	return 0;
+}
+
+static int node_enum_params(void *object, int seq, uint32_t id, uint32_t start,
+		uint32_t num, const struct spa_pod *filter)
+{
+	return 0;
+}
+
+static int node_set_param(void *object, uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	return -ENOTSUP;
+}
+
+static int node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static int node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
+		const struct spa_dict *props)
+{
+	return -ENOTSUP;
+}
+
+static int node_remove_port(void *object, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static struct spa_pod *build_format(struct spa_pod_builder *b, uint32_t id, uint32_t format)
+{
+	struct spa_pod_frame f;
+
+	spa_pod_builder_push_object(b, &f, SPA_TYPE_OBJECT_Format, id);
+	spa_pod_builder_add(b,
+		SPA_FORMAT_mediaType,		SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+		SPA_FORMAT_mediaSubtype,	SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+		SPA_FORMAT_AUDIO_format,	SPA_POD_Id(format),
+		SPA_FORMAT_AUDIO_rate,		SPA_POD_CHOICE_RANGE_Int(48000, 1, INT32_MAX),
+		SPA_FORMAT_AUDIO_channels,	SPA_POD_CHOICE_RANGE_Int(2, 1, SPA_AUDIO_MAX_CHANNELS),
+		0);
+	return spa_pod_builder_pop(b, &f);
+}
+
+static int node_port_enum_params(void *object, int seq, enum spa_direction direction,
+		uint32_t port_id, uint32_t id, uint32_t start, uint32_t num,
+		const struct spa_pod *filter)
+{
+	struct null_node *n = object;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_result_node_params result;
+	uint32_t count = 0;
+
+	result.id = id;
+	result.next = start;
+next:
+	result.index = result.next++;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	switch (id) {
+	case SPA_PARAM_EnumFormat:
+		n->n_enum++;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (result.index >= SPA_N_ELEMENTS(sink_formats))
+				return 0;
+			param = build_format(&b, id, sink_formats[result.index]);
+		} else {
+			if (result.index > 0)
+				return 0;
+			param = spa_format_audio_raw_build(&b, id,
+					&SPA_AUDIO_INFO_RAW_INIT(
+						.format = SPA_AUDIO_FORMAT_F32P,
+						.rate = 48000,
+						.channels = 2));
+		}
+		break;
+	case SPA_PARAM_Format:
+		if (result.index > 0)
+			return 0;
+		if (!n->have_format)
+			return -EIO;
+		param = spa_format_audio_raw_build(&b, id,
+				&SPA_AUDIO_INFO_RAW_INIT(
+					.format = SPA_AUDIO_FORMAT_F32P,
+					.rate = 48000,
+					.channels = 2));
+		break;
+	case SPA_PARAM_Buffers:
+		if (result.index > 0)
+			return 0;
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, id,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(2, 1, 8),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(2),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(1024 * sizeof(float)),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(sizeof(float)));
+		break;
+	default:
+		return -ENOENT;
+	}
+
+	if (spa_pod_filter(&b, &result.param, param, filter) < 0)
+		goto next;
+
+	spa_node_emit_result(&n->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+
+	if (++count != num)
+		goto next;
+
+	return 0;
+}
+
+static int node_port_set_param(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t id, uint32_t flags, const struct spa_pod *param)
+{
+	struct null_node *n = object;
+
+	if (id != SPA_PARAM_Format)
+		return -ENOENT;
+
+	n->have_format = param != NULL;
+	return 0;
+}
+
+static int node_port_use_buffers(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t flags, struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	return 0;
+}
+
+static int node_port_set_io(void *object, enum spa_direction direction, uint32_t port_id,
+		uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	return 0;
+}
+
+static int node_process(void *object)
+{
+	return SPA_STATUS_HAVE_DATA | SPA_STATUS_NEED_DATA;
+}
+
+static const struct spa_node_methods node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = node_add_listener,
+	.set_callbacks = node_set_callbacks,
+	.sync = node_sync,
+	.enum_params = node_enum_params,
+	.set_param = node_set_param,
+	.set_io = node_set_io,
+	.send_command = node_send_command,
+	.add_port = node_add_port,
+	.remove_port = node_remove_port,
+	.port_enum_params = node_port_enum_params,
+	.port_set_param = node_port_set_param,
+	.port_use_buffers = node_port_use_buffers,
+	.port_set_io = node_port_set_io,
+	.port_reuse_buffer = node_port_reuse_buffer,
+	.process = node_process,
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+
+	struct null_node *sink;
+	struct null_node *stream;
+
+	struct spa_hook link_listener;
+	uint32_t n_prepared;
+};
+
+static struct null_node *create_node(struct data *d, const char *name,
+		enum spa_direction direction, bool driver)
+{
+	struct null_node *n;
+
+	n = calloc(1, sizeof(*n));
+	spa_assert_se(n != NULL);
+
+	n->node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &node_methods, n);
+	spa_hook_list_init(&n->hooks);
+	n->direction = direction;
+
+	n->info = SPA_NODE_INFO_INIT();
+	n->info.max_input_ports = direction == SPA_DIRECTION_INPUT ? 1 : 0;
+	n->info.max_output_ports = direction == SPA_DIRECTION_OUTPUT ? 1 : 0;
+	n->info.change_mask = SPA_NODE_CHANGE_MASK_FLAGS;
+	n->info.flags = SPA_NODE_FLAG_RT;
+
+	n->port_info = SPA_PORT_INFO_INIT();
+	n->port_info.change_mask = SPA_PORT_CHANGE_MASK_FLAGS | SPA_PORT_CHANGE_MASK_PARAMS;
+	n->port_info.flags = SPA_PORT_FLAG_NO_REF;
+	n->port_params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	n->port_params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	n->port_params[2] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	n->port_params[3] = SPA_PARAM_INFO(SPA_PARAM_IO, 0);
+	n->port_info.params = n->port_params;
+	n->port_info.n_params = 4;
+
+	n->impl = pw_context_create_node(d->context,
+			pw_properties_new(
+				PW_KEY_NODE_NAME, name,
+				PW_KEY_NODE_DRIVER, driver ? "true" : "false",
+				PW_KEY_NODE_WANT_DRIVER, "true",
+				PW_KEY_NODE_PAUSE_ON_IDLE, "false",
+				NULL), 0);
+	spa_assert_se(n->impl != NULL);
+	spa_assert_se(pw_impl_node_set_implementation(n->impl, &n->node) >= 0);
+	spa_assert_se(pw_impl_node_register(n->impl, NULL) >= 0);
+	pw_impl_node_set_active(n->impl, true);
+	return n;
+}
+
+static void destroy_node(struct null_node *n)
+{
+	pw_impl_node_destroy(n->impl);
+	free(n);
+}
+
+static void link_state_changed(void *data, enum pw_link_state old,
+		enum pw_link_state state, const char *error)
+{
+	struct data *d = data;
+	if (old < PW_LINK_STATE_PAUSED && state >= PW_LINK_STATE_PAUSED)
+		d->n_prepared++;
+	else if (state == PW_LINK_STATE_ERROR)
+		fprintf(stderr, "link error: %s\n", error);
+}
+
+static const struct pw_impl_link_events link_events = {
+	PW_VERSION_IMPL_LINK_EVENTS,
+	.state_changed = link_state_changed,
+};
+
+static void iterate(struct data *d)
+{
+	/* run the main loop until there is nothing to do */
+	while (pw_loop_iterate(pw_main_loop_get_loop(d->loop), 0) > 0);
+}
+
+static void link_unlink(struct data *d, struct null_node *stream)
+{
+	struct pw_impl_link *link;
+
+	link = pw_context_create_link(d->context,
+			pw_impl_node_find_port(stream->impl, PW_DIRECTION_OUTPUT, 0),
+			pw_impl_node_find_port(d->sink->impl, PW_DIRECTION_INPUT, 0),
+			NULL, NULL, 0);
+	spa_assert_se(link != NULL);
+	pw_impl_link_add_listener(link, &d->link_listener, &link_events, d);
+	spa_assert_se(pw_impl_link_register(link, NULL) >= 0);
+	iterate(d);
+
+	spa_hook_remove(&d->link_listener);
+	pw_impl_link_destroy(link);
+	iterate(d);
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void run_test(bool cache)
+{
+	struct data d = { 0 };
+	struct null_node *stream;
+	uint64_t t[3];
+	uint32_t i, n_enum[2];
+
+	d.loop = pw_main_loop_new(NULL);
+	spa_assert_se(d.loop != NULL);
+	d.context = pw_context_new(pw_main_loop_get_loop(d.loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				"link.format-cache", cache ? "true" : "false",
+				NULL), 0);
+	spa_assert_se(d.context != NULL);
+
+	d.sink = create_node(&d, "sink", SPA_DIRECTION_INPUT, true);
+	iterate(&d);
+
+	/* a new stream for each link, like notification sounds */
+	t[0] = get_time_ns();
+	for (i = 0; i < N_LINKS; i++) {
+		stream = create_node(&d, "stream", SPA_DIRECTION_OUTPUT, false);
+		iterate(&d);
+		link_unlink(&d, stream);
+		destroy_node(stream);
+		iterate(&d);
+	}
+	n_enum[0] = d.sink->n_enum;
+	spa_assert_se(d.n_prepared == N_LINKS);
+
+	/* the same stream linked again and again */
+	d.sink->n_enum = 0;
+	stream = create_node(&d, "stream", SPA_DIRECTION_OUTPUT, false);
+	iterate(&d);
+	t[1] = get_time_ns();
+	for (i = 0; i < N_LINKS; i++)
+		link_unlink(&d, stream);
+	t[2] = get_time_ns();
+	n_enum[1] = d.sink->n_enum;
+	spa_assert_se(d.n_prepared == 2 * N_LINKS);
+
+	fprintf(stderr, "%-9s new stream:%8.2fus per link, %6.2f sink enums  "
+			"same stream:%8.2fus per link, %6.2f sink enums\n",
+			cache ? "cached" : "uncached",
+			(t[1] - t[0]) / 1000.0 / N_LINKS, (double)n_enum[0] / N_LINKS,
+			(t[2] - t[1]) / 1000.0 / N_LINKS, (double)n_enum[1] / N_LINKS);
+
+	destroy_node(stream);
+	destroy_node(d.sink);
+
+	pw_context_destroy(d.context);
+	pw_main_loop_destroy(d.loop);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	run_test(false);
+	run_test(true);
+
+	pw_deinit();
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/conf.h>
+
+#define N_RULES		60
+#define N_PROPS		10000
+
+static char *make_rules(void)
+{
+	char *rules;
+	size_t size;
+	FILE *f;
+	int i;
+
+	f = open_memstream(&rules, &size);
+	fprintf(f, "[\n");
+	for (i = 0; i < N_RULES; i++) {
+		switch (i % 4) {
+		case 0:
+			fprintf(f, "{ matches = [ { node.name = \"~alsa_output.card%d.*\" } ]\n", i);
+			break;
+		case 1:
+			fprintf(f, "{ matches = [ { device.name = \"alsa_card.%d\" } "
+					"{ device.nick = \"card %d\" device.bus = \"usb\" } ]\n", i, i);
+			break;
+		case 2:
+			fprintf(f, "{ matches = [ { application.name = \"app-%d\" "
+					"media.class = \"Stream/Output/Audio\" } ]\n", i);
+			break;
+		case 3:
+			fprintf(f, "{ matches = [ { application.process.binary = \"~^bin-%d$\" "
+					"node.dont-reconnect = null } ]\n", i);
+			break;
+		}
+		fprintf(f, "  actions = { update-props = { rule.index = %d } } }\n", i);
+	}
+	fprintf(f, "]\n");
+	fclose(f);
+	return rules;
+}
+
+static struct pw_properties *make_props(int i)
+{
+	switch (i % 3) {
+	case 0:
+		return pw_properties_new(
+				"media.class", "Audio/Sink",
+				"node.name", i % 7 ? "alsa_output.pci-0000_00_1f.3" : "alsa_output.card4.analog",
+				"node.description", "Built-in Audio",
+				"device.api", "alsa",
+				"object.serial", "42",
+				NULL);
+	case 1:
+		return pw_properties_new(
+				"media.class", "Stream/Output/Audio",
+				"application.name", i % 5 ? "Firefox" : "app-14",
+				"application.process.binary", "firefox",
+				"node.name", "Firefox",
+				"media.role", "Music",
+				NULL);
+	default:
+		return pw_properties_new(
+				"device.name", i % 11 ? "alsa_card.pci-0000_00_1f.3" : "alsa_card.13",
+				"device.nick", "HDA Intel PCH",
+				"device.bus", "pci",
+				"device.api", "alsa",
+				"media.class", "Audio/Device",
+				NULL);
+	}
+}
+
+static int rule_matched(void *data, const char *location, const char *action,
+		const char *str, size_t len)
+{
+	int *matched = data;
+	(*matched)++;
+	return 0;
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_properties **props;
+	char path[] = "/tmp/pw-benchmark-match-rules-XXXXXX";
+	char *rules;
+	uint64_t t1, t2, t3;
+	int i, fd, matched1 = 0, matched2 = 0;
+	FILE *f;
+
+	pw_init(&argc, &argv);
+
+	rules = make_rules();
+
+	if ((fd = mkstemp(path)) < 0 || (f = fdopen(fd, "w")) == NULL) {
+		fprintf(stderr, "can't create config: %m\n");
+		return -1;
+	}
+	fprintf(f, "benchmark.rules = %s\n", rules);
+	fclose(f);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(PW_KEY_CONFIG_NAME, path, NULL), 0);
+	unlink(path);
+	if (context == NULL) {
+		fprintf(stderr, "can't create context: %m\n");
+		return -1;
+	}
+
+	props = calloc(N_PROPS, sizeof(struct pw_properties *));
+	for (i = 0; i < N_PROPS; i++)
+		props[i] = make_props(i);
+
+	t1 = get_time();
+	for (i = 0; i < N_PROPS; i++)
+		pw_conf_match_rules(rules, strlen(rules), NULL,
+				&props[i]->dict, rule_matched, &matched1);
+	t2 = get_time();
+	for (i = 0; i < N_PROPS; i++)
+		pw_context_conf_section_match_rules(context, "benchmark.rules",
+				&props[i]->dict, rule_matched, &matched2);
+	t3 = get_time();
+
+	fprintf(stderr, "rules:%d props:%d matched:%d/%d\n",
+			N_RULES, N_PROPS, matched1, matched2);
+	fprintf(stderr, "  pw_conf_match_rules:                 %8.3fms (%.3fus per match)\n",
+			(t2 - t1) / 1000000.0, (t2 - t1) / 1000.0 / N_PROPS);
+	fprintf(stderr, "  pw_context_conf_section_match_rules: %8.3fms (%.3fus per match)\n",
+			(t3 - t2) / 1000000.0, (t3 - t2) / 1000.0 / N_PROPS);
+
+	for (i = 0; i < N_PROPS; i++)
+		pw_properties_free(props[i]);
+	free(props);
+	free(rules);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	pw_deinit();
+
+	return matched1 == matched2 ? 0 : -1;
+}
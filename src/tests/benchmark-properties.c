@@ -0,0 +1,176 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include <spa/utils/string.h>
+
+#include <pipewire/pipewire.h>
+
+#define MAX_COUNT	200000
+#define MAX_COPIES	20000
+
+static const char * const node_keys[] = {
+	PW_KEY_OBJECT_ID, PW_KEY_OBJECT_SERIAL, PW_KEY_OBJECT_PATH,
+	PW_KEY_FACTORY_ID, PW_KEY_FACTORY_NAME, PW_KEY_CLIENT_ID, PW_KEY_CLIENT_API,
+	PW_KEY_DEVICE_ID, PW_KEY_DEVICE_API, PW_KEY_DEVICE_NAME, PW_KEY_DEVICE_NICK,
+	PW_KEY_DEVICE_DESCRIPTION, PW_KEY_DEVICE_BUS, PW_KEY_DEVICE_BUS_PATH,
+	PW_KEY_DEVICE_VENDOR_ID, PW_KEY_DEVICE_PRODUCT_ID, PW_KEY_DEVICE_FORM_FACTOR,
+	PW_KEY_DEVICE_ICON_NAME, PW_KEY_NODE_ID, PW_KEY_NODE_NAME,
+	PW_KEY_NODE_NICK, PW_KEY_NODE_DESCRIPTION, PW_KEY_NODE_PLUGGED,
+	PW_KEY_NODE_SESSION, PW_KEY_NODE_GROUP, PW_KEY_NODE_EXCLUSIVE,
+	PW_KEY_NODE_AUTOCONNECT, PW_KEY_NODE_LATENCY, PW_KEY_NODE_MAX_LATENCY,
+	PW_KEY_NODE_LOCK_QUANTUM, PW_KEY_NODE_FORCE_QUANTUM, PW_KEY_NODE_RATE,
+	PW_KEY_NODE_DONT_RECONNECT, PW_KEY_NODE_ALWAYS_PROCESS, PW_KEY_NODE_WANT_DRIVER,
+	PW_KEY_NODE_PAUSE_ON_IDLE, PW_KEY_NODE_SUSPEND_ON_IDLE, PW_KEY_NODE_DRIVER,
+	PW_KEY_NODE_STREAM, PW_KEY_NODE_VIRTUAL, PW_KEY_NODE_PASSIVE,
+	PW_KEY_NODE_LINK_GROUP, PW_KEY_NODE_NETWORK, PW_KEY_NODE_TRIGGER,
+	PW_KEY_PRIORITY_SESSION, PW_KEY_PRIORITY_DRIVER, PW_KEY_MEDIA_CLASS,
+	PW_KEY_MEDIA_TYPE, PW_KEY_MEDIA_CATEGORY, PW_KEY_MEDIA_ROLE, PW_KEY_MEDIA_NAME,
+	PW_KEY_AUDIO_CHANNEL, PW_KEY_AUDIO_CHANNELS, PW_KEY_AUDIO_RATE,
+	PW_KEY_AUDIO_FORMAT, PW_KEY_APP_NAME, PW_KEY_APP_ID,
+	PW_KEY_APP_ICON_NAME, PW_KEY_APP_PROCESS_ID, PW_KEY_APP_PROCESS_BINARY,
+	PW_KEY_APP_PROCESS_USER, PW_KEY_APP_PROCESS_HOST, PW_KEY_PORT_NAME,
+	"api.alsa.path", "api.alsa.card", "api.alsa.pcm.card", "api.alsa.pcm.stream",
+	"alsa.card_name", "alsa.long_card_name", "alsa.driver_name", "alsa.resolution_bits",
+	"card.profile.device", "device.routes", NULL
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void report(const char *what, uint32_t n_items, uint64_t elapsed, uint32_t count)
+{
+	fprintf(stderr, "  %-28s %3u items: %8.2fns per op\n", what, n_items,
+			(double)elapsed / count);
+}
+
+static void test_props(uint32_t n_items)
+{
+	struct pw_properties *props, *copy;
+	char **keys;
+	uint64_t t1, t2;
+	uint32_t i, idx;
+	const char *str;
+
+	props = pw_properties_new(NULL, NULL);
+	keys = calloc(n_items, sizeof(char *));
+	for (i = 0; i < n_items; i++) {
+		pw_properties_setf(props, node_keys[i], "value-%u", i);
+		/* the same keys in other strings */
+		keys[i] = strdup(node_keys[i]);
+	}
+	assert(props->dict.n_items == n_items);
+
+	srandom(n_items);
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_items;
+		str = pw_properties_get(props, node_keys[idx]);
+		assert(str != NULL);
+	}
+	t2 = get_time();
+	report("pw_properties_get (PW_KEY)", n_items, t2 - t1, MAX_COUNT);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_items;
+		str = pw_properties_get(props, keys[idx]);
+		assert(str != NULL);
+	}
+	t2 = get_time();
+	report("pw_properties_get (string)", n_items, t2 - t1, MAX_COUNT);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		str = pw_properties_get(props, "not.in.the.dict");
+		assert(str == NULL);
+	}
+	t2 = get_time();
+	report("pw_properties_get (missing)", n_items, t2 - t1, MAX_COUNT);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_items;
+		str = spa_dict_lookup(&props->dict, keys[idx]);
+		assert(str != NULL);
+	}
+	t2 = get_time();
+	report("spa_dict_lookup", n_items, t2 - t1, MAX_COUNT);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COPIES; i++) {
+		copy = pw_properties_copy(props);
+		pw_properties_free(copy);
+	}
+	t2 = get_time();
+	report("pw_properties_copy", n_items, t2 - t1, MAX_COPIES);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COPIES; i++) {
+		copy = pw_properties_copy(props);
+		pw_properties_set(copy, PW_KEY_NODE_NAME, "changed");
+		pw_properties_free(copy);
+	}
+	t2 = get_time();
+	report("pw_properties_copy + set", n_items, t2 - t1, MAX_COPIES);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COPIES; i++) {
+		copy = pw_properties_new_dict(&props->dict);
+		pw_properties_free(copy);
+	}
+	t2 = get_time();
+	report("pw_properties_new_dict", n_items, t2 - t1, MAX_COPIES);
+
+	for (i = 0; i < n_items; i++)
+		free(keys[i]);
+	free(keys);
+	pw_properties_free(props);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n_keys;
+
+	pw_init(&argc, &argv);
+
+	for (n_keys = 0; node_keys[n_keys]; n_keys++);
+
+	test_props(8);
+	test_props(20);
+	test_props(40);
+	test_props(n_keys);
+
+	pw_deinit();
+
+	return 0;
+}
@@ -152,6 +152,8 @@ static void test_create(void)
 	struct spa_hook listener = { 0, };
 	const char *error = NULL;
 	struct pw_time tm;
+	struct pw_buffer *bufs[4];
+	uint8_t data[64];
 
 	loop = pw_main_loop_new(NULL);
 	context = pw_context_new(pw_main_loop_get_loop(loop), NULL, 12);
@@ -181,6 +183,12 @@ static void test_create(void)
 	spa_assert_se(tm.buffered == 0);
 
 	spa_assert_se(pw_stream_dequeue_buffer(stream) == NULL);
+	spa_assert_se(pw_stream_dequeue_buffers(stream, bufs, 4) == 0);
+	spa_assert_se(pw_stream_queue_buffers(stream, bufs, 0) == 0);
+
+	/* ring is only available with PW_STREAM_FLAG_RING */
+	spa_assert_se(pw_stream_ring_write(stream, data, 4) == -ENOTSUP);
+	spa_assert_se(pw_stream_ring_read(stream, data, 4) == -ENOTSUP);
 
 	/* check destroy */
 	destroy_count = 0;
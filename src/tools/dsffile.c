@@ -253,6 +253,14 @@ dsf_file_read(struct dsf_file *f, void *data, size_t samples, const struct dsf_l
 	return total;
 }
 
+uint64_t dsf_file_tell(struct dsf_file *f)
+{
+	size_t block = f->offset / f->info.blocksize;
+
+	return (f->p - f->data) + block * f->info.blocksize * f->info.channels +
+		f->offset % f->info.blocksize;
+}
+
 int dsf_file_close(struct dsf_file *f)
 {
 	if (f->mode == 1) {
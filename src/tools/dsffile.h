@@ -48,5 +48,8 @@ struct dsf_file * dsf_file_open(const char *filename, const char *mode, struct d
 
 ssize_t dsf_file_read(struct dsf_file *f, void *data, size_t samples, const struct dsf_layout *layout);
 
+/* the offset in the file of the next read */
+uint64_t dsf_file_tell(struct dsf_file *f);
+
 int dsf_file_close(struct dsf_file *f);
 
@@ -0,0 +1,613 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <spa/utils/string.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/param/audio/raw.h>
+
+#include "mapfile.h"
+
+/* how often the I/O thread runs */
+#define IO_PERIOD_NSEC		(10 * SPA_NSEC_PER_MSEC)
+/* seconds of data to read ahead or to buffer for writing */
+#define BUFFER_SEC		2
+#define MIN_BUFFER		(1u << 20)
+#define MAX_BUFFER		(1u << 30)
+/* bytes to prefault in one go */
+#define CHUNK_SIZE		(256u * 1024u)
+
+#define WAV_FORMAT_PCM		0x0001
+#define WAV_FORMAT_FLOAT	0x0003
+#define WAV_FORMAT_EXTENSIBLE	0xfffe
+
+#define MODE_READ	1
+#define MODE_WRITE	2
+
+struct map_file {
+	int mode;
+	int fd;
+	bool wav;
+	int error;
+
+	struct map_file_info info;
+	struct map_file_stats stats;
+
+	/* read */
+	uint8_t *map;
+	size_t map_size;
+	uint8_t *data;
+	uint64_t offset;	/* read position of map_file_read() */
+	uint64_t ahead;		/* bytes to read ahead */
+	uint64_t pos;		/* end of the last access */
+	uint64_t ready;		/* bytes that were read ahead */
+	uint64_t released;	/* bytes that were released again */
+
+	/* write */
+	struct spa_ringbuffer ring;
+	uint8_t *buffer;
+	uint32_t size;
+	uint64_t written;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+};
+
+static inline uint16_t parse_le16(const uint8_t *in)
+{
+	return in[0] | (in[1] << 8);
+}
+
+static inline uint32_t parse_le32(const uint8_t *in)
+{
+	return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static inline void write_le16(uint8_t *out, uint16_t val)
+{
+	out[0] = val;
+	out[1] = val >> 8;
+}
+
+static inline void write_le32(uint8_t *out, uint32_t val)
+{
+	out[0] = val;
+	out[1] = val >> 8;
+	out[2] = val >> 16;
+	out[3] = val >> 24;
+}
+
+static const struct wav_format {
+	uint32_t format;
+	uint16_t tag;
+	uint16_t bits;
+} wav_formats[] = {
+	{ SPA_AUDIO_FORMAT_U8, WAV_FORMAT_PCM, 8 },
+	{ SPA_AUDIO_FORMAT_S16_LE, WAV_FORMAT_PCM, 16 },
+	{ SPA_AUDIO_FORMAT_S24_LE, WAV_FORMAT_PCM, 24 },
+	{ SPA_AUDIO_FORMAT_S32_LE, WAV_FORMAT_PCM, 32 },
+	{ SPA_AUDIO_FORMAT_F32_LE, WAV_FORMAT_FLOAT, 32 },
+	{ SPA_AUDIO_FORMAT_F64_LE, WAV_FORMAT_FLOAT, 64 },
+};
+
+static uint32_t buffer_size(const struct map_file_info *info)
+{
+	uint64_t size = (uint64_t)info->rate * info->stride * BUFFER_SEC;
+	return SPA_CLAMP(size, MIN_BUFFER, MAX_BUFFER);
+}
+
+static int parse_wav(struct map_file *f)
+{
+	const uint8_t *p = f->map, *end = f->map + f->map_size;
+	const struct wav_format *wf = NULL;
+	uint16_t tag = 0, bits = 0;
+	bool have_fmt = false;
+
+	if (f->map_size < 12 ||
+	    memcmp(p, "RIFF", 4) != 0 ||
+	    memcmp(p + 8, "WAVE", 4) != 0)
+		return -ENOENT;
+
+	for (p += 12; end - p >= 8;) {
+		uint32_t size = parse_le32(p + 4);
+		const uint8_t *body = p + 8;
+
+		if (memcmp(p, "fmt ", 4) == 0) {
+			if (size < 16 || end - body < 16)
+				return -EINVAL;
+			tag = parse_le16(body);
+			f->info.channels = parse_le16(body + 2);
+			f->info.rate = parse_le32(body + 4);
+			bits = parse_le16(body + 14);
+			if (tag == WAV_FORMAT_EXTENSIBLE) {
+				if (size < 40 || end - body < 40)
+					return -EINVAL;
+				/* the first 2 bytes of the sub format GUID */
+				tag = parse_le16(body + 24);
+			}
+			have_fmt = true;
+		}
+		else if (memcmp(p, "data", 4) == 0) {
+			if (!have_fmt)
+				return -EINVAL;
+			f->data = (uint8_t*)body;
+			/* streamed files don't have the right size */
+			f->info.length = SPA_MIN((uint64_t)size, (uint64_t)(end - body));
+			if (size == 0)
+				f->info.length = end - body;
+			break;
+		}
+		if (size > (size_t)(end - body))
+			break;
+		p = body + size + (size & 1);
+	}
+	if (f->data == NULL)
+		return -EINVAL;
+
+	SPA_FOR_EACH_ELEMENT_VAR(wav_formats, i) {
+		if (i->tag == tag && i->bits == bits) {
+			wf = i;
+			break;
+		}
+	}
+	if (wf == NULL || f->info.channels == 0)
+		return -ENOTSUP;
+
+	f->info.format = wf->format;
+	f->info.stride = f->info.channels * bits / 8;
+	f->wav = true;
+	return 0;
+}
+
+static void prefault(struct map_file *f, uint64_t offset, size_t size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	uint8_t *start = SPA_PTR_ALIGN(f->data + offset - page_size + 1, page_size, uint8_t);
+	volatile const uint8_t *p;
+	uint8_t *end = f->data + offset + size;
+
+	if (start < f->map)
+		start = f->map;
+
+	madvise(start, end - start, MADV_WILLNEED);
+	for (p = start; p < end; p += page_size)
+		(void)*p;
+}
+
+static void release(struct map_file *f, uint64_t offset, size_t size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	uint8_t *start = SPA_PTR_ALIGN(f->data + offset, page_size, uint8_t);
+	uint8_t *end = SPA_PTR_ALIGN(f->data + offset + size - page_size + 1, page_size, uint8_t);
+
+	if (end <= start)
+		return;
+	/* make the pages the first to be reclaimed, fall back to dropping
+	 * them from the page cache on older kernels */
+#ifdef MADV_COLD
+	if (madvise(start, end - start, MADV_COLD) == 0)
+		return;
+#endif
+	posix_fadvise(f->fd, start - f->map, end - start, POSIX_FADV_DONTNEED);
+}
+
+static void read_ahead(struct map_file *f)
+{
+	uint64_t pos, target, ready;
+
+	pos = __atomic_load_n(&f->pos, __ATOMIC_RELAXED);
+	target = SPA_MIN(pos + f->ahead, f->info.length);
+	ready = SPA_MAX(f->ready, pos);
+
+	while (ready < target) {
+		size_t chunk = SPA_MIN(target - ready, (uint64_t)CHUNK_SIZE);
+
+		prefault(f, ready, chunk);
+		ready += chunk;
+		__atomic_store_n(&f->ready, ready, __ATOMIC_RELEASE);
+	}
+	/* keep the mapping small for long files, the pages stay in
+	 * the page cache */
+	if (pos > f->released + f->ahead) {
+		release(f, f->released, pos - f->ahead - f->released);
+		f->released = pos - f->ahead;
+	}
+}
+
+static void write_behind(struct map_file *f)
+{
+	uint32_t index, offs, l0;
+	int32_t filled;
+	ssize_t res;
+
+	filled = spa_ringbuffer_get_read_index(&f->ring, &index);
+	while (filled > 0 && f->error == 0) {
+		offs = index & (f->size - 1);
+		l0 = SPA_MIN((uint32_t)filled, f->size - offs);
+
+		res = write(f->fd, f->buffer + offs, l0);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			f->error = -errno;
+			break;
+		}
+		index += res;
+		filled -= res;
+		f->written += res;
+		spa_ringbuffer_read_update(&f->ring, index);
+	}
+}
+
+static void *io_thread(void *arg)
+{
+	struct map_file *f = arg;
+	struct timespec ts;
+
+	pthread_mutex_lock(&f->lock);
+	while (f->running) {
+		pthread_mutex_unlock(&f->lock);
+
+		if (f->mode == MODE_READ)
+			read_ahead(f);
+		else
+			write_behind(f);
+
+		pthread_mutex_lock(&f->lock);
+		if (!f->running)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_nsec += IO_PERIOD_NSEC;
+		if (ts.tv_nsec >= (long)SPA_NSEC_PER_SEC) {
+			ts.tv_sec++;
+			ts.tv_nsec -= SPA_NSEC_PER_SEC;
+		}
+		pthread_cond_timedwait(&f->cond, &f->lock, &ts);
+	}
+	pthread_mutex_unlock(&f->lock);
+	return NULL;
+}
+
+static int start_thread(struct map_file *f)
+{
+	pthread_condattr_t attr;
+	int res;
+
+	pthread_mutex_init(&f->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&f->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	f->running = true;
+	if ((res = pthread_create(&f->thread, NULL, io_thread, f)) != 0) {
+		f->running = false;
+		pthread_cond_destroy(&f->cond);
+		pthread_mutex_destroy(&f->lock);
+		return -res;
+	}
+	return 0;
+}
+
+static void stop_thread(struct map_file *f)
+{
+	pthread_mutex_lock(&f->lock);
+	f->running = false;
+	pthread_cond_signal(&f->cond);
+	pthread_mutex_unlock(&f->lock);
+
+	pthread_join(f->thread, NULL);
+	pthread_cond_destroy(&f->cond);
+	pthread_mutex_destroy(&f->lock);
+}
+
+static int open_read(struct map_file *f, const char *filename, struct map_file_info *info)
+{
+	int res;
+	struct stat st;
+
+	if ((f->fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0) {
+		res = -errno;
+		goto exit;
+	}
+	if (fstat(f->fd, &st) < 0) {
+		res = -errno;
+		goto exit_close;
+	}
+	if (st.st_size == 0) {
+		res = -EINVAL;
+		goto exit_close;
+	}
+	f->map_size = st.st_size;
+
+	f->map = mmap(NULL, f->map_size, PROT_READ, MAP_SHARED, f->fd, 0);
+	if (f->map == MAP_FAILED) {
+		res = -errno;
+		goto exit_close;
+	}
+	madvise(f->map, f->map_size, MADV_SEQUENTIAL);
+
+	if ((res = parse_wav(f)) == -ENOENT) {
+		/* raw file, only when asked for */
+		if (!SPA_FLAG_IS_SET(info->flags, MAP_FILE_FLAG_RAW)) {
+			res = -ENOTSUP;
+			goto exit_unmap;
+		}
+		if (info->stride == 0) {
+			res = -EINVAL;
+			goto exit_unmap;
+		}
+		f->info = *info;
+		f->data = f->map;
+		f->info.length = f->map_size;
+	} else if (res < 0)
+		goto exit_unmap;
+
+	f->info.length -= f->info.length % f->info.stride;
+	f->ahead = buffer_size(&f->info);
+
+	/* prime the read-ahead before the process thread starts */
+	read_ahead(f);
+
+	if ((res = start_thread(f)) < 0)
+		goto exit_unmap;
+
+	f->mode = MODE_READ;
+	*info = f->info;
+	return 0;
+
+exit_unmap:
+	munmap(f->map, f->map_size);
+exit_close:
+	close(f->fd);
+exit:
+	return res;
+}
+
+int map_file_wav_header(const struct map_file_info *info, uint64_t size, uint8_t *header)
+{
+	const struct wav_format *wf = NULL;
+	uint8_t *h = header;
+
+	SPA_FOR_EACH_ELEMENT_VAR(wav_formats, i)
+		if (i->format == info->format)
+			wf = i;
+	if (wf == NULL)
+		return -ENOTSUP;
+
+	/* the sizes are only 32 bits, readers use the file size for
+	 * longer files */
+	if (size > UINT32_MAX - (MAP_FILE_WAV_HEADER_SIZE - 8))
+		size = UINT32_MAX - (MAP_FILE_WAV_HEADER_SIZE - 8);
+
+	memcpy(h, "RIFF", 4);
+	write_le32(h + 4, size + MAP_FILE_WAV_HEADER_SIZE - 8);
+	memcpy(h + 8, "WAVE", 4);
+	memcpy(h + 12, "fmt ", 4);
+	write_le32(h + 16, 16);
+	write_le16(h + 20, wf->tag);
+	write_le16(h + 22, info->channels);
+	write_le32(h + 24, info->rate);
+	write_le32(h + 28, info->rate * info->stride);
+	write_le16(h + 32, info->stride);
+	write_le16(h + 34, wf->bits);
+	memcpy(h + 36, "data", 4);
+	write_le32(h + 40, size);
+	return 0;
+}
+
+static int open_write(struct map_file *f, const char *filename, struct map_file_info *info)
+{
+	uint8_t header[MAP_FILE_WAV_HEADER_SIZE];
+	int res;
+
+	if (info->stride == 0 || info->rate == 0)
+		return -EINVAL;
+
+	f->info = *info;
+	f->wav = spa_strendswith(filename, ".wav");
+	if (f->wav && (res = map_file_wav_header(&f->info, 0, header)) < 0)
+		return res;
+
+	f->size = 1u << (32 - __builtin_clz(buffer_size(&f->info) - 1));
+	if ((f->buffer = malloc(f->size)) == NULL)
+		return -errno;
+	/* fault the pages in now and not in the process thread */
+	memset(f->buffer, 0, f->size);
+	spa_ringbuffer_init(&f->ring);
+
+	if ((f->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+		res = -errno;
+		goto exit_free;
+	}
+	if (f->wav) {
+		if (write(f->fd, header, sizeof(header)) != sizeof(header)) {
+			res = -errno;
+			goto exit_close;
+		}
+	}
+	if ((res = start_thread(f)) < 0)
+		goto exit_close;
+
+	f->mode = MODE_WRITE;
+	return 0;
+
+exit_close:
+	close(f->fd);
+exit_free:
+	free(f->buffer);
+	return res;
+}
+
+struct map_file *
+map_file_open(const char *filename, const char *mode, struct map_file_info *info)
+{
+	int res;
+	struct map_file *f;
+
+	f = calloc(1, sizeof(struct map_file));
+	if (f == NULL)
+		return NULL;
+
+	if (spa_streq(mode, "r")) {
+		if ((res = open_read(f, filename, info)) < 0)
+			goto exit_free;
+	} else if (spa_streq(mode, "w")) {
+		if ((res = open_write(f, filename, info)) < 0)
+			goto exit_free;
+	} else {
+		res = -EINVAL;
+		goto exit_free;
+	}
+	return f;
+
+exit_free:
+	free(f);
+	errno = -res;
+	return NULL;
+}
+
+int map_file_access(struct map_file *f, uint64_t offset, size_t size)
+{
+	uint64_t end = SPA_MIN(offset + size, f->info.length);
+
+	if (end > __atomic_load_n(&f->ready, __ATOMIC_ACQUIRE)) {
+		/* the data is not consumed, read ahead from the start of it */
+		__atomic_store_n(&f->pos, SPA_MIN(offset, f->info.length), __ATOMIC_RELAXED);
+		f->stats.stalls++;
+		return -EAGAIN;
+	}
+	__atomic_store_n(&f->pos, end, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static void fill_silence(struct map_file *f, void *data, size_t size)
+{
+	memset(data, f->info.format == SPA_AUDIO_FORMAT_U8 ? 0x80 : 0, size);
+}
+
+ssize_t map_file_read(struct map_file *f, void *data, size_t n_frames)
+{
+	uint64_t size, avail, ready;
+
+	if (f->mode != MODE_READ)
+		return -EINVAL;
+	if (f->offset >= f->info.length)
+		return 0;
+
+	size = SPA_MIN(n_frames * f->info.stride, f->info.length - f->offset);
+
+	avail = size;
+	if (map_file_access(f, f->offset, size) < 0) {
+		/* only copy what was read ahead, the rest of the pages might
+		 * not be resident and we don't want to fault them in here */
+		ready = __atomic_load_n(&f->ready, __ATOMIC_ACQUIRE);
+		avail = ready > f->offset ? ready - f->offset : 0;
+		avail = SPA_MIN(avail - avail % f->info.stride, size);
+		fill_silence(f, SPA_PTROFF(data, avail, void), size - avail);
+		/* continue the read-ahead after what was copied */
+		__atomic_store_n(&f->pos, f->offset + avail, __ATOMIC_RELAXED);
+	}
+	memcpy(data, f->data + f->offset, avail);
+	f->offset += avail;
+
+	return size / f->info.stride;
+}
+
+ssize_t map_file_write(struct map_file *f, const void *data, size_t n_frames)
+{
+	uint32_t index, size, avail;
+	int32_t filled;
+
+	if (f->mode != MODE_WRITE)
+		return -EINVAL;
+	if (f->error < 0)
+		return f->error;
+
+	size = n_frames * f->info.stride;
+
+	filled = spa_ringbuffer_get_write_index(&f->ring, &index);
+	avail = f->size - filled;
+	if (size > avail) {
+		/* the disk can't keep up */
+		f->stats.stalls++;
+		f->stats.dropped += size - avail;
+		size = avail - avail % f->info.stride;
+	}
+	spa_ringbuffer_write_data(&f->ring, f->buffer, f->size,
+			index & (f->size - 1), data, size);
+	spa_ringbuffer_write_update(&f->ring, index + size);
+
+	if (filled + size > f->stats.max_fill)
+		f->stats.max_fill = filled + size;
+
+	return size / f->info.stride;
+}
+
+void map_file_get_stats(struct map_file *f, struct map_file_stats *stats)
+{
+	*stats = f->stats;
+}
+
+int map_file_close(struct map_file *f)
+{
+	uint8_t header[MAP_FILE_WAV_HEADER_SIZE];
+	int res = 0;
+
+	switch (f->mode) {
+	case MODE_READ:
+		stop_thread(f);
+		munmap(f->map, f->map_size);
+		break;
+	case MODE_WRITE:
+		stop_thread(f);
+		/* flush what is left */
+		write_behind(f);
+		if (f->wav && f->error == 0) {
+			map_file_wav_header(&f->info, f->written, header);
+			if (pwrite(f->fd, header, sizeof(header), 0) != sizeof(header))
+				f->error = -errno;
+		}
+		res = f->error;
+		free(f->buffer);
+		break;
+	default:
+		return -EINVAL;
+	}
+	close(f->fd);
+	free(f);
+	return res;
+}
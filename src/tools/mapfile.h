@@ -0,0 +1,78 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+
+#include <spa/utils/defs.h>
+
+/* A raw or WAV file that is memory mapped for reading or written through
+ * a ringbuffer. A separate I/O thread reads ahead of the read position or
+ * writes behind the write position so that the process thread does not
+ * wait for the disk. */
+struct map_file;
+
+struct map_file_info {
+	uint32_t format;	/* enum spa_audio_format */
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t stride;	/* bytes per frame */
+	uint64_t length;	/* bytes of audio data when reading */
+#define MAP_FILE_FLAG_RAW	(1<<0)	/* read a file that is not WAV as raw */
+	uint32_t flags;
+};
+
+struct map_file_stats {
+	uint64_t stalls;	/* accesses to data that was not read ahead or
+				 * writes to a full ringbuffer */
+	uint64_t dropped;	/* bytes dropped because the ringbuffer was full */
+	uint64_t max_fill;	/* max bytes waiting in the ringbuffer */
+};
+
+/* mode "r" maps a WAV file or, when the file is not WAV and MAP_FILE_FLAG_RAW
+ * is set, a raw file with the format given in info. Mode "w" writes a WAV file when the filename ends
+ * in .wav or a raw file with the format given in info. */
+struct map_file * map_file_open(const char *filename, const char *mode, struct map_file_info *info);
+
+/* announce that size bytes at offset of the audio data are going to be
+ * accessed and move the read-ahead window. Returns -EAGAIN and counts a
+ * stall when the data was not read ahead yet. */
+int map_file_access(struct map_file *f, uint64_t offset, size_t size);
+
+/* copy n_frames from the mapping, returns the number of frames. When the
+ * data was not read ahead yet, silence is returned for the missing frames
+ * and they are read in a later call. */
+ssize_t map_file_read(struct map_file *f, void *data, size_t n_frames);
+
+/* queue n_frames for writing, returns the number of frames */
+ssize_t map_file_write(struct map_file *f, const void *data, size_t n_frames);
+
+#define MAP_FILE_WAV_HEADER_SIZE	44
+
+/* fill header with a WAV header for size bytes of audio data with the
+ * format in info. Returns -ENOTSUP when WAV can't store the format. */
+int map_file_wav_header(const struct map_file_info *info, uint64_t size, uint8_t *header);
+
+void map_file_get_stats(struct map_file *f, struct map_file_stats *stats);
+
+int map_file_close(struct map_file *f);
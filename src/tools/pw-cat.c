@@ -60,6 +60,7 @@
 
 #include "midifile.h"
 #include "dsffile.h"
+#include "mapfile.h"
 
 #define DEFAULT_MEDIA_TYPE	"Audio"
 #define DEFAULT_MIDI_MEDIA_TYPE	"Midi"
@@ -146,6 +147,9 @@ struct data {
 	float volume;
 	bool volume_is_set;
 
+	bool mmap;
+	struct map_file *map;
+
 	fill_fn fill;
 
 	struct spa_io_position *position;
@@ -187,7 +191,7 @@ static const struct format_info {
 	{  "s24", SF_FORMAT_PCM_24, SPA_AUDIO_FORMAT_S24, 3 },
 	{  "s32", SF_FORMAT_PCM_32, SPA_AUDIO_FORMAT_S32, 4 },
 	{  "f32", SF_FORMAT_FLOAT, SPA_AUDIO_FORMAT_F32, 4 },
-	{  "f64", SF_FORMAT_DOUBLE, SPA_AUDIO_FORMAT_F32, 8 },
+	{  "f64", SF_FORMAT_DOUBLE, SPA_AUDIO_FORMAT_F64, 8 },
 };
 
 static const struct format_info *format_info_by_name(const char *str)
@@ -874,6 +878,15 @@ static void do_quit(void *userdata, int signal_number)
 	pw_main_loop_quit(data->loop);
 }
 
+static void print_map_stats(struct data *data)
+{
+	struct map_file_stats stats;
+
+	map_file_get_stats(data->map, &stats);
+	printf("mmap: stalls:%"PRIu64" dropped:%"PRIu64" max-fill:%"PRIu64"\n",
+			stats.stalls, stats.dropped, stats.max_fill);
+}
+
 static void do_print_delay(void *userdata, uint64_t expirations)
 {
 	struct data *data = userdata;
@@ -886,6 +899,8 @@ static void do_print_delay(void *userdata, uint64_t expirations)
 		time.rate.num, time.rate.denom,
 		time.ticks, time.delay, time.queued, time.buffered,
 		time.queued_buffers, time.avail_buffers);
+	if (data->map)
+		print_map_stats(data);
 }
 
 enum {
@@ -900,6 +915,7 @@ enum {
 	OPT_CHANNELMAP,
 	OPT_FORMAT,
 	OPT_VOLUME,
+	OPT_MMAP,
 };
 
 static const struct option long_options[] = {
@@ -926,6 +942,7 @@ static const struct option long_options[] = {
 	{ "format",		required_argument, NULL, OPT_FORMAT },
 	{ "volume",		required_argument, NULL, OPT_VOLUME },
 	{ "quality",		required_argument, NULL, 'q' },
+	{ "mmap",		no_argument,	   NULL, OPT_MMAP },
 
 	{ NULL, 0, NULL, 0 }
 };
@@ -970,6 +987,8 @@ static void show_usage(const char *name, bool is_error)
              "      --format                          Sample format %s (req. for rec) (default %s)\n"
 	     "      --volume                          Stream volume 0-1.0 (default %.3f)\n"
 	     "  -q  --quality                         Resampler quality (0 - 15) (default %d)\n"
+	     "      --mmap                            Map raw, WAV and DSF files and do disk\n"
+	     "                                          I/O in a separate thread\n"
 	     "\n"),
 	     DEFAULT_RATE,
 	     DEFAULT_CHANNELS,
@@ -1121,6 +1140,13 @@ static const struct dsd_layout_info dsd_layouts[] = {
 
 static int dsf_play(struct data *d, void *src, unsigned int n_frames)
 {
+	if (d->map && map_file_access(d->map, dsf_file_tell(d->dsf.file),
+				n_frames * d->stride) < 0) {
+		/* not read ahead yet, play DSD silence instead of waiting for
+		 * the disk */
+		memset(src, 0x69, n_frames * d->stride);
+		return n_frames;
+	}
 	return dsf_file_read(d->dsf.file, src, n_frames, &d->dsf.layout);
 }
 
@@ -1144,6 +1170,23 @@ static int setup_dsffile(struct data *data)
 
 	data->fill = dsf_play;
 
+	if (data->mmap) {
+		/* the dsf file is already mapped, only do the read-ahead */
+		struct map_file_info info;
+
+		spa_zero(info);
+		info.format = SPA_AUDIO_FORMAT_UNKNOWN;
+		info.rate = data->dsf.info.rate / 8;
+		info.channels = data->dsf.info.channels;
+		info.stride = data->dsf.info.channels;
+		info.flags = MAP_FILE_FLAG_RAW;
+
+		data->map = map_file_open(data->filename, "r", &info);
+		if (data->map == NULL) {
+			fprintf(stderr, "mapfile: can't map file '%s': %m\n", data->filename);
+			return -errno;
+		}
+	}
 	return 0;
 }
 
@@ -1462,6 +1505,66 @@ static int setup_sndfile(struct data *data)
 	return 0;
 }
 
+static int map_play(struct data *d, void *dest, unsigned int n_frames)
+{
+	return map_file_read(d->map, dest, n_frames);
+}
+
+static int map_record(struct data *d, void *src, unsigned int n_frames)
+{
+	return map_file_write(d->map, src, n_frames);
+}
+
+static int setup_mapfile(struct data *data)
+{
+	const struct format_info *fi;
+	struct map_file_info info;
+
+	/* for raw files and for record, the format comes from the options */
+	if ((fi = format_info_by_name(data->format ? data->format : DEFAULT_FORMAT)) == NULL) {
+		fprintf(stderr, "error: unknown format \"%s\"\n", data->format);
+		return -EINVAL;
+	}
+	spa_zero(info);
+	info.format = fi->spa_format;
+	info.rate = data->rate ? data->rate : DEFAULT_RATE;
+	info.channels = data->channels ? data->channels : DEFAULT_CHANNELS;
+	info.stride = fi->width * info.channels;
+	/* files that are not WAV are only played as raw when the format
+	 * was given or the file is named .raw */
+	if (data->format != NULL || spa_strendswith(data->filename, ".raw"))
+		info.flags = MAP_FILE_FLAG_RAW;
+
+	data->map = map_file_open(data->filename,
+			data->mode == mode_playback ? "r" : "w", &info);
+	if (data->map == NULL) {
+		fprintf(stderr, "mapfile: failed to open audio file \"%s\": %m\n",
+				data->filename);
+		return -EIO;
+	}
+	if (data->channels > 0 && info.channels != (uint32_t)data->channels) {
+		fprintf(stderr, "mapfile: given channels (%u) don't match file channels (%u)\n",
+				data->channels, info.channels);
+		return -EINVAL;
+	}
+
+	data->rate = info.rate;
+	data->channels = info.channels;
+	if (data->channelmap.n_channels == 0)
+		channelmap_default(&data->channelmap, data->channels);
+
+	data->spa_format = info.format;
+	data->stride = info.stride;
+	data->fill = data->mode == mode_playback ? map_play : map_record;
+
+	if (data->verbose)
+		printf("mapfile: opened file \"%s\" format:%s rate:%u channels:%u stride:%u length:%"PRIu64"\n",
+				data->filename,
+				spa_debug_type_find_short_name(spa_type_audio_format, info.format),
+				info.rate, info.channels, info.stride, info.length);
+	return 0;
+}
+
 static int setup_properties(struct data *data)
 {
 	const char *s;
@@ -1696,6 +1799,10 @@ int main(int argc, char *argv[])
 		case OPT_VOLUME:
 			data.volume = atof(optarg);
 			break;
+
+		case OPT_MMAP:
+			data.mmap = true;
+			break;
 		default:
 			goto error_usage;
 		}
@@ -1794,7 +1901,10 @@ int main(int argc, char *argv[])
 	} else {
 		switch (data.data_type) {
 		case TYPE_PCM:
-			ret = setup_sndfile(&data);
+			if (data.mmap)
+				ret = setup_mapfile(&data);
+			else
+				ret = setup_sndfile(&data);
 			break;
 		case TYPE_MIDI:
 			ret = setup_midifile(&data);
@@ -1962,6 +2072,15 @@ error_no_main_loop:
 		sf_close(data.file);
 	if (data.midi.file)
 		midi_file_close(data.midi.file);
+	if (data.map) {
+		if (data.verbose)
+			print_map_stats(&data);
+		if ((ret = map_file_close(data.map)) < 0) {
+			fprintf(stderr, "mapfile: error writing \"%s\": %s\n",
+					data.filename, spa_strerror(ret));
+			exit_code = EXIT_FAILURE;
+		}
+	}
 	pw_deinit();
 	return exit_code;
 
@@ -40,13 +40,18 @@
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
 #include <spa/pod/iter.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+#include <spa/param/profiler.h>
 #include <spa/debug/types.h>
 #include <spa/utils/json.h>
 #include <spa/utils/ansi.h>
 #include <spa/utils/string.h>
 
 #include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
 #include <pipewire/extensions/metadata.h>
+#include <pipewire/extensions/profiler.h>
 
 #define INDENT 2
 
@@ -124,6 +129,7 @@ struct object {
 	struct spa_list param_list;
 	struct spa_list pending_list;
 	struct spa_list data_list;
+	struct spa_pod *histograms;
 
 	struct pw_proxy *proxy;
 	struct spa_hook proxy_listener;
@@ -228,6 +234,7 @@ static void object_destroy(struct object *o)
 	pw_properties_free(o->props);
 	clear_params(&o->param_list, SPA_ID_INVALID);
 	clear_params(&o->pending_list, SPA_ID_INVALID);
+	free(o->histograms);
 	free(o->type);
 	free(o);
 }
@@ -861,6 +868,60 @@ static const struct class device_class = {
 };
 
 /* node */
+static void put_histograms(struct data *d, const char *key, const struct spa_pod *pod)
+{
+	static const char * const names[] = { "wakeup", "process", "cycle" };
+	static const struct {
+		const char *key;
+		double percentile;
+	} percentiles[] = {
+		{ "p50", 50.0 },
+		{ "p90", 90.0 },
+		{ "p99", 99.0 },
+		{ "p99.9", 99.9 },
+	};
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	uint32_t i, j, id, min_shift, sub_shift;
+
+	spa_pod_parser_pod(&prs, pod);
+	if (spa_pod_parser_push_struct(&prs, &f) < 0 ||
+	    spa_pod_parser_get(&prs,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&min_shift),
+			SPA_POD_Int(&sub_shift),
+			NULL) < 0)
+		return;
+
+	put_begin(d, key, "{", 0);
+	SPA_FOR_EACH_ELEMENT_VAR(names, n) {
+		uint32_t csize, ctype, n_buckets;
+		int64_t max;
+		uint64_t *buckets, count = 0;
+
+		if (spa_pod_parser_get(&prs,
+				SPA_POD_Long(&max),
+				SPA_POD_Array(&csize, &ctype, &n_buckets, &buckets),
+				NULL) < 0 ||
+		    csize != sizeof(int64_t) || ctype != SPA_TYPE_Long)
+			break;
+
+		for (i = 0; i < n_buckets; i++)
+			count += buckets[i];
+
+		put_begin(d, *n, "{", STATE_SIMPLE);
+		put_int(d, "count", count);
+		for (j = 0; j < SPA_N_ELEMENTS(percentiles); j++)
+			put_int(d, percentiles[j].key,
+					pw_profiler_histogram_percentile(buckets, n_buckets,
+						min_shift, sub_shift, max,
+						percentiles[j].percentile));
+		put_int(d, "max", max);
+		put_end(d, "}", STATE_SIMPLE);
+	}
+	put_end(d, "}", 0);
+}
+
 static void node_dump(struct object *o)
 {
 	static const struct flags_info fl[] = {
@@ -885,6 +946,8 @@ static void node_dump(struct object *o)
 	put_value(d, "error", i->error);
 	put_dict(d, "props", i->props);
 	put_params(d, "params", i->params, i->n_params, &o->param_list);
+	if (o->histograms)
+		put_histograms(d, "histograms", o->histograms);
 	put_end(d, "}", 0);
 }
 
@@ -1277,6 +1340,45 @@ static const struct class metadata_class = {
 	.name_key = PW_KEY_METADATA_NAME,
 };
 
+/* profiler */
+static void profiler_event_profile(void *data, const struct spa_pod *pod)
+{
+	struct object *o = data, *n;
+	struct spa_pod *obj;
+	struct spa_pod_prop *p;
+	uint32_t id;
+
+	SPA_POD_STRUCT_FOREACH(pod, obj) {
+		if (!spa_pod_is_object_type(obj, SPA_TYPE_OBJECT_Profiler))
+			continue;
+
+		SPA_POD_OBJECT_FOREACH((struct spa_pod_object*)obj, p) {
+			if (p->key != SPA_PROFILER_nodeHistogram)
+				continue;
+			if (spa_pod_parse_struct(&p->value, SPA_POD_Int(&id)) < 0 ||
+			    (n = find_object(o->data, id)) == NULL ||
+			    n->class != &node_class)
+				continue;
+
+			/* the histograms are only dumped when the node
+			 * changes, they update with every profile event */
+			free(n->histograms);
+			n->histograms = spa_pod_copy(&p->value);
+		}
+	}
+}
+
+static const struct pw_profiler_events profiler_events = {
+	PW_VERSION_PROFILER_EVENTS,
+	.profile = profiler_event_profile,
+};
+
+static const struct class profiler_class = {
+	.type = PW_TYPE_INTERFACE_Profiler,
+	.version = PW_VERSION_PROFILER,
+	.events = &profiler_events,
+};
+
 static const struct class *classes[] =
 {
 	&core_class,
@@ -1288,6 +1390,7 @@ static const struct class *classes[] =
 	&port_class,
 	&link_class,
 	&metadata_class,
+	&profiler_class,
 };
 
 static const struct class *find_class(const char *type, uint32_t version)
@@ -1365,7 +1468,8 @@ static void registry_event_global(void *data, uint32_t id,
 			pw_proxy_add_object_listener(o->proxy,
 					&o->object_listener,
 					o->class->events, o);
-		else
+		/* objects without info are dumped with their props */
+		if (o->class->events == NULL || o->class->dump == NULL)
 			o->changed++;
 	} else {
 		o->changed++;
@@ -1625,6 +1729,8 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	pw_context_load_module(data.context, PW_EXTENSION_MODULE_PROFILER, NULL, NULL);
+
 	data.core = pw_context_connect(data.context,
 			pw_properties_new(
 				PW_KEY_REMOTE_NAME, opt_remote,
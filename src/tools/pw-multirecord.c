@@ -0,0 +1,1029 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <locale.h>
+
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/param/audio/format-utils.h>
+
+#include <pipewire/pipewire.h>
+
+#include "mapfile.h"
+
+#define DEFAULT_RATE		48000
+#define DEFAULT_CHANNELS	1
+#define DEFAULT_FORMAT		"f32"
+
+#define MAX_STREAMS		1024
+/* seconds of data to buffer for each stream */
+#define BUFFER_SEC		2
+/* how often the writer thread runs */
+#define WRITE_PERIOD_NSEC	(20 * SPA_NSEC_PER_MSEC)
+/* the size of the writes to the files */
+#define BLOCK_SIZE		(256u * 1024u)
+#define MIN_RING_SIZE		(4 * BLOCK_SIZE)
+/* frames that the position and the resampled data can differ without
+ * being a gap or an overlap */
+#define RESAMPLE_JITTER		4
+
+struct data;
+
+struct stream {
+	struct data *data;
+	uint32_t index;
+	const char *target;
+	char *filename;
+	int fd;
+	uint64_t written;
+
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	struct spa_io_position *position;
+
+	struct spa_ringbuffer ring;
+	uint8_t *buffer;
+
+	/* set in the process thread */
+	bool started;
+	bool active;
+	uint64_t start;		/* frame position of the first frame */
+	uint64_t next;		/* frame position of the next frame to write */
+	uint64_t gaps;		/* frames of silence inserted */
+	uint64_t dropped;	/* frames dropped because the ring was full */
+	uint32_t max_fill;
+
+	/* writer thread */
+	bool padded;
+	uint64_t read_pos;	/* frame position of the ring read index */
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+
+	const char *remote;
+	const char *latency;
+	const char *group;
+	const char *interleave;
+	struct pw_properties *props;
+	bool verbose;
+
+	uint32_t format;
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t stride;	/* bytes per frame of one stream */
+	uint32_t ring_size;
+
+	struct stream *streams[MAX_STREAMS];
+	uint32_t n_streams;
+
+	/* frame position of the first frame in the files */
+	uint64_t origin;
+
+	/* process thread, the driver clock of the last cycle */
+	bool clock_valid;
+	uint32_t clock_id;
+	uint64_t clock_position;
+	uint64_t clock_offset;	/* added to the clock frames to get the frame position */
+	uint64_t clock_end;	/* frame position after the last cycle */
+
+	/* one interleaved file */
+	int fd;
+	uint64_t written;
+	uint64_t frames;
+	uint8_t *block;
+	uint8_t *scratch;
+	uint32_t block_frames;
+
+	uint8_t *zero;
+	int error;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool running;
+};
+
+static const struct format_info {
+	const char *name;
+	uint32_t format;
+	uint32_t width;
+} format_info[] = {
+	{ "s16", SPA_AUDIO_FORMAT_S16_LE, 2 },
+	{ "s24", SPA_AUDIO_FORMAT_S24_LE, 3 },
+	{ "s32", SPA_AUDIO_FORMAT_S32_LE, 4 },
+	{ "f32", SPA_AUDIO_FORMAT_F32_LE, 4 },
+	{ "f64", SPA_AUDIO_FORMAT_F64_LE, 8 },
+};
+
+static const struct format_info *format_info_by_name(const char *str)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(format_info, i)
+		if (spa_streq(str, i->name))
+			return i;
+	return NULL;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+	const uint8_t *p = data;
+	ssize_t res;
+
+	while (size > 0) {
+		res = write(fd, p, size);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += res;
+		size -= res;
+	}
+	return 0;
+}
+
+static int write_zero(struct data *d, int fd, uint64_t size)
+{
+	int res;
+
+	while (size > 0) {
+		uint32_t l = SPA_MIN(size, BLOCK_SIZE);
+		if ((res = write_all(fd, d->zero, l)) < 0)
+			return res;
+		size -= l;
+	}
+	return 0;
+}
+
+static int open_file(struct data *d, const char *filename, uint32_t channels)
+{
+	struct map_file_info info;
+	uint8_t header[MAP_FILE_WAV_HEADER_SIZE];
+	int fd, res;
+
+	if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+		return -errno;
+
+	if (spa_strendswith(filename, ".wav")) {
+		spa_zero(info);
+		info.format = d->format;
+		info.rate = d->rate;
+		info.channels = channels;
+		info.stride = d->stride / d->channels * channels;
+		if ((res = map_file_wav_header(&info, 0, header)) < 0 ||
+		    (res = write_all(fd, header, sizeof(header))) < 0) {
+			close(fd);
+			return res;
+		}
+	}
+	return fd;
+}
+
+static int close_file(struct data *d, int fd, const char *filename,
+		uint32_t channels, uint64_t size)
+{
+	struct map_file_info info;
+	uint8_t header[MAP_FILE_WAV_HEADER_SIZE];
+	int res = 0;
+
+	if (spa_strendswith(filename, ".wav")) {
+		spa_zero(info);
+		info.format = d->format;
+		info.rate = d->rate;
+		info.channels = channels;
+		info.stride = d->stride / d->channels * channels;
+		map_file_wav_header(&info, size, header);
+		if (pwrite(fd, header, sizeof(header), 0) != sizeof(header))
+			res = -errno;
+	}
+	if (close(fd) < 0 && res == 0)
+		res = -errno;
+	return res;
+}
+
+/* per stream files: pad the start with silence so that all files start at the
+ * origin and write the data in blocks */
+static int write_stream(struct data *d, struct stream *s, bool flush)
+{
+	uint32_t index, offs, l0;
+	int32_t filled;
+	int res;
+
+	if (!__atomic_load_n(&s->started, __ATOMIC_ACQUIRE))
+		return 0;
+
+	if (!s->padded) {
+		uint64_t origin = __atomic_load_n(&d->origin, __ATOMIC_RELAXED);
+		uint64_t pad = s->start > origin ? (s->start - origin) * d->stride : 0;
+
+		if ((res = write_zero(d, s->fd, pad)) < 0)
+			return res;
+		s->written += pad;
+		s->padded = true;
+	}
+
+	filled = spa_ringbuffer_get_read_index(&s->ring, &index);
+	while (filled > 0 && (flush || filled >= (int32_t)BLOCK_SIZE)) {
+		offs = index & (d->ring_size - 1);
+		l0 = SPA_MIN((uint32_t)filled, d->ring_size - offs);
+		if (!flush)
+			l0 = SPA_ROUND_DOWN(l0, BLOCK_SIZE);
+
+		if ((res = write_all(s->fd, s->buffer + offs, l0)) < 0)
+			return res;
+
+		index += l0;
+		filled -= l0;
+		s->written += l0;
+		spa_ringbuffer_read_update(&s->ring, index);
+	}
+	return 0;
+}
+
+/* one file: interleave the streams from the origin on. Streams that did not
+ * start yet or that are not running give silence */
+static int write_interleaved(struct data *d, bool flush)
+{
+	uint64_t origin, cur, end, n;
+	uint32_t i, fstride = d->stride * d->n_streams;
+	int res;
+
+	origin = __atomic_load_n(&d->origin, __ATOMIC_RELAXED);
+	if (origin == UINT64_MAX)
+		return 0;
+
+	while (true) {
+		cur = origin + d->frames;
+		end = UINT64_MAX;
+
+		for (i = 0; i < d->n_streams; i++) {
+			struct stream *s = d->streams[i];
+			uint32_t index;
+			int32_t filled;
+
+			if (!__atomic_load_n(&s->started, __ATOMIC_ACQUIRE))
+				continue;
+			if (!s->padded) {
+				s->read_pos = s->start;
+				s->padded = true;
+			}
+			/* don't wait for streams that are not running, the
+			 * final flush happens after the streams were stopped */
+			if (!flush && !__atomic_load_n(&s->active, __ATOMIC_RELAXED))
+				continue;
+
+			filled = spa_ringbuffer_get_read_index(&s->ring, &index);
+			end = SPA_MIN(end, s->read_pos + filled / d->stride);
+		}
+		if (end == UINT64_MAX || end <= cur)
+			break;
+
+		n = SPA_MIN(end - cur, d->block_frames);
+		if (n < d->block_frames && !flush)
+			break;
+
+		for (i = 0; i < d->n_streams; i++) {
+			struct stream *s = d->streams[i];
+			uint8_t *dst = d->block + i * d->stride;
+			uint32_t index = 0, j, lead = 0, avail = 0, count;
+			int32_t filled;
+
+			if (s->padded) {
+				filled = spa_ringbuffer_get_read_index(&s->ring, &index);
+				avail = filled / d->stride;
+
+				if (s->read_pos < cur) {
+					/* data from before the current position */
+					uint32_t skip = SPA_MIN(cur - s->read_pos, avail);
+					index += skip * d->stride;
+					avail -= skip;
+					s->read_pos += skip;
+				}
+				if (s->read_pos > cur)
+					lead = SPA_MIN(s->read_pos - cur, n);
+			} else {
+				lead = n;
+			}
+			count = SPA_MIN(n - lead, avail);
+
+			for (j = 0; j < lead; j++)
+				memset(dst + j * fstride, 0, d->stride);
+
+			if (count > 0) {
+				spa_ringbuffer_read_data(&s->ring, s->buffer, d->ring_size,
+						index & (d->ring_size - 1), d->scratch, count * d->stride);
+				for (j = 0; j < count; j++)
+					memcpy(dst + (lead + j) * fstride,
+						d->scratch + j * d->stride, d->stride);
+				index += count * d->stride;
+				s->read_pos += count;
+			}
+			if (s->padded)
+				spa_ringbuffer_read_update(&s->ring, index);
+
+			for (j = lead + count; j < n; j++)
+				memset(dst + j * fstride, 0, d->stride);
+		}
+		if ((res = write_all(d->fd, d->block, n * fstride)) < 0)
+			return res;
+
+		d->frames += n;
+		d->written += n * fstride;
+	}
+	return 0;
+}
+
+static void write_streams(struct data *d, bool flush)
+{
+	uint32_t i;
+	int res = 0;
+
+	if (d->error < 0)
+		return;
+
+	if (d->interleave) {
+		res = write_interleaved(d, flush);
+	} else {
+		for (i = 0; i < d->n_streams && res >= 0; i++)
+			res = write_stream(d, d->streams[i], flush);
+	}
+	d->error = res;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct data *d = arg;
+	struct timespec ts;
+
+	pthread_mutex_lock(&d->lock);
+	while (d->running) {
+		pthread_mutex_unlock(&d->lock);
+
+		write_streams(d, false);
+
+		pthread_mutex_lock(&d->lock);
+		if (!d->running)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_nsec += WRITE_PERIOD_NSEC;
+		if (ts.tv_nsec >= (long)SPA_NSEC_PER_SEC) {
+			ts.tv_sec++;
+			ts.tv_nsec -= SPA_NSEC_PER_SEC;
+		}
+		pthread_cond_timedwait(&d->cond, &d->lock, &ts);
+	}
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+static int start_writer(struct data *d)
+{
+	pthread_condattr_t attr;
+	int res;
+
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&d->cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	d->running = true;
+	if ((res = pthread_create(&d->thread, NULL, writer_thread, d)) != 0) {
+		d->running = false;
+		pthread_cond_destroy(&d->cond);
+		pthread_mutex_destroy(&d->lock);
+		return -res;
+	}
+	return 0;
+}
+
+static void stop_writer(struct data *d)
+{
+	pthread_mutex_lock(&d->lock);
+	d->running = false;
+	pthread_cond_signal(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+
+	pthread_join(d->thread, NULL);
+	pthread_cond_destroy(&d->cond);
+	pthread_mutex_destroy(&d->lock);
+}
+
+static void write_silence(struct stream *s, uint32_t index, uint32_t size)
+{
+	uint32_t ring_size = s->data->ring_size, offs = index & (ring_size - 1);
+	uint32_t l0 = SPA_MIN(size, ring_size - offs);
+
+	memset(s->buffer + offs, 0, l0);
+	memset(s->buffer, 0, size - l0);
+}
+
+/* the clock position counts samples at the graph rate, convert it to frames
+ * at the rate of the streams */
+static uint64_t clock_to_frames(struct data *d, const struct spa_io_clock *c,
+		uint64_t val, bool *resampled)
+{
+	uint64_t num = c->rate.num, denom = c->rate.denom;
+
+	if (num == 0 || denom == 0) {
+		*resampled = false;
+		return val;
+	}
+	*resampled = num * d->rate != denom;
+	return (val * num * d->rate + denom / 2) / denom;
+}
+
+/* the position of a new driver or a position that went back in time has
+ * nothing to do with what we wrote before, continue from the end of the
+ * previous cycle instead of padding or dropping the difference.
+ * All streams are in the same data loop, the first stream of a cycle
+ * updates the state for the others. */
+static uint64_t position_to_frames(struct data *d, const struct spa_io_position *p,
+		bool *resampled)
+{
+	const struct spa_io_clock *c = &p->clock;
+	uint64_t pos = clock_to_frames(d, c, c->position, resampled);
+	bool rebase = d->clock_valid &&
+		(c->id != d->clock_id || c->position < d->clock_position);
+
+	if (rebase)
+		d->clock_offset = d->clock_end - pos;
+
+	if (!d->clock_valid || rebase || c->position != d->clock_position) {
+		d->clock_valid = true;
+		d->clock_id = c->id;
+		d->clock_position = c->position;
+		d->clock_end = pos + d->clock_offset +
+			clock_to_frames(d, c, c->duration, resampled);
+	}
+	return pos + d->clock_offset;
+}
+
+static void on_process(void *userdata)
+{
+	struct stream *s = userdata;
+	struct data *d = s->data;
+	struct pw_buffer *b;
+	struct spa_data *bd;
+	uint64_t pos, gap;
+	uint32_t offs, size, n_frames, index, start, avail, n;
+	int32_t filled;
+	bool resampled;
+
+	if ((b = pw_stream_dequeue_buffer(s->stream)) == NULL)
+		return;
+
+	bd = &b->buffer->datas[0];
+	if (bd->data == NULL || s->position == NULL)
+		goto done;
+
+	offs = SPA_MIN(bd->chunk->offset, bd->maxsize);
+	size = SPA_MIN(bd->chunk->size, bd->maxsize - offs);
+	n_frames = size / d->stride;
+
+	/* all streams are in the same group and share the driver position */
+	pos = position_to_frames(d, s->position, &resampled);
+	/* the resampler doesn't produce exactly the same number of frames
+	 * every cycle, ignore small differences */
+	if (resampled && s->started &&
+	    (pos > s->next ? pos - s->next : s->next - pos) <= RESAMPLE_JITTER)
+		pos = s->next;
+
+	if (!s->started) {
+		uint64_t none = UINT64_MAX;
+		__atomic_compare_exchange_n(&d->origin, &none, pos, false,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+		s->start = s->next = pos;
+		__atomic_store_n(&s->started, true, __ATOMIC_RELEASE);
+	}
+
+	filled = spa_ringbuffer_get_write_index(&s->ring, &index);
+	avail = (d->ring_size - filled) / d->stride;
+	start = index;
+
+	if (pos > s->next) {
+		/* we were not scheduled, fill the hole with silence so that
+		 * the stream stays aligned with the others */
+		gap = SPA_MIN(pos - s->next, avail);
+		write_silence(s, index, gap * d->stride);
+		index += gap * d->stride;
+		avail -= gap;
+		s->next += gap;
+		s->gaps += gap;
+	} else if (pos < s->next) {
+		/* overlaps with what we already have */
+		n = SPA_MIN(s->next - pos, n_frames);
+		offs += n * d->stride;
+		n_frames -= n;
+		pos += n;
+	}
+
+	if (pos == s->next) {
+		n = SPA_MIN(n_frames, avail);
+		spa_ringbuffer_write_data(&s->ring, s->buffer, d->ring_size,
+				index & (d->ring_size - 1),
+				SPA_PTROFF(bd->data, offs, void), n * d->stride);
+		index += n * d->stride;
+		s->next += n;
+	} else {
+		n = 0;
+	}
+	/* what does not fit is filled with silence in a later cycle */
+	s->dropped += n_frames - n;
+
+	spa_ringbuffer_write_update(&s->ring, index);
+	if (filled + index - start > s->max_fill)
+		s->max_fill = filled + index - start;
+done:
+	pw_stream_queue_buffer(s->stream, b);
+}
+
+static void
+on_io_changed(void *userdata, uint32_t id, void *data, uint32_t size)
+{
+	struct stream *s = userdata;
+
+	switch (id) {
+	case SPA_IO_Position:
+		s->position = data;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+on_state_changed(void *userdata, enum pw_stream_state old,
+		 enum pw_stream_state state, const char *error)
+{
+	struct stream *s = userdata;
+	struct data *d = s->data;
+
+	if (d->verbose)
+		printf("stream %u (%s): state changed %s -> %s\n",
+				s->index, s->target,
+				pw_stream_state_as_string(old),
+				pw_stream_state_as_string(state));
+
+	__atomic_store_n(&s->active, state == PW_STREAM_STATE_STREAMING, __ATOMIC_RELAXED);
+
+	if (state == PW_STREAM_STATE_ERROR)
+		fprintf(stderr, "stream %u (%s): error: %s\n", s->index, s->target, error);
+}
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = on_state_changed,
+	.io_changed = on_io_changed,
+	.process = on_process,
+};
+
+static void on_core_error(void *userdata, uint32_t id, int seq, int res, const char *message)
+{
+	struct data *d = userdata;
+
+	fprintf(stderr, "remote error: id=%"PRIu32" seq:%d res:%d (%s): %s\n",
+			id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE && res == -EPIPE)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = on_core_error,
+};
+
+static void do_quit(void *userdata, int signal_number)
+{
+	struct data *d = userdata;
+	pw_main_loop_quit(d->loop);
+}
+
+static char *make_filename(const char *target)
+{
+	char *filename, *p;
+
+	if (asprintf(&filename, "%s.wav", target) < 0)
+		return NULL;
+	for (p = filename; *p; p++)
+		if (*p == '/')
+			*p = '_';
+	return filename;
+}
+
+static struct stream *stream_new(struct data *d, const char *arg)
+{
+	struct stream *s;
+	struct pw_properties *props;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_audio_info_raw info;
+	const char *sep;
+	uint32_t i;
+	int res;
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL)
+		return NULL;
+
+	s->data = d;
+	s->index = d->n_streams;
+	s->fd = -1;
+
+	/* TARGET[=FILE] */
+	if ((sep = strchr(arg, '=')) != NULL) {
+		s->target = strndup(arg, sep - arg);
+		s->filename = strdup(sep + 1);
+	} else {
+		s->target = strdup(arg);
+		s->filename = make_filename(arg);
+	}
+	if (s->target == NULL || s->filename == NULL)
+		goto error_errno;
+
+	if ((s->buffer = malloc(d->ring_size)) == NULL)
+		goto error_errno;
+	/* fault the pages in now and not in the process thread */
+	memset(s->buffer, 0, d->ring_size);
+	spa_ringbuffer_init(&s->ring);
+
+	if (d->interleave == NULL) {
+		if ((s->fd = open_file(d, s->filename, d->channels)) < 0) {
+			errno = -s->fd;
+			fprintf(stderr, "can't open file \"%s\": %m\n", s->filename);
+			goto error;
+		}
+	}
+
+	props = pw_properties_new(
+			PW_KEY_MEDIA_TYPE, "Audio",
+			PW_KEY_MEDIA_CATEGORY, "Capture",
+			PW_KEY_MEDIA_ROLE, "Production",
+			PW_KEY_TARGET_OBJECT, s->target,
+			PW_KEY_NODE_GROUP, d->group,
+			NULL);
+	if (props == NULL)
+		goto error_errno;
+
+	pw_properties_setf(props, PW_KEY_NODE_NAME, "%s.%u", d->group, s->index);
+	pw_properties_setf(props, PW_KEY_NODE_DESCRIPTION, "Record %s", s->target);
+	pw_properties_set(props, PW_KEY_MEDIA_NAME,
+			d->interleave ? d->interleave : s->filename);
+	pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%u", d->rate);
+	if (d->latency != NULL)
+		pw_properties_set(props, PW_KEY_NODE_LATENCY, d->latency);
+	pw_properties_update(props, &d->props->dict);
+
+	s->stream = pw_stream_new(d->core, d->group, props);
+	if (s->stream == NULL)
+		goto error_errno;
+
+	pw_stream_add_listener(s->stream, &s->listener, &stream_events, s);
+
+	spa_zero(info);
+	info.format = d->format;
+	info.rate = d->rate;
+	info.channels = d->channels;
+	if (d->channels == 1) {
+		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
+	} else if (d->channels == 2) {
+		info.position[0] = SPA_AUDIO_CHANNEL_FL;
+		info.position[1] = SPA_AUDIO_CHANNEL_FR;
+	} else {
+		for (i = 0; i < d->channels; i++)
+			info.position[i] = SPA_AUDIO_CHANNEL_START_Aux + i;
+	}
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &info);
+
+	if ((res = pw_stream_connect(s->stream,
+			PW_DIRECTION_INPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, 1)) < 0) {
+		errno = -res;
+		fprintf(stderr, "can't connect stream for \"%s\": %m\n", s->target);
+		goto error;
+	}
+	return s;
+
+error_errno:
+	fprintf(stderr, "can't create stream for \"%s\": %m\n", arg);
+error:
+	if (s->stream)
+		pw_stream_destroy(s->stream);
+	if (s->fd >= 0)
+		close(s->fd);
+	free(s->buffer);
+	free((char*)s->target);
+	free(s->filename);
+	free(s);
+	return NULL;
+}
+
+static void stream_destroy(struct stream *s)
+{
+	if (s->stream)
+		pw_stream_destroy(s->stream);
+	s->stream = NULL;
+}
+
+static void stream_free(struct stream *s)
+{
+	struct data *d = s->data;
+	int res;
+
+	if (s->fd >= 0 &&
+	    (res = close_file(d, s->fd, s->filename, d->channels, s->written)) < 0)
+		fprintf(stderr, "error writing \"%s\": %s\n", s->filename, spa_strerror(res));
+
+	if (d->verbose)
+		printf("stream %u (%s): gaps:%"PRIu64" dropped:%"PRIu64" max-fill:%u\n",
+				s->index, s->target, s->gaps, s->dropped, s->max_fill);
+
+	free(s->buffer);
+	free((char*)s->target);
+	free(s->filename);
+	free(s);
+}
+
+static void show_help(const char *name, bool error)
+{
+	fprintf(error ? stderr : stdout,
+		"%s [options] TARGET[=FILE] ...\n"
+		"Record TARGET nodes (name or serial) in one process, aligned\n"
+		"to the driver position. FILE defaults to TARGET.wav.\n\n"
+		"  -h, --help                            Show this help\n"
+		"      --version                         Show version\n"
+		"  -v, --verbose                         Enable verbose operations\n"
+		"  -r, --remote                          Remote daemon name\n"
+		"  -g, --group                           Node group (default '%s-<pid>')\n"
+		"  -P, --properties                      Set extra stream properties as JSON object\n"
+		"      --latency                         Node latency (e.g. 1024/48000)\n"
+		"      --rate                            Sample rate (default %u)\n"
+		"      --channels                        Number of channels per target (default %u)\n"
+		"      --format                          Sample format s16, s24, s32, f32 or f64\n"
+		"                                          (default %s)\n"
+		"  -i, --interleave=FILE                 Write all targets to one interleaved\n"
+		"                                          file instead of one file per target\n",
+		name, name, DEFAULT_RATE, DEFAULT_CHANNELS, DEFAULT_FORMAT);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	struct pw_loop *l;
+	const struct format_info *fi;
+	const char *format = DEFAULT_FORMAT, *prog;
+	char group[256];
+	uint32_t i;
+	int c, res, exit_code = EXIT_FAILURE;
+	enum {
+		OPT_VERSION = 1000,
+		OPT_LATENCY,
+		OPT_RATE,
+		OPT_CHANNELS,
+		OPT_FORMAT,
+	};
+	static const struct option long_options[] = {
+		{ "help",		no_argument,		NULL, 'h' },
+		{ "version",		no_argument,		NULL, OPT_VERSION },
+		{ "verbose",		no_argument,		NULL, 'v' },
+		{ "remote",		required_argument,	NULL, 'r' },
+		{ "group",		required_argument,	NULL, 'g' },
+		{ "properties",		required_argument,	NULL, 'P' },
+		{ "latency",		required_argument,	NULL, OPT_LATENCY },
+		{ "rate",		required_argument,	NULL, OPT_RATE },
+		{ "channels",		required_argument,	NULL, OPT_CHANNELS },
+		{ "format",		required_argument,	NULL, OPT_FORMAT },
+		{ "interleave",		required_argument,	NULL, 'i' },
+		{ NULL, 0, NULL, 0}
+	};
+
+	setlocale(LC_ALL, "");
+	pw_init(&argc, &argv);
+
+	data.rate = DEFAULT_RATE;
+	data.channels = DEFAULT_CHANNELS;
+	data.origin = UINT64_MAX;
+	data.fd = -1;
+	if ((prog = strrchr(argv[0], '/')) != NULL)
+		prog++;
+	else
+		prog = argv[0];
+
+	snprintf(group, sizeof(group), "%s-%zd", prog, (size_t) getpid());
+	data.group = group;
+
+	data.props = pw_properties_new(NULL, NULL);
+	if (data.props == NULL) {
+		fprintf(stderr, "can't create properties: %m\n");
+		goto exit;
+	}
+
+	while ((c = getopt_long(argc, argv, "hvr:g:P:i:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(prog, false);
+			return 0;
+		case OPT_VERSION:
+			printf("%s\n"
+				"Compiled with libpipewire %s\n"
+				"Linked with libpipewire %s\n",
+				argv[0],
+				pw_get_headers_version(),
+				pw_get_library_version());
+			return 0;
+		case 'v':
+			data.verbose = true;
+			break;
+		case 'r':
+			data.remote = optarg;
+			break;
+		case 'g':
+			data.group = optarg;
+			break;
+		case 'P':
+			pw_properties_update_string(data.props, optarg, strlen(optarg));
+			break;
+		case OPT_LATENCY:
+			data.latency = optarg;
+			break;
+		case OPT_RATE:
+			data.rate = atoi(optarg);
+			break;
+		case OPT_CHANNELS:
+			data.channels = atoi(optarg);
+			break;
+		case OPT_FORMAT:
+			format = optarg;
+			break;
+		case 'i':
+			data.interleave = optarg;
+			break;
+		default:
+			show_help(prog, true);
+			goto exit;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "no targets given\n");
+		show_help(prog, true);
+		goto exit;
+	}
+	if (argc - optind > MAX_STREAMS) {
+		fprintf(stderr, "too many targets, max %u\n", MAX_STREAMS);
+		goto exit;
+	}
+	if ((fi = format_info_by_name(format)) == NULL) {
+		fprintf(stderr, "unknown format \"%s\"\n", format);
+		goto exit;
+	}
+	if (data.rate == 0 || data.channels == 0 || data.channels > SPA_AUDIO_MAX_CHANNELS) {
+		fprintf(stderr, "invalid rate %u or channels %u\n", data.rate, data.channels);
+		goto exit;
+	}
+	data.format = fi->format;
+	data.stride = fi->width * data.channels;
+	data.ring_size = 1u << (32 - __builtin_clz(data.rate * data.stride * BUFFER_SEC - 1));
+	/* leave room for the process thread while a block is written */
+	data.ring_size = SPA_MAX(data.ring_size, MIN_RING_SIZE);
+
+	if ((data.zero = calloc(1, BLOCK_SIZE)) == NULL) {
+		fprintf(stderr, "can't allocate memory: %m\n");
+		goto exit;
+	}
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL) {
+		fprintf(stderr, "can't create main loop: %m\n");
+		goto exit;
+	}
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+
+	data.context = pw_context_new(l, NULL, 0);
+	if (data.context == NULL) {
+		fprintf(stderr, "can't create context: %m\n");
+		goto exit;
+	}
+
+	data.core = pw_context_connect(data.context,
+			pw_properties_new(
+				PW_KEY_REMOTE_NAME, data.remote,
+				NULL),
+			0);
+	if (data.core == NULL) {
+		fprintf(stderr, "can't connect: %m\n");
+		goto exit;
+	}
+	pw_core_add_listener(data.core, &data.core_listener, &core_events, &data);
+
+	if (data.interleave) {
+		uint32_t n_streams = argc - optind;
+
+		data.block_frames = SPA_MAX(BLOCK_SIZE / (data.stride * n_streams), 1u);
+		data.block = malloc(data.block_frames * data.stride * n_streams);
+		data.scratch = malloc(data.block_frames * data.stride);
+		if (data.block == NULL || data.scratch == NULL) {
+			fprintf(stderr, "can't allocate memory: %m\n");
+			goto exit;
+		}
+		if ((data.fd = open_file(&data, data.interleave,
+					data.channels * n_streams)) < 0) {
+			errno = -data.fd;
+			fprintf(stderr, "can't open file \"%s\": %m\n", data.interleave);
+			goto exit;
+		}
+	}
+
+	for (i = optind; i < (uint32_t)argc; i++) {
+		struct stream *s = stream_new(&data, argv[i]);
+		if (s == NULL)
+			goto exit;
+		data.streams[data.n_streams++] = s;
+	}
+
+	if ((res = start_writer(&data)) < 0) {
+		fprintf(stderr, "can't start writer thread: %s\n", spa_strerror(res));
+		goto exit;
+	}
+
+	pw_main_loop_run(data.loop);
+
+	for (i = 0; i < data.n_streams; i++)
+		stream_destroy(data.streams[i]);
+
+	stop_writer(&data);
+	write_streams(&data, true);
+
+	if (data.error < 0)
+		fprintf(stderr, "error writing: %s\n", spa_strerror(data.error));
+	else
+		exit_code = EXIT_SUCCESS;
+
+exit:
+	for (i = 0; i < data.n_streams; i++) {
+		stream_destroy(data.streams[i]);
+		stream_free(data.streams[i]);
+	}
+	if (data.fd >= 0 &&
+	    (res = close_file(&data, data.fd, data.interleave,
+			data.channels * data.n_streams, data.written)) < 0) {
+		fprintf(stderr, "error writing \"%s\": %s\n", data.interleave, spa_strerror(res));
+		exit_code = EXIT_FAILURE;
+	}
+	if (data.core)
+		pw_core_disconnect(data.core);
+	if (data.context)
+		pw_context_destroy(data.context);
+	if (data.loop)
+		pw_main_loop_destroy(data.loop);
+	pw_properties_free(data.props);
+	free(data.block);
+	free(data.scratch);
+	free(data.zero);
+	pw_deinit();
+
+	return exit_code;
+}
@@ -23,21 +23,29 @@
  */
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <signal.h>
 #include <getopt.h>
 #include <locale.h>
 
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
+#include <spa/utils/json.h>
 #include <spa/pod/parser.h>
+#include <spa/param/profiler-utils.h>
 #include <spa/debug/types.h>
 
 #include <pipewire/impl.h>
+#include <pipewire/private.h>
 #include <pipewire/extensions/profiler.h>
 
 #define MAX_NAME		128
 #define MAX_FOLLOWERS		64
 #define DEFAULT_FILENAME	"profiler.log"
+#define DEFAULT_TRACE_FILENAME	"profiler.json"
+
+#define FORMAT_GNUPLOT		0
+#define FORMAT_TRACE		1
 
 struct follower {
 	uint32_t id;
@@ -56,6 +64,7 @@ struct data {
 
 	const char *filename;
 	FILE *output;
+	uint32_t format;
 
 	int64_t count;
 	int64_t start_status;
@@ -69,6 +78,15 @@ struct data {
 
 	int n_followers;
 	struct follower followers[MAX_FOLLOWERS];
+
+	struct pw_array tracks;
+	uint64_t n_events;
+	uint64_t flow_id;
+};
+
+struct track {
+	uint32_t driver_id;
+	uint32_t id;
 };
 
 struct measurement {
@@ -90,44 +108,50 @@ struct point {
 
 static int process_info(struct data *d, const struct spa_pod *pod, struct point *point)
 {
-	return spa_pod_parse_struct(pod,
-			SPA_POD_Long(&point->count),
-			SPA_POD_Float(&point->cpu_load[0]),
-			SPA_POD_Float(&point->cpu_load[1]),
-			SPA_POD_Float(&point->cpu_load[2]));
+	struct spa_profiler_info info;
+	int res;
+
+	if ((res = spa_profiler_info_parse(pod, &info)) < 0)
+		return res;
+
+	point->count = info.counter;
+	memcpy(point->cpu_load, info.cpu_load, sizeof(point->cpu_load));
+	return 0;
 }
 
 static int process_clock(struct data *d, const struct spa_pod *pod, struct point *point)
 {
-	return spa_pod_parse_struct(pod,
-			SPA_POD_Int(&point->clock.flags),
-			SPA_POD_Int(&point->clock.id),
-			SPA_POD_Stringn(point->clock.name, sizeof(point->clock.name)),
-			SPA_POD_Long(&point->clock.nsec),
-			SPA_POD_Fraction(&point->clock.rate),
-			SPA_POD_Long(&point->clock.position),
-			SPA_POD_Long(&point->clock.duration),
-			SPA_POD_Long(&point->clock.delay),
-			SPA_POD_Double(&point->clock.rate_diff),
-			SPA_POD_Long(&point->clock.next_nsec));
+	return spa_profiler_clock_parse(pod, &point->clock);
+}
+
+static int parse_block(const struct spa_pod *pod, uint32_t *id, const char **name,
+		struct measurement *m)
+{
+	struct spa_profiler_block b;
+	int res;
+
+	if ((res = spa_profiler_block_parse(pod, &b)) < 0)
+		return res;
+
+	spa_zero(*m);
+	*id = b.id;
+	*name = b.name;
+	m->prev_signal = b.prev_signal;
+	m->signal = b.signal;
+	m->awake = b.awake;
+	m->finish = b.finish;
+	m->status = b.status;
+	return 0;
 }
 
 static int process_driver_block(struct data *d, const struct spa_pod *pod, struct point *point)
 {
-	char *name = NULL;
+	const char *name = NULL;
 	uint32_t driver_id = 0;
 	struct measurement driver;
 	int res;
 
-	spa_zero(driver);
-	if ((res = spa_pod_parse_struct(pod,
-			SPA_POD_Int(&driver_id),
-			SPA_POD_String(&name),
-			SPA_POD_Long(&driver.prev_signal),
-			SPA_POD_Long(&driver.signal),
-			SPA_POD_Long(&driver.awake),
-			SPA_POD_Long(&driver.finish),
-			SPA_POD_Int(&driver.status))) < 0)
+	if ((res = parse_block(pod, &driver_id, &name, &driver)) < 0)
 		return res;
 
 	if (d->driver_id == 0) {
@@ -175,15 +199,7 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 	struct measurement m;
 	int res, idx;
 
-	spa_zero(m);
-	if ((res = spa_pod_parse_struct(pod,
-			SPA_POD_Int(&id),
-			SPA_POD_String(&name),
-			SPA_POD_Long(&m.prev_signal),
-			SPA_POD_Long(&m.signal),
-			SPA_POD_Long(&m.awake),
-			SPA_POD_Long(&m.finish),
-			SPA_POD_Int(&m.status))) < 0)
+	if ((res = parse_block(pod, &id, &name, &m)) < 0)
 		return res;
 
 	if ((idx = find_follower(d, id, name)) < 0) {
@@ -424,6 +440,225 @@ static void dump_scripts(struct data *d)
 	printf("run 'sh generate_timings.sh' and load Timings.html in a browser\n");
 }
 
+/* Chrome trace event format, see
+ * https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ * The driver is a process with a thread for each node, the events are
+ * streamed to the file as a JSON array. */
+#define TS_FMT		"%"PRIu64".%03"PRIu64
+#define TS_ARGS(ns)	(uint64_t)(ns) / 1000, (uint64_t)(ns) % 1000
+
+struct trace_node {
+	uint32_t id;
+	const char *name;
+	struct measurement m;
+};
+
+struct trace_cycle {
+	struct trace_node driver;
+	uint32_t n_followers;
+	struct trace_node followers[MAX_FOLLOWERS];
+};
+
+static SPA_PRINTF_FUNC(2,3) void trace_event(struct data *d, const char *fmt, ...)
+{
+	va_list args;
+
+	fputs(d->n_events++ == 0 ? "[\n" : ",\n", d->output);
+	va_start(args, fmt);
+	vfprintf(d->output, fmt, args);
+	va_end(args);
+}
+
+static void trace_track(struct data *d, uint32_t driver_id, const struct trace_node *n)
+{
+	struct track *t;
+	char name[MAX_NAME * 6 + 3];
+
+	pw_array_for_each(t, &d->tracks) {
+		if (t->driver_id == driver_id && t->id == n->id)
+			return;
+	}
+	if ((t = pw_array_add(&d->tracks, sizeof(*t))) == NULL)
+		return;
+	t->driver_id = driver_id;
+	t->id = n->id;
+
+	spa_json_encode_string(name, sizeof(name), n->name ? n->name : "");
+	if (driver_id == n->id) {
+		printf("tracing driver %u (%s)\n", n->id, name);
+		trace_event(d, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,"
+				"\"args\":{\"name\":%s}}", driver_id, name);
+	}
+	trace_event(d, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+			"\"args\":{\"name\":%s}}", driver_id, n->id, name);
+	trace_event(d, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,"
+			"\"args\":{\"sort_index\":%u}}", driver_id, n->id,
+			driver_id == n->id ? 0 : n->id);
+}
+
+static void trace_flow(struct data *d, const struct trace_cycle *c, const struct trace_node *n)
+{
+	const struct trace_node *src;
+	int64_t ts;
+	uint32_t i;
+
+	/* a node is triggered when the last of its peers finishes, take the
+	 * node that finished last before the signal, or the driver when the
+	 * node was triggered at the start of the cycle */
+	src = &c->driver;
+	ts = c->driver.m.signal;
+	for (i = 0; i < c->n_followers; i++) {
+		const struct trace_node *f = &c->followers[i];
+		if (f != n && f->m.status == PW_NODE_ACTIVATION_FINISHED &&
+		    f->m.finish > f->m.awake && f->m.awake >= f->m.signal &&
+		    f->m.finish <= n->m.signal && f->m.finish > ts) {
+			src = f;
+			ts = f->m.finish;
+		}
+	}
+	/* inside the slice of the peer */
+	if (src != &c->driver)
+		ts--;
+
+	d->flow_id++;
+	trace_event(d, "{\"name\":\"trigger\",\"cat\":\"graph\",\"ph\":\"s\",\"id\":%"PRIu64","
+			"\"ts\":"TS_FMT",\"pid\":%u,\"tid\":%u}",
+			d->flow_id, TS_ARGS(ts), c->driver.id, src->id);
+	trace_event(d, "{\"name\":\"trigger\",\"cat\":\"graph\",\"ph\":\"f\",\"bp\":\"e\",\"id\":%"PRIu64","
+			"\"ts\":"TS_FMT",\"pid\":%u,\"tid\":%u}",
+			d->flow_id, TS_ARGS(n->m.awake), c->driver.id, n->id);
+}
+
+static void trace_point(struct data *d, struct point *point, struct trace_cycle *c)
+{
+	const struct trace_node *dr = &c->driver;
+	char load[3][64];
+	uint32_t i;
+
+	trace_track(d, dr->id, dr);
+
+	trace_event(d, "{\"name\":\"cycle\",\"ph\":\"i\",\"s\":\"p\",\"ts\":"TS_FMT","
+			"\"pid\":%u,\"tid\":%u,\"args\":{\"cycle\":%"PRIi64",\"position\":%"PRIu64","
+			"\"duration\":%"PRIu64",\"rate\":%u,\"delay\":%"PRIi64"}}",
+			TS_ARGS(dr->m.signal), dr->id, dr->id, point->count,
+			point->clock.position, point->clock.duration,
+			point->clock.rate.denom, point->clock.delay);
+
+	if (dr->m.finish > dr->m.signal)
+		trace_event(d, "{\"name\":\"graph\",\"ph\":\"X\",\"ts\":"TS_FMT",\"dur\":"TS_FMT","
+				"\"pid\":%u,\"tid\":%u,\"args\":{\"status\":%d}}",
+				TS_ARGS(dr->m.signal), TS_ARGS(dr->m.finish - dr->m.signal),
+				dr->id, dr->id, dr->m.status);
+
+	for (i = 0; i < 3; i++)
+		spa_json_format_float(load[i], sizeof(load[i]), point->cpu_load[i]);
+	trace_event(d, "{\"name\":\"cpu load\",\"ph\":\"C\",\"ts\":"TS_FMT",\"pid\":%u,"
+			"\"args\":{\"fast\":%s,\"medium\":%s,\"slow\":%s}}",
+			TS_ARGS(dr->m.signal), dr->id, load[0], load[1], load[2]);
+
+	for (i = 0; i < c->n_followers; i++) {
+		const struct trace_node *n = &c->followers[i];
+		int64_t end;
+
+		trace_track(d, dr->id, n);
+
+		if (n->m.signal < dr->m.signal || n->m.awake < n->m.signal) {
+			/* not triggered or not woken up in this cycle */
+			if (n->m.status != PW_NODE_ACTIVATION_FINISHED)
+				trace_event(d, "{\"name\":\"xrun\",\"ph\":\"i\",\"s\":\"t\","
+						"\"ts\":"TS_FMT",\"pid\":%u,\"tid\":%u,"
+						"\"args\":{\"status\":%d}}",
+						TS_ARGS(dr->m.finish), dr->id, n->id, n->m.status);
+			continue;
+		}
+		end = n->m.finish >= n->m.awake ? n->m.finish : dr->m.finish;
+
+		trace_event(d, "{\"name\":\"process\",\"ph\":\"X\",\"ts\":"TS_FMT",\"dur\":"TS_FMT","
+				"\"pid\":%u,\"tid\":%u,\"args\":{\"status\":%d,\"wakeup\":"TS_FMT"}}",
+				TS_ARGS(n->m.awake), TS_ARGS(SPA_MAX(end, n->m.awake) - n->m.awake),
+				dr->id, n->id, n->m.status, TS_ARGS(n->m.awake - n->m.signal));
+
+		if (n->m.status != PW_NODE_ACTIVATION_FINISHED)
+			trace_event(d, "{\"name\":\"xrun\",\"ph\":\"i\",\"s\":\"t\","
+					"\"ts\":"TS_FMT",\"pid\":%u,\"tid\":%u,"
+					"\"args\":{\"status\":%d}}",
+					TS_ARGS(end), dr->id, n->id, n->m.status);
+
+		trace_flow(d, c, n);
+	}
+
+	if (d->count == 0) {
+		d->start_status = point->clock.nsec;
+		d->last_status = point->clock.nsec;
+	}
+	else if (point->clock.nsec - d->last_status > SPA_NSEC_PER_SEC) {
+		printf("tracing %"PRIi64" cycles  %"PRIi64" seconds  %"PRIu64" events\r",
+				d->count, (int64_t) ((d->last_status - d->start_status) / SPA_NSEC_PER_SEC),
+				d->n_events);
+		fflush(stdout);
+		d->last_status = point->clock.nsec;
+	}
+	d->count++;
+}
+
+static int trace_node_block(const struct spa_pod *pod, struct trace_node *n)
+{
+	spa_zero(*n);
+	return spa_pod_parse_struct(pod,
+			SPA_POD_Int(&n->id),
+			SPA_POD_String(&n->name),
+			SPA_POD_Long(&n->m.prev_signal),
+			SPA_POD_Long(&n->m.signal),
+			SPA_POD_Long(&n->m.awake),
+			SPA_POD_Long(&n->m.finish),
+			SPA_POD_Int(&n->m.status));
+}
+
+static void trace_profile(struct data *d, const struct spa_pod *pod)
+{
+	struct spa_pod *o;
+	struct spa_pod_prop *p;
+	struct point point;
+	struct trace_cycle cycle;
+
+	SPA_POD_STRUCT_FOREACH(pod, o) {
+		int res = 0;
+		bool have_driver = false;
+		if (!spa_pod_is_object_type(o, SPA_TYPE_OBJECT_Profiler))
+			continue;
+
+		spa_zero(point);
+		cycle.n_followers = 0;
+		SPA_POD_OBJECT_FOREACH((struct spa_pod_object*)o, p) {
+			switch(p->key) {
+			case SPA_PROFILER_info:
+				res = process_info(d, &p->value, &point);
+				break;
+			case SPA_PROFILER_clock:
+				res = process_clock(d, &p->value, &point);
+				break;
+			case SPA_PROFILER_driverBlock:
+				res = trace_node_block(&p->value, &cycle.driver);
+				have_driver = true;
+				break;
+			case SPA_PROFILER_followerBlock:
+				if (cycle.n_followers < MAX_FOLLOWERS &&
+				    trace_node_block(&p->value, &cycle.followers[cycle.n_followers]) >= 0)
+					cycle.n_followers++;
+				break;
+			default:
+				break;
+			}
+			if (res < 0)
+				break;
+		}
+		if (res < 0 || !have_driver)
+			continue;
+
+		trace_point(d, &point, &cycle);
+	}
+}
+
 static void profiler_profile(void *data, const struct spa_pod *pod)
 {
         struct data *d = data;
@@ -431,8 +666,14 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 	struct spa_pod_prop *p;
 	struct point point;
 
+	if (d->format == FORMAT_TRACE) {
+		trace_profile(d, pod);
+		return;
+	}
+
 	SPA_POD_STRUCT_FOREACH(pod, o) {
 		int res = 0;
+		bool have_driver = false;
 		if (!spa_pod_is_object_type(o, SPA_TYPE_OBJECT_Profiler))
 			continue;
 
@@ -447,6 +688,7 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 				break;
 			case SPA_PROFILER_driverBlock:
 				res = process_driver_block(d, &p->value, &point);
+				have_driver = true;
 				break;
 			case SPA_PROFILER_followerBlock:
 				process_follower_block(d, &p->value, &point);
@@ -457,7 +699,8 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 			if (res < 0)
 				break;
 		}
-		if (res < 0)
+		/* skip the objects with only the node histograms */
+		if (res < 0 || !have_driver)
 			continue;
 
 		dump_point(d, &point);
@@ -546,9 +789,12 @@ static void show_help(const char *name, bool error)
 		"  -h, --help                            Show this help\n"
 		"      --version                         Show version\n"
 		"  -r, --remote                          Remote daemon name\n"
-		"  -o, --output                          Profiler output name (default \"%s\")\n",
+		"  -o, --output                          Profiler output name (default \"%s\",\n"
+		"                                          \"%s\" for trace)\n"
+		"  -f, --format                          Output format, gnuplot or trace\n"
+		"                                          (default gnuplot)\n",
 		name,
-		DEFAULT_FILENAME);
+		DEFAULT_FILENAME, DEFAULT_TRACE_FILENAME);
 }
 
 int main(int argc, char *argv[])
@@ -556,12 +802,13 @@ int main(int argc, char *argv[])
 	struct data data = { 0 };
 	struct pw_loop *l;
 	const char *opt_remote = NULL;
-	const char *opt_output = DEFAULT_FILENAME;
+	const char *opt_output = NULL;
 	static const struct option long_options[] = {
 		{ "help",	no_argument,		NULL, 'h' },
 		{ "version",	no_argument,		NULL, 'V' },
 		{ "remote",	required_argument,	NULL, 'r' },
 		{ "output",	required_argument,	NULL, 'o' },
+		{ "format",	required_argument,	NULL, 'f' },
 		{ NULL, 0, NULL, 0}
 	};
 	int c;
@@ -569,7 +816,7 @@ int main(int argc, char *argv[])
 	setlocale(LC_ALL, "");
 	pw_init(&argc, &argv);
 
-	while ((c = getopt_long(argc, argv, "hVr:o:", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hVr:o:f:", long_options, NULL)) != -1) {
 		switch (c) {
 		case 'h':
 			show_help(argv[0], false);
@@ -588,6 +835,17 @@ int main(int argc, char *argv[])
 		case 'r':
 			opt_remote = optarg;
 			break;
+		case 'f':
+			if (spa_streq(optarg, "gnuplot"))
+				data.format = FORMAT_GNUPLOT;
+			else if (spa_streq(optarg, "trace"))
+				data.format = FORMAT_TRACE;
+			else {
+				fprintf(stderr, "unknown format '%s'\n", optarg);
+				show_help(argv[0], true);
+				return -1;
+			}
+			break;
 		default:
 			show_help(argv[0], true);
 			return -1;
@@ -622,7 +880,11 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	if (opt_output == NULL)
+		opt_output = data.format == FORMAT_TRACE ?
+			DEFAULT_TRACE_FILENAME : DEFAULT_FILENAME;
 	data.filename = opt_output;
+	pw_array_init(&data.tracks, 64 * sizeof(struct track));
 
 	data.output = fopen(data.filename, "we");
 	if (data.output == NULL) {
@@ -655,9 +917,16 @@ int main(int argc, char *argv[])
 	pw_context_destroy(data.context);
 	pw_main_loop_destroy(data.loop);
 
+	if (data.format == FORMAT_TRACE) {
+		fputs(data.n_events == 0 ? "[\n]\n" : "\n]\n", data.output);
+		printf("\nwrote %"PRIu64" events, load %s in a trace viewer such as "
+				"https://ui.perfetto.dev\n", data.n_events, data.filename);
+	}
 	fclose(data.output);
+	pw_array_clear(&data.tracks);
 
-	dump_scripts(&data);
+	if (data.format == FORMAT_GNUPLOT)
+		dump_scripts(&data);
 
 	pw_deinit();
 
@@ -33,6 +33,7 @@
 #include <spa/pod/parser.h>
 #include <spa/debug/types.h>
 #include <spa/param/format-utils.h>
+#include <spa/param/profiler-utils.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/param/video/format-utils.h>
 
@@ -60,6 +61,13 @@ struct measurement {
 	struct spa_fraction latency;
 };
 
+enum {
+	HISTOGRAM_WAKEUP,
+	HISTOGRAM_PROCESS,
+	HISTOGRAM_CYCLE,
+	N_HISTOGRAMS,
+};
+
 struct node {
 	struct spa_list link;
 	struct data *data;
@@ -72,6 +80,8 @@ struct node {
 	uint32_t errors;
 	int32_t last_error_status;
 	uint32_t generation;
+	uint64_t p99[N_HISTOGRAMS];
+	uint64_t p999[N_HISTOGRAMS];
 	char format[MAX_FORMAT+1];
 	struct pw_proxy *proxy;
 	struct spa_hook proxy_listener;
@@ -99,6 +109,7 @@ struct data {
 	struct spa_list node_list;
 	uint32_t generation;
 	unsigned pending_refresh:1;
+	unsigned latency_view:1;
 
 	WINDOW *win;
 };
@@ -110,27 +121,21 @@ struct point {
 
 static int process_info(struct data *d, const struct spa_pod *pod, struct driver *info)
 {
-	return spa_pod_parse_struct(pod,
-			SPA_POD_Long(&info->count),
-			SPA_POD_Float(&info->cpu_load[0]),
-			SPA_POD_Float(&info->cpu_load[1]),
-			SPA_POD_Float(&info->cpu_load[2]),
-			SPA_POD_Int(&info->xrun_count));
+	struct spa_profiler_info i;
+	int res;
+
+	if ((res = spa_profiler_info_parse(pod, &i)) < 0)
+		return res;
+
+	info->count = i.counter;
+	memcpy(info->cpu_load, i.cpu_load, sizeof(info->cpu_load));
+	info->xrun_count = i.xrun_count;
+	return 0;
 }
 
 static int process_clock(struct data *d, const struct spa_pod *pod, struct driver *info)
 {
-	return spa_pod_parse_struct(pod,
-			SPA_POD_Int(&info->clock.flags),
-			SPA_POD_Int(&info->clock.id),
-			SPA_POD_Stringn(info->clock.name, sizeof(info->clock.name)),
-			SPA_POD_Long(&info->clock.nsec),
-			SPA_POD_Fraction(&info->clock.rate),
-			SPA_POD_Long(&info->clock.position),
-			SPA_POD_Long(&info->clock.duration),
-			SPA_POD_Long(&info->clock.delay),
-			SPA_POD_Double(&info->clock.rate_diff),
-			SPA_POD_Long(&info->clock.next_nsec));
+	return spa_profiler_clock_parse(pod, &info->clock);
 }
 
 static struct node *find_node(struct data *d, uint32_t id)
@@ -329,24 +334,33 @@ static void remove_node(struct data *d, struct node *n)
 	free(n);
 }
 
+static int parse_block(const struct spa_pod *pod, uint32_t *id, struct measurement *m)
+{
+	struct spa_profiler_block b;
+	int res;
+
+	if ((res = spa_profiler_block_parse(pod, &b)) < 0)
+		return res;
+
+	spa_zero(*m);
+	*id = b.id;
+	m->prev_signal = b.prev_signal;
+	m->signal = b.signal;
+	m->awake = b.awake;
+	m->finish = b.finish;
+	m->status = b.status;
+	m->latency = b.latency;
+	return 0;
+}
+
 static int process_driver_block(struct data *d, const struct spa_pod *pod, struct point *point)
 {
-	char *name = NULL;
 	uint32_t id = 0;
 	struct measurement m;
 	struct node *n;
 	int res;
 
-	spa_zero(m);
-	if ((res = spa_pod_parse_struct(pod,
-			SPA_POD_Int(&id),
-			SPA_POD_String(&name),
-			SPA_POD_Long(&m.prev_signal),
-			SPA_POD_Long(&m.signal),
-			SPA_POD_Long(&m.awake),
-			SPA_POD_Long(&m.finish),
-			SPA_POD_Int(&m.status),
-			SPA_POD_Fraction(&m.latency))) < 0)
+	if ((res = parse_block(pod, &id, &m)) < 0)
 		return res;
 
 	if ((n = find_node(d, id)) == NULL)
@@ -369,21 +383,11 @@ static int process_driver_block(struct data *d, const struct spa_pod *pod, struc
 static int process_follower_block(struct data *d, const struct spa_pod *pod, struct point *point)
 {
 	uint32_t id = 0;
-	const char *name =  NULL;
 	struct measurement m;
 	struct node *n;
 	int res;
 
-	spa_zero(m);
-	if ((res = spa_pod_parse_struct(pod,
-			SPA_POD_Int(&id),
-			SPA_POD_String(&name),
-			SPA_POD_Long(&m.prev_signal),
-			SPA_POD_Long(&m.signal),
-			SPA_POD_Long(&m.awake),
-			SPA_POD_Long(&m.finish),
-			SPA_POD_Int(&m.status),
-			SPA_POD_Fraction(&m.latency))) < 0)
+	if ((res = parse_block(pod, &id, &m)) < 0)
 		return res;
 
 	if ((n = find_node(d, id)) == NULL)
@@ -403,6 +407,47 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 	return 0;
 }
 
+static int process_node_histogram(struct data *d, const struct spa_pod *pod)
+{
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	uint32_t i, id, min_shift, sub_shift;
+	struct node *n;
+	int res;
+
+	spa_pod_parser_pod(&prs, pod);
+	if ((res = spa_pod_parser_push_struct(&prs, &f)) < 0 ||
+	    (res = spa_pod_parser_get(&prs,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&min_shift),
+			SPA_POD_Int(&sub_shift),
+			NULL)) < 0)
+		return res;
+
+	if ((n = find_node(d, id)) == NULL)
+		return -ENOENT;
+
+	for (i = 0; i < N_HISTOGRAMS; i++) {
+		uint32_t csize, ctype, n_buckets;
+		int64_t max;
+		uint64_t *buckets;
+
+		if ((res = spa_pod_parser_get(&prs,
+				SPA_POD_Long(&max),
+				SPA_POD_Array(&csize, &ctype, &n_buckets, &buckets),
+				NULL)) < 0)
+			return res;
+		if (csize != sizeof(int64_t) || ctype != SPA_TYPE_Long)
+			return -EINVAL;
+
+		n->p99[i] = pw_profiler_histogram_percentile(buckets, n_buckets,
+				min_shift, sub_shift, max, 99.0);
+		n->p999[i] = pw_profiler_histogram_percentile(buckets, n_buckets,
+				min_shift, sub_shift, max, 99.9);
+	}
+	return 0;
+}
+
 static const char *print_time(char *buf, bool active, size_t len, uint64_t val)
 {
 	if (val == (uint64_t)-1 || !active)
@@ -501,6 +546,37 @@ static void print_node(struct data *d, struct driver *i, struct node *n, int y)
 			n->name);
 }
 
+static void print_node_latency(struct data *d, struct driver *i, struct node *n, int y)
+{
+	char buf[2 * N_HISTOGRAMS][64];
+	struct spa_fraction frac;
+	bool active;
+	uint32_t j;
+
+	active = n->state == PW_NODE_STATE_RUNNING || n->state == PW_NODE_STATE_IDLE;
+
+	if (!active)
+		frac = SPA_FRACTION(0, 0);
+	else if (n->driver == n)
+		frac = SPA_FRACTION((uint32_t)(i->clock.duration * i->clock.rate.num), i->clock.rate.denom);
+	else
+		frac = SPA_FRACTION(n->measurement.latency.num, n->measurement.latency.denom);
+
+	for (j = 0; j < N_HISTOGRAMS; j++) {
+		print_time(buf[2*j], true, 64, n->p99[j] ? n->p99[j] : (uint64_t)-1);
+		print_time(buf[2*j+1], true, 64, n->p999[j] ? n->p999[j] : (uint64_t)-1);
+	}
+
+	mvwprintw(d->win, y, 0, "%s %4.1u %6.1u %6.1u %s %s %s %s %s %s  %3.1u %s%s",
+			state_as_string(n->state),
+			n->id,
+			frac.num, frac.denom,
+			buf[0], buf[1], buf[2], buf[3], buf[4], buf[5],
+			i->xrun_count + n->errors,
+			n->driver == n ? "" : " + ",
+			n->name);
+}
+
 static void clear_node(struct node *n)
 {
 	n->driver = n;
@@ -517,7 +593,10 @@ static void do_refresh(struct data *d)
 
 	wclear(d->win);
 	wattron(d->win, A_REVERSE);
-	wprintw(d->win, "%-*.*s", COLS, COLS, "S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q  ERR FORMAT           NAME ");
+	if (d->latency_view)
+		wprintw(d->win, "%-*.*s", COLS, COLS, "S   ID  QUANT   RATE   W-P99 W-P99.9   B-P99 B-P99.9   C-P99 C-P99.9  ERR NAME ");
+	else
+		wprintw(d->win, "%-*.*s", COLS, COLS, "S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q  ERR FORMAT           NAME ");
 	wattroff(d->win, A_REVERSE);
 	wprintw(d->win, "\n");
 
@@ -525,7 +604,10 @@ static void do_refresh(struct data *d)
 		if (n->driver != n)
 			continue;
 
-		print_node(d, &n->info, n, y++);
+		if (d->latency_view)
+			print_node_latency(d, &n->info, n, y++);
+		else
+			print_node(d, &n->info, n, y++);
 		if(y > LINES)
 			break;
 
@@ -536,7 +618,10 @@ static void do_refresh(struct data *d)
 			if (f->driver != n || f == n)
 				continue;
 
-			print_node(d, &n->info, f, y++);
+			if (d->latency_view)
+				print_node_latency(d, &n->info, f, y++);
+			else
+				print_node(d, &n->info, f, y++);
 			if(y > LINES)
 				break;
 
@@ -585,6 +670,9 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 			case SPA_PROFILER_followerBlock:
 				process_follower_block(d, &p->value, &point);
 				break;
+			case SPA_PROFILER_nodeHistogram:
+				process_node_histogram(d, &p->value);
+				break;
 			default:
 				break;
 			}
@@ -738,6 +826,10 @@ static void do_handle_io(void *data, int fd, uint32_t mask)
 		case 'q':
 			pw_main_loop_quit(d->loop);
 			break;
+		case 'l':
+			d->latency_view = !d->latency_view;
+			do_refresh(d);
+			break;
 		default:
 			do_refresh(d);
 			break;
@@ -93,10 +93,82 @@ PWTEST(config_load_nullname)
 	return PWTEST_PASS;
 }
 
+struct rule_result {
+	char actions[256];
+	int count;
+};
+
+static int rule_matched(void *data, const char *location, const char *action,
+		const char *str, size_t len)
+{
+	struct rule_result *r = data;
+	size_t l = strlen(r->actions);
+
+	snprintf(r->actions + l, sizeof(r->actions) - l, "%s%s=%.*s",
+			l ? " " : "", action, (int)len, str);
+	r->count++;
+	return 0;
+}
+
+static struct rule_result match_rules(const char *rules, const struct spa_dict *props)
+{
+	struct rule_result r = { 0 };
+	int res;
+
+	res = pw_conf_match_rules(rules, strlen(rules), NULL, props, rule_matched, &r);
+	pwtest_neg_errno_ok(res);
+	return r;
+}
+
+PWTEST(config_match_rules)
+{
+	static const char rules[] =
+		"[ { matches = [ { media.class = \"Audio/Sink\" node.name = \"~alsa_output.*\" } ]"
+		"    actions = { update-props = { a = 1 } } }"
+		"  { matches = [ { media.class = null } { node.name = \"exact\" } ]"
+		"    actions = { b = 2 c = \"x\" } }"
+		"  { matches = [ { } ] actions = { d = 3 } }"
+		"  { matches = [ { node.name = \"~(\" } ] actions = { e = 4 } }"
+		"  { matches = [ { node.name = \"~.*\" } ] } ]";
+	struct rule_result r;
+
+	r = match_rules(rules, &SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+			{ "media.class", "Audio/Sink" },
+			{ "node.name", "alsa_output.pci" } })));
+	pwtest_int_eq(r.count, 1);
+	pwtest_str_eq(r.actions, "update-props={ a = 1 }");
+
+	r = match_rules(rules, &SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+			{ "media.class", "Audio/Source" },
+			{ "node.name", "alsa_output.pci" } })));
+	pwtest_int_eq(r.count, 0);
+
+	r = match_rules(rules, &SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+			{ "node.name", "alsa_input.pci" } })));
+	pwtest_int_eq(r.count, 2);
+	pwtest_str_eq(r.actions, "b=2 c=\"x\"");
+
+	r = match_rules(rules, &SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+			{ "media.class", "Video/Source" },
+			{ "node.name", "exact" } })));
+	pwtest_int_eq(r.count, 2);
+
+	r = match_rules(rules, &SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+			{ "media.class", "Video/Source" },
+			{ "node.name", "exactly" } })));
+	pwtest_int_eq(r.count, 0);
+
+	r = match_rules("{ }", &SPA_DICT_INIT(NULL, 0));
+	pwtest_int_eq(r.count, 0);
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(context)
 {
 	pwtest_add(config_load_abspath, PWTEST_NOARG);
 	pwtest_add(config_load_nullname, PWTEST_NOARG);
+	pwtest_add(config_match_rules, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
@@ -24,12 +24,21 @@
 
 #include "pwtest.h"
 
+#include <spa/utils/names.h>
 #include <spa/utils/string.h>
 #include <spa/support/dbus.h>
 #include <spa/support/cpu.h>
 
+#include <spa/param/audio/format.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/param.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/iter.h>
+
 #include <pipewire/pipewire.h>
 #include <pipewire/global.h>
+#include <pipewire/impl.h>
+#include <pipewire/extensions/metadata.h>
 
 #define TEST_FUNC(a,b,func)	\
 do {				\
@@ -232,6 +241,7 @@ PWTEST(context_support)
 		SPA_TYPE_INTERFACE_System,
 		SPA_TYPE_INTERFACE_Loop,
 		SPA_TYPE_INTERFACE_LoopUtils,
+		SPA_TYPE_INTERFACE_ThreadUtils,
 		SPA_TYPE_INTERFACE_Log,
 #ifdef HAVE_DBUS
 		SPA_TYPE_INTERFACE_DBus,
@@ -266,12 +276,498 @@ PWTEST(context_support)
 	return PWTEST_PASS;
 }
 
+struct rate_data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+	struct pw_proxy *node;
+	struct spa_hook node_listener;
+	struct pw_proxy *metadata;
+	struct pw_proxy *port;
+	struct spa_hook port_listener;
+	uint32_t node_id;
+	uint32_t rate;
+	uint32_t n_enum;
+};
+
+static void rate_node_bound(void *data, uint32_t global_id)
+{
+	struct rate_data *d = data;
+	d->node_id = global_id;
+}
+
+static const struct pw_proxy_events rate_node_events = {
+	PW_VERSION_PROXY_EVENTS,
+	.bound = rate_node_bound,
+};
+
+static void rate_port_param(void *data, int seq, uint32_t id,
+		uint32_t index, uint32_t next, const struct spa_pod *param)
+{
+	struct rate_data *d = data;
+	const struct spa_pod_prop *prop;
+	uint32_t n_vals, choice;
+	struct spa_pod *val;
+	int32_t rate = 0;
+
+	if (id != SPA_PARAM_EnumFormat ||
+	    (prop = spa_pod_find_prop(param, NULL, SPA_FORMAT_AUDIO_rate)) == NULL)
+		return;
+
+	/* the default rate of the EnumFormat follows the graph rate */
+	val = spa_pod_get_values(&prop->value, &n_vals, &choice);
+	pwtest_neg_errno_ok(spa_pod_get_int(val, &rate));
+	d->rate = rate;
+}
+
+static const struct pw_port_events rate_port_events = {
+	PW_VERSION_PORT_EVENTS,
+	.param = rate_port_param,
+};
+
+static void rate_registry_global(void *data, uint32_t id,
+		uint32_t permissions, const char *type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct rate_data *d = data;
+	const char *str;
+
+	if (spa_streq(type, PW_TYPE_INTERFACE_Metadata) && d->metadata == NULL &&
+	    spa_streq(spa_dict_lookup(props, PW_KEY_METADATA_NAME), "settings")) {
+		d->metadata = pw_registry_bind(d->registry, id, type, PW_VERSION_METADATA, 0);
+		pwtest_ptr_notnull(d->metadata);
+	} else if (spa_streq(type, PW_TYPE_INTERFACE_Port) && d->port == NULL &&
+	    d->node_id != SPA_ID_INVALID &&
+	    (str = spa_dict_lookup(props, PW_KEY_NODE_ID)) != NULL &&
+	    (uint32_t)atoi(str) == d->node_id) {
+		d->port = pw_registry_bind(d->registry, id, type, PW_VERSION_PORT, 0);
+		pwtest_ptr_notnull(d->port);
+		pw_port_add_listener((struct pw_port *)d->port, &d->port_listener,
+				&rate_port_events, d);
+	}
+}
+
+static const struct pw_registry_events rate_registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = rate_registry_global,
+};
+
+static void rate_timeout(void *data, uint64_t expirations)
+{
+	struct rate_data *d = data;
+
+	if (d->port == NULL || d->metadata == NULL)
+		return;
+
+	if (d->rate == 48000)
+		/* the EnumFormat at this rate is cached now */
+		pw_metadata_set_property((struct pw_metadata *)d->metadata,
+				PW_ID_CORE, "clock.force-rate", "", "44100");
+	else if (d->rate == 44100)
+		pw_main_loop_quit(d->loop);
+
+	pwtest_int_lt(d->n_enum++, 500u);
+	pw_port_enum_params((struct pw_port *)d->port, 0,
+			SPA_PARAM_EnumFormat, 0, 0, NULL);
+}
+
+PWTEST(context_format_cache_rate)
+{
+	struct rate_data d = { .node_id = SPA_ID_INVALID };
+	struct pw_context *context;
+	struct pw_loop *loop;
+	struct spa_source *timer;
+	struct timespec value = { 0, 10 * SPA_NSEC_PER_MSEC }, interval = value;
+
+	pw_init(0, NULL);
+
+	d.loop = pw_main_loop_new(NULL);
+	loop = pw_main_loop_get_loop(d.loop);
+	context = pw_context_new(loop, NULL, 0);
+	pwtest_ptr_notnull(context);
+	d.core = pw_context_connect(context, NULL, 0);
+	pwtest_ptr_notnull(d.core);
+
+	/* the ports of a converter in convert mode have the graph rate
+	 * as the default rate in their EnumFormat */
+	d.node = pw_core_create_object(d.core,
+			"adapter",
+			PW_TYPE_INTERFACE_Node,
+			PW_VERSION_NODE,
+			&SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+				{ "factory.name", "support.null-audio-sink" },
+				{ PW_KEY_NODE_NAME, "rate-test-sink" },
+				{ PW_KEY_MEDIA_CLASS, "Audio/Sink" },
+				{ PW_KEY_NODE_ALWAYS_PROCESS, "true" },
+				{ "audio.position", "[ MONO ]" },
+				{ "adapter.auto-port-config", "{ mode = convert }" } })), 0);
+	pwtest_ptr_notnull(d.node);
+	pw_proxy_add_listener(d.node, &d.node_listener, &rate_node_events, &d);
+
+	d.registry = pw_core_get_registry(d.core, PW_VERSION_REGISTRY, 0);
+	pw_registry_add_listener(d.registry, &d.registry_listener,
+			&rate_registry_events, &d);
+
+	timer = pw_loop_add_timer(loop, rate_timeout, &d);
+	pw_loop_update_timer(loop, timer, &value, &interval, false);
+
+	pw_main_loop_run(d.loop);
+
+	pwtest_int_eq(d.rate, 44100u);
+
+	pw_metadata_set_property((struct pw_metadata *)d.metadata,
+			PW_ID_CORE, "clock.force-rate", "", NULL);
+
+	pw_loop_destroy_source(loop, timer);
+	spa_hook_remove(&d.port_listener);
+	pw_proxy_destroy(d.port);
+	pw_proxy_destroy(d.metadata);
+	spa_hook_remove(&d.registry_listener);
+	pw_proxy_destroy((struct pw_proxy *)d.registry);
+	spa_hook_remove(&d.node_listener);
+	pw_proxy_destroy(d.node);
+	pw_core_disconnect(d.core);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d.loop);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+struct dead_data {
+	struct pw_impl_port *port;
+	enum pw_direction direction;
+};
+
+static int find_port(void *data, struct pw_impl_port *port)
+{
+	struct dead_data *d = data;
+	if (pw_impl_port_get_direction(port) != d->direction)
+		return 0;
+	d->port = port;
+	return 1;
+}
+
+static struct pw_impl_port *get_port(struct pw_impl_node *node, enum pw_direction direction)
+{
+	struct dead_data d = { .direction = direction };
+	pw_impl_node_for_each_port(node, direction, find_port, &d);
+	return d.port;
+}
+
+static struct pw_impl_node *make_filter(struct pw_context *context, const char *name,
+		const char *pause_on_idle)
+{
+	struct pw_impl_factory *factory;
+	struct pw_impl_node *node;
+	struct spa_node *impl;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b;
+	struct spa_pod *format, *param;
+	struct spa_audio_info_raw info = {
+		.format = SPA_AUDIO_FORMAT_F32P,
+		.rate = 48000,
+		.channels = 1,
+		.position = { SPA_AUDIO_CHANNEL_MONO } };
+	enum spa_direction direction;
+
+	factory = pw_context_find_factory(context, "spa-node-factory");
+	pwtest_ptr_notnull(factory);
+
+	node = pw_impl_factory_create_object(factory, NULL,
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+			pw_properties_new(
+				"factory.name", SPA_NAME_AUDIO_CONVERT,
+				PW_KEY_NODE_NAME, name,
+				PW_KEY_NODE_WANT_DRIVER, "true",
+				PW_KEY_NODE_PAUSE_ON_IDLE, pause_on_idle,
+				NULL), 0);
+	pwtest_ptr_notnull(node);
+
+	/* a mono input and output port */
+	impl = pw_impl_node_get_implementation(node);
+	for (direction = SPA_DIRECTION_INPUT; direction <= SPA_DIRECTION_OUTPUT; direction++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		format = spa_format_audio_raw_build(&b, SPA_PARAM_Format, &info);
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamPortConfig, SPA_PARAM_PortConfig,
+			SPA_PARAM_PORT_CONFIG_direction, SPA_POD_Id(direction),
+			SPA_PARAM_PORT_CONFIG_mode,	 SPA_POD_Id(SPA_PARAM_PORT_CONFIG_MODE_dsp),
+			SPA_PARAM_PORT_CONFIG_format,	 SPA_POD_Pod(format));
+		pwtest_neg_errno_ok(spa_node_set_param(impl, SPA_PARAM_PortConfig, 0, param));
+	}
+	pwtest_ptr_notnull(get_port(node, PW_DIRECTION_INPUT));
+	pwtest_ptr_notnull(get_port(node, PW_DIRECTION_OUTPUT));
+	return node;
+}
+
+static struct pw_impl_link *make_link(struct pw_context *context,
+		struct pw_impl_node *output, struct pw_impl_node *input)
+{
+	struct pw_impl_port *output_port, *input_port;
+	struct pw_impl_link *link;
+
+	output_port = get_port(output, PW_DIRECTION_OUTPUT);
+	pwtest_ptr_notnull(output_port);
+	input_port = get_port(input, PW_DIRECTION_INPUT);
+	pwtest_ptr_notnull(input_port);
+
+	link = pw_context_create_link(context, output_port, input_port, NULL, NULL, 0);
+	pwtest_ptr_notnull(link);
+	pwtest_neg_errno_ok(pw_impl_link_register(link, NULL));
+	return link;
+}
+
+static void iterate(struct pw_main_loop *loop)
+{
+	int i;
+	for (i = 0; i < 20; i++)
+		pw_loop_iterate(pw_main_loop_get_loop(loop), 10);
+}
+
+static bool node_running(struct pw_impl_node *node)
+{
+	return pw_impl_node_get_info(node)->state == PW_NODE_STATE_RUNNING;
+}
+
+PWTEST(context_dead_nodes)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_impl_factory *factory;
+	struct pw_impl_node *sink, *live, *dead, *tail;
+	struct pw_impl_link *link;
+	int iteration = pwtest_get_iteration(current_test);
+	bool skip_dead = iteration & 1;
+	const char *pause_on_idle = iteration & 2 ? "true" : "false";
+
+	pw_init(0, NULL);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				"link.skip-dead-nodes", skip_dead ? "true" : "false",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+
+	pw_context_add_spa_lib(context, "audio.convert.*", "audioconvert/libspa-audioconvert");
+	pw_context_add_spa_lib(context, "support.*", "support/libspa-support");
+	pwtest_ptr_notnull(pw_context_load_module(context, "libpipewire-module-adapter", NULL, NULL));
+	pwtest_ptr_notnull(pw_context_load_module(context, "libpipewire-module-spa-node-factory", NULL, NULL));
+
+	factory = pw_context_find_factory(context, "adapter");
+	pwtest_ptr_notnull(factory);
+	sink = pw_impl_factory_create_object(factory, NULL,
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+			pw_properties_new(
+				"factory.name", "support.null-audio-sink",
+				PW_KEY_NODE_NAME, "dead-test-sink",
+				PW_KEY_MEDIA_CLASS, "Audio/Sink",
+				PW_KEY_NODE_DRIVER, "true",
+				"audio.position", "[ MONO ]",
+				"adapter.auto-port-config", "{ mode = dsp }",
+				NULL), 0);
+	pwtest_ptr_notnull(sink);
+
+	/* live -> sink and dead -> tail, the dead and tail nodes want a
+	 * driver but they can't reach the sink */
+	live = make_filter(context, "live", pause_on_idle);
+	dead = make_filter(context, "dead", pause_on_idle);
+	tail = make_filter(context, "tail", pause_on_idle);
+	make_link(context, live, sink);
+	make_link(context, dead, tail);
+	iterate(loop);
+
+	/* they only run when dead nodes are not skipped */
+	pwtest_bool_true(node_running(sink));
+	pwtest_bool_true(node_running(live));
+	pwtest_bool_eq(node_running(dead), !skip_dead);
+	pwtest_bool_eq(node_running(tail), !skip_dead);
+
+	/* linking them to the sink brings them back */
+	link = make_link(context, tail, sink);
+	iterate(loop);
+	pwtest_bool_true(node_running(dead));
+	pwtest_bool_true(node_running(tail));
+
+	/* and unlinking makes them dead again */
+	pw_impl_link_destroy(link);
+	iterate(loop);
+	pwtest_bool_true(node_running(live));
+	pwtest_bool_eq(node_running(dead), !skip_dead);
+	pwtest_bool_eq(node_running(tail), !skip_dead);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+#define N_GRAPH_NODES	6
+#define N_GRAPH_STEPS	6
+
+struct graph_node {
+	struct pw_impl_node *node;
+	struct pw_impl_node *driver;
+	struct spa_hook listener;
+};
+
+struct graph_state {
+	bool running[N_GRAPH_NODES];
+	int driver[N_GRAPH_NODES];
+};
+
+static void graph_driver_changed(void *data, struct pw_impl_node *old,
+		struct pw_impl_node *driver)
+{
+	struct graph_node *n = data;
+	n->driver = driver;
+}
+
+static const struct pw_impl_node_events graph_node_events = {
+	PW_VERSION_IMPL_NODE_EVENTS,
+	.driver_changed = graph_driver_changed,
+};
+
+static struct pw_impl_node *make_sink(struct pw_context *context, const char *name)
+{
+	struct pw_impl_factory *factory;
+	struct pw_impl_node *node;
+
+	factory = pw_context_find_factory(context, "adapter");
+	pwtest_ptr_notnull(factory);
+	node = pw_impl_factory_create_object(factory, NULL,
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+			pw_properties_new(
+				"factory.name", "support.null-audio-sink",
+				PW_KEY_NODE_NAME, name,
+				PW_KEY_MEDIA_CLASS, "Audio/Sink",
+				PW_KEY_NODE_DRIVER, "true",
+				"audio.position", "[ MONO ]",
+				"adapter.auto-port-config", "{ mode = dsp }",
+				NULL), 0);
+	pwtest_ptr_notnull(node);
+	return node;
+}
+
+static void save_graph(struct graph_node *nodes, struct graph_state *state)
+{
+	int i, j;
+
+	for (i = 0; i < N_GRAPH_NODES; i++) {
+		state->running[i] = node_running(nodes[i].node);
+		state->driver[i] = -1;
+		for (j = 0; j < N_GRAPH_NODES; j++)
+			if (nodes[i].driver == nodes[j].node)
+				state->driver[i] = j;
+	}
+}
+
+/* run the same link changes with the queued or the full recalculation and
+ * save the graph state after each of them */
+static void run_graph(bool incremental, struct graph_state *states)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct graph_node nodes[N_GRAPH_NODES];
+	struct pw_impl_link *ca, *as;
+	int i;
+
+	pw_init(0, NULL);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				"link.incremental-recalc", incremental ? "true" : "false",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+
+	pw_context_add_spa_lib(context, "audio.convert.*", "audioconvert/libspa-audioconvert");
+	pw_context_add_spa_lib(context, "support.*", "support/libspa-support");
+	pwtest_ptr_notnull(pw_context_load_module(context, "libpipewire-module-adapter", NULL, NULL));
+	pwtest_ptr_notnull(pw_context_load_module(context, "libpipewire-module-spa-node-factory", NULL, NULL));
+
+	spa_zero(nodes);
+	nodes[0].node = make_sink(context, "sink-0");
+	nodes[1].node = make_sink(context, "sink-1");
+	nodes[2].node = make_filter(context, "a", "false");
+	nodes[3].node = make_filter(context, "b", "false");
+	nodes[4].node = make_filter(context, "c", "false");
+	nodes[5].node = make_filter(context, "d", "false");
+	for (i = 0; i < N_GRAPH_NODES; i++)
+		pw_impl_node_add_listener(nodes[i].node, &nodes[i].listener,
+				&graph_node_events, &nodes[i]);
+	iterate(loop);
+	save_graph(nodes, &states[0]);
+
+	/* a -> sink-0 and b -> sink-1 */
+	as = make_link(context, nodes[2].node, nodes[0].node);
+	make_link(context, nodes[3].node, nodes[1].node);
+	iterate(loop);
+	save_graph(nodes, &states[1]);
+
+	/* c -> a joins sink-0 */
+	ca = make_link(context, nodes[4].node, nodes[2].node);
+	iterate(loop);
+	save_graph(nodes, &states[2]);
+
+	/* c -> b joins both sinks in one group */
+	make_link(context, nodes[4].node, nodes[3].node);
+	iterate(loop);
+	save_graph(nodes, &states[3]);
+
+	pw_impl_link_destroy(ca);
+	iterate(loop);
+	save_graph(nodes, &states[4]);
+
+	/* d -> a and a loses its sink */
+	make_link(context, nodes[5].node, nodes[2].node);
+	pw_impl_link_destroy(as);
+	iterate(loop);
+	save_graph(nodes, &states[5]);
+
+	for (i = 0; i < N_GRAPH_NODES; i++)
+		spa_hook_remove(&nodes[i].listener);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	pw_deinit();
+}
+
+PWTEST(context_recalc_queued)
+{
+	struct graph_state full[N_GRAPH_STEPS], queued[N_GRAPH_STEPS];
+	int i, j;
+
+	run_graph(false, full);
+	run_graph(true, queued);
+
+	for (i = 0; i < N_GRAPH_STEPS; i++) {
+		for (j = 0; j < N_GRAPH_NODES; j++) {
+			pwtest_bool_eq(queued[i].running[j], full[i].running[j]);
+			pwtest_int_eq(queued[i].driver[j], full[i].driver[j]);
+		}
+	}
+	/* the linked filters run with a sink */
+	pwtest_bool_true(full[2].running[4]);
+	pwtest_int_eq(full[2].driver[4], 0);
+	pwtest_int_eq(full[3].driver[4], full[3].driver[3]);
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(context)
 {
 	pwtest_add(context_abi, PWTEST_NOARG);
 	pwtest_add(context_create, PWTEST_NOARG);
 	pwtest_add(context_properties, PWTEST_NOARG);
 	pwtest_add(context_support, PWTEST_NOARG);
+	pwtest_add(context_format_cache_rate, PWTEST_ARG_DAEMON);
+	pwtest_add(context_dead_nodes, PWTEST_ARG_RANGE, 0, 4);
+	pwtest_add(context_recalc_queued, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
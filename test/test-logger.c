@@ -399,6 +399,83 @@ PWTEST(logger_debug_env_invalid)
 	return PWTEST_PASS;
 }
 
+PWTEST(logger_deferred)
+{
+	struct pwtest_spa_plugin *plugin;
+	void *iface;
+	char fname[PATH_MAX];
+	struct spa_dict_item items[2];
+	struct spa_dict info;
+	char buffer[1024];
+	FILE *fp;
+	const char *expected[] = {
+		"MARK1: str def int -12 long 1234567890123 unsigned 42 hex 0x2a",
+		"MARK2: float 1.50 padded [   7] [abc] [(null)] 100%",
+		"MARK3: Permission denied",
+		"MARK4: char x size 99 int8 -3",
+		"tmptopic     |  MARK5: copied",
+	};
+	bool found[SPA_N_ELEMENTS(expected)] = { false, };
+	char str[] = "abcdef";
+	const char *null_str = NULL;
+	char topic_name[] = "tmptopic";
+	char fmt[] = "MARK5: %s";
+	struct spa_log_topic topic = SPA_LOG_TOPIC(0, topic_name);
+	size_t i;
+
+	pw_init(0, NULL);
+
+	pwtest_mkstemp(fname);
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_FILE, fname);
+	items[1] = SPA_DICT_ITEM_INIT(SPA_KEY_LOG_DEFERRED, "true");
+	info = SPA_DICT_INIT(items, 2);
+	plugin = pwtest_spa_plugin_new();
+	iface = pwtest_spa_plugin_load_interface(plugin, "support/libspa-support",
+						 SPA_NAME_SUPPORT_LOG, SPA_TYPE_INTERFACE_Log,
+						 &info);
+	pwtest_ptr_notnull(iface);
+
+	spa_log_error(iface, "MARK1: str %s int %d long %lld unsigned %u hex %#x",
+			str + 3, -12, 1234567890123ll, 42u, 42);
+	spa_log_error(iface, "MARK2: float %.2f padded [%*d] [%.*s] [%s] 100%%",
+			1.5, 4, 7, 3, str, null_str);
+	/* the string is copied, changing it afterwards has no effect */
+	str[0] = 'X';
+	errno = EACCES;
+	spa_log_error(iface, "MARK3: %m");
+	spa_log_error(iface, "MARK4: char %c size %zd int8 %hhd",
+			'x', (ssize_t)99, (signed char)-3);
+	/* the topic and format are copied as well, like when they would be
+	 * in a module that is unloaded before the message is written */
+	spa_logt_error(iface, &topic, fmt, "copied");
+	memset(topic_name, 'X', sizeof(topic_name) - 1);
+	memset(fmt, 'X', sizeof(fmt) - 1);
+
+	/* destroying the logger writes out the pending messages */
+	pwtest_spa_plugin_destroy(plugin);
+
+	fp = fopen(fname, "re");
+	while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+		for (i = 0; i < SPA_N_ELEMENTS(expected); i++) {
+			if (strstr(buffer, expected[i]) != NULL) {
+				/* the messages are written in order */
+				pwtest_bool_false(found[i]);
+				if (i > 0)
+					pwtest_bool_true(found[i - 1]);
+				found[i] = true;
+			}
+		}
+	}
+	fclose(fp);
+
+	for (i = 0; i < SPA_N_ELEMENTS(expected); i++)
+		pwtest_bool_true(found[i]);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST(logger_topics)
 {
 	struct pwtest_spa_plugin *plugin;
@@ -648,6 +725,7 @@ PWTEST_SUITE(logger)
 	pwtest_add(logger_debug_env_invalid,
 		   PWTEST_ARG_RANGE, 0, 7, /* see the test */
 		   PWTEST_NOARG);
+	pwtest_add(logger_deferred, PWTEST_NOARG);
 	pwtest_add(logger_topics, PWTEST_NOARG);
 	pwtest_add(logger_journal, PWTEST_NOARG);
 	pwtest_add(logger_journal_chain, PWTEST_NOARG);
@@ -0,0 +1,278 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pwtest.h"
+
+#include <spa/param/profiler.h>
+#include <spa/pod/parser.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/filter.h>
+#include <pipewire/extensions/profiler.h>
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+	struct pw_proxy *profiler;
+	struct spa_hook profiler_listener;
+	struct pw_filter *filter;
+	struct pw_memmap *map;
+	const struct pw_profiler_ring *ring;
+	uint64_t index;
+	bool use_ring;
+	uint32_t n_driver;
+	uint32_t n_filter;
+	uint64_t n_wakeup;
+	uint64_t n_process;
+};
+
+static void on_profiler_ring(void *data, uint32_t mem_id, uint32_t offset, uint32_t size)
+{
+	struct data *d = data;
+	struct pw_mempool *pool = pw_core_get_mempool(d->core);
+	struct pw_memmap *map;
+
+	/* the ring can't be mapped writable */
+	map = pw_mempool_map_id(pool, mem_id, PW_MEMMAP_FLAG_READWRITE, offset, size, NULL);
+	pwtest_ptr_null(map);
+
+	d->map = pw_mempool_map_id(pool, mem_id, PW_MEMMAP_FLAG_READ, offset, size, NULL);
+	pwtest_ptr_notnull(d->map);
+
+	d->ring = d->map->ptr;
+	pwtest_int_eq(d->ring->magic, PW_PROFILER_RING_MAGIC);
+	pwtest_int_eq(d->ring->version, (uint32_t)PW_PROFILER_RING_VERSION);
+	pwtest_int_ge(d->ring->record_size, sizeof(struct pw_profiler_record));
+	pwtest_int_eq(d->ring->n_records & (d->ring->n_records - 1), 0u);
+	pwtest_int_le(d->ring->offset + (uint64_t)d->ring->n_records * d->ring->record_size,
+			(uint64_t)size);
+}
+
+static uint64_t histogram_count(struct spa_pod_parser *prs)
+{
+	uint32_t i, csize, ctype, n_buckets;
+	uint64_t *buckets, count = 0;
+	int64_t max;
+
+	pwtest_neg_errno_ok(spa_pod_parser_get(prs,
+			SPA_POD_Long(&max),
+			SPA_POD_Array(&csize, &ctype, &n_buckets, &buckets),
+			NULL));
+	pwtest_int_eq(csize, sizeof(int64_t));
+	pwtest_int_eq(ctype, (uint32_t)SPA_TYPE_Long);
+	for (i = 0; i < n_buckets; i++)
+		count += buckets[i];
+	if (count > 0)
+		pwtest_int_gt(max, 0);
+	return count;
+}
+
+static void on_profiler_profile(void *data, const struct spa_pod *pod)
+{
+	struct data *d = data;
+	struct spa_pod *obj;
+	struct spa_pod_prop *p;
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	uint32_t id, min_shift, sub_shift;
+
+	SPA_POD_STRUCT_FOREACH(pod, obj) {
+		if (!spa_pod_is_object_type(obj, SPA_TYPE_OBJECT_Profiler))
+			continue;
+
+		SPA_POD_OBJECT_FOREACH((struct spa_pod_object*)obj, p) {
+			if (p->key != SPA_PROFILER_nodeHistogram)
+				continue;
+
+			spa_pod_parser_pod(&prs, &p->value);
+			pwtest_neg_errno_ok(spa_pod_parser_push_struct(&prs, &f));
+			pwtest_neg_errno_ok(spa_pod_parser_get(&prs,
+					SPA_POD_Int(&id),
+					SPA_POD_Int(&min_shift),
+					SPA_POD_Int(&sub_shift),
+					NULL));
+			if (id != pw_filter_get_node_id(d->filter))
+				continue;
+
+			d->n_wakeup = histogram_count(&prs);
+			d->n_process = histogram_count(&prs);
+			/* the filter is not a driver */
+			pwtest_int_eq(histogram_count(&prs), 0u);
+		}
+	}
+	if (d->n_wakeup > 10)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_profiler_events profiler_events = {
+	PW_VERSION_PROFILER_EVENTS,
+	.profile = on_profiler_profile,
+	.ring = on_profiler_ring,
+};
+
+static void registry_global(void *data, uint32_t id,
+		uint32_t permissions, const char *type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct data *d = data;
+
+	if (d->profiler != NULL || !spa_streq(type, PW_TYPE_INTERFACE_Profiler))
+		return;
+
+	pwtest_int_ge(version, 4u);
+	d->profiler = pw_registry_bind(d->registry, id, type, PW_VERSION_PROFILER, 0);
+	pwtest_ptr_notnull(d->profiler);
+	pw_proxy_add_object_listener(d->profiler, &d->profiler_listener,
+			&profiler_events, d);
+	if (d->use_ring)
+		pw_profiler_start_ring((struct pw_profiler *)d->profiler);
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_global,
+};
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	struct pw_profiler_record r;
+	uint32_t node_id;
+	int res;
+
+	if (d->ring == NULL)
+		return;
+
+	node_id = pw_filter_get_node_id(d->filter);
+
+	while ((res = pw_profiler_ring_read(d->ring, &d->index, &r)) != 0) {
+		if (res < 0)
+			continue;
+		if (r.flags & PW_PROFILER_RECORD_FLAG_DRIVER) {
+			pwtest_int_eq(r.id, r.driver_id);
+			pwtest_int_gt(r.clock_rate.denom, 0u);
+			d->n_driver++;
+		} else if (r.id == node_id) {
+			pwtest_int_ne(r.driver_id, node_id);
+			d->n_filter++;
+		}
+	}
+	if (d->n_driver > 0 && d->n_filter > 0)
+		pw_main_loop_quit(d->loop);
+}
+
+static void filter_process(void *data, struct spa_io_position *position)
+{
+}
+
+static const struct pw_filter_events filter_events = {
+	PW_VERSION_FILTER_EVENTS,
+	.process = filter_process,
+};
+
+static void run_profiler(struct data *d)
+{
+	struct pw_context *context;
+	struct pw_loop *loop;
+	struct spa_source *timer;
+	struct timespec value = { 0, 10 * SPA_NSEC_PER_MSEC }, interval = value;
+
+	pw_init(0, NULL);
+
+	d->loop = pw_main_loop_new(NULL);
+	loop = pw_main_loop_get_loop(d->loop);
+	context = pw_context_new(loop, NULL, 0);
+	pwtest_ptr_notnull(context);
+	d->core = pw_context_connect(context, NULL, 0);
+	pwtest_ptr_notnull(d->core);
+
+	d->registry = pw_core_get_registry(d->core, PW_VERSION_REGISTRY, 0);
+	pw_registry_add_listener(d->registry, &d->registry_listener, &registry_events, d);
+
+	/* a node that is scheduled without links, with the dummy driver */
+	d->filter = pw_filter_new_simple(loop, "profiler-test",
+			pw_properties_new(
+				PW_KEY_MEDIA_TYPE, "Audio",
+				PW_KEY_MEDIA_CATEGORY, "Filter",
+				PW_KEY_MEDIA_ROLE, "DSP",
+				PW_KEY_NODE_ALWAYS_PROCESS, "true",
+				NULL),
+			&filter_events, d);
+	pwtest_ptr_notnull(d->filter);
+	pwtest_neg_errno_ok(pw_filter_connect(d->filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0));
+
+	timer = pw_loop_add_timer(loop, on_timeout, d);
+	pw_loop_update_timer(loop, timer, &value, &interval, false);
+
+	pw_main_loop_run(d->loop);
+
+	pw_loop_destroy_source(loop, timer);
+	pw_filter_destroy(d->filter);
+	if (d->map)
+		pw_memmap_free(d->map);
+	spa_hook_remove(&d->profiler_listener);
+	pw_proxy_destroy(d->profiler);
+	spa_hook_remove(&d->registry_listener);
+	pw_proxy_destroy((struct pw_proxy *)d->registry);
+	pw_core_disconnect(d->core);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d->loop);
+	pw_deinit();
+}
+
+PWTEST(profiler_ring_read)
+{
+	struct data d = { .use_ring = true };
+
+	run_profiler(&d);
+
+	pwtest_int_gt(d.n_driver, 0u);
+	pwtest_int_gt(d.n_filter, 0u);
+
+	return PWTEST_PASS;
+}
+
+/* the histograms are kept by the server, the filter only shares the
+ * activation with it */
+PWTEST(profiler_histograms)
+{
+	struct data d = { .use_ring = false };
+
+	run_profiler(&d);
+
+	pwtest_int_gt(d.n_wakeup, 10u);
+	pwtest_int_gt(d.n_process, 10u);
+
+	return PWTEST_PASS;
+}
+
+PWTEST_SUITE(profiler)
+{
+	pwtest_add(profiler_ring_read, PWTEST_ARG_DAEMON);
+	pwtest_add(profiler_histograms, PWTEST_ARG_DAEMON);
+
+	return PWTEST_PASS;
+}
@@ -28,6 +28,7 @@
 
 #include "pwtest.h"
 
+#include "pipewire/keys.h"
 #include "pipewire/properties.h"
 
 PWTEST(properties_abi)
@@ -605,6 +606,83 @@ PWTEST(properties_update)
 	return PWTEST_PASS;
 }
 
+PWTEST(properties_large)
+{
+	struct pw_properties *p1, *p2;
+	char key[64], val[64];
+	const char *val_p;
+	int i;
+
+	p1 = pw_properties_new(PW_KEY_NODE_NAME, "node", NULL);
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		pw_properties_setf(p1, key, "%d", i);
+	}
+	pwtest_int_eq(p1->dict.n_items, 101u);
+
+	p2 = pw_properties_copy(p1);
+	pwtest_int_eq(pw_properties_set(p2, "key.50", NULL), 1);
+	pwtest_str_eq(pw_properties_get(p1, "key.50"), "50");
+	pwtest_ptr_null(pw_properties_get(p2, "key.50"));
+
+	/* sorting moves the items around */
+	spa_dict_qsort(&p2->dict);
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		snprintf(val, sizeof(val), "%d", i);
+		pwtest_str_eq(pw_properties_get(p1, key), val);
+		if (i == 50)
+			pwtest_ptr_null(pw_properties_get(p2, key));
+		else
+			pwtest_str_eq(pw_properties_get(p2, key), val);
+	}
+	pwtest_int_eq(pw_properties_set(p2, "key.60", NULL), 1);
+	pwtest_int_eq(pw_properties_set(p2, "key.160", "160"), 1);
+	pwtest_ptr_null(pw_properties_get(p2, "key.60"));
+	pwtest_str_eq(pw_properties_get(p2, "key.160"), "160");
+	pwtest_str_eq(pw_properties_get(p2, "key.70"), "70");
+	pwtest_str_eq(pw_properties_get(p2, PW_KEY_NODE_NAME), "node");
+
+	/* the sort of the copy did not touch the original */
+	pwtest_str_eq(p1->dict.items[0].key, PW_KEY_NODE_NAME);
+
+	pw_properties_clear(p1);
+	pwtest_int_eq(p1->dict.n_items, 0u);
+	pwtest_ptr_null(pw_properties_get(p1, "key.1"));
+	pwtest_str_eq(pw_properties_get(p2, "key.1"), "1");
+
+	/* values of the copy stay valid when the original is freed */
+	p1 = pw_properties_copy(p2);
+	val_p = pw_properties_get(p2, "key.1");
+	pw_properties_free(p1);
+	pwtest_int_eq(pw_properties_set(p2, "key.2", "two"), 1);
+	pwtest_str_eq(val_p, "1");
+
+	/* removing keeps the other keys in the index */
+	for (i = 1; i < 100; i += 2) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		pw_properties_set(p2, key, NULL);
+	}
+	spa_dict_qsort(&p2->dict);
+	for (i = 0; i < 100; i++) {
+		snprintf(key, sizeof(key), "key.%d", i);
+		snprintf(val, sizeof(val), "%d", i);
+		if (i & 1 || i == 50 || i == 60)
+			pwtest_ptr_null(pw_properties_get(p2, key));
+		else if (i == 2)
+			pwtest_str_eq(pw_properties_get(p2, key), "two");
+		else
+			pwtest_str_eq(pw_properties_get(p2, key), val);
+	}
+	pwtest_int_eq(pw_properties_set(p2, "key.40", NULL), 1);
+	pwtest_ptr_null(pw_properties_get(p2, "key.40"));
+	pwtest_str_eq(pw_properties_get(p2, "key.42"), "42");
+
+	pw_properties_free(p2);
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(properties)
 {
 	pwtest_add(properties_abi, PWTEST_NOARG);
@@ -624,6 +702,7 @@ PWTEST_SUITE(properties)
 	pwtest_add(properties_new_dict, PWTEST_NOARG);
 	pwtest_add(properties_new_json, PWTEST_NOARG);
 	pwtest_add(properties_update, PWTEST_NOARG);
+	pwtest_add(properties_large, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
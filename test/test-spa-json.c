@@ -213,6 +213,68 @@ PWTEST(json_array)
 	return PWTEST_PASS;
 }
 
+static void test_long(const char *json)
+{
+	struct spa_json it[2];
+	const char *value;
+	char str[128];
+	int len;
+
+	spa_json_init(&it[0], json, strlen(json));
+	expect_type(&it[0], TYPE_OBJECT);
+	spa_json_enter(&it[0], &it[1]);
+	expect_string(&it[1], "a string that is longer than a block with \"escapes\" and \xc3\xbc ");
+	pwtest_int_gt((len = spa_json_get_string(&it[1], str, sizeof(str))), 0);
+	pwtest_str_eq(str, "very.long.bare.word.that.is.longer.than.a.block");
+	expect_string(&it[1], "nested");
+	pwtest_int_gt((len = spa_json_next(&it[1], &value)), 0);
+	pwtest_bool_true(spa_json_is_container(value, len));
+	len = spa_json_container_len(&it[1], value, len);
+	pwtest_int_eq(value[len - 1], '}');
+	pwtest_int_gt(spa_json_get_string(&it[1], str, sizeof(str)), 0);
+	pwtest_str_eq(str, "last");
+	expect_float(&it[1], 1.0f);
+	pwtest_int_eq(spa_json_next(&it[1], &value), 0);
+}
+
+static void test_invalid(const char *json)
+{
+	struct spa_json it;
+	const char *value;
+
+	spa_json_init(&it, json, strlen(json));
+	pwtest_int_eq(spa_json_next(&it, &value), -1);
+}
+
+PWTEST(json_long)
+{
+	static const char json[] =
+		"{\n"
+		"                                        # a comment that is longer than a block ] } \" \n"
+		"    \"a string that is longer than a block with \\\"escapes\\\" and \xc3\xbc \": "
+				"very.long.bare.word.that.is.longer.than.a.block\n"
+		"    \"nested\" = { \"key with a long name............\" = "
+				"[ \"x\", long.bare.word.in.an.array.......... ] }\n"
+		"    last                                                   = 1\n"
+		"}";
+	char buf[512];
+	int i;
+
+	/* move the runs over the block boundaries */
+	for (i = 0; i < 32; i++) {
+		snprintf(buf, sizeof(buf), "%*s%s", i, "", json);
+		test_long(buf);
+
+		snprintf(buf, sizeof(buf), "%*s\"abcdefghijklmnopqrstuvwxyz\x01 abc\"", i, "");
+		test_invalid(buf);
+		snprintf(buf, sizeof(buf), "%*s\"abcdefghijklmnopqrstuvwxyz\xc3( abc\"", i, "");
+		test_invalid(buf);
+		snprintf(buf, sizeof(buf), "%*s\"abcdefghijklmnopqrstuvwxyz\\x abc\"", i, "");
+		test_invalid(buf);
+	}
+	return PWTEST_PASS;
+}
+
 PWTEST(json_overflow)
 {
 	struct spa_json it[2];
@@ -324,6 +386,7 @@ PWTEST_SUITE(spa_json)
 	pwtest_add(json_parse, PWTEST_NOARG);
 	pwtest_add(json_encode, PWTEST_NOARG);
 	pwtest_add(json_array, PWTEST_NOARG);
+	pwtest_add(json_long, PWTEST_NOARG);
 	pwtest_add(json_overflow, PWTEST_NOARG);
 	pwtest_add(json_float, PWTEST_NOARG);
 	pwtest_add(json_float_check, PWTEST_NOARG);
@@ -21,6 +21,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <spa/control/merge.h>
 #include <spa/pod/pod.h>
 #include <spa/pod/builder.h>
 #include <spa/pod/command.h>
@@ -30,6 +31,7 @@
 #include <spa/pod/vararg.h>
 #include <spa/debug/pod.h>
 #include <spa/param/format.h>
+#include <spa/param/profiler-utils.h>
 #include <spa/param/video/raw.h>
 #include <spa/utils/string.h>
 
@@ -1687,6 +1689,187 @@ PWTEST(pod_overflow2)
 	return PWTEST_PASS;
 }
 
+static struct spa_pod_sequence *build_midi(uint8_t *buffer, size_t size,
+		const uint32_t *offsets, const uint8_t *status, uint32_t n_events)
+{
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, size);
+	struct spa_pod_frame f;
+	uint32_t i;
+
+	spa_pod_builder_push_sequence(&b, &f, 0);
+	for (i = 0; i < n_events; i++) {
+		uint8_t ev[3] = { status[i], 60, 100 };
+		spa_pod_builder_control(&b, offsets[i], SPA_CONTROL_Midi);
+		spa_pod_builder_bytes(&b, ev, sizeof(ev));
+	}
+	return spa_pod_builder_pop(&b, &f);
+}
+
+PWTEST(pod_control_merge)
+{
+	uint8_t buffer[3][1024];
+	struct spa_pod_sequence *seq[4];
+	struct spa_control_merge_item items[4];
+	struct spa_control_merge merge;
+	struct spa_pod_control *c;
+	static const uint32_t off0[] = { 0, 10, 10, 30 };
+	static const uint8_t st0[] = { 0x90, 0x90, 0x80, 0x90 };
+	static const uint32_t off1[] = { 5, 10, 40 };
+	static const uint8_t st1[] = { 0x90, 0xb0, 0x80 };
+	static const uint32_t off2[] = { 10 };
+	static const uint8_t st2[] = { 0xc0 };
+	/* the expected order of offsets and status bytes */
+	static const uint32_t offsets[] = { 0, 5, 10, 10, 10, 10, 30, 40 };
+	static const uint8_t status[] = { 0x90, 0x90, 0xb0, 0xc0, 0x90, 0x80, 0x90, 0x80 };
+	uint8_t empty[64];
+	uint32_t n = 0;
+
+	seq[0] = build_midi(buffer[0], sizeof(buffer[0]), off0, st0, SPA_N_ELEMENTS(off0));
+	seq[1] = build_midi(buffer[1], sizeof(buffer[1]), off1, st1, SPA_N_ELEMENTS(off1));
+	seq[2] = build_midi(empty, sizeof(empty), NULL, NULL, 0);
+	seq[3] = build_midi(buffer[2], sizeof(buffer[2]), off2, st2, SPA_N_ELEMENTS(off2));
+
+	spa_control_merge_init(&merge, items, seq, 4);
+	while ((c = spa_control_merge_peek(&merge)) != NULL) {
+		const uint8_t *data = SPA_POD_BODY(&c->value);
+
+		pwtest_int_lt(n, SPA_N_ELEMENTS(offsets));
+		pwtest_int_eq(c->offset, offsets[n]);
+		pwtest_int_eq(data[0], status[n]);
+		pwtest_int_ne(spa_control_merge_index(&merge), 2u);
+		n++;
+		spa_control_merge_advance(&merge);
+	}
+	pwtest_int_eq(n, SPA_N_ELEMENTS(offsets));
+	pwtest_int_eq(spa_control_merge_index(&merge), SPA_ID_INVALID);
+
+	return PWTEST_PASS;
+}
+
+struct test_layout {
+	struct spa_pod_struct pod;
+	struct spa_pod_int i;
+	struct spa_pod_long l;
+	struct spa_pod_fraction f;
+};
+
+#define TEST_LAYOUT_INIT(i,l,f)						\
+	((struct test_layout) {						\
+		SPA_POD_INIT_Struct(sizeof(struct test_layout) -	\
+				sizeof(struct spa_pod)),		\
+		SPA_POD_INIT_Int(i),					\
+		SPA_POD_INIT_Long(l),					\
+		SPA_POD_INIT_Fraction(f) })
+
+PWTEST(pod_layout)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod_parser p;
+	struct test_layout l = TEST_LAYOUT_INIT(3, 7, SPA_FRACTION(1, 48000));
+	struct spa_pod *pod;
+	int32_t i;
+	int64_t v;
+	struct spa_fraction f;
+
+	/* the layout is encoded the same as the vararg builder would */
+	pwtest_int_eq(spa_pod_builder_layout(&b, &l, sizeof(l)), 0);
+	pod = (struct spa_pod *)buffer;
+	pwtest_int_eq(SPA_POD_SIZE(pod), sizeof(l));
+	pwtest_int_eq(spa_pod_parse_struct(pod,
+			SPA_POD_Int(&i),
+			SPA_POD_Long(&v),
+			SPA_POD_Fraction(&f)), 3);
+	pwtest_int_eq(i, 3);
+	pwtest_int_eq(v, 7);
+	pwtest_int_eq(f.denom, 48000u);
+
+	l = TEST_LAYOUT_INIT(0, 0, SPA_FRACTION(0, 0));
+	spa_pod_parser_pod(&p, pod);
+	pwtest_int_eq(spa_pod_parser_get_layout(&p, &l, sizeof(l)), 0);
+	pwtest_int_eq(l.i.value, 3);
+	pwtest_int_eq(l.l.value, 7);
+	pwtest_int_eq(l.f.value.num, 1u);
+	pwtest_int_eq(l.f.value.denom, 48000u);
+	pwtest_int_eq(p.state.offset, sizeof(l));
+
+	/* not enough data */
+	spa_pod_parser_pod(&p, pod);
+	pwtest_int_eq(spa_pod_parser_get_layout(&p, &l, sizeof(l) + 8), -EPIPE);
+
+	/* an Int where the layout has a Long */
+	b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	pod = spa_pod_builder_add_struct(&b,
+			SPA_POD_Int(3),
+			SPA_POD_Int(7),
+			SPA_POD_Fraction(&SPA_FRACTION(1, 48000)));
+	l = TEST_LAYOUT_INIT(0, 0, SPA_FRACTION(0, 0));
+	spa_pod_parser_pod(&p, pod);
+	pwtest_int_eq(spa_pod_parser_get_layout(&p, &l, sizeof(l)), -EPROTO);
+	pwtest_int_eq(p.state.offset, 0u);
+
+	return PWTEST_PASS;
+}
+
+PWTEST(pod_layout_profiler)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_io_clock clock, c;
+	struct spa_profiler_block block, bl;
+	struct spa_pod *pod;
+
+	spa_zero(clock);
+	clock.id = 12;
+	snprintf(clock.name, sizeof(clock.name), "clock.system.monotonic");
+	clock.rate = SPA_FRACTION(1, 48000);
+	clock.duration = 1024;
+	clock.rate_diff = 1.0;
+
+	pwtest_int_eq(spa_profiler_clock_build(&b, &clock), 0);
+	pod = (struct spa_pod *)buffer;
+	spa_zero(c);
+	pwtest_int_eq(spa_profiler_clock_parse(pod, &c), 0);
+	pwtest_int_eq(c.id, 12u);
+	pwtest_str_eq(c.name, "clock.system.monotonic");
+	pwtest_int_eq(c.rate.denom, 48000u);
+	pwtest_int_eq(c.duration, 1024u);
+	pwtest_double_eq(c.rate_diff, 1.0);
+
+	/* a follower block from an older version without latency */
+	b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	pod = spa_pod_builder_add_struct(&b,
+			SPA_POD_Int(5),
+			SPA_POD_String("follower"),
+			SPA_POD_Long(1),
+			SPA_POD_Long(2),
+			SPA_POD_Long(3),
+			SPA_POD_Long(4),
+			SPA_POD_Int(3));
+	spa_zero(bl);
+	pwtest_int_eq(spa_profiler_block_parse(pod, &bl), 0);
+	pwtest_int_eq(bl.id, 5);
+	pwtest_str_eq(bl.name, "follower");
+	pwtest_int_eq(bl.finish, 4);
+	pwtest_int_eq(bl.status, 3);
+	pwtest_int_eq(bl.latency.denom, 0u);
+
+	block = SPA_PROFILER_BLOCK(.id = 6, .name = "driver", .signal = 10,
+			.status = 3, .latency = SPA_FRACTION(256, 48000), .n_dead = 2);
+	b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	pwtest_int_eq(spa_profiler_block_build(&b, &block, true), 0);
+	pod = (struct spa_pod *)buffer;
+	spa_zero(bl);
+	pwtest_int_eq(spa_profiler_block_parse(pod, &bl), 0);
+	pwtest_int_eq(bl.id, 6);
+	pwtest_str_eq(bl.name, "driver");
+	pwtest_int_eq(bl.signal, 10);
+	pwtest_int_eq(bl.latency.num, 256u);
+	pwtest_int_eq(bl.n_dead, 2);
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(spa_pod)
 {
 	pwtest_add(pod_abi_sizes, PWTEST_NOARG);
@@ -1701,6 +1884,9 @@ PWTEST_SUITE(spa_pod)
 	pwtest_add(pod_static, PWTEST_NOARG);
 	pwtest_add(pod_overflow, PWTEST_NOARG);
 	pwtest_add(pod_overflow2, PWTEST_NOARG);
+	pwtest_add(pod_control_merge, PWTEST_NOARG);
+	pwtest_add(pod_layout, PWTEST_NOARG);
+	pwtest_add(pod_layout_profiler, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
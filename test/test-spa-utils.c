@@ -34,6 +34,7 @@
 #include <spa/utils/list.h>
 #include <spa/utils/hook.h>
 #include <spa/utils/ringbuffer.h>
+#include <spa/utils/mailbox.h>
 #include <spa/utils/string.h>
 #include <spa/utils/type.h>
 #include <spa/utils/ansi.h>
@@ -487,6 +488,47 @@ PWTEST(utils_ringbuffer)
 	return PWTEST_PASS;
 }
 
+PWTEST(utils_mailbox)
+{
+	struct spa_mailbox mb;
+	int slots[SPA_MAILBOX_SLOTS];
+	uint32_t w, r;
+
+	spa_mailbox_init(&mb);
+	pwtest_bool_false(spa_mailbox_fetch(&mb));
+
+	w = spa_mailbox_write_index(&mb);
+	pwtest_int_lt(w, SPA_MAILBOX_SLOTS);
+	slots[w] = 1;
+	spa_mailbox_publish(&mb);
+	pwtest_int_ne(spa_mailbox_write_index(&mb), w);
+
+	pwtest_bool_true(spa_mailbox_fetch(&mb));
+	r = spa_mailbox_read_index(&mb);
+	pwtest_int_eq(r, w);
+	pwtest_int_eq(slots[r], 1);
+	pwtest_bool_false(spa_mailbox_fetch(&mb));
+	pwtest_int_eq(spa_mailbox_read_index(&mb), r);
+
+	/* only the last published value is seen, the reader slot is
+	 * never handed to the writer */
+	slots[spa_mailbox_write_index(&mb)] = 2;
+	spa_mailbox_publish(&mb);
+	pwtest_int_ne(spa_mailbox_write_index(&mb), r);
+	slots[spa_mailbox_write_index(&mb)] = 3;
+	spa_mailbox_publish(&mb);
+	pwtest_int_ne(spa_mailbox_write_index(&mb), r);
+	pwtest_int_eq(slots[r], 1);
+
+	pwtest_bool_true(spa_mailbox_fetch(&mb));
+	r = spa_mailbox_read_index(&mb);
+	pwtest_int_eq(slots[r], 3);
+	pwtest_int_ne(spa_mailbox_write_index(&mb), r);
+	pwtest_bool_false(spa_mailbox_fetch(&mb));
+
+	return PWTEST_PASS;
+}
+
 PWTEST(utils_strtol)
 {
 	int32_t v = 0xabcd;
@@ -1020,6 +1062,7 @@ PWTEST_SUITE(spa_utils)
 	pwtest_add(utils_list, PWTEST_NOARG);
 	pwtest_add(utils_hook, PWTEST_NOARG);
 	pwtest_add(utils_ringbuffer, PWTEST_NOARG);
+	pwtest_add(utils_mailbox, PWTEST_NOARG);
 	pwtest_add(utils_strtol, PWTEST_NOARG);
 	pwtest_add(utils_strtoul, PWTEST_NOARG);
 	pwtest_add(utils_strtoll, PWTEST_NOARG);
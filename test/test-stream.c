@@ -0,0 +1,225 @@
+/* PipeWire
+ *
+ * Copyright © 2023 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pwtest.h"
+
+#include <spa/param/audio/format-utils.h>
+
+#include <pipewire/pipewire.h>
+
+#define RATE		48000
+/* more than fits in the ring of 1/10 second */
+#define N_RAMP		(RATE / 5)
+#define MAX_READ	(RATE * 4)
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_core *core;
+	struct pw_stream *out;
+	struct spa_hook out_listener;
+	struct pw_stream *in;
+	struct spa_hook in_listener;
+	struct pw_proxy *link;
+
+	float ramp[N_RAMP];
+	uint32_t n_written;
+
+	float samples[MAX_READ];
+	uint32_t n_read;
+};
+
+static void out_param_changed(void *data, uint32_t id, const struct spa_pod *param)
+{
+	struct data *d = data;
+	struct pw_time t;
+	int res;
+
+	if (id != SPA_PARAM_Format || param == NULL || d->n_written > 0)
+		return;
+
+	/* the ring only takes what fits */
+	res = pw_stream_ring_write(d->out, d->ramp, N_RAMP);
+	pwtest_int_gt(res, 0);
+	pwtest_int_lt(res, N_RAMP);
+	d->n_written = res;
+
+	/* the frames in the ring are reported as queued */
+	pwtest_neg_errno_ok(pw_stream_get_time_n(d->out, &t, sizeof(t)));
+	pwtest_int_eq(t.queued, (uint64_t)d->n_written);
+
+	/* the ring is full now */
+	pwtest_int_eq(pw_stream_ring_write(d->out, d->ramp, N_RAMP), 0);
+}
+
+static void stream_state_changed(void *data, enum pw_stream_state old,
+		enum pw_stream_state state, const char *error)
+{
+	struct data *d = data;
+	char val[2][16];
+
+	pwtest_int_ne(state, PW_STREAM_STATE_ERROR);
+
+	if (d->link != NULL ||
+	    pw_stream_get_node_id(d->out) == SPA_ID_INVALID ||
+	    pw_stream_get_node_id(d->in) == SPA_ID_INVALID)
+		return;
+
+	/* there is no session manager, link the streams ourselves */
+	snprintf(val[0], sizeof(val[0]), "%u", pw_stream_get_node_id(d->out));
+	snprintf(val[1], sizeof(val[1]), "%u", pw_stream_get_node_id(d->in));
+	d->link = pw_core_create_object(d->core,
+			"link-factory",
+			PW_TYPE_INTERFACE_Link,
+			PW_VERSION_LINK,
+			&SPA_DICT_INIT_ARRAY(((struct spa_dict_item[]) {
+				{ PW_KEY_LINK_OUTPUT_NODE, val[0] },
+				{ PW_KEY_LINK_INPUT_NODE, val[1] },
+				{ PW_KEY_OBJECT_LINGER, "false" } })), 0);
+	pwtest_ptr_notnull(d->link);
+}
+
+static const struct pw_stream_events out_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = stream_state_changed,
+	.param_changed = out_param_changed,
+};
+
+static const struct pw_stream_events in_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = stream_state_changed,
+};
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	int res;
+
+	res = pw_stream_ring_read(d->in, &d->samples[d->n_read], MAX_READ - d->n_read);
+	if (res == -EAGAIN)
+		return;
+	pwtest_int_ge(res, 0);
+	d->n_read += res;
+
+	if (d->n_read == MAX_READ)
+		pw_main_loop_quit(d->loop);
+}
+
+static struct pw_stream *make_stream(struct data *d, const char *name,
+		enum pw_direction direction)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	const struct spa_pod *params[1];
+	struct pw_stream *stream;
+
+	stream = pw_stream_new(d->core, name,
+			pw_properties_new(
+				PW_KEY_MEDIA_TYPE, "Audio",
+				PW_KEY_NODE_RATE, "1/48000",
+				PW_KEY_NODE_LATENCY, "256/48000",
+				PW_KEY_NODE_ALWAYS_PROCESS, "true",
+				"adapter.auto-port-config", "{ mode = dsp }",
+				NULL));
+	pwtest_ptr_notnull(stream);
+
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat,
+			&SPA_AUDIO_INFO_RAW_INIT(
+				.format = SPA_AUDIO_FORMAT_F32,
+				.rate = RATE,
+				.channels = 1,
+				.position = { SPA_AUDIO_CHANNEL_MONO }));
+
+	pwtest_neg_errno_ok(pw_stream_connect(stream, direction, PW_ID_ANY,
+			PW_STREAM_FLAG_RING | PW_STREAM_FLAG_RT_PROCESS,
+			params, 1));
+	return stream;
+}
+
+PWTEST(stream_ring)
+{
+	struct data d = { 0 };
+	struct pw_context *context;
+	struct pw_loop *loop;
+	struct spa_source *timer;
+	struct timespec value = { 0, 5 * SPA_NSEC_PER_MSEC }, interval = value;
+	uint32_t i, start, first;
+
+	pw_init(0, NULL);
+
+	for (i = 0; i < N_RAMP; i++)
+		d.ramp[i] = (i + 1) / (float)N_RAMP;
+
+	d.loop = pw_main_loop_new(NULL);
+	loop = pw_main_loop_get_loop(d.loop);
+	context = pw_context_new(loop, NULL, 0);
+	pwtest_ptr_notnull(context);
+	d.core = pw_context_connect(context, NULL, 0);
+	pwtest_ptr_notnull(d.core);
+
+	d.out = make_stream(&d, "ring-out", PW_DIRECTION_OUTPUT);
+	pw_stream_add_listener(d.out, &d.out_listener, &out_events, &d);
+	d.in = make_stream(&d, "ring-in", PW_DIRECTION_INPUT);
+	pw_stream_add_listener(d.in, &d.in_listener, &in_events, &d);
+
+	timer = pw_loop_add_timer(loop, on_timeout, &d);
+	pw_loop_update_timer(loop, timer, &value, &interval, false);
+
+	pw_main_loop_run(d.loop);
+
+	/* the capture starts with silence until the streams are linked and
+	 * the first quanta of the playback might not reach the capture.
+	 * From then on, the quanta sliced from the ring follow each other
+	 * without gaps and the underrun after the end of the ring is filled
+	 * with silence */
+	pwtest_int_gt(d.n_written, 0u);
+	for (start = 0; start < d.n_read && d.samples[start] == 0.0f; start++);
+	pwtest_int_lt(start, d.n_read);
+	first = (uint32_t)(d.samples[start] * N_RAMP + 0.5f) - 1;
+	pwtest_int_lt(first, d.n_written);
+	pwtest_int_le(start + d.n_written - first, d.n_read);
+	for (i = first; i < d.n_written; i++)
+		pwtest_double_eq(d.samples[start + i - first], d.ramp[i]);
+	for (i = start + d.n_written - first; i < d.n_read; i++)
+		pwtest_double_eq(d.samples[i], 0.0);
+
+	pw_loop_destroy_source(loop, timer);
+	pw_proxy_destroy(d.link);
+	spa_hook_remove(&d.in_listener);
+	pw_stream_destroy(d.in);
+	spa_hook_remove(&d.out_listener);
+	pw_stream_destroy(d.out);
+	pw_core_disconnect(d.core);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d.loop);
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+PWTEST_SUITE(stream)
+{
+	pwtest_add(stream_ring, PWTEST_ARG_DAEMON);
+
+	return PWTEST_PASS;
+}